@@ -23,6 +23,7 @@ distribution.
 */
 
 #include <ctype.h>
+#include <new>
 
 #ifdef TIXML_USE_STL
 #include <sstream>
@@ -49,16 +50,210 @@ FILE* TiXmlFOpen( const char* filename, const char* mode )
 	#endif
 }
 
+// Every TinyXml object is preceded by the arena it was allocated from, null for the
+// heap, and for heap nodes adopted by an arena, the slot the arena keeps them in.
+struct TiXmlAllocation
+{
+	TiXmlArena*		arena;
+	TiXmlNode**		owner;
+};
+
+
+void* TiXmlBase::operator new( size_t size, TiXmlArena* arena )
+{
+	TiXmlAllocation* header;
+	if ( arena )
+		header = (TiXmlAllocation*) arena->Alloc( sizeof( TiXmlAllocation ) + size );
+	else
+		header = (TiXmlAllocation*) ::operator new( sizeof( TiXmlAllocation ) + size );
+
+	header->arena = arena;
+	header->owner = 0;
+	return header + 1;
+}
+
+
+void TiXmlBase::operator delete( void* p )
+{
+	if ( !p )
+		return;
+
+	TiXmlAllocation* header = (TiXmlAllocation*) p - 1;
+
+	// Arena memory is only released with the whole arena.
+	if ( header->arena )
+		return;
+
+	if ( header->owner )
+		*header->owner = 0;
+	::operator delete( header );
+}
+
+
+void* TiXmlArena::Alloc( size_t size )
+{
+	const size_t align = 2 * sizeof( void* );
+	const size_t header = ( sizeof( Block ) + align - 1 ) & ~( align - 1 );
+	size = ( size + align - 1 ) & ~( align - 1 );
+
+	if ( !blocks || blocks->used + size > blocks->size )
+	{
+		// Big requests, like a whole file, get a block of their own so the
+		// block being filled isn't abandoned.
+		size_t blockSize = ( size > BLOCK_SIZE / 4 ) ? size : (size_t) BLOCK_SIZE;
+		Block* block = (Block*) ::operator new( header + blockSize );
+		block->size = blockSize;
+		block->used = 0;
+
+		if ( blocks && blockSize == size )
+		{
+			block->next = blocks->next;
+			blocks->next = block;
+			block->used = size;
+			return (char*) block + header;
+		}
+
+		block->next = blocks;
+		blocks = block;
+	}
+
+	void* p = (char*) blocks + header + blocks->used;
+	blocks->used += size;
+	return p;
+}
+
+
+char* TiXmlArena::Store( const char* str, size_t length )
+{
+	char* p = (char*) Alloc( length + 1 );
+	memcpy( p, str, length );
+	p[length] = 0;
+	return p;
+}
+
+
+TIXML_string* TiXmlArena::NewString( const char* str )
+{
+	StringRecord* record = new ( Alloc( sizeof( StringRecord ) ) ) StringRecord;
+	record->str = str;
+	record->next = strings;
+	strings = record;
+	return &record->str;
+}
+
+
+void TiXmlArena::Adopt( TiXmlNode* node )
+{
+	TiXmlAllocation* header = (TiXmlAllocation*) node - 1;
+	if ( header->arena || header->owner )
+		return;
+
+	NodeRecord* record = (NodeRecord*) Alloc( sizeof( NodeRecord ) );
+	record->node = node;
+	record->next = adopted;
+	adopted = record;
+	header->owner = &record->node;
+}
+
+
+void TiXmlArena::Reset()
+{
+	// Heap nodes that were linked into the arena DOM are the only ones with
+	// destructors to run. Deleting one clears its record.
+	for ( NodeRecord* record = adopted; record; record = record->next )
+	{
+		delete record->node;
+	}
+	adopted = 0;
+
+	while ( strings )
+	{
+		StringRecord* record = strings;
+		strings = strings->next;
+		record->~StringRecord();
+	}
+
+	while ( blocks )
+	{
+		Block* block = blocks;
+		blocks = blocks->next;
+		::operator delete( block );
+	}
+}
+
+
+const TIXML_string& TiXmlValue::Str() const
+{
+	if ( !view )
+		return str;
+
+	if ( !cache )
+		cache = arena->NewString( view );
+	return *cache;
+}
+
+
+void TiXmlValue::Assign( const char* s, size_t length )
+{
+	if ( arena )
+	{
+		view = length ? arena->Store( s, length ) : "";
+		cache = 0;
+	}
+	else
+	{
+		str.assign( s, length );
+	}
+}
+
+
+void TiXmlValue::Swap( TIXML_string& s )
+{
+	if ( arena )
+		Assign( s.c_str(), s.length() );
+	else
+		str.swap( s );
+}
+
+
 void TiXmlBase::Encodestring( const TIXML_string& str, TIXML_string* outstring )
 {
+	Encodestring( str.c_str(), outstring );
+}
+
+
+void TiXmlBase::Encodestring( const char* str, TIXML_string* outstring )
+{
+	// Characters that are replaced: markup, quotes and control characters.
+	static const unsigned char special[256] =
+	{
+		1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1,
+		1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1,
+		0, 0, 1, 0, 0, 0, 1, 1, 0, 0, 0, 0, 0, 0, 0, 0,		// " & '
+		0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 1, 0, 1, 0,		// < >
+	};
+
 	int i=0;
+	const int length = (int) strlen( str );
 
-	while( i<(int)str.length() )
+	while( i<length )
 	{
+		// Copy the run of plain characters in one go.
+		int run = i;
+		while ( run<length && !special[ (unsigned char) str[run] ] )
+			++run;
+
+		if ( run > i )
+		{
+			outstring->append( str + i, run - i );
+			i = run;
+			continue;
+		}
+
 		unsigned char c = (unsigned char) str[i];
 
 		if (    c == '&' 
-		     && i < ( (int)str.length() - 2 )
+		     && i < ( length - 2 )
 			 && str[i+1] == '#'
 			 && str[i+2] == 'x' )
 		{
@@ -72,13 +267,11 @@ void TiXmlBase::Encodestring( const TIXML_string& str, TIXML_string* outstring )
 			// while fails (error case) and break (semicolon found).
 			// However, there is no mechanism (currently) for
 			// this function to return an error.
-			while ( i<(int)str.length()-1 )
-			{
-				outstring->append( str.c_str() + i, 1 );
-				++i;
-				if ( str[i] == ';' )
-					break;
-			}
+			int end = i+1;
+			while ( end<length-1 && str[end] != ';' )
+				++end;
+			outstring->append( str + i, end - i );
+			i = end;
 		}
 		else if ( c == '&' )
 		{
@@ -105,28 +298,13 @@ void TiXmlBase::Encodestring( const TIXML_string& str, TIXML_string* outstring )
 			outstring->append( entity[4].str, entity[4].strLength );
 			++i;
 		}
-		else if ( c < 32 )
+		else
 		{
 			// Easy pass at non-alpha/numeric/symbol
 			// Below 32 is symbolic.
-			char buf[ 32 ];
-			
-			#if defined(TIXML_SNPRINTF)		
-				TIXML_SNPRINTF( buf, sizeof(buf), "&#x%02X;", (unsigned) ( c & 0xff ) );
-			#else
-				sprintf( buf, "&#x%02X;", (unsigned) ( c & 0xff ) );
-			#endif		
-
-			//*ME:	warning C4267: convert 'size_t' to 'int'
-			//*ME:	Int-Cast to make compiler happy ...
-			outstring->append( buf, (int)strlen( buf ) );
-			++i;
-		}
-		else
-		{
-			//char realc = (char) c;
-			//outstring->append( &realc, 1 );
-			*outstring += (char) c;	// somewhat more efficient function call.
+			const char* hex = "0123456789ABCDEF";
+			char buf[ 6 ] = { '&', '#', 'x', hex[ c >> 4 ], hex[ c & 0xf ], ';' };
+			outstring->append( buf, 6 );
 			++i;
 		}
 	}
@@ -168,6 +346,16 @@ void TiXmlNode::CopyTo( TiXmlNode* target ) const
 
 void TiXmlNode::Clear()
 {
+	// The children of an arena document are released all at once.
+	TiXmlDocument* document = ToDocument();
+	if ( document && document->arena )
+	{
+		document->arena->Reset();
+		firstChild = 0;
+		lastChild = 0;
+		return;
+	}
+
 	TiXmlNode* node = firstChild;
 	TiXmlNode* temp = 0;
 
@@ -183,6 +371,21 @@ void TiXmlNode::Clear()
 }
 
 
+TiXmlArena* TiXmlNode::Arena() const
+{
+	const TiXmlDocument* document = ToDocument();
+	return document ? document->arena : value.Arena();
+}
+
+
+void TiXmlNode::Adopt( TiXmlNode* node )
+{
+	TiXmlArena* arena = Arena();
+	if ( arena )
+		arena->Adopt( node );
+}
+
+
 TiXmlNode* TiXmlNode::LinkEndChild( TiXmlNode* node )
 {
 	assert( node->parent == 0 || node->parent == this );
@@ -197,6 +400,7 @@ TiXmlNode* TiXmlNode::LinkEndChild( TiXmlNode* node )
 	}
 
 	node->parent = this;
+	Adopt( node );
 
 	node->prev = lastChild;
 	node->next = 0;
@@ -243,6 +447,7 @@ TiXmlNode* TiXmlNode::InsertBeforeChild( TiXmlNode* beforeThis, const TiXmlNode&
 	if ( !node )
 		return 0;
 	node->parent = this;
+	Adopt( node );
 
 	node->next = beforeThis;
 	node->prev = beforeThis->prev;
@@ -276,6 +481,7 @@ TiXmlNode* TiXmlNode::InsertAfterChild( TiXmlNode* afterThis, const TiXmlNode& a
 	if ( !node )
 		return 0;
 	node->parent = this;
+	Adopt( node );
 
 	node->prev = afterThis;
 	node->next = afterThis->next;
@@ -328,6 +534,7 @@ TiXmlNode* TiXmlNode::ReplaceChild( TiXmlNode* replaceThis, const TiXmlNode& wit
 
 	delete replaceThis;
 	node->parent = this;
+	Adopt( node );
 	return node;
 }
 
@@ -739,7 +946,7 @@ int TiXmlElement::QueryDoubleAttribute( const std::string& name, double* dval )
 
 void TiXmlElement::SetAttribute( const char * name, int val )
 {	
-	TiXmlAttribute* attrib = attributeSet.FindOrCreate( name );
+	TiXmlAttribute* attrib = attributeSet.FindOrCreate( name, Arena() );
 	if ( attrib ) {
 		attrib->SetIntValue( val );
 	}
@@ -749,7 +956,7 @@ void TiXmlElement::SetAttribute( const char * name, int val )
 #ifdef TIXML_USE_STL
 void TiXmlElement::SetAttribute( const std::string& name, int val )
 {	
-	TiXmlAttribute* attrib = attributeSet.FindOrCreate( name );
+	TiXmlAttribute* attrib = attributeSet.FindOrCreate( name, Arena() );
 	if ( attrib ) {
 		attrib->SetIntValue( val );
 	}
@@ -759,7 +966,7 @@ void TiXmlElement::SetAttribute( const std::string& name, int val )
 
 void TiXmlElement::SetDoubleAttribute( const char * name, double val )
 {	
-	TiXmlAttribute* attrib = attributeSet.FindOrCreate( name );
+	TiXmlAttribute* attrib = attributeSet.FindOrCreate( name, Arena() );
 	if ( attrib ) {
 		attrib->SetDoubleValue( val );
 	}
@@ -769,7 +976,7 @@ void TiXmlElement::SetDoubleAttribute( const char * name, double val )
 #ifdef TIXML_USE_STL
 void TiXmlElement::SetDoubleAttribute( const std::string& name, double val )
 {	
-	TiXmlAttribute* attrib = attributeSet.FindOrCreate( name );
+	TiXmlAttribute* attrib = attributeSet.FindOrCreate( name, Arena() );
 	if ( attrib ) {
 		attrib->SetDoubleValue( val );
 	}
@@ -779,7 +986,7 @@ void TiXmlElement::SetDoubleAttribute( const std::string& name, double val )
 
 void TiXmlElement::SetAttribute( const char * cname, const char * cvalue )
 {
-	TiXmlAttribute* attrib = attributeSet.FindOrCreate( cname );
+	TiXmlAttribute* attrib = attributeSet.FindOrCreate( cname, Arena() );
 	if ( attrib ) {
 		attrib->SetValue( cvalue );
 	}
@@ -789,7 +996,7 @@ void TiXmlElement::SetAttribute( const char * cname, const char * cvalue )
 #ifdef TIXML_USE_STL
 void TiXmlElement::SetAttribute( const std::string& _name, const std::string& _value )
 {
-	TiXmlAttribute* attrib = attributeSet.FindOrCreate( _name );
+	TiXmlAttribute* attrib = attributeSet.FindOrCreate( _name, Arena() );
 	if ( attrib ) {
 		attrib->SetValue( _value );
 	}
@@ -799,54 +1006,9 @@ void TiXmlElement::SetAttribute( const std::string& _name, const std::string& _v
 
 void TiXmlElement::Print( FILE* cfile, int depth ) const
 {
-	int i;
 	assert( cfile );
-	for ( i=0; i<depth; i++ ) {
-		fprintf( cfile, "  " );
-	}
-
-	fprintf( cfile, "<%s", value.c_str() );
-
-	const TiXmlAttribute* attrib;
-	for ( attrib = attributeSet.First(); attrib; attrib = attrib->Next() )
-	{
-		fprintf( cfile, " " );
-		attrib->Print( cfile, depth );
-	}
-
-	// There are 3 different formatting approaches:
-	// 1) An element without children is printed as a <foo /> node
-	// 2) An element with only a text child is printed as <foo> text </foo>
-	// 3) An element with children is printed on multiple lines.
-	TiXmlNode* node;
-	if ( !firstChild )
-	{
-		fprintf( cfile, " />" );
-	}
-	else if ( firstChild == lastChild && firstChild->ToText() )
-	{
-		fprintf( cfile, ">" );
-		firstChild->Print( cfile, depth + 1 );
-		fprintf( cfile, "</%s>", value.c_str() );
-	}
-	else
-	{
-		fprintf( cfile, ">" );
-
-		for ( node = firstChild; node; node=node->NextSibling() )
-		{
-			if ( !node->ToText() )
-			{
-				fprintf( cfile, "\n" );
-			}
-			node->Print( cfile, depth+1 );
-		}
-		fprintf( cfile, "\n" );
-		for( i=0; i<depth; ++i ) {
-			fprintf( cfile, "  " );
-		}
-		fprintf( cfile, "</%s>", value.c_str() );
-	}
+	TiXmlWriter writer( cfile );
+	writer.Print( *this, depth );
 }
 
 
@@ -912,6 +1074,7 @@ const char* TiXmlElement::GetText() const
 
 TiXmlDocument::TiXmlDocument() : TiXmlNode( TiXmlNode::TINYXML_DOCUMENT )
 {
+	arena = 0;
 	tabsize = 4;
 	useMicrosoftBOM = false;
 	ClearError();
@@ -919,6 +1082,7 @@ TiXmlDocument::TiXmlDocument() : TiXmlNode( TiXmlNode::TINYXML_DOCUMENT )
 
 TiXmlDocument::TiXmlDocument( const char * documentName ) : TiXmlNode( TiXmlNode::TINYXML_DOCUMENT )
 {
+	arena = 0;
 	tabsize = 4;
 	useMicrosoftBOM = false;
 	value = documentName;
@@ -929,6 +1093,7 @@ TiXmlDocument::TiXmlDocument( const char * documentName ) : TiXmlNode( TiXmlNode
 #ifdef TIXML_USE_STL
 TiXmlDocument::TiXmlDocument( const std::string& documentName ) : TiXmlNode( TiXmlNode::TINYXML_DOCUMENT )
 {
+	arena = 0;
 	tabsize = 4;
 	useMicrosoftBOM = false;
     value = documentName;
@@ -939,10 +1104,39 @@ TiXmlDocument::TiXmlDocument( const std::string& documentName ) : TiXmlNode( TiX
 
 TiXmlDocument::TiXmlDocument( const TiXmlDocument& copy ) : TiXmlNode( TiXmlNode::TINYXML_DOCUMENT )
 {
+	arena = 0;
 	copy.CopyTo( this );
 }
 
 
+TiXmlDocument::~TiXmlDocument()
+{
+	if ( arena )
+	{
+		// Everything below an arena document goes away with the arena.
+		firstChild = 0;
+		lastChild = 0;
+		delete arena;
+	}
+}
+
+
+void TiXmlDocument::SetArenaMode( bool enable )
+{
+	Clear();
+
+	if ( enable && !arena )
+	{
+		arena = new TiXmlArena();
+	}
+	else if ( !enable && arena )
+	{
+		delete arena;
+		arena = 0;
+	}
+}
+
+
 TiXmlDocument& TiXmlDocument::operator=( const TiXmlDocument& copy )
 {
 	Clear();
@@ -1029,11 +1223,13 @@ bool TiXmlDocument::LoadFile( FILE* file, TiXmlEncoding encoding )
 	}
 	*/
 
-	char* buf = new char[ length+1 ];
+	// Arena documents keep the buffer, their text and attribute values point into it.
+	char* buf = arena ? (char*) arena->Alloc( length+1 ) : new char[ length+1 ];
 	buf[0] = 0;
 
 	if ( fread( buf, length, 1, file ) != 1 ) {
-		delete [] buf;
+		if ( !arena )
+			delete [] buf;
 		SetError( TIXML_ERROR_OPENING_FILE, 0, 0, TIXML_ENCODING_UNKNOWN );
 		return false;
 	}
@@ -1074,9 +1270,15 @@ bool TiXmlDocument::LoadFile( FILE* file, TiXmlEncoding encoding )
 	assert( q <= (buf+length) );
 	*q = 0;
 
-	Parse( buf, 0, encoding );
-
-	delete [] buf;
+	if ( arena )
+	{
+		ParseDocument( buf, 0, encoding, true );
+	}
+	else
+	{
+		Parse( buf, 0, encoding );
+		delete [] buf;
+	}
 	return !Error();
 }
 
@@ -1145,11 +1347,8 @@ TiXmlNode* TiXmlDocument::Clone() const
 void TiXmlDocument::Print( FILE* cfile, int depth ) const
 {
 	assert( cfile );
-	for ( const TiXmlNode* node=FirstChild(); node; node=node->NextSibling() )
-	{
-		node->Print( cfile, depth );
-		fprintf( cfile, "\n" );
-	}
+	TiXmlWriter writer( cfile );
+	writer.Print( *this, depth );
 }
 
 
@@ -1211,10 +1410,10 @@ void TiXmlAttribute::Print( FILE* cfile, int /*depth*/, TIXML_string* str ) cons
 {
 	TIXML_string n, v;
 
-	Encodestring( name, &n );
-	Encodestring( value, &v );
+	Encodestring( name.c_str(), &n );
+	Encodestring( value.c_str(), &v );
 
-	if (value.find ('\"') == TIXML_string::npos) {
+	if ( !strchr( value.c_str(), '\"' ) ) {
 		if ( cfile ) {
 			fprintf (cfile, "%s=\"%s\"", n.c_str(), v.c_str() );
 		}
@@ -1297,11 +1496,8 @@ TiXmlComment& TiXmlComment::operator=( const TiXmlComment& base )
 void TiXmlComment::Print( FILE* cfile, int depth ) const
 {
 	assert( cfile );
-	for ( int i=0; i<depth; i++ )
-	{
-		fprintf( cfile,  "  " );
-	}
-	fprintf( cfile, "<!--%s-->", value.c_str() );
+	TiXmlWriter writer( cfile );
+	writer.Print( *this, depth );
 }
 
 
@@ -1332,21 +1528,8 @@ TiXmlNode* TiXmlComment::Clone() const
 void TiXmlText::Print( FILE* cfile, int depth ) const
 {
 	assert( cfile );
-	if ( cdata )
-	{
-		int i;
-		fprintf( cfile, "\n" );
-		for ( i=0; i<depth; i++ ) {
-			fprintf( cfile, "  " );
-		}
-		fprintf( cfile, "<![CDATA[%s]]>\n", value.c_str() );	// unformatted output
-	}
-	else
-	{
-		TIXML_string buffer;
-		Encodestring( value, &buffer );
-		fprintf( cfile, "%s", buffer.c_str() );
-	}
+	TiXmlWriter writer( cfile );
+	writer.Print( *this, depth );
 }
 
 
@@ -1422,15 +1605,15 @@ void TiXmlDeclaration::Print( FILE* cfile, int /*depth*/, TIXML_string* str ) co
 
 	if ( !version.empty() ) {
 		if ( cfile ) fprintf (cfile, "version=\"%s\" ", version.c_str ());
-		if ( str ) { (*str) += "version=\""; (*str) += version; (*str) += "\" "; }
+		if ( str ) { (*str) += "version=\""; (*str) += version.c_str(); (*str) += "\" "; }
 	}
 	if ( !encoding.empty() ) {
 		if ( cfile ) fprintf (cfile, "encoding=\"%s\" ", encoding.c_str ());
-		if ( str ) { (*str) += "encoding=\""; (*str) += encoding; (*str) += "\" "; }
+		if ( str ) { (*str) += "encoding=\""; (*str) += encoding.c_str(); (*str) += "\" "; }
 	}
 	if ( !standalone.empty() ) {
 		if ( cfile ) fprintf (cfile, "standalone=\"%s\" ", standalone.c_str ());
-		if ( str ) { (*str) += "standalone=\""; (*str) += standalone; (*str) += "\" "; }
+		if ( str ) { (*str) += "standalone=\""; (*str) += standalone.c_str(); (*str) += "\" "; }
 	}
 	if ( cfile ) fprintf( cfile, "?>" );
 	if ( str )	 (*str) += "?>";
@@ -1441,9 +1624,18 @@ void TiXmlDeclaration::CopyTo( TiXmlDeclaration* target ) const
 {
 	TiXmlNode::CopyTo( target );
 
-	target->version = version;
-	target->encoding = encoding;
-	target->standalone = standalone;
+	target->version = version.c_str();
+	target->encoding = encoding.c_str();
+	target->standalone = standalone.c_str();
+}
+
+
+void TiXmlDeclaration::SetArena( TiXmlArena* arena )
+{
+	TiXmlNode::SetArena( arena );
+	version.SetArena( arena );
+	encoding.SetArena( arena );
+	standalone.SetArena( arena );
 }
 
 
@@ -1467,9 +1659,9 @@ TiXmlNode* TiXmlDeclaration::Clone() const
 
 void TiXmlUnknown::Print( FILE* cfile, int depth ) const
 {
-	for ( int i=0; i<depth; i++ )
-		fprintf( cfile, "  " );
-	fprintf( cfile, "<%s>", value.c_str() );
+	assert( cfile );
+	TiXmlWriter writer( cfile );
+	writer.Print( *this, depth );
 }
 
 
@@ -1550,17 +1742,19 @@ TiXmlAttribute* TiXmlAttributeSet::Find( const std::string& name ) const
 {
 	for( TiXmlAttribute* node = sentinel.next; node != &sentinel; node = node->next )
 	{
-		if ( node->name == name )
+		if ( strcmp( node->name.c_str(), name.c_str() ) == 0 )
 			return node;
 	}
 	return 0;
 }
 
-TiXmlAttribute* TiXmlAttributeSet::FindOrCreate( const std::string& _name )
+TiXmlAttribute* TiXmlAttributeSet::FindOrCreate( const std::string& _name, TiXmlArena* arena )
 {
 	TiXmlAttribute* attrib = Find( _name );
 	if ( !attrib ) {
-		attrib = new TiXmlAttribute();
+		attrib = new ( arena ) TiXmlAttribute();
+		if ( arena )
+			attrib->SetArena( arena );
 		Add( attrib );
 		attrib->SetName( _name );
 	}
@@ -1580,11 +1774,13 @@ TiXmlAttribute* TiXmlAttributeSet::Find( const char* name ) const
 }
 
 
-TiXmlAttribute* TiXmlAttributeSet::FindOrCreate( const char* _name )
+TiXmlAttribute* TiXmlAttributeSet::FindOrCreate( const char* _name, TiXmlArena* arena )
 {
 	TiXmlAttribute* attrib = Find( _name );
 	if ( !attrib ) {
-		attrib = new TiXmlAttribute();
+		attrib = new ( arena ) TiXmlAttribute();
+		if ( arena )
+			attrib->SetArena( arena );
 		Add( attrib );
 		attrib->SetName( _name );
 	}
@@ -1839,14 +2035,14 @@ bool TiXmlPrinter::Visit( const TiXmlText& text )
 	else if ( simpleTextPrint )
 	{
 		TIXML_string str;
-		TiXmlBase::Encodestring( text.ValueTStr(), &str );
+		TiXmlBase::Encodestring( text.Value(), &str );
 		buffer += str;
 	}
 	else
 	{
 		DoIndent();
 		TIXML_string str;
-		TiXmlBase::Encodestring( text.ValueTStr(), &str );
+		TiXmlBase::Encodestring( text.Value(), &str );
 		buffer += str;
 		DoLineBreak();
 	}
@@ -1884,3 +2080,170 @@ bool TiXmlPrinter::Visit( const TiXmlUnknown& unknown )
 	return true;
 }
 
+
+void TiXmlWriter::SetFile( FILE* _file )
+{
+	Flush();
+	file = _file;
+
+	if ( file && buffer.capacity() < BUFFER_SIZE )
+		buffer.reserve( BUFFER_SIZE + BUFFER_SIZE / 4 );
+}
+
+
+void TiXmlWriter::Flush()
+{
+	if ( file && !buffer.empty() )
+	{
+		fwrite( buffer.c_str(), 1, buffer.size(), file );
+		buffer.clear();
+	}
+}
+
+
+bool TiXmlWriter::SimpleText( const TiXmlNode& node )
+{
+	return node.FirstChild() == node.LastChild() && node.FirstChild()->ToText();
+}
+
+
+void TiXmlWriter::Print( const TiXmlNode& root, int depth )
+{
+	const TiXmlNode* node = &root;
+
+	for ( ;; )
+	{
+		if ( Open( *node, depth ) )
+		{
+			// Go down to the children.
+			if ( node->ToElement() )
+				++depth;
+			node = node->FirstChild();
+		}
+		else
+		{
+			// Go back up past the parents this was the last child of, closing them.
+			// Nodes at the top of a document end their line.
+			while ( node != &root && !node->NextSibling() )
+			{
+				if ( node->Parent()->ToDocument() )
+					buffer += '\n';
+
+				node = node->Parent();
+				if ( node->ToElement() )
+					--depth;
+				Close( *node, depth );
+			}
+
+			if ( node == &root )
+				break;
+
+			if ( node->Parent()->ToDocument() )
+				buffer += '\n';
+			node = node->NextSibling();
+		}
+
+		// Children of elements that hold more than one text start a line, except for text.
+		const TiXmlNode* parent = node->Parent();
+		if ( parent->ToElement() && !node->ToText() && !SimpleText( *parent ) )
+			buffer += '\n';
+
+		if ( file && buffer.size() >= BUFFER_SIZE )
+			Flush();
+	}
+
+	if ( file && buffer.size() >= BUFFER_SIZE )
+		Flush();
+}
+
+
+bool TiXmlWriter::Open( const TiXmlNode& node, int depth )
+{
+	switch ( node.Type() )
+	{
+		case TiXmlNode::TINYXML_DOCUMENT:
+			return node.FirstChild() != 0;
+
+		case TiXmlNode::TINYXML_ELEMENT:
+		{
+			const TiXmlElement* element = node.ToElement();
+			Indent( depth );
+			buffer += '<';
+			buffer += element->Value();
+
+			for ( const TiXmlAttribute* attrib = element->FirstAttribute(); attrib; attrib = attrib->Next() )
+			{
+				// Values holding a double quote go in single quotes.
+				char quote = strchr( attrib->Value(), '\"' ) ? '\'' : '\"';
+				buffer += ' ';
+				TiXmlBase::Encodestring( attrib->Name(), &buffer );
+				buffer += '=';
+				buffer += quote;
+				TiXmlBase::Encodestring( attrib->Value(), &buffer );
+				buffer += quote;
+			}
+
+			if ( !element->FirstChild() )
+			{
+				buffer += " />";
+				return false;
+			}
+			buffer += '>';
+			return true;
+		}
+
+		case TiXmlNode::TINYXML_TEXT:
+			if ( node.ToText()->CDATA() )
+			{
+				// unformatted output
+				buffer += '\n';
+				Indent( depth );
+				buffer += "<![CDATA[";
+				buffer += node.Value();
+				buffer += "]]>\n";
+			}
+			else
+			{
+				TiXmlBase::Encodestring( node.Value(), &buffer );
+			}
+			return false;
+
+		case TiXmlNode::TINYXML_COMMENT:
+			Indent( depth );
+			buffer += "<!--";
+			buffer += node.Value();
+			buffer += "-->";
+			return false;
+
+		case TiXmlNode::TINYXML_UNKNOWN:
+			Indent( depth );
+			buffer += '<';
+			buffer += node.Value();
+			buffer += '>';
+			return false;
+
+		case TiXmlNode::TINYXML_DECLARATION:
+			node.ToDeclaration()->Print( 0, 0, &buffer );
+			return false;
+
+		default:
+			return false;
+	}
+}
+
+
+void TiXmlWriter::Close( const TiXmlNode& node, int depth )
+{
+	const TiXmlElement* element = node.ToElement();
+	if ( !element )
+		return;
+
+	if ( !SimpleText( node ) )
+	{
+		buffer += '\n';
+		Indent( depth );
+	}
+	buffer += "</";
+	buffer += element->Value();
+	buffer += '>';
+}
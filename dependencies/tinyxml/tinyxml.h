@@ -105,6 +105,7 @@ bool FromString(T& t,
   return !(iss >> f >> t).fail();
 }
 
+class TiXmlNode;
 class TiXmlDocument;
 class TiXmlElement;
 class TiXmlComment;
@@ -131,6 +132,107 @@ struct TiXmlCursor
 };
 
 
+/**	A block allocator owned by an arena document (see TiXmlDocument::SetArenaMode.)
+	The nodes, attributes and strings of the document are carved out of large blocks,
+	and all of them are released at once by Reset(), without visiting the tree.
+*/
+class TiXmlArena
+{
+public:
+	TiXmlArena() : blocks( 0 ), strings( 0 ), adopted( 0 ) {}
+	~TiXmlArena()	{ Reset(); }
+
+	/// Allocate memory aligned for any TinyXml object. It is only released by Reset().
+	void* Alloc( size_t size );
+
+	/// Copy length characters into the arena and null terminate them.
+	char* Store( const char* str, size_t length );
+
+	/// Build a std::string that lives until the arena is reset.
+	TIXML_string* NewString( const char* str );
+
+	/** [internal use] Remember a heap allocated node that was linked below an arena
+		node, so Reset() can delete it along with the arena.
+	*/
+	void Adopt( TiXmlNode* node );
+
+	/// Release everything allocated from the arena.
+	void Reset();
+
+private:
+	TiXmlArena( const TiXmlArena& );		// not allowed.
+	void operator=( const TiXmlArena& );	// not allowed.
+
+	enum
+	{
+		BLOCK_SIZE = 64 * 1024
+	};
+
+	struct Block
+	{
+		Block*	next;
+		size_t	size;
+		size_t	used;
+	};
+
+	struct StringRecord
+	{
+		TIXML_string	str;
+		StringRecord*	next;
+	};
+
+	struct NodeRecord
+	{
+		TiXmlNode*	node;
+		NodeRecord*	next;
+	};
+
+	Block*			blocks;
+	StringRecord*	strings;
+	NodeRecord*		adopted;
+};
+
+
+/**	The storage of a name or a value. Outside of an arena it is a plain string.
+	Inside an arena document it is a null terminated view into the loaded buffer
+	or into the arena, and a std::string is only built when one is asked for.
+*/
+class TiXmlValue
+{
+public:
+	TiXmlValue() : view( 0 ), cache( 0 ), arena( 0 ) {}
+
+	const char* c_str() const	{ return view ? view : str.c_str(); }
+	size_t length() const		{ return view ? strlen( view ) : str.length(); }
+	bool empty() const			{ return view ? *view == 0 : str.empty(); }
+
+	/// The value as a std::string. Arena values build it on the first call and keep it in the arena.
+	const TIXML_string& Str() const;
+
+	void Assign( const char* s, size_t length );
+	void operator=( const char* s )				{ Assign( s, strlen( s ) ); }
+	void operator=( const TIXML_string& s )		{ Assign( s.c_str(), s.length() ); }
+
+	// [internal use] Store this value in the given arena from now on.
+	void SetArena( TiXmlArena* _arena )	{ arena = _arena; view = _arena ? "" : 0; cache = 0; }
+	TiXmlArena* Arena() const			{ return arena; }
+
+	// [internal use] Point at a null terminated string that lives as long as the arena.
+	void SetView( const char* s )		{ view = s; cache = 0; }
+	// [internal use] Take the contents of s, leaving s unspecified.
+	void Swap( TIXML_string& s );
+
+private:
+	TiXmlValue( const TiXmlValue& );		// not allowed.
+	void operator=( const TiXmlValue& );	// not allowed.
+
+	TIXML_string			str;
+	const char*				view;
+	mutable TIXML_string*	cache;
+	TiXmlArena*				arena;
+};
+
+
 /**
 	Implements the interface to the "Visitor pattern" (see the Accept() method.)
 	If you call the Accept() method, it requires being passed a TiXmlVisitor
@@ -226,6 +328,15 @@ public:
 	TiXmlBase()	:	userData(0)		{}
 	virtual ~TiXmlBase()			{}
 
+	/**	Every TinyXml object is allocated either from the heap or from the arena of
+		an arena document. Deleting an arena object runs its destructor but leaves
+		the memory to the arena, so the usual ownership rules keep working.
+	*/
+	static void* operator new( size_t size )						{ return operator new( size, (TiXmlArena*) 0 ); }
+	static void* operator new( size_t size, TiXmlArena* arena );
+	static void operator delete( void* p );
+	static void operator delete( void* p, TiXmlArena* )				{ operator delete( p ); }
+
 	/**	All TinyXml classes can print themselves to a filestream
 		or the string class (TiXmlstring in non-STL mode, std::string
 		in STL mode.) Either or both cfile and str can be null.
@@ -285,6 +396,7 @@ public:
 		or they will be transformed into entities!
 	*/
 	static void Encodestring( const TIXML_string& str, TIXML_string* out );
+	static void Encodestring( const char* str, TIXML_string* out );
 
 	enum
 	{
@@ -332,17 +444,19 @@ protected:
 		a pointer just past the last character of the name,
 		or 0 if the function has an error.
 	*/
-	static const char* ReadName( const char* p, TIXML_string* name, TiXmlEncoding encoding );
+	static const char* ReadName( const char* p, TiXmlValue* name, TiXmlEncoding encoding );
 
 	/*	Reads text. Returns a pointer past the given end tag.
 		Wickedly complex options, but it keeps the (sensitive) code in one place.
+		With inSitu, arena values are decoded over the buffer they are read from.
 	*/
 	static const char* ReadText(	const char* in,				// where to start
-									TIXML_string* text,			// the string read
+									TiXmlValue* text,			// the string read
 									bool ignoreWhiteSpace,		// whether to keep the white space
 									const char* endTag,			// what ends this text
 									bool ignoreCase,			// whether to ignore case in the end tag
-									TiXmlEncoding encoding );	// the current encoding
+									TiXmlEncoding encoding,		// the current encoding
+									bool inSitu = false );		// whether the buffer may be written to
 
 	// If an entity has been found, transform it into a character.
 	static const char* GetEntity( const char* in, char* value, int* length, TiXmlEncoding encoding );
@@ -516,10 +630,10 @@ public:
 	    this is more efficient than calling Value().
 		Only available in STL mode.
 	*/
-	const std::string& ValueStr() const { return value; }
+	const std::string& ValueStr() const { return value.Str(); }
 	#endif
 
-	const TIXML_string& ValueTStr() const { return value; }
+	const TIXML_string& ValueTStr() const { return value.Str(); }
 
 	/** Changes the value of the node. Defined as:
 		@verbatim
@@ -777,13 +891,20 @@ protected:
 	// Figure out what is at *p, and parse it. Returns null if it is not an xml node.
 	TiXmlNode* Identify( const char* start, TiXmlEncoding encoding );
 
+	// The arena this node allocates from, or null for heap nodes.
+	TiXmlArena* Arena() const;
+	// [internal use] Move the strings of a new node into the arena.
+	virtual void SetArena( TiXmlArena* arena )	{ value.SetArena( arena ); }
+	// [internal use] Hand heap nodes linked below an arena node over to the arena.
+	void Adopt( TiXmlNode* node );
+
 	TiXmlNode*		parent;
 	NodeType		type;
 
 	TiXmlNode*		firstChild;
 	TiXmlNode*		lastChild;
 
-	TIXML_string	value;
+	TiXmlValue		value;
 
 	TiXmlNode*		prev;
 	TiXmlNode*		next;
@@ -836,13 +957,13 @@ public:
 	const char*		Name()  const		{ return name.c_str(); }		///< Return the name of this attribute.
 	const char*		Value() const		{ return value.c_str(); }		///< Return the value of this attribute.
 	#ifdef TIXML_USE_STL
-	const std::string& ValueStr() const	{ return value; }				///< Return the value of this attribute.
+	const std::string& ValueStr() const	{ return value.Str(); }			///< Return the value of this attribute.
 	#endif
 	int				IntValue() const;									///< Return the value of this attribute, converted to an integer.
 	double			DoubleValue() const;								///< Return the value of this attribute, converted to a double.
 
 	// Get the tinyxml string representation
-	const TIXML_string& NameTStr() const { return name; }
+	const TIXML_string& NameTStr() const { return name.Str(); }
 
 	/** QueryIntValue examines the value string. It is an alternative to the
 		IntValue() method with richer error checking.
@@ -882,9 +1003,9 @@ public:
 		return const_cast< TiXmlAttribute* >( (const_cast< const TiXmlAttribute* >(this))->Previous() );
 	}
 
-	bool operator==( const TiXmlAttribute& rhs ) const { return rhs.name == name; }
-	bool operator<( const TiXmlAttribute& rhs )	 const { return name < rhs.name; }
-	bool operator>( const TiXmlAttribute& rhs )  const { return name > rhs.name; }
+	bool operator==( const TiXmlAttribute& rhs ) const { return strcmp( rhs.name.c_str(), name.c_str() ) == 0; }
+	bool operator<( const TiXmlAttribute& rhs )	 const { return strcmp( name.c_str(), rhs.name.c_str() ) < 0; }
+	bool operator>( const TiXmlAttribute& rhs )  const { return strcmp( name.c_str(), rhs.name.c_str() ) > 0; }
 
 	/*	Attribute parsing starts: first letter of the name
 						 returns: the next char after the value end quote
@@ -901,13 +1022,17 @@ public:
 	// Set the document pointer so the attribute can report errors.
 	void SetDocument( TiXmlDocument* doc )	{ document = doc; }
 
+	// [internal use]
+	// Move the name and value of a new attribute into the arena.
+	void SetArena( TiXmlArena* arena )		{ name.SetArena( arena ); value.SetArena( arena ); }
+
 private:
 	TiXmlAttribute( const TiXmlAttribute& );				// not implemented.
 	void operator=( const TiXmlAttribute& base );	// not allowed.
 
 	TiXmlDocument*	document;	// A pointer back to a document, for error reporting.
-	TIXML_string name;
-	TIXML_string value;
+	TiXmlValue name;
+	TiXmlValue value;
 	TiXmlAttribute*	prev;
 	TiXmlAttribute*	next;
 };
@@ -940,11 +1065,11 @@ public:
 	TiXmlAttribute* Last()					{ return ( sentinel.prev == &sentinel ) ? 0 : sentinel.prev; }
 
 	TiXmlAttribute*	Find( const char* _name ) const;
-	TiXmlAttribute* FindOrCreate( const char* _name );
+	TiXmlAttribute* FindOrCreate( const char* _name, TiXmlArena* arena );
 
 #	ifdef TIXML_USE_STL
 	TiXmlAttribute*	Find( const std::string& _name ) const;
-	TiXmlAttribute* FindOrCreate( const std::string& _name );
+	TiXmlAttribute* FindOrCreate( const std::string& _name, TiXmlArena* arena );
 #	endif
 
 
@@ -1361,11 +1486,13 @@ protected:
 	virtual void StreamIn( std::istream * in, TIXML_string * tag );
 	#endif
 
+	virtual void SetArena( TiXmlArena* arena );
+
 private:
 
-	TIXML_string version;
-	TIXML_string encoding;
-	TIXML_string standalone;
+	TiXmlValue version;
+	TiXmlValue encoding;
+	TiXmlValue standalone;
 };
 
 
@@ -1431,7 +1558,7 @@ public:
 	TiXmlDocument( const TiXmlDocument& copy );
 	TiXmlDocument& operator=( const TiXmlDocument& copy );
 
-	virtual ~TiXmlDocument() {}
+	virtual ~TiXmlDocument();
 
 	/** Load a file using the current document value.
 		Returns true if successful. Will delete any existing
@@ -1530,6 +1657,31 @@ public:
 
 	int TabSize() const	{ return tabsize; }
 
+	/** SetArenaMode() switches the document between the usual heap allocated DOM and
+		an arena DOM, which is much cheaper to load and to throw away. An arena document
+		allocates its nodes and attributes from large blocks it owns, decodes the loaded
+		text in place and keeps text and attribute values as views into it. Clearing or
+		deleting the document then releases everything at once instead of node by node.
+
+		The DOM API is unchanged. ValueStr() and friends build their std::string on the
+		first call and keep it until the document is cleared, and values that are changed
+		keep their old text in the arena until then too. Heap nodes linked into the
+		document are deleted with it as usual.
+
+		Row and column tracking is not available for a document parsed in place, so
+		nodes have no location and errors have no row or column.
+
+		Changing the mode deletes any existing document data. Correct usage:
+		@verbatim
+		TiXmlDocument doc;
+		doc.SetArenaMode( true );
+		doc.LoadFile( "myfile.xml" );
+		@endverbatim
+	*/
+	void SetArenaMode( bool enable );
+
+	bool ArenaMode() const	{ return arena != 0; }
+
 	/** If you have handled the error, it can be reset with this call. The error
 		state is automatically cleared if you Parse a new XML block.
 	*/
@@ -1569,8 +1721,13 @@ protected :
 	#endif
 
 private:
+	friend class TiXmlNode;
+
 	void CopyTo( TiXmlDocument* target ) const;
+	// The work of Parse(). In situ, p belongs to the arena and the decoded text is written over it.
+	const char* ParseDocument( const char* p, TiXmlParsingData* prevData, TiXmlEncoding encoding, bool inSitu );
 
+	TiXmlArena* arena;
 	bool error;
 	int  errorId;
 	TIXML_string errorDesc;
@@ -1823,6 +1980,68 @@ private:
 };
 
 
+/** The serializer behind Print() and SaveFile(). It formats nodes exactly like
+	TiXmlNode::Print(), but writes them through one large buffer that is handed
+	to the FILE in big blocks instead of with an fprintf per piece, and walks the
+	tree without recursion. Without a FILE it prints to memory.
+
+	A writer can be reused for several nodes or documents and keeps its buffer:
+	@verbatim
+	TiXmlWriter writer( fp );
+	writer.Print( doc );
+	writer.Flush();
+	@endverbatim
+*/
+class TiXmlWriter
+{
+public:
+	TiXmlWriter( FILE* _file = 0 ) : file( 0 )	{ SetFile( _file ); }
+	~TiXmlWriter()								{ Flush(); }
+
+	/// Write the node and everything below it, starting at the given indentation depth.
+	void Print( const TiXmlNode& node, int depth = 0 );
+
+	/// Hand the buffered text to the FILE. A memory writer keeps it.
+	void Flush();
+
+	/// Write to another FILE, or to memory when null, after flushing what is pending.
+	void SetFile( FILE* _file );
+
+	/// The text printed to memory.
+	const char* CStr() const						{ return buffer.c_str(); }
+	/// The length of the text printed to memory.
+	size_t Size() const								{ return buffer.size(); }
+	/// Discard the text printed to memory, keeping the buffer for reuse.
+	void Clear()									{ buffer.clear(); }
+
+	#ifdef TIXML_USE_STL
+	/// The text printed to memory.
+	const std::string& Str() const					{ return buffer; }
+	#endif
+
+private:
+	TiXmlWriter( const TiXmlWriter& );		// not allowed.
+	void operator=( const TiXmlWriter& );	// not allowed.
+
+	enum
+	{
+		BUFFER_SIZE = 64 * 1024
+	};
+
+	// Writes the start of a node, or all of it when it has no children to visit.
+	bool Open( const TiXmlNode& node, int depth );
+	// Writes the end of a node whose children have been visited.
+	void Close( const TiXmlNode& node, int depth );
+	// Whether an element prints as <foo>text</foo>, without line breaks.
+	static bool SimpleText( const TiXmlNode& node );
+
+	void Indent( int depth )						{ buffer.append( depth * 2, ' ' ); }
+
+	FILE* file;
+	TIXML_string buffer;
+};
+
+
 #ifdef _MSC_VER
 #pragma warning( pop )
 #endif
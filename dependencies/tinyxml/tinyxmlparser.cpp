@@ -176,20 +176,25 @@ class TiXmlParsingData
 
 	const TiXmlCursor& Cursor() const	{ return cursor; }
 
+	// Whether the text being parsed belongs to the arena and may be written over.
+	bool InSitu() const					{ return inSitu; }
+
   private:
 	// Only used by the document!
-	TiXmlParsingData( const char* start, int _tabsize, int row, int col )
+	TiXmlParsingData( const char* start, int _tabsize, int row, int col, bool _inSitu )
 	{
 		assert( start );
 		stamp = start;
 		tabsize = _tabsize;
 		cursor.row = row;
 		cursor.col = col;
+		inSitu = _inSitu;
 	}
 
 	TiXmlCursor		cursor;
 	const char*		stamp;
 	int				tabsize;
+	bool			inSitu;
 };
 
 
@@ -398,7 +403,7 @@ const char* TiXmlBase::SkipWhiteSpace( const char* p, TiXmlEncoding encoding )
 // One of TinyXML's more performance demanding functions. Try to keep the memory overhead down. The
 // "assign" optimization removes over 10% of the execution time.
 //
-const char* TiXmlBase::ReadName( const char* p, TIXML_string * name, TiXmlEncoding encoding )
+const char* TiXmlBase::ReadName( const char* p, TiXmlValue * name, TiXmlEncoding encoding )
 {
 	// Oddly, not supported on some comilers,
 	//name->clear();
@@ -428,7 +433,7 @@ const char* TiXmlBase::ReadName( const char* p, TIXML_string * name, TiXmlEncodi
 			++p;
 		}
 		if ( p-start > 0 ) {
-			name->assign( start, p-start );
+			name->Assign( start, p-start );
 		}
 		return p;
 	}
@@ -571,14 +576,36 @@ bool TiXmlBase::stringEqual( const char* p,
 	return false;
 }
 
+// Appends decoded characters either to the buffer being read, when parsing in
+// place, or to a string.
+static inline void AppendText( char*& out, TIXML_string& text, const char* c, int length )
+{
+	if ( out )
+	{
+		for ( int i=0; i<length; ++i )
+			*out++ = c[i];
+	}
+	else
+	{
+		text.append( c, length );
+	}
+}
+
 const char* TiXmlBase::ReadText(	const char* p, 
-									TIXML_string * text, 
+									TiXmlValue * text, 
 									bool trimWhiteSpace, 
 									const char* endTag, 
 									bool caseInsensitive,
-									TiXmlEncoding encoding )
+									TiXmlEncoding encoding,
+									bool inSitu )
 {
-    *text = "";
+	// In place, the decoded text is written over the text being read. Entities and
+	// condensed white space only ever make it shorter, so the write head never
+	// passes the read head.
+	char* start = ( inSitu && text->Arena() ) ? const_cast< char* >( p ) : 0;
+	char* out = start;
+	TIXML_string buffer;
+
 	if (    !trimWhiteSpace			// certain tags always keep whitespace
 		 || !condenseWhiteSpace )	// if true, whitespace is always kept
 	{
@@ -590,7 +617,7 @@ const char* TiXmlBase::ReadText(	const char* p,
 			int len;
 			char cArr[4] = { 0, 0, 0, 0 };
 			p = GetChar( p, cArr, &len, encoding );
-			text->append( cArr, len );
+			AppendText( out, buffer, cArr, len );
 		}
 	}
 	else
@@ -618,21 +645,39 @@ const char* TiXmlBase::ReadText(	const char* p,
 				// new character. Any whitespace just becomes a space.
 				if ( whitespace )
 				{
-					(*text) += ' ';
+					AppendText( out, buffer, " ", 1 );
 					whitespace = false;
 				}
 				int len;
 				char cArr[4] = { 0, 0, 0, 0 };
 				p = GetChar( p, cArr, &len, encoding );
-				if ( len == 1 )
-					(*text) += cArr[0];	// more efficient
-				else
-					text->append( cArr, len );
+				AppendText( out, buffer, cArr, len );
 			}
 		}
 	}
+
+	const char* end = p;
 	if ( p && *p )
 		p += strlen( endTag );
+
+	if ( start )
+	{
+		// The terminator can go over the end tag, which has been read, except for
+		// the '<' that ends a text node: its parser steps back onto it.
+		if ( end && ( out < end || *endTag != '<' ) )
+		{
+			*out = 0;
+			text->SetView( start );
+		}
+		else
+		{
+			text->Assign( start, out - start );
+		}
+	}
+	else
+	{
+		text->Swap( buffer );
+	}
 	return ( p && *p ) ? p : 0;
 }
 
@@ -702,6 +747,18 @@ void TiXmlDocument::StreamIn( std::istream * in, TIXML_string * tag )
 #endif
 
 const char* TiXmlDocument::Parse( const char* p, TiXmlParsingData* prevData, TiXmlEncoding encoding )
+{
+	if ( arena && p )
+	{
+		// Arena documents decode a copy of their own in place.
+		char* buffer = arena->Store( p, strlen( p ) );
+		const char* end = ParseDocument( buffer, prevData, encoding, true );
+		return end ? p + ( end - buffer ) : 0;
+	}
+	return ParseDocument( p, prevData, encoding, false );
+}
+
+const char* TiXmlDocument::ParseDocument( const char* p, TiXmlParsingData* prevData, TiXmlEncoding encoding, bool inSitu )
 {
 	ClearError();
 
@@ -728,7 +785,8 @@ const char* TiXmlDocument::Parse( const char* p, TiXmlParsingData* prevData, TiX
 		location.row = 0;
 		location.col = 0;
 	}
-	TiXmlParsingData data( p, TabSize(), location.row, location.col );
+	// Locations can't be tracked over text that is decoded in place.
+	TiXmlParsingData data( p, inSitu ? 0 : TabSize(), location.row, location.col, inSitu );
 	location = data.Cursor();
 
 	if ( encoding == TIXML_ENCODING_UNKNOWN )
@@ -839,6 +897,8 @@ TiXmlNode* TiXmlNode::Identify( const char* p, TiXmlEncoding encoding )
 	// - Everthing else is unknown to tinyxml.
 	//
 
+	TiXmlArena* arena = Arena();
+
 	const char* xmlHeader = { "<?xml" };
 	const char* commentHeader = { "<!--" };
 	const char* dtdHeader = { "<!" };
@@ -849,21 +909,21 @@ TiXmlNode* TiXmlNode::Identify( const char* p, TiXmlEncoding encoding )
 		#ifdef DEBUG_PARSER
 			TIXML_LOG( "XML parsing Declaration\n" );
 		#endif
-		returnNode = new TiXmlDeclaration();
+		returnNode = new ( arena ) TiXmlDeclaration();
 	}
 	else if ( stringEqual( p, commentHeader, false, encoding ) )
 	{
 		#ifdef DEBUG_PARSER
 			TIXML_LOG( "XML parsing Comment\n" );
 		#endif
-		returnNode = new TiXmlComment();
+		returnNode = new ( arena ) TiXmlComment();
 	}
 	else if ( stringEqual( p, cdataHeader, false, encoding ) )
 	{
 		#ifdef DEBUG_PARSER
 			TIXML_LOG( "XML parsing CDATA\n" );
 		#endif
-		TiXmlText* text = new TiXmlText( "" );
+		TiXmlText* text = new ( arena ) TiXmlText( "" );
 		text->SetCDATA( true );
 		returnNode = text;
 	}
@@ -872,7 +932,7 @@ TiXmlNode* TiXmlNode::Identify( const char* p, TiXmlEncoding encoding )
 		#ifdef DEBUG_PARSER
 			TIXML_LOG( "XML parsing Unknown(1)\n" );
 		#endif
-		returnNode = new TiXmlUnknown();
+		returnNode = new ( arena ) TiXmlUnknown();
 	}
 	else if (    IsAlpha( *(p+1), encoding )
 			  || *(p+1) == '_' )
@@ -880,20 +940,22 @@ TiXmlNode* TiXmlNode::Identify( const char* p, TiXmlEncoding encoding )
 		#ifdef DEBUG_PARSER
 			TIXML_LOG( "XML parsing Element\n" );
 		#endif
-		returnNode = new TiXmlElement( "" );
+		returnNode = new ( arena ) TiXmlElement( "" );
 	}
 	else
 	{
 		#ifdef DEBUG_PARSER
 			TIXML_LOG( "XML parsing Unknown(2)\n" );
 		#endif
-		returnNode = new TiXmlUnknown();
+		returnNode = new ( arena ) TiXmlUnknown();
 	}
 
 	if ( returnNode )
 	{
 		// Set the parent, so it can report errors
 		returnNode->parent = this;
+		if ( arena )
+			returnNode->SetArena( arena );
 	}
 	return returnNode;
 }
@@ -1075,8 +1137,9 @@ const char* TiXmlElement::Parse( const char* p, TiXmlParsingData* data, TiXmlEnc
 		return 0;
 	}
 
-    TIXML_string endTag ("</");
-	endTag += value;
+	// The end tag is "</" and the name, compared in place rather than built.
+	const char* name = value.c_str();
+	size_t nameLength = strlen( name );
 
 	// Check for and read attributes. Also look for an empty
 	// tag or an end tag.
@@ -1119,9 +1182,9 @@ const char* TiXmlElement::Parse( const char* p, TiXmlParsingData* data, TiXmlEnc
 			// </foo > and
 			// </foo> 
 			// are both valid end tags.
-			if ( stringEqual( p, endTag.c_str(), false, encoding ) )
+			if ( stringEqual( p, "</", false, encoding ) && strncmp( p+2, name, nameLength ) == 0 )
 			{
-				p += endTag.length();
+				p += 2 + nameLength;
 				p = SkipWhiteSpace( p, encoding );
 				if ( p && *p && *p == '>' ) {
 					++p;
@@ -1139,11 +1202,14 @@ const char* TiXmlElement::Parse( const char* p, TiXmlParsingData* data, TiXmlEnc
 		else
 		{
 			// Try to read an attribute:
-			TiXmlAttribute* attrib = new TiXmlAttribute();
+			TiXmlArena* arena = Arena();
+			TiXmlAttribute* attrib = new ( arena ) TiXmlAttribute();
 			if ( !attrib )
 			{
 				return 0;
 			}
+			if ( arena )
+				attrib->SetArena( arena );
 
 			attrib->SetDocument( document );
 			pErr = p;
@@ -1189,12 +1255,15 @@ const char* TiXmlElement::ReadValue( const char* p, TiXmlParsingData* data, TiXm
 		if ( *p != '<' )
 		{
 			// Take what we have, make a text element.
-			TiXmlText* textNode = new TiXmlText( "" );
+			TiXmlArena* arena = Arena();
+			TiXmlText* textNode = new ( arena ) TiXmlText( "" );
 
 			if ( !textNode )
 			{
 			    return 0;
 			}
+			if ( arena )
+				textNode->SetArena( arena );
 
 			if ( TiXmlBase::IsWhiteSpaceCondensed() )
 			{
@@ -1288,13 +1357,13 @@ const char* TiXmlUnknown::Parse( const char* p, TiXmlParsingData* data, TiXmlEnc
 		return 0;
 	}
 	++p;
-    value = "";
 
+	const char* start = p;
 	while ( p && *p && *p != '>' )
 	{
-		value += *p;
 		++p;
 	}
+	value.Assign( start, p - start );
 
 	if ( !p )
 	{
@@ -1375,13 +1444,13 @@ const char* TiXmlComment::Parse( const char* p, TiXmlParsingData* data, TiXmlEnc
 				  <!-- declarations for <head> & <body> -->
 	*/
 
-    value = "";
 	// Keep all the white space.
+	const char* start = p;
 	while (	p && *p && !stringEqual( p, endTag, false, encoding ) )
 	{
-		value.append( p, 1 );
 		++p;
 	}
+	value.Assign( start, p - start );
 	if ( p && *p ) 
 		p += strlen( endTag );
 
@@ -1430,20 +1499,20 @@ const char* TiXmlAttribute::Parse( const char* p, TiXmlParsingData* data, TiXmlE
 	{
 		++p;
 		end = "\'";		// single quote in string
-		p = ReadText( p, &value, false, end, false, encoding );
+		p = ReadText( p, &value, false, end, false, encoding, data && data->InSitu() );
 	}
 	else if ( *p == DOUBLE_QUOTE )
 	{
 		++p;
 		end = "\"";		// double quote in string
-		p = ReadText( p, &value, false, end, false, encoding );
+		p = ReadText( p, &value, false, end, false, encoding, data && data->InSitu() );
 	}
 	else
 	{
 		// All attribute values should be in single or double quotes.
 		// But this is such a common error that the parser will try
 		// its best, even without them.
-		value = "";
+		const char* start = p;
 		while (    p && *p											// existence
 				&& !IsWhiteSpace( *p )								// whitespace
 				&& *p != '/' && *p != '>' )							// tag end
@@ -1455,9 +1524,9 @@ const char* TiXmlAttribute::Parse( const char* p, TiXmlParsingData* data, TiXmlE
 				if ( document ) document->SetError( TIXML_ERROR_READING_ATTRIBUTES, p, data, encoding );
 				return 0;
 			}
-			value += *p;
 			++p;
 		}
+		value.Assign( start, p - start );
 	}
 	return p;
 }
@@ -1496,7 +1565,6 @@ void TiXmlText::StreamIn( std::istream * in, TIXML_string * tag )
 
 const char* TiXmlText::Parse( const char* p, TiXmlParsingData* data, TiXmlEncoding encoding )
 {
-	value = "";
 	TiXmlDocument* document = GetDocument();
 
 	if ( data )
@@ -1521,24 +1589,25 @@ const char* TiXmlText::Parse( const char* p, TiXmlParsingData* data, TiXmlEncodi
 		p += strlen( startTag );
 
 		// Keep all the white space, ignore the encoding, etc.
+		const char* start = p;
 		while (	   p && *p
 				&& !stringEqual( p, endTag, false, encoding )
 			  )
 		{
-			value += *p;
 			++p;
 		}
+		value.Assign( start, p - start );
 
-		TIXML_string dummy; 
-		p = ReadText( p, &dummy, false, endTag, false, encoding );
-		return p;
+		if ( p && *p )
+			p += strlen( endTag );
+		return ( p && *p ) ? p : 0;
 	}
 	else
 	{
 		bool ignoreWhite = true;
 
 		const char* end = "<";
-		p = ReadText( p, &value, ignoreWhite, end, false, encoding );
+		p = ReadText( p, &value, ignoreWhite, end, false, encoding, data && data->InSitu() );
 		if ( p && *p )
 			return p-1;	// don't truncate the '<'
 		return 0;
@@ -1630,8 +1699,8 @@ const char* TiXmlDeclaration::Parse( const char* p, TiXmlParsingData* data, TiXm
 
 bool TiXmlText::Blank() const
 {
-	for ( unsigned i=0; i<value.length(); i++ )
-		if ( !IsWhiteSpace( value[i] ) )
+	for ( const char* p = value.c_str(); *p; p++ )
+		if ( !IsWhiteSpace( *p ) )
 			return false;
 	return true;
 }
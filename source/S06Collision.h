@@ -24,6 +24,9 @@
 #define LIBGENS_S06_COLLISION_ERROR_MESSAGE_NULL_FILE       "Trying to read collision data from unreferenced file."
 #define LIBGENS_S06_COLLISION_ERROR_MESSAGE_WRITE_NULL_FILE "Trying to write collision data to an unreferenced file."
 
+#define LIBGENS_S06_COLLISION_BVH_LANES                     4
+#define LIBGENS_S06_COLLISION_BVH_MAX_LEAF                  16
+
 namespace LibGens {
 	class SonicCollisionFace {
 		public:
@@ -36,6 +39,95 @@ namespace LibGens {
 			void write(File *file);
 	};
 
+	class SonicCollision;
+
+	class SonicCollisionRay {
+		public:
+			Vector3 origin;
+			Vector3 direction;
+			float max_distance;
+			float radius;
+
+			SonicCollisionRay() {
+				max_distance = -1.0f;
+				radius = 0.0f;
+			}
+
+			SonicCollisionRay(Vector3 origin_p, Vector3 direction_p, float max_distance_p=-1.0f, float radius_p=0.0f) {
+				origin = origin_p;
+				direction = direction_p;
+				max_distance = max_distance_p;
+				radius = radius_p;
+			}
+	};
+
+	class SonicCollisionHit {
+		public:
+			bool hit;
+			float distance;
+			Vector3 point;
+			Vector3 normal;
+			unsigned int face;
+			unsigned int collision_flag;
+
+			SonicCollisionHit() {
+				hit = false;
+				distance = 0.0f;
+				face = 0;
+				collision_flag = 0;
+			}
+	};
+
+	// Bounding volume hierarchy over a collision mesh, built with binned SAH splits. Triangles are copied
+	// into blocks of four laid out per component so leaves test four at once. Queries skip faces with any
+	// of the ignored flag bits set, and distances are along the normalized direction.
+	class SonicCollisionBVH {
+		protected:
+			struct Node {
+				float box_min[3];
+				float box_max[3];
+				unsigned int left;
+				unsigned int right;
+				unsigned int block_start;
+				unsigned int block_count;
+			};
+
+			// Lanes are loaded as one vector each, keep them aligned for the SSE kernel
+			struct alignas(16) TriangleBlock {
+				float v0[3][LIBGENS_S06_COLLISION_BVH_LANES];
+				float e1[3][LIBGENS_S06_COLLISION_BVH_LANES];
+				float e2[3][LIBGENS_S06_COLLISION_BVH_LANES];
+				unsigned int face[LIBGENS_S06_COLLISION_BVH_LANES];
+				unsigned int collision_flag[LIBGENS_S06_COLLISION_BVH_LANES];
+			};
+
+			struct BuildContext;
+
+			vector<Node> nodes;
+			vector<TriangleBlock> blocks;
+
+			static unsigned int buildNode(BuildContext &context, vector<Node> &out_nodes, vector<TriangleBlock> &out_blocks, size_t start, size_t end, bool defer);
+			static void setHit(const TriangleBlock &block, size_t lane, SonicCollisionHit &hit);
+			static void intersectBlock(const TriangleBlock &block, const float *origin, const float *direction, float *t);
+		public:
+			SonicCollisionBVH() {
+			}
+
+			void build(SonicCollision *collision, unsigned int thread_count=0);
+
+			bool empty() const {
+				return nodes.empty();
+			}
+
+			bool castRay(const SonicCollisionRay &ray, SonicCollisionHit &hit, unsigned int ignore_flags=0) const;
+			bool castSphere(const SonicCollisionRay &ray, SonicCollisionHit &hit, unsigned int ignore_flags=0) const;
+			bool closestPoint(const Vector3 &point, float max_distance, SonicCollisionHit &hit, unsigned int ignore_flags=0) const;
+
+			// Batch queries spread over threads, rays with a radius are cast as spheres
+			void castRays(const vector<SonicCollisionRay> &rays, vector<SonicCollisionHit> &hits, unsigned int ignore_flags=0, unsigned int thread_count=0) const;
+			void closestPoints(const vector<Vector3> &points, float max_distance, vector<SonicCollisionHit> &hits, unsigned int ignore_flags=0, unsigned int thread_count=0) const;
+	};
+
 	class SonicCollision {
 		public:
 			vector<Vector3> vertex_pool;
@@ -46,12 +138,24 @@ namespace LibGens {
 			Vector3 mopp_code_center;
 			float mopp_code_w;
 
+			// Empty until buildBVH is called, so loading and re-saving files doesn't pay for it.
+			// Call it again after editing the pools.
+			SonicCollisionBVH bvh;
+
+			// Empty collision, for filling the pools by hand
+			SonicCollision() {
+				mopp_code_data = NULL;
+				mopp_code_size = 0;
+				mopp_code_w = 0.0f;
+			}
+
 			SonicCollision(string filename);
 
 			SonicCollision(FBX *fbx);
 
 			void addFbxNode(FbxNode *node);
 			void buildMoppCode();
+			void buildBVH(unsigned int thread_count=0);
 
 			void read(File *file);
 			void save(string filename);
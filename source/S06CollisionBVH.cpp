@@ -0,0 +1,898 @@
+//=========================================================================
+//	  Copyright (c) 2016 SonicGLvl
+//
+//    This file is part of SonicGLvl, a community-created free level editor 
+//    for the PC version of Sonic Generations.
+//
+//    SonicGLvl is free software: you can redistribute it and/or modify
+//    it under the terms of the GNU General Public License as published by
+//    the Free Software Foundation, either version 3 of the License, or
+//    (at your option) any later version.
+//
+//    SonicGLvl is distributed in the hope that it will be useful,
+//    but WITHOUT ANY WARRANTY; without even the implied warranty of
+//    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+//    
+//
+//    Read AUTHORS.txt, LICENSE.txt and COPYRIGHT.txt for more details.
+//=========================================================================
+
+
+#include "LibGens.h"
+#include <algorithm>
+#include <atomic>
+#include <thread>
+#include "S06Common.h"
+#include "S06Collision.h"
+
+#if (LIBGENS_S06_COLLISION_BVH_LANES == 4) && (defined(__SSE__) || defined(_M_X64) || (defined(_M_IX86_FP) && (_M_IX86_FP >= 1)))
+#include <xmmintrin.h>
+#define LIBGENS_COLLISION_BVH_SSE
+#endif
+
+#define LIBGENS_COLLISION_BVH_BINS                16
+#define LIBGENS_COLLISION_BVH_SUBTREE_SIZE        4096
+#define LIBGENS_COLLISION_BVH_BATCH_SIZE          64
+#define LIBGENS_COLLISION_BVH_EPSILON             1e-8f
+#define LIBGENS_COLLISION_BVH_BARYCENTRIC_EPSILON 1e-5f
+#define LIBGENS_COLLISION_BVH_INFINITY            3.402823e+38f
+#define LIBGENS_COLLISION_BVH_NO_FACE             0xFFFFFFFF
+
+namespace LibGens {
+	static inline float dot3(const float *a, const float *b) {
+		return a[0]*b[0] + a[1]*b[1] + a[2]*b[2];
+	}
+
+	static inline void cross3(const float *a, const float *b, float *out) {
+		out[0] = a[1]*b[2] - a[2]*b[1];
+		out[1] = a[2]*b[0] - a[0]*b[2];
+		out[2] = a[0]*b[1] - a[1]*b[0];
+	}
+
+	static inline void sub3(const float *a, const float *b, float *out) {
+		out[0] = a[0]-b[0];
+		out[1] = a[1]-b[1];
+		out[2] = a[2]-b[2];
+	}
+
+	static inline float boxArea(const float *box_min, const float *box_max) {
+		float x=box_max[0]-box_min[0], y=box_max[1]-box_min[1], z=box_max[2]-box_min[2];
+		return 2.0f * (x*y + y*z + z*x);
+	}
+
+	static inline void resetBox(float *box_min, float *box_max) {
+		for (size_t k=0; k<3; k++) {
+			box_min[k] = LIBGENS_COLLISION_BVH_INFINITY;
+			box_max[k] = -LIBGENS_COLLISION_BVH_INFINITY;
+		}
+	}
+
+	static inline void growBox(float *box_min, float *box_max, const float *other_min, const float *other_max) {
+		for (size_t k=0; k<3; k++) {
+			box_min[k] = std::min(box_min[k], other_min[k]);
+			box_max[k] = std::max(box_max[k], other_max[k]);
+		}
+	}
+
+	static inline unsigned int resolveThreadCount(unsigned int thread_count, size_t work) {
+		if (!thread_count) thread_count = std::thread::hardware_concurrency();
+		if (!thread_count) thread_count = 1;
+		return (unsigned int) std::max((size_t) 1, std::min((size_t) thread_count, work));
+	}
+
+	// Entry distance of a ray into a box, or a negative value when it misses within max_distance
+	static inline float rayBox(const float *box_min, const float *box_max, const float *origin, const float *inverse, float max_distance) {
+		float t_min=0.0f, t_max=max_distance;
+		for (size_t k=0; k<3; k++) {
+			float t1=(box_min[k] - origin[k]) * inverse[k];
+			float t2=(box_max[k] - origin[k]) * inverse[k];
+			t_min = std::max(t_min, std::min(t1, t2));
+			t_max = std::min(t_max, std::max(t1, t2));
+		}
+		return (t_min <= t_max) ? t_min : -1.0f;
+	}
+
+	static inline float boxDistanceSquared(const float *box_min, const float *box_max, const float *point) {
+		float distance=0.0f;
+		for (size_t k=0; k<3; k++) {
+			float d=std::max(std::max(box_min[k] - point[k], point[k] - box_max[k]), 0.0f);
+			distance += d*d;
+		}
+		return distance;
+	}
+
+	// Closest point to p on the triangle a, a+e1, a+e2
+	static void closestPointTriangle(const float *p, const float *a, const float *e1, const float *e2, float *out) {
+		float ap[3];
+		sub3(p, a, ap);
+		float d1=dot3(e1, ap), d2=dot3(e2, ap);
+		if ((d1 <= 0.0f) && (d2 <= 0.0f)) {
+			out[0] = a[0]; out[1] = a[1]; out[2] = a[2];
+			return;
+		}
+
+		float bp[3]={ ap[0]-e1[0], ap[1]-e1[1], ap[2]-e1[2] };
+		float d3=dot3(e1, bp), d4=dot3(e2, bp);
+		if ((d3 >= 0.0f) && (d4 <= d3)) {
+			for (size_t k=0; k<3; k++) out[k] = a[k] + e1[k];
+			return;
+		}
+
+		float vc=d1*d4 - d3*d2;
+		if ((vc <= 0.0f) && (d1 >= 0.0f) && (d3 <= 0.0f)) {
+			float v=d1 / (d1 - d3);
+			for (size_t k=0; k<3; k++) out[k] = a[k] + e1[k]*v;
+			return;
+		}
+
+		float cp[3]={ ap[0]-e2[0], ap[1]-e2[1], ap[2]-e2[2] };
+		float d5=dot3(e1, cp), d6=dot3(e2, cp);
+		if ((d6 >= 0.0f) && (d5 <= d6)) {
+			for (size_t k=0; k<3; k++) out[k] = a[k] + e2[k];
+			return;
+		}
+
+		float vb=d5*d2 - d1*d6;
+		if ((vb <= 0.0f) && (d2 >= 0.0f) && (d6 <= 0.0f)) {
+			float w=d2 / (d2 - d6);
+			for (size_t k=0; k<3; k++) out[k] = a[k] + e2[k]*w;
+			return;
+		}
+
+		float va=d3*d6 - d5*d4;
+		if ((va <= 0.0f) && ((d4 - d3) >= 0.0f) && ((d5 - d6) >= 0.0f)) {
+			float w=(d4 - d3) / ((d4 - d3) + (d5 - d6));
+			for (size_t k=0; k<3; k++) out[k] = a[k] + e1[k] + (e2[k] - e1[k])*w;
+			return;
+		}
+
+		float denominator=1.0f / (va + vb + vc);
+		float v=vb * denominator;
+		float w=vc * denominator;
+		for (size_t k=0; k<3; k++) out[k] = a[k] + e1[k]*v + e2[k]*w;
+	}
+
+	// Earliest time a ray hits a sphere, or a negative value
+	static float raySphere(const float *origin, const float *direction, const float *center, float radius) {
+		float m[3];
+		sub3(origin, center, m);
+		float b=dot3(m, direction);
+		float c=dot3(m, m) - radius*radius;
+		if ((c > 0.0f) && (b > 0.0f)) return -1.0f;
+
+		float discriminant=b*b - c;
+		if (discriminant < 0.0f) return -1.0f;
+		return std::max(-b - sqrt(discriminant), 0.0f);
+	}
+
+	// Earliest time a ray hits the cylinder of the given radius around the segment p, p+edge, or a negative value
+	static float rayEdge(const float *origin, const float *direction, const float *p, const float *edge, float radius) {
+		float m[3];
+		sub3(origin, p, m);
+		float ee=dot3(edge, edge), ed=dot3(edge, direction), em=dot3(edge, m);
+		float a=ee - ed*ed;
+		if (a <= LIBGENS_COLLISION_BVH_EPSILON * ee) return -1.0f;
+
+		float b=ee*dot3(m, direction) - em*ed;
+		float c=ee*(dot3(m, m) - radius*radius) - em*em;
+		float discriminant=b*b - a*c;
+		if (discriminant < 0.0f) return -1.0f;
+
+		float t=(-b - sqrt(discriminant)) / a;
+		if (t < 0.0f) return -1.0f;
+
+		float s=(em + t*ed) / ee;
+		return ((s >= 0.0f) && (s <= 1.0f)) ? t : -1.0f;
+	}
+
+	// Earliest time a sphere moving along a ray touches the triangle a, a+e1, a+e2, or a negative value
+	static float sweepSphereTriangle(const float *ray_origin, const float *direction, float radius, const float *a, const float *e1, const float *e2) {
+		// Start next to the triangle's bounding sphere, the contact equations lose their precision far from it
+		float center[3], corner[3], reach=0.0f;
+		for (size_t k=0; k<3; k++) center[k] = a[k] + (e1[k] + e2[k]) / 3.0f;
+		for (size_t p=0; p<3; p++) {
+			for (size_t k=0; k<3; k++) corner[k] = a[k] + ((p == 1) ? e1[k] : 0.0f) + ((p == 2) ? e2[k] : 0.0f) - center[k];
+			reach = std::max(reach, dot3(corner, corner));
+		}
+
+		float to_center[3];
+		sub3(center, ray_origin, to_center);
+		float skip=std::max(dot3(to_center, direction) - sqrt(reach) - radius, 0.0f);
+		float origin[3];
+		for (size_t k=0; k<3; k++) origin[k] = ray_origin[k] + direction[k]*skip;
+
+		float closest[3], offset[3];
+		closestPointTriangle(origin, a, e1, e2, closest);
+		sub3(origin, closest, offset);
+		if (dot3(offset, offset) <= radius*radius) return skip;
+
+		float best=-1.0f;
+
+		// Face, the sphere touching the plane inside the triangle comes before any edge or corner contact
+		float normal[3];
+		cross3(e1, e2, normal);
+		float normal_length=sqrt(dot3(normal, normal));
+		if (normal_length > 0.0f) {
+			for (size_t k=0; k<3; k++) normal[k] /= normal_length;
+
+			float ao[3];
+			sub3(origin, a, ao);
+			float distance=dot3(normal, ao);
+			float speed=dot3(normal, direction);
+			float target=(distance >= 0.0f) ? radius : -radius;
+
+			// Starting within the slab around the plane, the first contact can only be an edge or corner
+			if ((fabs(distance) >= radius) && (fabs(speed) > LIBGENS_COLLISION_BVH_EPSILON)) {
+				float t=(target - distance) / speed;
+				if (t >= 0.0f) {
+					// Barycentrics of the contact relative to a, so the test doesn't depend on where the triangle is
+					float contact[3];
+					for (size_t k=0; k<3; k++) contact[k] = ao[k] + direction[k]*t - normal[k]*target;
+
+					float d00=dot3(e1, e1), d01=dot3(e1, e2), d11=dot3(e2, e2);
+					float d20=dot3(contact, e1), d21=dot3(contact, e2);
+					float denominator=d00*d11 - d01*d01;
+					float v=(d11*d20 - d01*d21) / denominator;
+					float w=(d00*d21 - d01*d20) / denominator;
+					if ((v >= -LIBGENS_COLLISION_BVH_BARYCENTRIC_EPSILON) && (w >= -LIBGENS_COLLISION_BVH_BARYCENTRIC_EPSILON) && (v + w <= 1.0f + LIBGENS_COLLISION_BVH_BARYCENTRIC_EPSILON)) return skip + t;
+				}
+			}
+		}
+
+		float b[3], c[3], bc[3];
+		for (size_t k=0; k<3; k++) {
+			b[k] = a[k] + e1[k];
+			c[k] = a[k] + e2[k];
+			bc[k] = e2[k] - e1[k];
+		}
+
+		float candidates[6]={
+			raySphere(origin, direction, a, radius),
+			raySphere(origin, direction, b, radius),
+			raySphere(origin, direction, c, radius),
+			rayEdge(origin, direction, a, e1, radius),
+			rayEdge(origin, direction, a, e2, radius),
+			rayEdge(origin, direction, b, bc, radius)
+		};
+
+		for (size_t i=0; i<6; i++) {
+			if ((candidates[i] >= 0.0f) && ((best < 0.0f) || (candidates[i] < best))) best = candidates[i];
+		}
+
+		return (best >= 0.0f) ? skip + best : -1.0f;
+	}
+
+	struct SonicCollisionBVH::BuildContext {
+		vector<float> face_min;
+		vector<float> face_max;
+		vector<float> centroids;
+		vector<unsigned int> indices;
+		SonicCollision *collision;
+
+		// Ranges left for the worker threads, with the placeholder node standing in for them
+		size_t subtree_size;
+		vector<pair<unsigned int, pair<size_t, size_t> > > subtrees;
+	};
+
+	unsigned int SonicCollisionBVH::buildNode(BuildContext &context, vector<Node> &out_nodes, vector<TriangleBlock> &out_blocks, size_t start, size_t end, bool defer) {
+		unsigned int node_index=out_nodes.size();
+		out_nodes.push_back(Node());
+
+		size_t count=end - start;
+		if (defer && (count <= context.subtree_size)) {
+			context.subtrees.push_back(make_pair(node_index, make_pair(start, end)));
+			return node_index;
+		}
+
+		float box_min[3], box_max[3], center_min[3], center_max[3];
+		resetBox(box_min, box_max);
+		resetBox(center_min, center_max);
+		for (size_t i=start; i<end; i++) {
+			unsigned int face=context.indices[i];
+			growBox(box_min, box_max, &context.face_min[face*3], &context.face_max[face*3]);
+			growBox(center_min, center_max, &context.centroids[face*3], &context.centroids[face*3]);
+		}
+
+		for (size_t k=0; k<3; k++) {
+			out_nodes[node_index].box_min[k] = box_min[k];
+			out_nodes[node_index].box_max[k] = box_max[k];
+		}
+
+		// Binned SAH over the centroids, costs counted in blocks of lanes since that's how leaves are tested
+		size_t best_axis=3, best_split=0;
+		float best_cost=LIBGENS_COLLISION_BVH_INFINITY;
+		float parent_area=std::max(boxArea(box_min, box_max), LIBGENS_COLLISION_BVH_EPSILON);
+
+		for (size_t axis=0; axis<3; axis++) {
+			float extent=center_max[axis] - center_min[axis];
+			if (extent <= 0.0f) continue;
+
+			float bin_min[LIBGENS_COLLISION_BVH_BINS][3], bin_max[LIBGENS_COLLISION_BVH_BINS][3];
+			size_t bin_count[LIBGENS_COLLISION_BVH_BINS]={ 0 };
+			for (size_t b=0; b<LIBGENS_COLLISION_BVH_BINS; b++) resetBox(bin_min[b], bin_max[b]);
+
+			float scale=LIBGENS_COLLISION_BVH_BINS / extent;
+			for (size_t i=start; i<end; i++) {
+				unsigned int face=context.indices[i];
+				size_t b=std::min((size_t) ((context.centroids[face*3 + axis] - center_min[axis]) * scale), (size_t) LIBGENS_COLLISION_BVH_BINS-1);
+				bin_count[b]++;
+				growBox(bin_min[b], bin_max[b], &context.face_min[face*3], &context.face_max[face*3]);
+			}
+
+			float right_area[LIBGENS_COLLISION_BVH_BINS];
+			size_t right_count[LIBGENS_COLLISION_BVH_BINS];
+			float sweep_min[3], sweep_max[3];
+			resetBox(sweep_min, sweep_max);
+			size_t sweep_count=0;
+			for (size_t b=LIBGENS_COLLISION_BVH_BINS-1; b>0; b--) {
+				growBox(sweep_min, sweep_max, bin_min[b], bin_max[b]);
+				sweep_count += bin_count[b];
+				right_area[b] = sweep_count ? boxArea(sweep_min, sweep_max) : 0.0f;
+				right_count[b] = sweep_count;
+			}
+
+			resetBox(sweep_min, sweep_max);
+			sweep_count = 0;
+			for (size_t b=0; b<LIBGENS_COLLISION_BVH_BINS-1; b++) {
+				growBox(sweep_min, sweep_max, bin_min[b], bin_max[b]);
+				sweep_count += bin_count[b];
+				if (!sweep_count || !right_count[b+1]) continue;
+
+				size_t left_blocks=(sweep_count + LIBGENS_S06_COLLISION_BVH_LANES-1) / LIBGENS_S06_COLLISION_BVH_LANES;
+				size_t right_blocks=(right_count[b+1] + LIBGENS_S06_COLLISION_BVH_LANES-1) / LIBGENS_S06_COLLISION_BVH_LANES;
+				float cost=1.0f + (boxArea(sweep_min, sweep_max)*left_blocks + right_area[b+1]*right_blocks) / parent_area;
+				if (cost < best_cost) {
+					best_cost = cost;
+					best_axis = axis;
+					best_split = b;
+				}
+			}
+		}
+
+		size_t leaf_cost=(count + LIBGENS_S06_COLLISION_BVH_LANES-1) / LIBGENS_S06_COLLISION_BVH_LANES;
+		bool leaf=(count <= LIBGENS_S06_COLLISION_BVH_LANES) || ((count <= LIBGENS_S06_COLLISION_BVH_MAX_LEAF) && (leaf_cost <= best_cost));
+
+		if (leaf) {
+			Node &node=out_nodes[node_index];
+			node.left = node.right = 0;
+			node.block_start = out_blocks.size();
+			node.block_count = leaf_cost;
+
+			for (size_t i=start; i<end; i+=LIBGENS_S06_COLLISION_BVH_LANES) {
+				TriangleBlock block;
+				memset(&block, 0, sizeof(TriangleBlock));
+				for (size_t l=0; l<LIBGENS_S06_COLLISION_BVH_LANES; l++) block.face[l] = LIBGENS_COLLISION_BVH_NO_FACE;
+
+				for (size_t l=0; (l<LIBGENS_S06_COLLISION_BVH_LANES) && (i+l<end); l++) {
+					unsigned int face=context.indices[i+l];
+					SonicCollisionFace &collision_face=context.collision->face_pool[face];
+					Vector3 &a=context.collision->vertex_pool[collision_face.v1];
+					Vector3 &b=context.collision->vertex_pool[collision_face.v2];
+					Vector3 &c=context.collision->vertex_pool[collision_face.v3];
+
+					block.v0[0][l] = a.x;
+					block.v0[1][l] = a.y;
+					block.v0[2][l] = a.z;
+					block.e1[0][l] = b.x - a.x;
+					block.e1[1][l] = b.y - a.y;
+					block.e1[2][l] = b.z - a.z;
+					block.e2[0][l] = c.x - a.x;
+					block.e2[1][l] = c.y - a.y;
+					block.e2[2][l] = c.z - a.z;
+					block.face[l] = face;
+					block.collision_flag[l] = collision_face.collision_flag;
+				}
+
+				out_blocks.push_back(block);
+			}
+
+			return node_index;
+		}
+
+		size_t middle=start;
+		if (best_axis < 3) {
+			float scale=LIBGENS_COLLISION_BVH_BINS / (center_max[best_axis] - center_min[best_axis]);
+			float axis_min=center_min[best_axis];
+			vector<float> &centroids=context.centroids;
+			middle = std::partition(context.indices.begin() + start, context.indices.begin() + end, [&](unsigned int face) {
+				return std::min((size_t) ((centroids[face*3 + best_axis] - axis_min) * scale), (size_t) LIBGENS_COLLISION_BVH_BINS-1) <= best_split;
+			}) - context.indices.begin();
+		}
+
+		// Coincident centroids or a failed partition fall back to an even split
+		if ((middle == start) || (middle == end)) {
+			middle = start + count/2;
+		}
+
+		unsigned int left=buildNode(context, out_nodes, out_blocks, start, middle, defer);
+		unsigned int right=buildNode(context, out_nodes, out_blocks, middle, end, defer);
+
+		Node &node=out_nodes[node_index];
+		node.left = left;
+		node.right = right;
+		node.block_start = node.block_count = 0;
+		return node_index;
+	}
+
+	void SonicCollisionBVH::build(SonicCollision *collision, unsigned int thread_count) {
+		nodes.clear();
+		blocks.clear();
+		if (!collision) return;
+
+		BuildContext context;
+		context.collision = collision;
+
+		size_t vertex_count=collision->vertex_pool.size();
+		size_t face_count=collision->face_pool.size();
+		context.face_min.resize(face_count*3);
+		context.face_max.resize(face_count*3);
+		context.centroids.resize(face_count*3);
+		context.indices.reserve(face_count);
+
+		for (size_t f=0; f<face_count; f++) {
+			SonicCollisionFace &face=collision->face_pool[f];
+			if ((face.v1 >= vertex_count) || (face.v2 >= vertex_count) || (face.v3 >= vertex_count)) continue;
+
+			Vector3 *points[3]={ &collision->vertex_pool[face.v1], &collision->vertex_pool[face.v2], &collision->vertex_pool[face.v3] };
+			float *face_min=&context.face_min[f*3];
+			float *face_max=&context.face_max[f*3];
+			resetBox(face_min, face_max);
+			for (size_t p=0; p<3; p++) {
+				float point[3]={ points[p]->x, points[p]->y, points[p]->z };
+				growBox(face_min, face_max, point, point);
+			}
+
+			for (size_t k=0; k<3; k++) context.centroids[f*3 + k] = (face_min[k] + face_max[k]) * 0.5f;
+			context.indices.push_back(f);
+		}
+
+		if (context.indices.empty()) return;
+
+		// The top of the tree is split here, the subtrees below it are built in parallel and stitched in
+		thread_count = resolveThreadCount(thread_count, context.indices.size() / LIBGENS_COLLISION_BVH_SUBTREE_SIZE);
+		bool defer=(thread_count > 1);
+		context.subtree_size = std::max(context.indices.size() / (thread_count*4), (size_t) LIBGENS_COLLISION_BVH_SUBTREE_SIZE);
+		buildNode(context, nodes, blocks, 0, context.indices.size(), defer);
+
+		size_t subtree_count=context.subtrees.size();
+		if (!subtree_count) return;
+
+		vector<vector<Node> > subtree_nodes(subtree_count);
+		vector<vector<TriangleBlock> > subtree_blocks(subtree_count);
+		std::atomic<size_t> next_subtree(0);
+		vector<std::thread> threads;
+		for (unsigned int t=0; t<std::min((size_t) thread_count, subtree_count); t++) {
+			threads.push_back(std::thread([&]() {
+				for (size_t i=next_subtree++; i<subtree_count; i=next_subtree++) {
+					buildNode(context, subtree_nodes[i], subtree_blocks[i], context.subtrees[i].second.first, context.subtrees[i].second.second, false);
+				}
+			}));
+		}
+
+		for (size_t t=0; t<threads.size(); t++) {
+			threads[t].join();
+		}
+
+		// Each subtree root replaces its placeholder, the rest of its nodes and blocks are appended
+		for (size_t i=0; i<subtree_count; i++) {
+			unsigned int placeholder=context.subtrees[i].first;
+			unsigned int node_base=nodes.size() - 1;
+			unsigned int block_base=blocks.size();
+			vector<Node> &local=subtree_nodes[i];
+
+			for (size_t n=0; n<local.size(); n++) {
+				Node node=local[n];
+				if (node.block_count) {
+					node.block_start += block_base;
+				}
+				else {
+					node.left += node_base;
+					node.right += node_base;
+				}
+
+				if (n) nodes.push_back(node);
+				else nodes[placeholder] = node;
+			}
+
+			blocks.insert(blocks.end(), subtree_blocks[i].begin(), subtree_blocks[i].end());
+		}
+
+		// Refit the top, whose placeholders had no bounds when their parents were built
+		for (size_t n=nodes.size(); n>0; n--) {
+			Node &node=nodes[n-1];
+			if (node.block_count) continue;
+
+			resetBox(node.box_min, node.box_max);
+			growBox(node.box_min, node.box_max, nodes[node.left].box_min, nodes[node.left].box_max);
+			growBox(node.box_min, node.box_max, nodes[node.right].box_min, nodes[node.right].box_max);
+		}
+	}
+
+	void SonicCollisionBVH::setHit(const TriangleBlock &block, size_t lane, SonicCollisionHit &hit) {
+		hit.hit = true;
+		hit.face = block.face[lane];
+		hit.collision_flag = block.collision_flag[lane];
+	}
+
+	// Moller-Trumbore on all lanes of a block at once, misses come out negative
+	void SonicCollisionBVH::intersectBlock(const TriangleBlock &block, const float *origin, const float *direction, float *t) {
+#ifdef LIBGENS_COLLISION_BVH_SSE
+		__m128 d_x=_mm_set1_ps(direction[0]);
+		__m128 d_y=_mm_set1_ps(direction[1]);
+		__m128 d_z=_mm_set1_ps(direction[2]);
+		__m128 e1_x=_mm_load_ps(block.e1[0]);
+		__m128 e1_y=_mm_load_ps(block.e1[1]);
+		__m128 e1_z=_mm_load_ps(block.e1[2]);
+		__m128 e2_x=_mm_load_ps(block.e2[0]);
+		__m128 e2_y=_mm_load_ps(block.e2[1]);
+		__m128 e2_z=_mm_load_ps(block.e2[2]);
+		__m128 zero=_mm_setzero_ps();
+		__m128 one=_mm_set1_ps(1.0f);
+
+		__m128 p_x=_mm_sub_ps(_mm_mul_ps(d_y, e2_z), _mm_mul_ps(d_z, e2_y));
+		__m128 p_y=_mm_sub_ps(_mm_mul_ps(d_z, e2_x), _mm_mul_ps(d_x, e2_z));
+		__m128 p_z=_mm_sub_ps(_mm_mul_ps(d_x, e2_y), _mm_mul_ps(d_y, e2_x));
+		__m128 determinant=_mm_add_ps(_mm_add_ps(_mm_mul_ps(e1_x, p_x), _mm_mul_ps(e1_y, p_y)), _mm_mul_ps(e1_z, p_z));
+		__m128 valid=_mm_cmpgt_ps(_mm_andnot_ps(_mm_set1_ps(-0.0f), determinant), _mm_set1_ps(LIBGENS_COLLISION_BVH_EPSILON));
+		__m128 inverse_determinant=_mm_div_ps(one, determinant);
+
+		__m128 s_x=_mm_sub_ps(_mm_set1_ps(origin[0]), _mm_load_ps(block.v0[0]));
+		__m128 s_y=_mm_sub_ps(_mm_set1_ps(origin[1]), _mm_load_ps(block.v0[1]));
+		__m128 s_z=_mm_sub_ps(_mm_set1_ps(origin[2]), _mm_load_ps(block.v0[2]));
+		__m128 u=_mm_mul_ps(_mm_add_ps(_mm_add_ps(_mm_mul_ps(s_x, p_x), _mm_mul_ps(s_y, p_y)), _mm_mul_ps(s_z, p_z)), inverse_determinant);
+
+		__m128 q_x=_mm_sub_ps(_mm_mul_ps(s_y, e1_z), _mm_mul_ps(s_z, e1_y));
+		__m128 q_y=_mm_sub_ps(_mm_mul_ps(s_z, e1_x), _mm_mul_ps(s_x, e1_z));
+		__m128 q_z=_mm_sub_ps(_mm_mul_ps(s_x, e1_y), _mm_mul_ps(s_y, e1_x));
+		__m128 v=_mm_mul_ps(_mm_add_ps(_mm_add_ps(_mm_mul_ps(d_x, q_x), _mm_mul_ps(d_y, q_y)), _mm_mul_ps(d_z, q_z)), inverse_determinant);
+		__m128 distance=_mm_mul_ps(_mm_add_ps(_mm_add_ps(_mm_mul_ps(e2_x, q_x), _mm_mul_ps(e2_y, q_y)), _mm_mul_ps(e2_z, q_z)), inverse_determinant);
+
+		// Degenerate and empty lanes are dropped by the determinant mask, whatever the division gave them
+		__m128 inside=_mm_and_ps(valid, _mm_cmpge_ps(u, zero));
+		inside = _mm_and_ps(inside, _mm_cmpge_ps(v, zero));
+		inside = _mm_and_ps(inside, _mm_cmple_ps(_mm_add_ps(u, v), one));
+		inside = _mm_and_ps(inside, _mm_cmpge_ps(distance, zero));
+		_mm_storeu_ps(t, _mm_or_ps(_mm_and_ps(inside, distance), _mm_andnot_ps(inside, _mm_set1_ps(-1.0f))));
+#else
+		for (size_t l=0; l<LIBGENS_S06_COLLISION_BVH_LANES; l++) {
+			float p_x=direction[1]*block.e2[2][l] - direction[2]*block.e2[1][l];
+			float p_y=direction[2]*block.e2[0][l] - direction[0]*block.e2[2][l];
+			float p_z=direction[0]*block.e2[1][l] - direction[1]*block.e2[0][l];
+			float determinant=block.e1[0][l]*p_x + block.e1[1][l]*p_y + block.e1[2][l]*p_z;
+			float inverse_determinant=(fabs(determinant) > LIBGENS_COLLISION_BVH_EPSILON) ? 1.0f / determinant : 0.0f;
+
+			float s_x=origin[0] - block.v0[0][l];
+			float s_y=origin[1] - block.v0[1][l];
+			float s_z=origin[2] - block.v0[2][l];
+			float u=(s_x*p_x + s_y*p_y + s_z*p_z) * inverse_determinant;
+
+			float q_x=s_y*block.e1[2][l] - s_z*block.e1[1][l];
+			float q_y=s_z*block.e1[0][l] - s_x*block.e1[2][l];
+			float q_z=s_x*block.e1[1][l] - s_y*block.e1[0][l];
+			float v=(direction[0]*q_x + direction[1]*q_y + direction[2]*q_z) * inverse_determinant;
+			float distance=(block.e2[0][l]*q_x + block.e2[1][l]*q_y + block.e2[2][l]*q_z) * inverse_determinant;
+
+			bool inside=(inverse_determinant != 0.0f) && (u >= 0.0f) && (v >= 0.0f) && (u + v <= 1.0f) && (distance >= 0.0f);
+			t[l] = inside ? distance : -1.0f;
+		}
+#endif
+	}
+
+	static bool prepareRay(const SonicCollisionRay &ray, float *origin, float *direction, float *inverse, float &max_distance) {
+		origin[0] = ray.origin.x;
+		origin[1] = ray.origin.y;
+		origin[2] = ray.origin.z;
+		direction[0] = ray.direction.x;
+		direction[1] = ray.direction.y;
+		direction[2] = ray.direction.z;
+
+		float length=sqrt(dot3(direction, direction));
+		if (length <= 0.0f) return false;
+
+		for (size_t k=0; k<3; k++) {
+			direction[k] /= length;
+			inverse[k] = (fabs(direction[k]) > LIBGENS_COLLISION_BVH_EPSILON) ? 1.0f / direction[k] : ((direction[k] >= 0.0f) ? 1e30f : -1e30f);
+		}
+
+		max_distance = (ray.max_distance >= 0.0f) ? ray.max_distance : LIBGENS_COLLISION_BVH_INFINITY;
+		return true;
+	}
+
+	static void faceNormal(const float *e1, const float *e2, float *normal) {
+		cross3(e1, e2, normal);
+		float length=sqrt(dot3(normal, normal));
+		if (length > 0.0f) {
+			for (size_t k=0; k<3; k++) normal[k] /= length;
+		}
+	}
+
+	bool SonicCollisionBVH::castRay(const SonicCollisionRay &ray, SonicCollisionHit &hit, unsigned int ignore_flags) const {
+		hit = SonicCollisionHit();
+		if (nodes.empty()) return false;
+
+		float origin[3], direction[3], inverse[3], best;
+		if (!prepareRay(ray, origin, direction, inverse, best)) return false;
+
+		const TriangleBlock *best_block=NULL;
+		size_t best_lane=0;
+
+		vector<pair<float, unsigned int> > stack;
+		stack.reserve(64);
+		float root_entry=rayBox(nodes[0].box_min, nodes[0].box_max, origin, inverse, best);
+		if (root_entry >= 0.0f) stack.push_back(make_pair(root_entry, 0));
+
+		while (!stack.empty()) {
+			pair<float, unsigned int> entry=stack.back();
+			stack.pop_back();
+			if (entry.first > best) continue;
+
+			const Node &node=nodes[entry.second];
+			if (node.block_count) {
+				for (size_t b=node.block_start; b<node.block_start+node.block_count; b++) {
+					const TriangleBlock &block=blocks[b];
+
+					float t[LIBGENS_S06_COLLISION_BVH_LANES];
+					intersectBlock(block, origin, direction, t);
+
+					for (size_t l=0; l<LIBGENS_S06_COLLISION_BVH_LANES; l++) {
+						if ((t[l] >= 0.0f) && (t[l] <= best) && (block.face[l] != LIBGENS_COLLISION_BVH_NO_FACE) && !(block.collision_flag[l] & ignore_flags)) {
+							best = t[l];
+							best_block = &block;
+							best_lane = l;
+						}
+					}
+				}
+				continue;
+			}
+
+			// Visit the nearer child first
+			float left=rayBox(nodes[node.left].box_min, nodes[node.left].box_max, origin, inverse, best);
+			float right=rayBox(nodes[node.right].box_min, nodes[node.right].box_max, origin, inverse, best);
+			unsigned int left_index=node.left, right_index=node.right;
+			if ((left >= 0.0f) && (right >= 0.0f) && (left < right)) {
+				stack.push_back(make_pair(right, right_index));
+				stack.push_back(make_pair(left, left_index));
+			}
+			else {
+				if (left >= 0.0f) stack.push_back(make_pair(left, left_index));
+				if (right >= 0.0f) stack.push_back(make_pair(right, right_index));
+			}
+		}
+
+		if (!best_block) return false;
+
+		setHit(*best_block, best_lane, hit);
+		hit.distance = best;
+		hit.point = Vector3(origin[0] + direction[0]*best, origin[1] + direction[1]*best, origin[2] + direction[2]*best);
+
+		float e1[3], e2[3], normal[3];
+		for (size_t k=0; k<3; k++) {
+			e1[k] = best_block->e1[k][best_lane];
+			e2[k] = best_block->e2[k][best_lane];
+		}
+		faceNormal(e1, e2, normal);
+		if (dot3(normal, direction) > 0.0f) {
+			for (size_t k=0; k<3; k++) normal[k] = -normal[k];
+		}
+		hit.normal = Vector3(normal[0], normal[1], normal[2]);
+		return true;
+	}
+
+	bool SonicCollisionBVH::castSphere(const SonicCollisionRay &ray, SonicCollisionHit &hit, unsigned int ignore_flags) const {
+		if (ray.radius <= 0.0f) return castRay(ray, hit, ignore_flags);
+
+		hit = SonicCollisionHit();
+		if (nodes.empty()) return false;
+
+		float origin[3], direction[3], inverse[3], best;
+		if (!prepareRay(ray, origin, direction, inverse, best)) return false;
+
+		float radius=ray.radius;
+		const TriangleBlock *best_block=NULL;
+		size_t best_lane=0;
+
+		vector<unsigned int> stack;
+		stack.reserve(64);
+		stack.push_back(0);
+
+		while (!stack.empty()) {
+			const Node &node=nodes[stack.back()];
+			stack.pop_back();
+
+			// Boxes are grown by the radius so the swept sphere becomes a ray test
+			float box_min[3], box_max[3];
+			for (size_t k=0; k<3; k++) {
+				box_min[k] = node.box_min[k] - radius;
+				box_max[k] = node.box_max[k] + radius;
+			}
+			if (rayBox(box_min, box_max, origin, inverse, best) < 0.0f) continue;
+
+			if (!node.block_count) {
+				stack.push_back(node.right);
+				stack.push_back(node.left);
+				continue;
+			}
+
+			for (size_t b=node.block_start; b<node.block_start+node.block_count; b++) {
+				const TriangleBlock &block=blocks[b];
+
+				for (size_t l=0; l<LIBGENS_S06_COLLISION_BVH_LANES; l++) {
+					if ((block.face[l] == LIBGENS_COLLISION_BVH_NO_FACE) || (block.collision_flag[l] & ignore_flags)) continue;
+
+					float v0[3]={ block.v0[0][l], block.v0[1][l], block.v0[2][l] };
+					float e1[3]={ block.e1[0][l], block.e1[1][l], block.e1[2][l] };
+					float e2[3]={ block.e2[0][l], block.e2[1][l], block.e2[2][l] };
+					float t=sweepSphereTriangle(origin, direction, radius, v0, e1, e2);
+					if ((t >= 0.0f) && (t <= best)) {
+						best = t;
+						best_block = &block;
+						best_lane = l;
+					}
+				}
+			}
+		}
+
+		if (!best_block) return false;
+
+		setHit(*best_block, best_lane, hit);
+		hit.distance = best;
+
+		float center[3], v0[3], e1[3], e2[3], contact[3], normal[3];
+		for (size_t k=0; k<3; k++) {
+			center[k] = origin[k] + direction[k]*best;
+			v0[k] = best_block->v0[k][best_lane];
+			e1[k] = best_block->e1[k][best_lane];
+			e2[k] = best_block->e2[k][best_lane];
+		}
+		closestPointTriangle(center, v0, e1, e2, contact);
+		sub3(center, contact, normal);
+
+		float length=sqrt(dot3(normal, normal));
+		if (length > LIBGENS_COLLISION_BVH_EPSILON) {
+			for (size_t k=0; k<3; k++) normal[k] /= length;
+		}
+		else {
+			faceNormal(e1, e2, normal);
+			if (dot3(normal, direction) > 0.0f) {
+				for (size_t k=0; k<3; k++) normal[k] = -normal[k];
+			}
+		}
+
+		hit.point = Vector3(contact[0], contact[1], contact[2]);
+		hit.normal = Vector3(normal[0], normal[1], normal[2]);
+		return true;
+	}
+
+	bool SonicCollisionBVH::closestPoint(const Vector3 &point, float max_distance, SonicCollisionHit &hit, unsigned int ignore_flags) const {
+		hit = SonicCollisionHit();
+		if (nodes.empty()) return false;
+
+		float query[3]={ point.x, point.y, point.z };
+		float best=(max_distance >= 0.0f) ? max_distance*max_distance : LIBGENS_COLLISION_BVH_INFINITY;
+		float best_point[3]={ 0.0f, 0.0f, 0.0f };
+		const TriangleBlock *best_block=NULL;
+		size_t best_lane=0;
+
+		vector<pair<float, unsigned int> > stack;
+		stack.reserve(64);
+		stack.push_back(make_pair(boxDistanceSquared(nodes[0].box_min, nodes[0].box_max, query), 0));
+
+		while (!stack.empty()) {
+			pair<float, unsigned int> entry=stack.back();
+			stack.pop_back();
+			if (entry.first > best) continue;
+
+			const Node &node=nodes[entry.second];
+			if (!node.block_count) {
+				float left=boxDistanceSquared(nodes[node.left].box_min, nodes[node.left].box_max, query);
+				float right=boxDistanceSquared(nodes[node.right].box_min, nodes[node.right].box_max, query);
+				if (left < right) {
+					stack.push_back(make_pair(right, node.right));
+					stack.push_back(make_pair(left, node.left));
+				}
+				else {
+					stack.push_back(make_pair(left, node.left));
+					stack.push_back(make_pair(right, node.right));
+				}
+				continue;
+			}
+
+			for (size_t b=node.block_start; b<node.block_start+node.block_count; b++) {
+				const TriangleBlock &block=blocks[b];
+
+				for (size_t l=0; l<LIBGENS_S06_COLLISION_BVH_LANES; l++) {
+					if ((block.face[l] == LIBGENS_COLLISION_BVH_NO_FACE) || (block.collision_flag[l] & ignore_flags)) continue;
+
+					float v0[3]={ block.v0[0][l], block.v0[1][l], block.v0[2][l] };
+					float e1[3]={ block.e1[0][l], block.e1[1][l], block.e1[2][l] };
+					float e2[3]={ block.e2[0][l], block.e2[1][l], block.e2[2][l] };
+					float closest[3], offset[3];
+					closestPointTriangle(query, v0, e1, e2, closest);
+					sub3(query, closest, offset);
+
+					float distance=dot3(offset, offset);
+					if (distance <= best) {
+						best = distance;
+						best_block = &block;
+						best_lane = l;
+						for (size_t k=0; k<3; k++) best_point[k] = closest[k];
+					}
+				}
+			}
+		}
+
+		if (!best_block) return false;
+
+		setHit(*best_block, best_lane, hit);
+		hit.distance = sqrt(best);
+		hit.point = Vector3(best_point[0], best_point[1], best_point[2]);
+
+		float normal[3];
+		sub3(query, best_point, normal);
+		if (hit.distance > LIBGENS_COLLISION_BVH_EPSILON) {
+			for (size_t k=0; k<3; k++) normal[k] /= hit.distance;
+		}
+		else {
+			float e1[3], e2[3];
+			for (size_t k=0; k<3; k++) {
+				e1[k] = best_block->e1[k][best_lane];
+				e2[k] = best_block->e2[k][best_lane];
+			}
+			faceNormal(e1, e2, normal);
+		}
+		hit.normal = Vector3(normal[0], normal[1], normal[2]);
+		return true;
+	}
+
+	void SonicCollisionBVH::castRays(const vector<SonicCollisionRay> &rays, vector<SonicCollisionHit> &hits, unsigned int ignore_flags, unsigned int thread_count) const {
+		hits.resize(rays.size());
+
+		size_t batch_count=(rays.size() + LIBGENS_COLLISION_BVH_BATCH_SIZE-1) / LIBGENS_COLLISION_BVH_BATCH_SIZE;
+		thread_count = resolveThreadCount(thread_count, batch_count);
+
+		std::atomic<size_t> next_batch(0);
+		vector<std::thread> threads;
+		for (unsigned int t=0; t<thread_count; t++) {
+			threads.push_back(std::thread([&]() {
+				for (size_t batch=next_batch++; batch<batch_count; batch=next_batch++) {
+					size_t end=std::min((batch+1) * LIBGENS_COLLISION_BVH_BATCH_SIZE, rays.size());
+					for (size_t i=batch * LIBGENS_COLLISION_BVH_BATCH_SIZE; i<end; i++) {
+						castSphere(rays[i], hits[i], ignore_flags);
+					}
+				}
+			}));
+		}
+
+		for (size_t t=0; t<threads.size(); t++) {
+			threads[t].join();
+		}
+	}
+
+	void SonicCollisionBVH::closestPoints(const vector<Vector3> &points, float max_distance, vector<SonicCollisionHit> &hits, unsigned int ignore_flags, unsigned int thread_count) const {
+		hits.resize(points.size());
+
+		size_t batch_count=(points.size() + LIBGENS_COLLISION_BVH_BATCH_SIZE-1) / LIBGENS_COLLISION_BVH_BATCH_SIZE;
+		thread_count = resolveThreadCount(thread_count, batch_count);
+
+		std::atomic<size_t> next_batch(0);
+		vector<std::thread> threads;
+		for (unsigned int t=0; t<thread_count; t++) {
+			threads.push_back(std::thread([&]() {
+				for (size_t batch=next_batch++; batch<batch_count; batch=next_batch++) {
+					size_t end=std::min((batch+1) * LIBGENS_COLLISION_BVH_BATCH_SIZE, points.size());
+					for (size_t i=batch * LIBGENS_COLLISION_BVH_BATCH_SIZE; i<end; i++) {
+						closestPoint(points[i], max_distance, hits[i], ignore_flags);
+					}
+				}
+			}));
+		}
+
+		for (size_t t=0; t<threads.size(); t++) {
+			threads[t].join();
+		}
+	}
+
+	void SonicCollision::buildBVH(unsigned int thread_count) {
+		bvh.build(this, thread_count);
+	}
+};
@@ -18,9 +18,229 @@
 //=========================================================================
 
 #include "LibGens.h"
+#include <algorithm>
+#if __has_include(<charconv>)
+#include <charconv>
+#endif
 #include "S06Common.h"
 
+#define LIBGENS_UNICODE_BLOCK_SIZE   16
+#define LIBGENS_UNICODE_REPLACEMENT  0xFFFD
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && (_M_IX86_FP >= 2))
+#include <emmintrin.h>
+#define LIBGENS_UNICODE_SSE2
+#endif
+
 namespace LibGens {
+	size_t SonicNumberFormat::writeFloat(char *buffer, float value) {
+#ifdef __cpp_lib_to_chars
+		return std::to_chars(buffer, buffer + LIBGENS_NUMBER_BUFFER_SIZE, value).ptr - buffer;
+#else
+		// Standard libraries without floating point to_chars: widen the precision until the text round-trips
+		int length=0;
+		for (int precision=6; precision<=9; precision++) {
+			length = snprintf(buffer, LIBGENS_NUMBER_BUFFER_SIZE, "%.*g", precision, value);
+			if ((value != value) || (strtof(buffer, NULL) == value)) break;
+		}
+		return length;
+#endif
+	}
+
+	size_t SonicNumberFormat::writeInt(char *buffer, long long value) {
+		char digits[LIBGENS_NUMBER_BUFFER_SIZE];
+		size_t digit_count=0;
+
+		// Work on the unsigned magnitude so the most negative value doesn't overflow
+		unsigned long long magnitude=(value < 0) ? (0ULL - (unsigned long long) value) : (unsigned long long) value;
+		do {
+			digits[digit_count++] = '0' + (magnitude % 10);
+			magnitude /= 10;
+		} while (magnitude);
+
+		size_t length=0;
+		if (value < 0) buffer[length++] = '-';
+		while (digit_count) buffer[length++] = digits[--digit_count];
+		return length;
+	}
+
+	static void appendUTF8(string &output, unsigned int code) {
+		if (code < 0x80) {
+			output += (char) code;
+		}
+		else if (code < 0x800) {
+			output += (char) (0xC0 | (code >> 6));
+			output += (char) (0x80 | (code & 0x3F));
+		}
+		else if (code < 0x10000) {
+			output += (char) (0xE0 | (code >> 12));
+			output += (char) (0x80 | ((code >> 6) & 0x3F));
+			output += (char) (0x80 | (code & 0x3F));
+		}
+		else {
+			output += (char) (0xF0 | (code >> 18));
+			output += (char) (0x80 | ((code >> 12) & 0x3F));
+			output += (char) (0x80 | ((code >> 6) & 0x3F));
+			output += (char) (0x80 | (code & 0x3F));
+		}
+	}
+
+	static void appendUTF16BE(vector<unsigned char> &output, unsigned int code) {
+		if (code >= 0x10000) {
+			code -= 0x10000;
+			unsigned int high=0xD800 | (code >> 10);
+			unsigned int low=0xDC00 | (code & 0x3FF);
+			output.push_back(high >> 8);
+			output.push_back(high & 0xFF);
+			output.push_back(low >> 8);
+			output.push_back(low & 0xFF);
+		}
+		else {
+			output.push_back(code >> 8);
+			output.push_back(code & 0xFF);
+		}
+	}
+
+	// Narrows a block of big endian units to ASCII, or returns false if any of them is null or not ASCII
+	static bool decodeASCIIBlock(const unsigned char *block, char *ascii) {
+#if defined(LIBGENS_UNICODE_SSE2) && (LIBGENS_UNICODE_BLOCK_SIZE == 16)
+		// Swapped into native 16 bit lanes, ASCII units are exactly the ones in 1 to 0x7F as signed values
+		__m128i first=_mm_loadu_si128((const __m128i *) block);
+		__m128i second=_mm_loadu_si128((const __m128i *) (block + 16));
+		first = _mm_or_si128(_mm_slli_epi16(first, 8), _mm_srli_epi16(first, 8));
+		second = _mm_or_si128(_mm_slli_epi16(second, 8), _mm_srli_epi16(second, 8));
+
+		__m128i zero=_mm_setzero_si128();
+		__m128i limit=_mm_set1_epi16(0x80);
+		__m128i valid=_mm_and_si128(_mm_cmpgt_epi16(first, zero), _mm_cmplt_epi16(first, limit));
+		valid = _mm_and_si128(valid, _mm_and_si128(_mm_cmpgt_epi16(second, zero), _mm_cmplt_epi16(second, limit)));
+		if (_mm_movemask_epi8(valid) != 0xFFFF) return false;
+
+		_mm_storeu_si128((__m128i *) ascii, _mm_packus_epi16(first, second));
+		return true;
+#else
+		unsigned char high=0;
+		unsigned char low=0xFF;
+		for (size_t k=0; k<LIBGENS_UNICODE_BLOCK_SIZE; k++) {
+			high |= block[k*2] | (block[k*2+1] & 0x80);
+			low = std::min(low, block[k*2+1]);
+		}
+
+		if (high || !low) return false;
+		for (size_t k=0; k<LIBGENS_UNICODE_BLOCK_SIZE; k++) ascii[k] = block[k*2+1];
+		return true;
+#endif
+	}
+
+	// Widens a block of ASCII bytes to big endian units, or returns false if any of them isn't ASCII
+	static bool encodeASCIIBlock(const unsigned char *data, unsigned char *units) {
+#if defined(LIBGENS_UNICODE_SSE2) && (LIBGENS_UNICODE_BLOCK_SIZE == 16)
+		__m128i bytes=_mm_loadu_si128((const __m128i *) data);
+		if (_mm_movemask_epi8(bytes)) return false;
+
+		__m128i zero=_mm_setzero_si128();
+		_mm_storeu_si128((__m128i *) units, _mm_unpacklo_epi8(zero, bytes));
+		_mm_storeu_si128((__m128i *) (units + 16), _mm_unpackhi_epi8(zero, bytes));
+		return true;
+#else
+		unsigned char high=0;
+		for (size_t k=0; k<LIBGENS_UNICODE_BLOCK_SIZE; k++) high |= data[k];
+		if (high & 0x80) return false;
+
+		for (size_t k=0; k<LIBGENS_UNICODE_BLOCK_SIZE; k++) {
+			units[k*2] = 0;
+			units[k*2+1] = data[k];
+		}
+		return true;
+#endif
+	}
+
+	size_t SonicUnicode::decodeUTF16BE(const unsigned char *data, size_t count, string &output) {
+		output.reserve(output.size() + count);
+
+		size_t i=0;
+		while (i < count) {
+			// A block of units that are all ASCII and none null is copied straight through
+			if (i + LIBGENS_UNICODE_BLOCK_SIZE <= count) {
+				char ascii[LIBGENS_UNICODE_BLOCK_SIZE];
+				if (decodeASCIIBlock(data + i*2, ascii)) {
+					output.append(ascii, LIBGENS_UNICODE_BLOCK_SIZE);
+					i += LIBGENS_UNICODE_BLOCK_SIZE;
+					continue;
+				}
+			}
+
+			unsigned int unit=(data[i*2] << 8) | data[i*2+1];
+			if (!unit) return i;
+			i++;
+
+			if ((unit >= 0xD800) && (unit < 0xDC00)) {
+				unsigned int low=(i < count) ? ((data[i*2] << 8) | data[i*2+1]) : 0;
+				if ((low >= 0xDC00) && (low < 0xE000)) {
+					appendUTF8(output, 0x10000 + ((unit - 0xD800) << 10) + (low - 0xDC00));
+					i++;
+				}
+				else {
+					appendUTF8(output, LIBGENS_UNICODE_REPLACEMENT);
+				}
+			}
+			else if ((unit >= 0xDC00) && (unit < 0xE000)) {
+				appendUTF8(output, LIBGENS_UNICODE_REPLACEMENT);
+			}
+			else {
+				appendUTF8(output, unit);
+			}
+		}
+
+		return i;
+	}
+
+	void SonicUnicode::encodeUTF16BE(const string &value, vector<unsigned char> &output) {
+		const unsigned char *data=(const unsigned char *) value.data();
+		size_t count=value.size();
+		output.reserve(output.size() + count*2);
+
+		size_t i=0;
+		while (i < count) {
+			if (i + LIBGENS_UNICODE_BLOCK_SIZE <= count) {
+				unsigned char units[LIBGENS_UNICODE_BLOCK_SIZE*2];
+				if (encodeASCIIBlock(data + i, units)) {
+					output.insert(output.end(), units, units + LIBGENS_UNICODE_BLOCK_SIZE*2);
+					i += LIBGENS_UNICODE_BLOCK_SIZE;
+					continue;
+				}
+			}
+
+			unsigned char c=data[i];
+			size_t length=1;
+			unsigned int code=c;
+			unsigned int minimum=0;
+
+			if (c >= 0xF0 && c < 0xF5) { length = 4; code = c & 0x07; minimum = 0x10000; }
+			else if (c >= 0xE0 && c < 0xF0) { length = 3; code = c & 0x0F; minimum = 0x800; }
+			else if (c >= 0xC2 && c < 0xE0) { length = 2; code = c & 0x1F; minimum = 0x80; }
+			else if (c >= 0x80) { length = 0; }
+
+			// Continuation bytes are checked before use, anything malformed consumes one byte
+			bool valid=(length != 0) && (i + length <= count);
+			for (size_t k=1; valid && (k<length); k++) {
+				if ((data[i+k] & 0xC0) != 0x80) valid = false;
+				else code = (code << 6) | (data[i+k] & 0x3F);
+			}
+
+			if (valid && ((code < minimum) || (code > 0x10FFFF) || ((code >= 0xD800) && (code < 0xE000)))) valid = false;
+
+			if (valid) {
+				appendUTF16BE(output, code);
+				i += length;
+			}
+			else {
+				appendUTF16BE(output, LIBGENS_UNICODE_REPLACEMENT);
+				i++;
+			}
+		}
+	}
+
 	void SonicStringTable::writeString(File *file, string str) {
 		file->writeNull(4);
 
@@ -34,13 +254,14 @@ namespace LibGens {
 			return;
 		}
 
-		for (size_t i=0; i<strings.size(); i++) {
-			if (strings[i].value == str) {
-				strings[i].addresses.push_back(file->getCurrentAddress()-4);
-				return;
-			}
+		unordered_map<string, size_t>::iterator it=string_indices.find(str);
+		if (it != string_indices.end()) {
+			strings[null_string_count + it->second].addresses.push_back(file->getCurrentAddress()-4);
+			return;
 		}
 
+		string_indices[str] = strings.size() - null_string_count;
+
 		SonicString new_string;
 		new_string.addresses.clear();
 		new_string.addresses.push_back(file->getCurrentAddress()-4);
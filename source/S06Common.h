@@ -19,7 +19,29 @@
 
 #pragma once
 
+#include <unordered_map>
+
+#define LIBGENS_NUMBER_BUFFER_SIZE 32
+
 namespace LibGens {
+	// Locale independent number formatting into a caller buffer of at least LIBGENS_NUMBER_BUFFER_SIZE
+	// bytes, for text exporters writing large number arrays. Floats are written with the fewest digits
+	// that still read back to the same value. Both return the length, the buffer isn't null terminated.
+	class SonicNumberFormat {
+		public:
+			static size_t writeFloat(char *buffer, float value);
+			static size_t writeInt(char *buffer, long long value);
+	};
+
+	// Conversion between UTF-8 strings and the big endian UTF-16 text stored in game files. Runs of ASCII
+	// are handled in blocks of 16 units with SSE2 where available, invalid sequences become U+FFFD.
+	class SonicUnicode {
+		public:
+			// Decodes up to count units, stopping at a null unit, and returns how many units were read
+			static size_t decodeUTF16BE(const unsigned char *data, size_t count, string &output);
+			static void encodeUTF16BE(const string &value, vector<unsigned char> &output);
+	};
+
 	class SonicString {
 		public:
 			vector<size_t> addresses;
@@ -30,6 +52,9 @@ namespace LibGens {
 		protected:
 			vector<SonicString> strings;
 			size_t null_string_count;
+
+			// Position of each non-empty string after the empty ones, which are kept in front
+			unordered_map<string, size_t> string_indices;
 		public:
 			SonicStringTable() {
 				null_string_count = 0;
@@ -40,6 +65,7 @@ namespace LibGens {
 
 			void clear() {
 				strings.clear();
+				string_indices.clear();
 				null_string_count = 0;
 			}
 	};
@@ -18,13 +18,224 @@
 //=========================================================================
 
 #include "LibGens.h"
+#include <atomic>
+#include <thread>
+#include "S06Common.h"
 #include "S06XnFile.h"
 
 namespace LibGens {
+	SonicDAEWriter::SonicDAEWriter(size_t depth_p) {
+		file = NULL;
+		depth = depth_p;
+	}
+
+	SonicDAEWriter::~SonicDAEWriter() {
+		close();
+	}
+
+	bool SonicDAEWriter::open(string filename) {
+		close();
+
+		// Text mode like TiXmlDocument::SaveFile, so line endings come out the same
+		file = fopen(filename.c_str(), "w");
+		buffer.reserve(LIBGENS_DAE_WRITER_BUFFER_SIZE * 2);
+		return (file != NULL);
+	}
+
+	void SonicDAEWriter::close() {
+		flush();
+		if (file) {
+			fclose(file);
+			file = NULL;
+		}
+	}
+
+	void SonicDAEWriter::flush() {
+		// Fragments keep everything in memory until they're appended
+		if (!file) return;
+
+		if (buffer.size()) fwrite(buffer.c_str(), 1, buffer.size(), file);
+		buffer.clear();
+	}
+
+	void SonicDAEWriter::declaration(string version) {
+		buffer += "<?xml version=\"" + version + "\" ?>\n";
+	}
+
+	void SonicDAEWriter::append(SonicDAEWriter &fragment) {
+		if (tags.size()) closeTag(LIBGENS_DAE_WRITER_ELEMENTS);
+
+		if (file) {
+			flush();
+			fwrite(fragment.buffer.c_str(), 1, fragment.buffer.size(), file);
+		}
+		else buffer += fragment.buffer;
+
+		fragment.buffer.clear();
+	}
+
+	void SonicDAEWriter::closeTag(unsigned char state) {
+		unsigned char &current=states.back();
+		if (current == LIBGENS_DAE_WRITER_TAG_OPEN) buffer += ">";
+		current = state;
+	}
+
+	void SonicDAEWriter::beginElement(const char *tag) {
+		if (tags.size() || depth) {
+			if (tags.size()) closeTag(LIBGENS_DAE_WRITER_ELEMENTS);
+			buffer += "\n";
+			buffer.append((depth + tags.size())*2, ' ');
+		}
+
+		buffer += "<";
+		buffer += tag;
+		tags.push_back(tag);
+		states.push_back(LIBGENS_DAE_WRITER_TAG_OPEN);
+	}
+
+	void SonicDAEWriter::attribute(const char *name, const string &value) {
+		encoded.clear();
+		TiXmlBase::Encodestring(value, &encoded);
+
+		char quote=(value.find('\"') == string::npos) ? '\"' : '\'';
+		buffer += " ";
+		buffer += name;
+		buffer += "=";
+		buffer += quote;
+		buffer += encoded;
+		buffer += quote;
+	}
+
+	void SonicDAEWriter::attribute(const char *name, long long value) {
+		char number[LIBGENS_NUMBER_BUFFER_SIZE];
+		size_t length=SonicNumberFormat::writeInt(number, value);
+
+		buffer += " ";
+		buffer += name;
+		buffer += "=\"";
+		buffer.append(number, length);
+		buffer += "\"";
+	}
+
+	void SonicDAEWriter::endElement() {
+		unsigned char state=states.back();
+		if (state == LIBGENS_DAE_WRITER_TAG_OPEN) {
+			buffer += " />";
+		}
+		else {
+			if (state == LIBGENS_DAE_WRITER_ELEMENTS) {
+				buffer += "\n";
+				buffer.append((depth + tags.size()-1)*2, ' ');
+			}
+
+			buffer += "</";
+			buffer += tags.back();
+			buffer += ">";
+		}
+
+		tags.pop_back();
+		states.pop_back();
+
+		// Top level nodes end their line, like TiXmlDocument::Print
+		if (!tags.size() && !depth) buffer += "\n";
+		if (buffer.size() >= LIBGENS_DAE_WRITER_BUFFER_SIZE) flush();
+	}
+
+	void SonicDAEWriter::element(const char *tag, const string &value) {
+		beginElement(tag);
+		beginText();
+		text(value);
+		endElement();
+	}
+
+	void SonicDAEWriter::elementFloat(const char *tag, float value) {
+		char number[LIBGENS_NUMBER_BUFFER_SIZE];
+		size_t length=SonicNumberFormat::writeFloat(number, value);
+
+		beginElement(tag);
+		beginText();
+		buffer.append(number, length);
+		endElement();
+	}
+
+	void SonicDAEWriter::beginText() {
+		closeTag(LIBGENS_DAE_WRITER_TEXT);
+	}
+
+	void SonicDAEWriter::text(const string &value) {
+		encoded.clear();
+		TiXmlBase::Encodestring(value, &encoded);
+		buffer += encoded;
+		if (buffer.size() >= LIBGENS_DAE_WRITER_BUFFER_SIZE) flush();
+	}
+
+	void SonicDAEWriter::textFloat(float value) {
+		char number[LIBGENS_NUMBER_BUFFER_SIZE + 1];
+		size_t length=SonicNumberFormat::writeFloat(number, value);
+		number[length++] = ' ';
+		buffer.append(number, length);
+		if (buffer.size() >= LIBGENS_DAE_WRITER_BUFFER_SIZE) flush();
+	}
+
+	void SonicDAEWriter::textInt(long long value) {
+		char number[LIBGENS_NUMBER_BUFFER_SIZE + 1];
+		size_t length=SonicNumberFormat::writeInt(number, value);
+		number[length++] = ' ';
+		buffer.append(number, length);
+		if (buffer.size() >= LIBGENS_DAE_WRITER_BUFFER_SIZE) flush();
+	}
+
+
+	// Generated bone and material names are the object name followed by an index
+	static void appendDAEIndex(string &value, long long index) {
+		char number[LIBGENS_NUMBER_BUFFER_SIZE];
+		size_t length=SonicNumberFormat::writeInt(number, index);
+		value.append(number, length);
+	}
+
+
+	vector<string> SonicXNFile::exportTextures(string filename) {
+		vector<string> textures;
+		SonicXNTexture *texture=getTexture();
+		if (!texture) return textures;
+
+		textures = texture->getTextures();
+
+		string target_folder = filename;
+		size_t sz=target_folder.size();
+		int last_slash=0;
+		for (size_t i=0; i<sz; i++) {
+			if ((target_folder[i] == '\\') || (target_folder[i] == '/')) last_slash=i;
+		}
+		if (last_slash) target_folder.erase(last_slash+1, target_folder.size()-last_slash-1);
+		else target_folder="";
+
+
+		CreateDirectory((target_folder+"textures").c_str(), NULL);
+		for (size_t j=0; j<textures.size(); j++) {
+			string &tex_name=textures[j];
+			
+			size_t pos=tex_name.find(".gvr");
+			if (pos == string::npos) pos=tex_name.find(".GVR");
+			if (pos != string::npos) {
+				std::transform(tex_name.begin(), tex_name.end(), tex_name.begin(), ::tolower);
+				tex_name.replace(pos, 4, ".png");
+			}
+
+			File texture(folder+tex_name, "rb");
+			if (texture.valid()) {
+				texture.clone(target_folder + "./textures/" + tex_name);
+				texture.close();
+			}
+		}
+
+		return textures;
+	}
+
 	void SonicXNFile::saveDAE(string filename, bool only_animation, float unit_scale) {
-		TiXmlDocument doc;
-		TiXmlDeclaration *decl = new TiXmlDeclaration( "1.0", "", "" );
-		doc.LinkEndChild( decl );
+		SonicDAEWriter writer;
+		writer.open(filename);
+		writer.declaration("1.0");
 
 
 		printf("Save DAE called...\n");
@@ -42,81 +253,72 @@ namespace LibGens {
 		if (motion) printf("Found Motion...\n");
 
 		printf("Model Names Set...\n");
-		TiXmlElement *colladaRoot = new TiXmlElement("COLLADA");
-		colladaRoot->SetAttribute("xmlns", "http://www.collada.org/2005/11/COLLADASchema");
-		colladaRoot->SetAttribute("version", "1.4.1");
+		writer.beginElement("COLLADA");
+		writer.attribute("xmlns", "http://www.collada.org/2005/11/COLLADASchema");
+		writer.attribute("version", "1.4.1");
 
 		printf("Creating Collada Root...\n");
 
-		TiXmlElement *assetRoot = new TiXmlElement("asset");
+		writer.beginElement("asset");
 		{
-			TiXmlElement *newElem = new TiXmlElement("contributor");
-			TiXmlElement *authoring = new TiXmlElement("authoring_tool");
-			TiXmlText *text = new TiXmlText("LibS06 - COLLADA Exporter");
-			authoring->LinkEndChild(text);
-			newElem->LinkEndChild(authoring);
-			assetRoot->LinkEndChild(newElem);
-
-			newElem = new TiXmlElement("unit");
-			newElem->SetAttribute("name", "meters");
-			newElem->SetAttribute("meter", "1.0");
-			assetRoot->LinkEndChild(newElem);
-
-			newElem = new TiXmlElement("up_axis");
-			text = new TiXmlText("Y_UP");
-			newElem->LinkEndChild(text);
-			assetRoot->LinkEndChild(newElem);
+			writer.beginElement("contributor");
+			writer.element("authoring_tool", "LibS06 - COLLADA Exporter");
+			writer.endElement();
+
+			writer.beginElement("unit");
+			writer.attribute("name", "meters");
+			writer.attribute("meter", "1.0");
+			writer.endElement();
+
+			writer.element("up_axis", "Y_UP");
+		}
+		writer.endElement();
+
+		// Geometry and controllers don't depend on anything else in the document, so they're generated
+		// into fragments on their own threads while the textures, materials and animations are written
+		SonicDAEWriter geometries(writer.getDepth());
+		SonicDAEWriter controllers(writer.getDepth());
+		SonicDAEWriter animations(writer.getDepth());
+		vector<std::thread> threads;
+
+		if (object && !only_animation) {
+			threads.push_back(std::thread([&]() {
+				printf("Creating Geometry Library...\n");
+				// Geometry Library
+				geometries.beginElement("library_geometries");
+				object->writeMeshesDAE(geometries, unit_scale);
+				geometries.endElement();
+			}));
+
+			threads.push_back(std::thread([&]() {
+				printf("Creating Controller Library...\n");
+				// Controller Library
+				controllers.beginElement("library_controllers");
+				object->writeControllerDAE(controllers, unit_scale);
+				controllers.endElement();
+			}));
 		}
-		colladaRoot->LinkEndChild(assetRoot);
 
 		printf("Creating Texture Library...\n");
 
 		// Texture library
 		if (texture && !only_animation) {
-			TiXmlElement *imagesRoot = new TiXmlElement("library_images");
-			vector<string> textures = texture->getTextures();
-
-
-			string target_folder = filename;
-			size_t sz=target_folder.size();
-			int last_slash=0;
-			for (size_t i=0; i<sz; i++) {
-				if ((target_folder[i] == '\\') || (target_folder[i] == '/')) last_slash=i;
-			}
-			if (last_slash) target_folder.erase(last_slash+1, target_folder.size()-last_slash-1);
-			else target_folder="";
-	
+			writer.beginElement("library_images");
+			vector<string> textures=exportTextures(filename);
 
-			CreateDirectory((target_folder+"textures").c_str(), NULL);
 			for (size_t j=0; j<textures.size(); j++) {
 				string tex_name=textures[j];
-				
-				size_t pos=tex_name.find(".gvr");
-				if (pos == string::npos) pos=tex_name.find(".GVR");
-				if (pos != string::npos) {
-					std::transform(tex_name.begin(), tex_name.end(), tex_name.begin(), ::tolower);
-					tex_name.replace(pos, 4, ".png");
-				}
 
-				TiXmlElement *imageNode = new TiXmlElement("image");
-				imageNode->SetAttribute("id", tex_name+"-image");
-				imageNode->SetAttribute("name", tex_name+"-image");
+				writer.beginElement("image");
+				writer.attribute("id", tex_name+"-image");
+				writer.attribute("name", tex_name+"-image");
 
 				string nm="./textures/"+tex_name;
-				TiXmlElement *newElem = new TiXmlElement("init_from");
-				TiXmlText *text = new TiXmlText(nm);
-				newElem->LinkEndChild(text);
-				imageNode->LinkEndChild(newElem);
-
-				File texture(folder+tex_name, "rb");
-				if (texture.valid()) {
-					texture.clone(target_folder + nm);
-					texture.close();
-				}
+				writer.element("init_from", nm);
 
-				imagesRoot->LinkEndChild(imageNode);
+				writer.endElement();
 			}
-			colladaRoot->LinkEndChild(imagesRoot);
+			writer.endElement();
 		}
 
 		
@@ -126,187 +328,222 @@ namespace LibGens {
 				// Material Library
 				if (texture) {
 					printf("Creating Material Library...\n");
-					TiXmlElement *materialsRoot = new TiXmlElement("library_materials");
-					object->writeMaterialDAE(materialsRoot);
-					colladaRoot->LinkEndChild(materialsRoot);
+					writer.beginElement("library_materials");
+					object->writeMaterialDAE(writer);
+					writer.endElement();
 				
 				
 					printf("Creating Effects Library...\n");
 					// Effects library
-					TiXmlElement *effectsRoot = new TiXmlElement("library_effects");
-					object->writeEffectsDAE(effectsRoot, texture);
-					colladaRoot->LinkEndChild(effectsRoot);
+					writer.beginElement("library_effects");
+					object->writeEffectsDAE(writer, texture);
+					writer.endElement();
 				}
-		
-				printf("Creating Geometry Library...\n");
-				// Geometry Library
-				TiXmlElement *geometryRoot = new TiXmlElement("library_geometries");
-				object->writeMeshesDAE(geometryRoot, unit_scale);
-				colladaRoot->LinkEndChild(geometryRoot);
-
-				printf("Creating Controller Library...\n");
-				// Controller Library
-				TiXmlElement *controllersRoot = new TiXmlElement("library_controllers");
-				object->writeControllerDAE(controllersRoot, unit_scale);
-				colladaRoot->LinkEndChild(controllersRoot);
 			}
 			
 			if (motion) {
 				printf("Creating Animation Library...\n");
 				// Animation Library
-				TiXmlElement *animationRoot = new TiXmlElement("library_animations");
-				motion->writeDAE(animationRoot, object, bones, unit_scale);
-				colladaRoot->LinkEndChild(animationRoot);
+				animations.beginElement("library_animations");
+				motion->writeDAE(animations, object, bones, unit_scale);
+				animations.endElement();
 			}
 
+			for (size_t t=0; t<threads.size(); t++) {
+				threads[t].join();
+			}
+
+			writer.append(geometries);
+			writer.append(controllers);
+			writer.append(animations);
+
 			printf("Creating Visual Scene...\n");
 			// Visual Scene
-			TiXmlElement *visualScenesRoot = new TiXmlElement("library_visual_scenes");
+			writer.beginElement("library_visual_scenes");
 			{
-				TiXmlElement *visualScene = new TiXmlElement("visual_scene");
-				visualScene->SetAttribute("id", "LibGensScene");
-				visualScene->SetAttribute("name", "LibGensScene");
+				writer.beginElement("visual_scene");
+				writer.attribute("id", "LibGensScene");
+				writer.attribute("name", "LibGensScene");
 
 				printf("Writing main object...\n");
-				object->writeDAE(visualScene, only_animation, unit_scale);
+				object->writeDAE(writer, only_animation, unit_scale);
 
 				printf("Checking for motion...\n");
 				if (motion) {
-					TiXmlElement *extraNode = new TiXmlElement("extra");
+					writer.beginElement("extra");
 
-					TiXmlElement *techniqueMax3DNode = new TiXmlElement("technique");
-					techniqueMax3DNode->SetAttribute("profile", "MAX3D");
+					writer.beginElement("technique");
+					writer.attribute("profile", "MAX3D");
 					{
-						TiXmlElement *frameRateNode = new TiXmlElement("frame_rate");
-						TiXmlText *pValue=new TiXmlText("30.000000");
-						frameRateNode->LinkEndChild(pValue);
-						techniqueMax3DNode->LinkEndChild(frameRateNode);
+						writer.element("frame_rate", "30.000000");
 					}
-					extraNode->LinkEndChild(techniqueMax3DNode);
+					writer.endElement();
 
-					TiXmlElement *techniqueColladaNode = new TiXmlElement("technique");
-					techniqueColladaNode->SetAttribute("profile", "FCOLLADA");
+					writer.beginElement("technique");
+					writer.attribute("profile", "FCOLLADA");
 					{
-						TiXmlElement *startTimeNode = new TiXmlElement("start_time");
-						TiXmlText *pValue=new TiXmlText("0.000000");
-						startTimeNode->LinkEndChild(pValue);
-						techniqueColladaNode->LinkEndChild(startTimeNode);
-
-						TiXmlElement *endTimeNode = new TiXmlElement("end_time");
-						pValue=new TiXmlText(ToString(motion->getDuration()));
-						endTimeNode->LinkEndChild(pValue);
-						techniqueColladaNode->LinkEndChild(endTimeNode);
+						writer.element("start_time", "0.000000");
+						writer.elementFloat("end_time", motion->getDuration());
 					}
-					extraNode->LinkEndChild(techniqueColladaNode);
+					writer.endElement();
 
-					visualScene->LinkEndChild(extraNode);
+					writer.endElement();
 				}
 
-				visualScenesRoot->LinkEndChild(visualScene);
+				writer.endElement();
 			}
-			colladaRoot->LinkEndChild(visualScenesRoot);
+			writer.endElement();
 		}
 	
-		TiXmlElement *sceneRoot = new TiXmlElement("scene");
+		writer.beginElement("scene");
 		{
-			TiXmlElement *newElem = new TiXmlElement("instance_visual_scene");
-			newElem->SetAttribute("url", "#LibGensScene");
-			sceneRoot->LinkEndChild(newElem);
+			writer.beginElement("instance_visual_scene");
+			writer.attribute("url", "#LibGensScene");
+			writer.endElement();
 		}
-		colladaRoot->LinkEndChild(sceneRoot);
+		writer.endElement();
 
 
-		doc.LinkEndChild(colladaRoot);
-		doc.SaveFile(filename.c_str());
+		writer.endElement();
+		writer.close();
 	}
 
 
-	void SonicXNObject::writeBonesDAE(TiXmlElement *root, size_t current, float unit_scale) {
+	void SonicXNObject::writeBonesDAE(SonicDAEWriter &writer, size_t current, float unit_scale) {
 		printf("Writing bone %d...\n", current);
-		string bone_name=(bones_names ? bones_names->getName(current) : name+ToString(current));
+		string bone_name;
+		if (bones_names) bone_name = bones_names->getName(current);
+		else {
+			bone_name = name;
+			appendDAEIndex(bone_name, current);
+		}
 
 		Error::addMessage(Error::WARNING, "Writing bone " + ToString(current) + " with name " + bone_name + " and Skinning Matrix Index " + ToString(bones[current]->matrix_index));
 
 		printf("Writing bone with name %s...\n", bone_name.c_str());
 
-		TiXmlElement *nodeRoot = new TiXmlElement("node");
-		nodeRoot->SetAttribute("id", bone_name);
-		nodeRoot->SetAttribute("sid", bone_name);
-		nodeRoot->SetAttribute("name", bone_name);
-		nodeRoot->SetAttribute("type", "JOINT");
+		// Siblings have always been placed before the bone itself in the parent node
+		if (bones[current]->sibling_index != 0xFFFF) writeBonesDAE(writer, bones[current]->sibling_index, unit_scale);
+
+		writer.beginElement("node");
+		writer.attribute("id", bone_name);
+		writer.attribute("sid", bone_name);
+		writer.attribute("name", bone_name);
+		writer.attribute("type", "JOINT");
 
 		Matrix4 m=bones[current]->current_matrix;
-		string nm="";
-		nm += ToString(m[0][0]) + " " + ToString(m[0][1]) + " " + ToString(m[0][2]) + " " + ToString(m[0][3] * unit_scale) + " ";
-		nm += ToString(m[1][0]) + " " + ToString(m[1][1]) + " " + ToString(m[1][2]) + " " + ToString(m[1][3] * unit_scale) + " ";
-		nm += ToString(m[2][0]) + " " + ToString(m[2][1]) + " " + ToString(m[2][2]) + " " + ToString(m[2][3] * unit_scale) + " ";
-		nm += ToString(m[3][0]) + " " + ToString(m[3][1]) + " " + ToString(m[3][2]) + " " + ToString(m[3][3] * unit_scale) + " ";
-
-		TiXmlElement *matrixRoot = new TiXmlElement("matrix");
-		TiXmlText *text = new TiXmlText(nm);
-		matrixRoot->LinkEndChild(text);
-		nodeRoot->LinkEndChild(matrixRoot);
-
-		if (bones[current]->sibling_index != 0xFFFF) writeBonesDAE(root, bones[current]->sibling_index, unit_scale);
-		if (bones[current]->child_index   != 0xFFFF) writeBonesDAE(nodeRoot, bones[current]->child_index, unit_scale);
-
-		TiXmlElement *extraRoot = new TiXmlElement("extra");
-		TiXmlElement *techniqueRoot = new TiXmlElement("technique");
-		techniqueRoot->SetAttribute("profile", "FCOLLADA");
-		TiXmlElement *visibilityRoot = new TiXmlElement("visibility");
-		text = new TiXmlText("1.000000");
-		visibilityRoot->LinkEndChild(text);
-		techniqueRoot->LinkEndChild(visibilityRoot);
-		extraRoot->LinkEndChild(techniqueRoot);
-		nodeRoot->LinkEndChild(extraRoot);
-
-		root->LinkEndChild(nodeRoot);
+		writer.beginElement("matrix");
+		writer.beginText();
+		for (size_t x=0; x<4; x++) {
+			writer.textFloat(m[x][0]);
+			writer.textFloat(m[x][1]);
+			writer.textFloat(m[x][2]);
+			writer.textFloat(m[x][3] * unit_scale);
+		}
+		writer.endElement();
+
+		if (bones[current]->child_index   != 0xFFFF) writeBonesDAE(writer, bones[current]->child_index, unit_scale);
+
+		writer.beginElement("extra");
+		writer.beginElement("technique");
+		writer.attribute("profile", "FCOLLADA");
+		writer.element("visibility", "1.000000");
+		writer.endElement();
+		writer.endElement();
+
+		writer.endElement();
 	}
 	
-	void SonicXNObject::writeControllerDAE(TiXmlElement *root, float unit_scale) {
-		TiXmlElement *controllerRoot = new TiXmlElement("controller");
-		controllerRoot->SetAttribute("id", name+"-controller");
+	// Indices of unique attribute values in the order they were first seen. Values are keyed on
+	// their bit patterns, with -0.0 folded into 0.0 and NaN never matching, so lookups give the
+	// same result as comparing against every earlier value with ==.
+	class SonicDAEValuePool {
+		protected:
+			struct Key {
+				uint32_t bits[4];
+
+				bool operator == (const Key &key) const {
+					return (bits[0] == key.bits[0]) && (bits[1] == key.bits[1]) && (bits[2] == key.bits[2]) && (bits[3] == key.bits[3]);
+				}
+			};
+
+			struct KeyHash {
+				size_t operator () (const Key &key) const {
+					size_t hash=0;
+					for (size_t i=0; i<4; i++) hash = (hash ^ key.bits[i]) * 0x9E3779B1u + (hash >> 16);
+					return hash;
+				}
+			};
+
+			std::unordered_map<Key, unsigned int, KeyHash> indices;
+		public:
+			// Returns true and the earlier index if the value was already added, otherwise
+			// registers it under next_index
+			bool find(const float *values, size_t count, unsigned int next_index, unsigned int &index) {
+				Key key;
+				memset(key.bits, 0, sizeof(key.bits));
+
+				for (size_t i=0; i<count; i++) {
+					float value=values[i];
+					if (value != value) {
+						index = next_index;
+						return false;
+					}
+
+					if (value == 0.0f) value = 0.0f;
+					memcpy(&key.bits[i], &value, 4);
+				}
+
+				std::pair<std::unordered_map<Key, unsigned int, KeyHash>::iterator, bool> result=indices.insert(std::make_pair(key, next_index));
+				index = result.first->second;
+				return !result.second;
+			}
+	};
+
+	static void addJointDAE(const vector<int> &matrix_to_bone, size_t matrix_index, vector<unsigned int> &joint_map) {
+		if ((matrix_index < matrix_to_bone.size()) && (matrix_to_bone[matrix_index] >= 0)) {
+			joint_map.push_back(matrix_to_bone[matrix_index]);
+		}
+	}
 
-		TiXmlElement *skinRoot = new TiXmlElement("skin");
-		skinRoot->SetAttribute("source", "#"+name+"-geometry");
+	static void addWeightDAE(SonicDAEValuePool &weight_pool, vector<float> &bone_weights, float w, vector<unsigned int> &weight_map) {
+		unsigned int index=0;
+		if (!weight_pool.find(&w, 1, bone_weights.size(), index)) bone_weights.push_back(w);
+		weight_map.push_back(index);
+	}
+
+	void SonicXNObject::writeControllerDAE(SonicDAEWriter &writer, float unit_scale) {
+		writer.beginElement("controller");
+		writer.attribute("id", name+"-controller");
+
+		writer.beginElement("skin");
+		writer.attribute("source", "#"+name+"-geometry");
 		{
-			TiXmlElement *bindShapeRoot = new TiXmlElement("bind_shape_matrix");
-			TiXmlText *text = new TiXmlText("1.0 0.0 0.0 0.0 0.0 1.0 0.0 0.0 0.0 0.0 1.0 0.0 0.0 0.0 0.0 1.0");
-			bindShapeRoot->LinkEndChild(text);
-			skinRoot->LinkEndChild(bindShapeRoot);
+			writer.element("bind_shape_matrix", "1.0 0.0 0.0 0.0 0.0 1.0 0.0 0.0 0.0 0.0 1.0 0.0 0.0 0.0 0.0 1.0");
 		}
 
 		vector<float> bone_weights;
 		vector< vector<unsigned int> > vertex_joint_map;
 		vector< vector<unsigned int> > vertex_weight_map;
+		SonicDAEValuePool weight_pool;
+
+		vector<int> matrix_to_bone;
+		buildMatrixToBone(matrix_to_bone);
 
 		// XNO and ZNO
 		for (size_t i=0; i<vertex_tables.size(); i++) {
-			vector<unsigned int> blending_table=vertex_tables[i]->bone_table;
+			vector<unsigned int> &blending_table=vertex_tables[i]->bone_table;
+			vector<SonicVertex *> &vertices=vertex_tables[i]->vertices;
 
-			for (size_t j=0; j<vertex_tables[i]->vertices.size(); j++) {
+			for (size_t j=0; j<vertices.size(); j++) {
 				vector<unsigned int> joint_map;
 				vector<unsigned int> weight_map;
-				vector<SonicVertex *> vertices=vertex_tables[i]->vertices;
 
 				if (!blending_table.size()) {
 					joint_map.push_back(0);
 					weight_map.push_back(0);
 
-					bool added=false;
-					float w=1.0;
-
-					for (size_t x=0; x<bone_weights.size(); x++) {
-						if (w==bone_weights[x]) {
-							added=true;
-							weight_map.push_back(x);
-							break;
-						}
-					}
-					if (!added) {
-						bone_weights.push_back(w);
-						weight_map.push_back(bone_weights.size()-1);
-					}
+					addWeightDAE(weight_pool, bone_weights, 1.0, weight_map);
 
 					vertex_joint_map.push_back(joint_map);
 					vertex_weight_map.push_back(weight_map);
@@ -320,30 +557,8 @@ namespace LibGens {
 						}
 
 						size_t index=blending_table[vertices[j]->bone_indices[k]];
-						SonicBone *bone=NULL;
-						bool player_switch=false;
-
-						for (size_t b=0; b<bones.size(); b++) {
-							if (bones[b]->matrix_index == index) {
-								joint_map.push_back(b);
-								break;
-							}
-						}
-
-
-						bool added=false;
-						float w=vertices[j]->bone_weights_f[k];
-						for (size_t x=0; x<bone_weights.size(); x++) {
-							if (w==bone_weights[x]) {
-								added=true;
-								weight_map.push_back(x);
-								break;
-							}
-						}
-						if (!added) {
-							bone_weights.push_back(w);
-							weight_map.push_back(bone_weights.size()-1);
-						}
+						addJointDAE(matrix_to_bone, index, joint_map);
+						addWeightDAE(weight_pool, bone_weights, vertices[j]->bone_weights_f[k], weight_map);
 					}
 				}
 
@@ -394,49 +609,13 @@ namespace LibGens {
 				SonicVertexBoneData *bone_data=&vertex_resource_tables[i]->bones[j];
 
 				if (bone_data->weight > 0) {
-					for (size_t b=0; b<bones.size(); b++) {
-						if (bones[b]->matrix_index == bone_data->bone_1) {
-							joint_map.push_back(b);
-							break;
-						}
-					}
-
-					bool added=false;
-					float w=(bone_data->weight)/16384.0;
-					for (size_t x=0; x<bone_weights.size(); x++) {
-						if (w==bone_weights[x]) {
-							added=true;
-							weight_map.push_back(x);
-							break;
-						}
-					}
-					if (!added) {
-						bone_weights.push_back(w);
-						weight_map.push_back(bone_weights.size()-1);
-					}
+					addJointDAE(matrix_to_bone, bone_data->bone_1, joint_map);
+					addWeightDAE(weight_pool, bone_weights, (bone_data->weight)/16384.0, weight_map);
 				}
 
 				if (bone_data->weight < 16384) {
-					for (size_t b=0; b<bones.size(); b++) {
-						if (bones[b]->matrix_index == bone_data->bone_2) {
-							joint_map.push_back(b);
-							break;
-						}
-					}
-
-					bool added=false;
-					float w=1.0 - (bone_data->weight)/16384.0;
-					for (size_t x=0; x<bone_weights.size(); x++) {
-						if (w==bone_weights[x]) {
-							added=true;
-							weight_map.push_back(x);
-							break;
-						}
-					}
-					if (!added) {
-						bone_weights.push_back(w);
-						weight_map.push_back(bone_weights.size()-1);
-					}
+					addJointDAE(matrix_to_bone, bone_data->bone_2, joint_map);
+					addWeightDAE(weight_pool, bone_weights, 1.0 - (bone_data->weight)/16384.0, weight_map);
 				}
 
 				vertex_joint_map.push_back(joint_map);
@@ -446,176 +625,210 @@ namespace LibGens {
 
 
 		// Joints
-		TiXmlElement *sourceRoot = new TiXmlElement("source");
-		sourceRoot->SetAttribute("id", name+"-controller-Joints");
+		writer.beginElement("source");
+		writer.attribute("id", name+"-controller-Joints");
 		{
 			// Names
-			TiXmlElement *nameArray = new TiXmlElement("Name_array");
-			nameArray->SetAttribute("id", name+"-controller-Joints-array");
-			nameArray->SetAttribute("count", ToString(bones.size()));
+			writer.beginElement("Name_array");
+			writer.attribute("id", name+"-controller-Joints-array");
+			writer.attribute("count", bones.size());
 
 			string nm="";
 			for (size_t i=0; i<bones.size(); i++) {
-				string bone_name=(bones_names ? bones_names->getName(i) : name+ToString(i));
-				nm += bone_name + " ";
+				if (bones_names) nm += bones_names->getName(i);
+				else {
+					nm += name;
+					appendDAEIndex(nm, i);
+				}
+				nm += " ";
 			}
-			TiXmlText *text = new TiXmlText(nm);
-			nameArray->LinkEndChild(text);
-			sourceRoot->LinkEndChild(nameArray);
+			writer.beginText();
+			writer.text(nm);
+			writer.endElement();
 
 			// Technique
-			TiXmlElement *techniqueRoot = new TiXmlElement("technique_common");
-			TiXmlElement *accessorRoot = new TiXmlElement("accessor");
-			accessorRoot->SetAttribute("source", "#"+name+"-controller-Joints-array");
-			accessorRoot->SetAttribute("count", ToString(bones.size()));
-
-			TiXmlElement *paramRoot = new TiXmlElement("param");
-			paramRoot->SetAttribute("type", "name");
-			accessorRoot->LinkEndChild(paramRoot);
+			writer.beginElement("technique_common");
+			writer.beginElement("accessor");
+			writer.attribute("source", "#"+name+"-controller-Joints-array");
+			writer.attribute("count", bones.size());
+
+			writer.beginElement("param");
+			writer.attribute("type", "name");
+			writer.endElement();
 	
-			techniqueRoot->LinkEndChild(accessorRoot);
-			sourceRoot->LinkEndChild(techniqueRoot);
+			writer.endElement();
+			writer.endElement();
 		}
-		skinRoot->LinkEndChild(sourceRoot);
+		writer.endElement();
 
 
-		sourceRoot = new TiXmlElement("source");
-		sourceRoot->SetAttribute("id", name+"-controller-Matrices");
+		writer.beginElement("source");
+		writer.attribute("id", name+"-controller-Matrices");
 		{
 			// Matrices
-			TiXmlElement *floatArray = new TiXmlElement("float_array");
-			floatArray->SetAttribute("id", name+"-controller-Matrices-array");
-			floatArray->SetAttribute("count", ToString(16*bones.size()));
+			writer.beginElement("float_array");
+			writer.attribute("id", name+"-controller-Matrices-array");
+			writer.attribute("count", 16*bones.size());
 
-			string nm="";
+			writer.beginText();
 			for (size_t i=0; i<bones.size(); i++) {
 				Matrix4 m=bones[i]->matrix.transpose();
 
-				nm+=ToString(m[0][0]) + " " + ToString(m[0][1]) + " " + ToString(m[0][2]) + " " + ToString(m[0][3]*unit_scale) + " ";
-				nm+=ToString(m[1][0]) + " " + ToString(m[1][1]) + " " + ToString(m[1][2]) + " " + ToString(m[1][3]*unit_scale) + " ";
-				nm+=ToString(m[2][0]) + " " + ToString(m[2][1]) + " " + ToString(m[2][2]) + " " + ToString(m[2][3]*unit_scale) + " ";
-				nm+=ToString(m[3][0]) + " " + ToString(m[3][1]) + " " + ToString(m[3][2]) + " " + ToString(m[3][3]) + " ";
+				for (size_t x=0; x<3; x++) {
+					writer.textFloat(m[x][0]);
+					writer.textFloat(m[x][1]);
+					writer.textFloat(m[x][2]);
+					writer.textFloat(m[x][3]*unit_scale);
+				}
+				writer.textFloat(m[3][0]);
+				writer.textFloat(m[3][1]);
+				writer.textFloat(m[3][2]);
+				writer.textFloat(m[3][3]);
 			}
-			TiXmlText *text = new TiXmlText(nm);
-			floatArray->LinkEndChild(text);
-			sourceRoot->LinkEndChild(floatArray);
+			writer.endElement();
 
 			// Technique
-			TiXmlElement *techniqueRoot = new TiXmlElement("technique_common");
-			TiXmlElement *accessorRoot = new TiXmlElement("accessor");
-			accessorRoot->SetAttribute("source", "#"+name+"-controller-Matrices-array");
-			accessorRoot->SetAttribute("count", ToString(bones.size()));
-			accessorRoot->SetAttribute("stride", "16");
-
-			TiXmlElement *paramRoot = new TiXmlElement("param");
-			paramRoot->SetAttribute("type", "float4x4");
-			accessorRoot->LinkEndChild(paramRoot);
-
-			techniqueRoot->LinkEndChild(accessorRoot);
-			sourceRoot->LinkEndChild(techniqueRoot);
+			writer.beginElement("technique_common");
+			writer.beginElement("accessor");
+			writer.attribute("source", "#"+name+"-controller-Matrices-array");
+			writer.attribute("count", bones.size());
+			writer.attribute("stride", "16");
+
+			writer.beginElement("param");
+			writer.attribute("type", "float4x4");
+			writer.endElement();
+
+			writer.endElement();
+			writer.endElement();
 		}
-		skinRoot->LinkEndChild(sourceRoot);
+		writer.endElement();
 
-		sourceRoot = new TiXmlElement("source");
-		sourceRoot->SetAttribute("id", name+"-controller-Weights");
+		writer.beginElement("source");
+		writer.attribute("id", name+"-controller-Weights");
 		{
 			// Weights
-			TiXmlElement *floatArray = new TiXmlElement("float_array");
-			floatArray->SetAttribute("id", name+"-controller-Weights-array");
-			floatArray->SetAttribute("count", ToString(bone_weights.size()));
+			writer.beginElement("float_array");
+			writer.attribute("id", name+"-controller-Weights-array");
+			writer.attribute("count", bone_weights.size());
 
-			string nm="";
+			writer.beginText();
 			for (size_t i=0; i<bone_weights.size(); i++) {
-				nm += ToString(bone_weights[i]) + " ";
+				writer.textFloat(bone_weights[i]);
 			}
-			TiXmlText *text = new TiXmlText(nm);
-			floatArray->LinkEndChild(text);
-			sourceRoot->LinkEndChild(floatArray);
+			writer.endElement();
 
 			// Technique
-			TiXmlElement *techniqueRoot = new TiXmlElement("technique_common");
-			TiXmlElement *accessorRoot = new TiXmlElement("accessor");
-			accessorRoot->SetAttribute("source", "#"+name+"-controller-Weights-array");
-			accessorRoot->SetAttribute("count", ToString(bone_weights.size()));
+			writer.beginElement("technique_common");
+			writer.beginElement("accessor");
+			writer.attribute("source", "#"+name+"-controller-Weights-array");
+			writer.attribute("count", bone_weights.size());
 
-			TiXmlElement *paramRoot = new TiXmlElement("param");
-			paramRoot->SetAttribute("type", "float");
-			accessorRoot->LinkEndChild(paramRoot);
+			writer.beginElement("param");
+			writer.attribute("type", "float");
+			writer.endElement();
 
-			techniqueRoot->LinkEndChild(accessorRoot);
-			sourceRoot->LinkEndChild(techniqueRoot);
+			writer.endElement();
+			writer.endElement();
 		}
-		skinRoot->LinkEndChild(sourceRoot);
+		writer.endElement();
 
 
 		// Joints Root
-		sourceRoot = new TiXmlElement("joints");
+		writer.beginElement("joints");
 		{
-			TiXmlElement *input = new TiXmlElement("input");
-			input->SetAttribute("semantic", "JOINT");
-			input->SetAttribute("source", "#"+name+"-controller-Joints");
-			sourceRoot->LinkEndChild(input);
-
-			input = new TiXmlElement("input");
-			input->SetAttribute("semantic", "INV_BIND_MATRIX");
-			input->SetAttribute("source", "#"+name+"-controller-Matrices");
-			sourceRoot->LinkEndChild(input);
+			writer.beginElement("input");
+			writer.attribute("semantic", "JOINT");
+			writer.attribute("source", "#"+name+"-controller-Joints");
+			writer.endElement();
+
+			writer.beginElement("input");
+			writer.attribute("semantic", "INV_BIND_MATRIX");
+			writer.attribute("source", "#"+name+"-controller-Matrices");
+			writer.endElement();
 		}
-		skinRoot->LinkEndChild(sourceRoot);
+		writer.endElement();
 
 
 		// Weights
-		sourceRoot = new TiXmlElement("vertex_weights");
-		sourceRoot->SetAttribute("count", ToString(vertex_joint_map.size()));
+		writer.beginElement("vertex_weights");
+		writer.attribute("count", vertex_joint_map.size());
 		{
-			TiXmlElement *input = new TiXmlElement("input");
-			input->SetAttribute("semantic", "JOINT");
-			input->SetAttribute("offset", "0");
-			input->SetAttribute("source", "#"+name+"-controller-Joints");
-			sourceRoot->LinkEndChild(input);
-
-			input = new TiXmlElement("input");
-			input->SetAttribute("semantic", "WEIGHT");
-			input->SetAttribute("offset", "1");
-			input->SetAttribute("source", "#"+name+"-controller-Weights");
-			sourceRoot->LinkEndChild(input);
-
-			string nm="";
+			writer.beginElement("input");
+			writer.attribute("semantic", "JOINT");
+			writer.attribute("offset", "0");
+			writer.attribute("source", "#"+name+"-controller-Joints");
+			writer.endElement();
+
+			writer.beginElement("input");
+			writer.attribute("semantic", "WEIGHT");
+			writer.attribute("offset", "1");
+			writer.attribute("source", "#"+name+"-controller-Weights");
+			writer.endElement();
+
+			writer.beginElement("vcount");
+			writer.beginText();
 			for (size_t i=0; i<vertex_joint_map.size(); i++) {
-				nm+=ToString(vertex_joint_map[i].size())+" ";
+				writer.textInt(vertex_joint_map[i].size());
 			}
+			writer.endElement();
 
-			TiXmlElement *vcount = new TiXmlElement("vcount");
-			TiXmlText *text= new TiXmlText(nm);
-			vcount->LinkEndChild(text);
-			sourceRoot->LinkEndChild(vcount);
 
-
-			nm="";
+			writer.beginElement("v");
+			writer.beginText();
 			for (size_t i=0; i<vertex_joint_map.size(); i++) {
 				for (size_t k=0; k<vertex_joint_map[i].size(); k++) {
-					nm += ToString(vertex_joint_map[i][k]) + " " + ToString(vertex_weight_map[i][k]) + " ";
+					writer.textInt(vertex_joint_map[i][k]);
+					writer.textInt(vertex_weight_map[i][k]);
 				}
 			}
-	
-			TiXmlElement *v= new TiXmlElement("v");
-			text= new TiXmlText(nm);
-			v->LinkEndChild(text);
-			sourceRoot->LinkEndChild(v);
+			writer.endElement();
 		}
-		skinRoot->LinkEndChild(sourceRoot);
+		writer.endElement();
 	
-		controllerRoot->LinkEndChild(skinRoot);
-		root->LinkEndChild(controllerRoot);
+		writer.endElement();
+		writer.endElement();
+	}
+
+	// Float array source with an accessor of one float param per name, the layout every geometry source uses
+	static void beginGeometrySourceDAE(SonicDAEWriter &writer, string id, size_t count, size_t stride) {
+		writer.beginElement("source");
+		writer.attribute("id", id);
+
+		writer.beginElement("float_array");
+		writer.attribute("id", id+"-array");
+		writer.attribute("count", count*stride);
+		writer.beginText();
+	}
+
+	static void endGeometrySourceDAE(SonicDAEWriter &writer, string id, size_t count, const char **names, size_t stride) {
+		writer.endElement();
+
+		// Technique declaration
+		writer.beginElement("technique_common");
+		{
+			writer.beginElement("accessor");
+			writer.attribute("source", "#"+id+"-array");
+			writer.attribute("count", count);
+			writer.attribute("stride", stride);
+			for (size_t i=0; i<stride; i++) {
+				writer.beginElement("param");
+				writer.attribute("name", names[i]);
+				writer.attribute("type", "float");
+				writer.endElement();
+			}
+			writer.endElement();
+		}
+		writer.endElement();
+
+		writer.endElement();
 	}
 
-	void SonicXNObject::writeMeshesDAE(TiXmlElement *root, float unit_scale) {
-		TiXmlElement *geometryRoot = new TiXmlElement("geometry");
-		geometryRoot->SetAttribute("id", name+"-geometry");
-		geometryRoot->SetAttribute("name", name+"-geometry");
+	void SonicXNObject::writeMeshesDAE(SonicDAEWriter &writer, float unit_scale) {
+		writer.beginElement("geometry");
+		writer.attribute("id", name+"-geometry");
+		writer.attribute("name", name+"-geometry");
 
-		TiXmlElement *meshRoot = new TiXmlElement("mesh");
-		geometryRoot->LinkEndChild(meshRoot);
+		writer.beginElement("mesh");
 
 		vector<int> pfaces;
 		pfaces.clear();
@@ -636,10 +849,16 @@ namespace LibGens {
 
 		printf("Creating Indices...\n");
 
+		SonicDAEValuePool normal_pool;
+		SonicDAEValuePool uv_pool;
+		SonicDAEValuePool uv_2_pool;
+		SonicDAEValuePool color_pool;
+		unsigned int index=0;
+
 		unsigned int global_index=0;
 		vector<unsigned int> global_indices;
 		for (size_t x=0; x<vertex_tables.size(); x++) {
-			vector<SonicVertex *> vertices = vertex_tables[x]->vertices;
+			vector<SonicVertex *> &vertices = vertex_tables[x]->vertices;
 
 			for (size_t i=0; i<vertices.size(); i++) {
 				// Position
@@ -647,61 +866,28 @@ namespace LibGens {
 				pfaces.push_back(base_vertices.size()-1);
 
 				// Normals
-				bool added=false;
-				for (size_t k=0; k<base_vert_normals.size(); k++) {
-					if (base_vert_normals[k] == vertices[i]->normal) {
-						pfaces.push_back(k);
-						added=true;
-						break;
-					}
-				}
-				if (!added) {
-					base_vert_normals.push_back(vertices[i]->normal);
-					pfaces.push_back(base_vert_normals.size()-1);
-				}
-
+				Vector3 normal=vertices[i]->normal;
+				float normal_values[3]={ normal.x, normal.y, normal.z };
+				if (!normal_pool.find(normal_values, 3, base_vert_normals.size(), index)) base_vert_normals.push_back(normal);
+				pfaces.push_back(index);
 
 				// UVs
-				added=false;
-				for (size_t k=0; k<base_uvs.size(); k++) {
-					if (base_uvs[k] == vertices[i]->uv[0]) {
-						pfaces.push_back(k);
-						added=true;
-						break;
-					}
-				}
-				if (!added) {
-					base_uvs.push_back(vertices[i]->uv[0]);
-					pfaces.push_back(base_uvs.size()-1);
-				}
+				Vector2 uv=vertices[i]->uv[0];
+				float uv_values[2]={ uv.x, uv.y };
+				if (!uv_pool.find(uv_values, 2, base_uvs.size(), index)) base_uvs.push_back(uv);
+				pfaces.push_back(index);
 
 				// UVs 2
-				added=false;
-				for (size_t k=0; k<base_uvs_2.size(); k++) {
-					if (base_uvs_2[k] == vertices[i]->uv[1]) {
-						pfaces.push_back(k);
-						added=true;
-						break;
-					}
-				}
-				if (!added) {
-					base_uvs_2.push_back(vertices[i]->uv[1]);
-					pfaces.push_back(base_uvs_2.size()-1);
-				}
+				Vector2 uv_2=vertices[i]->uv[1];
+				float uv_2_values[2]={ uv_2.x, uv_2.y };
+				if (!uv_2_pool.find(uv_2_values, 2, base_uvs_2.size(), index)) base_uvs_2.push_back(uv_2);
+				pfaces.push_back(index);
 
 				// Color
-				added=false;
-				for (size_t k=0; k<base_colors.size(); k++) {
-					if (base_colors[k] == Color(vertices[i]->rgba)) {
-						pfaces.push_back(k);
-						added=true;
-						break;
-					}
-				}
-				if (!added) {
-					base_colors.push_back(Color(vertices[i]->rgba));
-					pfaces.push_back(base_colors.size()-1);
-				}
+				Color color(vertices[i]->rgba);
+				float color_values[4]={ color.r, color.g, color.b, color.a };
+				if (!color_pool.find(color_values, 4, base_colors.size(), index)) base_colors.push_back(color);
+				pfaces.push_back(index);
 			}
 
 			global_indices.push_back(global_index);
@@ -715,7 +901,7 @@ namespace LibGens {
 				for (size_t s=0; s<meshes[m]->submeshes.size(); s++) {
 					size_t indices_index=meshes[m]->submeshes[s]->indices_index;
 
-					vector<Vector3> indices_vector=index_tables[indices_index]->indices_vector;
+					vector<Vector3> &indices_vector=index_tables[indices_index]->indices_vector;
 					global_index = global_indices[meshes[m]->submeshes[s]->vertex_index];
 
 					for (size_t i=0; i<indices_vector.size(); i++) {
@@ -764,329 +950,104 @@ namespace LibGens {
 			}
 		}
 
-		printf("Creating Geometry Positions...\n");
-
-		TiXmlElement *sourcePosition = new TiXmlElement("source");
-		sourcePosition->SetAttribute("id", name+"-geometry-position");
-		{
-			// Float array with positions
-			TiXmlElement *floatArray = new TiXmlElement("float_array");
-			floatArray->SetAttribute("id", name+"-geometry-position-array");
-			floatArray->SetAttribute("count", ToString(base_vertices.size()*3));
-
-			string farray_string="";
-			for (size_t i=0; i<base_vertices.size(); i++) {
-				farray_string+=ToString(base_vertices[i].x*unit_scale)+" ";
-				farray_string+=ToString(base_vertices[i].y*unit_scale)+" ";
-				farray_string+=ToString(base_vertices[i].z*unit_scale)+" ";
-			}
-
-			TiXmlText *text = new TiXmlText(farray_string);
-			floatArray->LinkEndChild(text);
-			sourcePosition->LinkEndChild(floatArray);
-
-			// Technique declaration
-			TiXmlElement *technique = new TiXmlElement("technique_common");
-			{
-				TiXmlElement *accessor = new TiXmlElement("accessor");
-				accessor->SetAttribute("source", "#"+name+"-geometry-position-array");
-				accessor->SetAttribute("count", ToString(base_vertices.size()));
-				accessor->SetAttribute("stride", "3");
-				{
-					TiXmlElement *xparam = new TiXmlElement("param");
-					TiXmlElement *yparam = new TiXmlElement("param");
-					TiXmlElement *zparam = new TiXmlElement("param");
-
-					xparam->SetAttribute("name", "X");
-					yparam->SetAttribute("name", "Y");
-					zparam->SetAttribute("name", "Z");
-
-					xparam->SetAttribute("type", "float");
-					yparam->SetAttribute("type", "float");
-					zparam->SetAttribute("type", "float");
+		const char *xyz_names[3]={ "X", "Y", "Z" };
+		const char *st_names[2]={ "S", "T" };
+		const char *rgba_names[4]={ "R", "G", "B", "A" };
 
-					accessor->LinkEndChild(xparam);
-					accessor->LinkEndChild(yparam);
-					accessor->LinkEndChild(zparam);
-				}
-	
-				technique->LinkEndChild(accessor);
-			}
+		printf("Creating Geometry Positions...\n");
 
-			sourcePosition->LinkEndChild(technique);
+		beginGeometrySourceDAE(writer, name+"-geometry-position", base_vertices.size(), 3);
+		for (size_t i=0; i<base_vertices.size(); i++) {
+			writer.textFloat(base_vertices[i].x*unit_scale);
+			writer.textFloat(base_vertices[i].y*unit_scale);
+			writer.textFloat(base_vertices[i].z*unit_scale);
 		}
-		meshRoot->LinkEndChild(sourcePosition);
+		endGeometrySourceDAE(writer, name+"-geometry-position", base_vertices.size(), xyz_names, 3);
 
 		printf("Creating Geometry Normals...\n");
 
-		TiXmlElement *sourceNormal = new TiXmlElement("source");
-		sourceNormal->SetAttribute("id", name+"-geometry-normal");
-		{
-			// Float array with positions
-			TiXmlElement *floatArray = new TiXmlElement("float_array");
-			floatArray->SetAttribute("id", name+"-geometry-normal-array");
-			floatArray->SetAttribute("count", ToString(base_vert_normals.size()*3));
-
-			string farray_string="";
-			for (size_t i=0; i<base_vert_normals.size(); i++) {
-				farray_string+=ToString(base_vert_normals[i].x)+" ";
-				farray_string+=ToString(base_vert_normals[i].y)+" ";
-				farray_string+=ToString(base_vert_normals[i].z)+" ";
-			}
-
-			TiXmlText *text = new TiXmlText(farray_string);
-			floatArray->LinkEndChild(text);
-			sourceNormal->LinkEndChild(floatArray);
-
-			// Technique declaration
-			TiXmlElement *technique = new TiXmlElement("technique_common");
-			{
-				TiXmlElement *accessor = new TiXmlElement("accessor");
-				accessor->SetAttribute("source", "#"+name+"-geometry-normal-array");
-				accessor->SetAttribute("count", ToString(base_vert_normals.size()));
-				accessor->SetAttribute("stride", "3");
-				{
-					TiXmlElement *xparam = new TiXmlElement("param");
-					TiXmlElement *yparam = new TiXmlElement("param");
-					TiXmlElement *zparam = new TiXmlElement("param");
-
-					xparam->SetAttribute("name", "X");
-					yparam->SetAttribute("name", "Y");
-					zparam->SetAttribute("name", "Z");
-
-					xparam->SetAttribute("type", "float");
-					yparam->SetAttribute("type", "float");
-					zparam->SetAttribute("type", "float");
-
-					accessor->LinkEndChild(xparam);
-					accessor->LinkEndChild(yparam);
-					accessor->LinkEndChild(zparam);
-				}
-
-				technique->LinkEndChild(accessor);
-			}
-
-			sourceNormal->LinkEndChild(technique);
+		beginGeometrySourceDAE(writer, name+"-geometry-normal", base_vert_normals.size(), 3);
+		for (size_t i=0; i<base_vert_normals.size(); i++) {
+			writer.textFloat(base_vert_normals[i].x);
+			writer.textFloat(base_vert_normals[i].y);
+			writer.textFloat(base_vert_normals[i].z);
 		}
-		meshRoot->LinkEndChild(sourceNormal);
+		endGeometrySourceDAE(writer, name+"-geometry-normal", base_vert_normals.size(), xyz_names, 3);
 
 		printf("Creating Geometry UVs...\n");
 
-		TiXmlElement *sourceUV = new TiXmlElement("source");
-		sourceUV->SetAttribute("id", name+"-geometry-uv");
-		{
-			// Float array with positions
-			TiXmlElement *floatArray = new TiXmlElement("float_array");
-			floatArray->SetAttribute("id", name+"-geometry-uv-array");
-			floatArray->SetAttribute("count", ToString(base_uvs.size()*2));
-
-			string farray_string="";
-			for (size_t i=0; i<base_uvs.size(); i++) {
-				farray_string+=ToString(base_uvs[i].x)+" ";
-				farray_string+=ToString(1.0 - base_uvs[i].y)+" ";
-			}
-
-			TiXmlText *text = new TiXmlText(farray_string);
-			floatArray->LinkEndChild(text);
-			sourceUV->LinkEndChild(floatArray);
-
-			// Technique declaration
-			TiXmlElement *technique = new TiXmlElement("technique_common");
-			{
-				TiXmlElement *accessor = new TiXmlElement("accessor");
-				accessor->SetAttribute("source", "#"+name+"-geometry-uv-array");
-				accessor->SetAttribute("count", ToString(base_uvs.size()));
-				accessor->SetAttribute("stride", "2");
-				{
-					TiXmlElement *xparam = new TiXmlElement("param");
-					TiXmlElement *yparam = new TiXmlElement("param");
-
-					xparam->SetAttribute("name", "S");
-					yparam->SetAttribute("name", "T");
-
-					xparam->SetAttribute("type", "float");
-					yparam->SetAttribute("type", "float");
-
-					accessor->LinkEndChild(xparam);
-					accessor->LinkEndChild(yparam);
-				}
-
-				technique->LinkEndChild(accessor);
-			}
-
-			sourceUV->LinkEndChild(technique);
+		beginGeometrySourceDAE(writer, name+"-geometry-uv", base_uvs.size(), 2);
+		for (size_t i=0; i<base_uvs.size(); i++) {
+			writer.textFloat(base_uvs[i].x);
+			writer.textFloat(1.0f - base_uvs[i].y);
 		}
-		meshRoot->LinkEndChild(sourceUV);
+		endGeometrySourceDAE(writer, name+"-geometry-uv", base_uvs.size(), st_names, 2);
 
 		printf("Creating Geometry UVs 2...\n");
 		
-		TiXmlElement *sourceUV2 = new TiXmlElement("source");
-		sourceUV2->SetAttribute("id", name+"-geometry-uv2");
-		{
-			// Float array with positions
-			TiXmlElement *floatArray = new TiXmlElement("float_array");
-			floatArray->SetAttribute("id", name+"-geometry-uv2-array");
-			floatArray->SetAttribute("count", ToString(base_uvs_2.size()*2));
-
-			string farray_string="";
-			for (size_t i=0; i<base_uvs_2.size(); i++) {
-				farray_string+=ToString(base_uvs_2[i].x)+" ";
-				farray_string+=ToString(1.0 - base_uvs_2[i].y)+" ";
-			}
-
-			TiXmlText *text = new TiXmlText(farray_string);
-			floatArray->LinkEndChild(text);
-			sourceUV2->LinkEndChild(floatArray);
-
-			// Technique declaration
-			TiXmlElement *technique = new TiXmlElement("technique_common");
-			{
-				TiXmlElement *accessor = new TiXmlElement("accessor");
-				accessor->SetAttribute("source", "#"+name+"-geometry-uv2-array");
-				accessor->SetAttribute("count", ToString(base_uvs_2.size()));
-				accessor->SetAttribute("stride", "2");
-				{
-					TiXmlElement *xparam = new TiXmlElement("param");
-					TiXmlElement *yparam = new TiXmlElement("param");
-
-					xparam->SetAttribute("name", "S");
-					yparam->SetAttribute("name", "T");
-
-					xparam->SetAttribute("type", "float");
-					yparam->SetAttribute("type", "float");
-
-					accessor->LinkEndChild(xparam);
-					accessor->LinkEndChild(yparam);
-				}
-
-				technique->LinkEndChild(accessor);
-			}
-
-			sourceUV2->LinkEndChild(technique);
+		beginGeometrySourceDAE(writer, name+"-geometry-uv2", base_uvs_2.size(), 2);
+		for (size_t i=0; i<base_uvs_2.size(); i++) {
+			writer.textFloat(base_uvs_2[i].x);
+			writer.textFloat(1.0f - base_uvs_2[i].y);
 		}
-		meshRoot->LinkEndChild(sourceUV2);
+		endGeometrySourceDAE(writer, name+"-geometry-uv2", base_uvs_2.size(), st_names, 2);
 
 		printf("Creating Geometry Colors...\n");
 		
-		TiXmlElement *sourceColor = new TiXmlElement("source");
-		sourceColor->SetAttribute("id", name+"-geometry-color");
-		{
-			// Float array with positions
-			TiXmlElement *floatArray = new TiXmlElement("float_array");
-			floatArray->SetAttribute("id", name+"-geometry-color-array");
-			floatArray->SetAttribute("count", ToString(base_colors.size()*4));
-
-			string farray_string="";
-			for (size_t i=0; i<base_colors.size(); i++) {
-				farray_string+=ToString(base_colors[i].r)+" ";
-				farray_string+=ToString(base_colors[i].g)+" ";
-				farray_string+=ToString(base_colors[i].b)+" ";
-				farray_string+=ToString(base_colors[i].a)+" ";
-			}
-
-			TiXmlText *text = new TiXmlText(farray_string);
-			floatArray->LinkEndChild(text);
-			sourceColor->LinkEndChild(floatArray);
-
-			// Technique declaration
-			TiXmlElement *technique = new TiXmlElement("technique_common");
-			{
-				TiXmlElement *accessor = new TiXmlElement("accessor");
-				accessor->SetAttribute("source", "#"+name+"-geometry-color-array");
-				accessor->SetAttribute("count", ToString(base_colors.size()));
-				accessor->SetAttribute("stride", "4");
-				{
-					TiXmlElement *rparam = new TiXmlElement("param");
-					TiXmlElement *gparam = new TiXmlElement("param");
-					TiXmlElement *bparam = new TiXmlElement("param");
-					TiXmlElement *aparam = new TiXmlElement("param");
-
-					rparam->SetAttribute("name", "R");
-					rparam->SetAttribute("type", "float");
-
-					gparam->SetAttribute("name", "G");
-					gparam->SetAttribute("type", "float");
-
-					bparam->SetAttribute("name", "B");
-					bparam->SetAttribute("type", "float");
-
-					aparam->SetAttribute("name", "A");
-					aparam->SetAttribute("type", "float");
-
-					accessor->LinkEndChild(rparam);
-					accessor->LinkEndChild(gparam);
-					accessor->LinkEndChild(bparam);
-					accessor->LinkEndChild(aparam);
-				}
-
-				technique->LinkEndChild(accessor);
-			}
-
-			sourceColor->LinkEndChild(technique);
+		beginGeometrySourceDAE(writer, name+"-geometry-color", base_colors.size(), 4);
+		for (size_t i=0; i<base_colors.size(); i++) {
+			writer.textFloat(base_colors[i].r);
+			writer.textFloat(base_colors[i].g);
+			writer.textFloat(base_colors[i].b);
+			writer.textFloat(base_colors[i].a);
 		}
-		meshRoot->LinkEndChild(sourceColor);
+		endGeometrySourceDAE(writer, name+"-geometry-color", base_colors.size(), rgba_names, 4);
 
 
 		printf("Creating Vertex Declaration...\n");
 
 		// Vertex Decl
-		TiXmlElement *sourceVertex = new TiXmlElement("vertices");
-		sourceVertex->SetAttribute("id", name+"-geometry-vertex");
+		writer.beginElement("vertices");
+		writer.attribute("id", name+"-geometry-vertex");
 
-		TiXmlElement *inputVertex = new TiXmlElement("input");
-		inputVertex->SetAttribute("semantic", "POSITION");
-		inputVertex->SetAttribute("source", "#"+name+"-geometry-position");
-		sourceVertex->LinkEndChild(inputVertex);
-		meshRoot->LinkEndChild(sourceVertex);
+		writer.beginElement("input");
+		writer.attribute("semantic", "POSITION");
+		writer.attribute("source", "#"+name+"-geometry-position");
+		writer.endElement();
+		writer.endElement();
 
 		printf("Creating Faces...\n");
 		global_index=0;
 		for (size_t m=0; m<meshes.size(); m++) {
 			for (size_t s=0; s<meshes[m]->submeshes.size(); s++) {
-				TiXmlElement *trianglesRoot = new TiXmlElement("triangles");
+				writer.beginElement("triangles");
 				unsigned int mat_index = meshes[m]->submeshes[s]->material_index;
-				string mat_name = name + ToString(mat_index);
-				trianglesRoot->SetAttribute("material", mat_name);
+				string mat_name = name;
+				appendDAEIndex(mat_name, mat_index);
+				writer.attribute("material", mat_name);
+
+				size_t sz=0;
+				if (file_mode == MODE_GNO) sz = polygon_tables[meshes[m]->submeshes[s]->indices_index]->faces.size();
+				else sz = index_tables[meshes[m]->submeshes[s]->indices_index]->indices_vector.size();
+				writer.attribute("count", sz);
 				{
-					inputVertex = new TiXmlElement("input");
-					inputVertex->SetAttribute("semantic", "VERTEX");
-					inputVertex->SetAttribute("source", "#"+name+"-geometry-vertex");
-					inputVertex->SetAttribute("offset", "0");
-					trianglesRoot->LinkEndChild(inputVertex);
-
-					inputVertex = new TiXmlElement("input");
-					inputVertex->SetAttribute("semantic", "NORMAL");
-					inputVertex->SetAttribute("source", "#"+name+"-geometry-normal");
-					inputVertex->SetAttribute("offset", "1");
-					trianglesRoot->LinkEndChild(inputVertex);
-
-					inputVertex = new TiXmlElement("input");
-					inputVertex->SetAttribute("semantic", "TEXCOORD");
-					inputVertex->SetAttribute("source", "#"+name+"-geometry-uv");
-					inputVertex->SetAttribute("offset", "2");
-					inputVertex->SetAttribute("set", "0");
-					trianglesRoot->LinkEndChild(inputVertex);
-
-					inputVertex = new TiXmlElement("input");
-					inputVertex->SetAttribute("semantic", "TEXCOORD");
-					inputVertex->SetAttribute("source", "#"+name+"-geometry-uv2");
-					inputVertex->SetAttribute("offset", "3");
-					inputVertex->SetAttribute("set", "1");
-					trianglesRoot->LinkEndChild(inputVertex);
-
-					inputVertex = new TiXmlElement("input");
-					inputVertex->SetAttribute("semantic", "COLOR");
-					inputVertex->SetAttribute("source", "#"+name+"-geometry-color");
-					inputVertex->SetAttribute("offset", "4");
-					inputVertex->SetAttribute("set", "0");
-					trianglesRoot->LinkEndChild(inputVertex);
-
-					string pfaces_str="";
+					const char *semantics[5]={ "VERTEX", "NORMAL", "TEXCOORD", "TEXCOORD", "COLOR" };
+					const char *sources[5]={ "-geometry-vertex", "-geometry-normal", "-geometry-uv", "-geometry-uv2", "-geometry-color" };
+					const char *sets[5]={ NULL, NULL, "0", "1", "0" };
+
+					for (size_t i=0; i<5; i++) {
+						writer.beginElement("input");
+						writer.attribute("semantic", semantics[i]);
+						writer.attribute("source", "#"+name+sources[i]);
+						writer.attribute("offset", i);
+						if (sets[i]) writer.attribute("set", sets[i]);
+						writer.endElement();
+					}
+
+					writer.beginElement("p");
+					writer.beginText();
 					if (file_mode == MODE_GNO) {
 						unsigned int polygon_index=meshes[m]->submeshes[s]->indices_index;
-						size_t sz=polygon_tables[polygon_index]->faces.size();
-
-						trianglesRoot->SetAttribute("count", ToString(sz));
 
 						unsigned int positions_offset=0;
 						unsigned int normals_offset=1;
@@ -1103,73 +1064,51 @@ namespace LibGens {
 							colors_offset    += vertex_resource_tables[x]->colors.size();
 						}
 
-						
+						SonicVertexResourceTable *vertex_resource_table=vertex_resource_tables[v_index];
 
 						for (size_t i=0; i<sz; i++) {
 							for (size_t p=0; p<3; p++) {
-								pfaces_str += ToString(polygon_tables[polygon_index]->faces[i]->points[p].position_index + positions_offset) + " ";
-								
-								if (vertex_resource_tables[v_index]->normals.size()) pfaces_str += ToString(polygon_tables[polygon_index]->faces[i]->points[p].normal_index + normals_offset)   + " ";
-								else pfaces_str += "0 ";
-
-								if (vertex_resource_tables[v_index]->uvs.size())     pfaces_str += ToString(polygon_tables[polygon_index]->faces[i]->points[p].uv_index     + uvs_offset)       + " ";
-								else pfaces_str += "0 ";
-
-								if (vertex_resource_tables[v_index]->uvs_2.size())   pfaces_str += ToString(polygon_tables[polygon_index]->faces[i]->points[p].uv2_index    + uvs_2_offset)     + " ";
-								else pfaces_str += "0 ";
-
-								if (vertex_resource_tables[v_index]->colors.size())  pfaces_str += ToString(polygon_tables[polygon_index]->faces[i]->points[p].color_index  + colors_offset)    + " ";
-								else pfaces_str += "0 ";
+								SonicPolygonPoint &point=polygon_tables[polygon_index]->faces[i]->points[p];
+								writer.textInt(point.position_index + positions_offset);
+								writer.textInt(vertex_resource_table->normals.size() ? point.normal_index + normals_offset : 0);
+								writer.textInt(vertex_resource_table->uvs.size()     ? point.uv_index     + uvs_offset     : 0);
+								writer.textInt(vertex_resource_table->uvs_2.size()   ? point.uv2_index    + uvs_2_offset   : 0);
+								writer.textInt(vertex_resource_table->colors.size()  ? point.color_index  + colors_offset  : 0);
 							}
 						}
 					}
 					else {
-						int sz=index_tables[meshes[m]->submeshes[s]->indices_index]->indices_vector.size();
-
-						trianglesRoot->SetAttribute("count", ToString(sz));
 						for (size_t i=global_index; i<global_index+sz; i++) {
-							pfaces_str += ToString(pfaces[base_indices[i].x*5]) + " ";
-							pfaces_str += ToString(pfaces[base_indices[i].x*5 + 1]) + " ";
-							pfaces_str += ToString(pfaces[base_indices[i].x*5 + 2]) + " ";
-							pfaces_str += ToString(pfaces[base_indices[i].x*5 + 3]) + " ";
-							pfaces_str += ToString(pfaces[base_indices[i].x*5 + 4]) + " ";
-							pfaces_str += ToString(pfaces[base_indices[i].y*5]) + " ";
-							pfaces_str += ToString(pfaces[base_indices[i].y*5 + 1]) + " ";
-							pfaces_str += ToString(pfaces[base_indices[i].y*5 + 2]) + " ";
-							pfaces_str += ToString(pfaces[base_indices[i].y*5 + 3]) + " ";
-							pfaces_str += ToString(pfaces[base_indices[i].y*5 + 4]) + " ";
-							pfaces_str += ToString(pfaces[base_indices[i].z*5]) + " ";
-							pfaces_str += ToString(pfaces[base_indices[i].z*5 + 1]) + " ";
-							pfaces_str += ToString(pfaces[base_indices[i].z*5 + 2]) + " ";
-							pfaces_str += ToString(pfaces[base_indices[i].z*5 + 3]) + " ";
-							pfaces_str += ToString(pfaces[base_indices[i].z*5 + 4]) + " ";
+							size_t corners[3]={ (size_t)base_indices[i].x, (size_t)base_indices[i].y, (size_t)base_indices[i].z };
+							for (size_t c=0; c<3; c++) {
+								for (size_t k=0; k<5; k++) {
+									writer.textInt(pfaces[corners[c]*5 + k]);
+								}
+							}
 						}
 
 						global_index+=sz;
 					}
-
-					TiXmlElement *pFaces = new TiXmlElement("p");
-					TiXmlText *text = new TiXmlText(pfaces_str);
-					pFaces->LinkEndChild(text);
-					trianglesRoot->LinkEndChild(pFaces);
+					writer.endElement();
 				}
 
-				meshRoot->LinkEndChild(trianglesRoot);
+				writer.endElement();
 			}
 		}
 		
-		root->LinkEndChild(geometryRoot);
+		writer.endElement();
+		writer.endElement();
 
 		printf("Finished with geometry...\n");
 	}
 
-	void SonicXNObject::writeDAE(TiXmlElement *root, bool only_bones, float unit_scale) {
+	void SonicXNObject::writeDAE(SonicDAEWriter &writer, bool only_bones, float unit_scale) {
 		printf("Writing bones...\n");
 		
 		// Create bone nodes via recursive method
 		for (size_t i=0; i<bones.size(); i++) {
 			if (bones[i]->parent_index > bones.size()) {
-				writeBonesDAE(root, i, unit_scale);
+				writeBonesDAE(writer, i, unit_scale);
 			}
 		}
 
@@ -1177,205 +1116,174 @@ namespace LibGens {
 
 		printf("Writing node name...\n");
 
-		TiXmlElement *nodeRoot = new TiXmlElement("node");
-		nodeRoot->SetAttribute("id", name);
-		nodeRoot->SetAttribute("sid", name);
-		nodeRoot->SetAttribute("name", name);
+		writer.beginElement("node");
+		writer.attribute("id", name);
+		writer.attribute("sid", name);
+		writer.attribute("name", name);
 
 		if (bones.size()) {
-			TiXmlElement *instance = new TiXmlElement("instance_controller");
-			instance->SetAttribute("url", "#"+name+"-controller");
-			writeMaterialBindDAE(instance);
-			nodeRoot->LinkEndChild(instance);
-			root->LinkEndChild(nodeRoot);
+			writer.beginElement("instance_controller");
+			writer.attribute("url", "#"+name+"-controller");
+			writeMaterialBindDAE(writer);
+			writer.endElement();
+			writer.endElement();
 			return;
 		}
 		
 		printf("Writing instanced geometry with material binds...\n");
-		TiXmlElement *instanceGeometry = new TiXmlElement("instance_geometry");
-		instanceGeometry->SetAttribute("url", "#"+name+"-geometry");
-		writeMaterialBindDAE(instanceGeometry);
-		nodeRoot->LinkEndChild(instanceGeometry);
+		writer.beginElement("instance_geometry");
+		writer.attribute("url", "#"+name+"-geometry");
+		writeMaterialBindDAE(writer);
+		writer.endElement();
 
 		printf("Writing translation matrix...\n");
-		TiXmlElement *matrixNode = new TiXmlElement("matrix");
 		string matrix_str="1.0 0.0 0.0 0.0 0.0 1.0 0.0 0.0 0.0 0.0 1.0 0.0 0.0 0.0 0.0 1.0";
-		TiXmlText *text = new TiXmlText(matrix_str);
-		matrixNode->LinkEndChild(text);
-		nodeRoot->LinkEndChild(matrixNode);
+		writer.element("matrix", matrix_str);
 
-		root->LinkEndChild(nodeRoot);
+		writer.endElement();
 	}
 
-	void SonicXNObject::writeMaterialDAE(TiXmlElement *root) {
-		for (size_t i=0; i<material_tables.size(); i++) {
-			string mat_name = name+ToString(i);
-
-			TiXmlElement *materialNode = new TiXmlElement("material");
-			materialNode->SetAttribute("id", mat_name+"ID");
-			materialNode->SetAttribute("name", mat_name);
-
-
-			TiXmlElement *newElem = new TiXmlElement("instance_effect");
-			newElem->SetAttribute("url", "#"+mat_name+"-effect");
-			materialNode->LinkEndChild(newElem);
-
-			root->LinkEndChild(materialNode);
-		}
-
-		for (size_t i=0; i<old_material_tables.size(); i++) {
-			string mat_name = name+ToString(i);
+	void SonicXNObject::writeMaterialDAE(SonicDAEWriter &writer) {
+		size_t material_count=material_tables.size() + old_material_tables.size();
+		for (size_t m=0; m<material_count; m++) {
+			string mat_name = name;
+			appendDAEIndex(mat_name, m < material_tables.size() ? m : m - material_tables.size());
 
-			TiXmlElement *materialNode = new TiXmlElement("material");
-			materialNode->SetAttribute("id", mat_name+"ID");
-			materialNode->SetAttribute("name", mat_name);
+			writer.beginElement("material");
+			writer.attribute("id", mat_name+"ID");
+			writer.attribute("name", mat_name);
 
 
-			TiXmlElement *newElem = new TiXmlElement("instance_effect");
-			newElem->SetAttribute("url", "#"+mat_name+"-effect");
-			materialNode->LinkEndChild(newElem);
+			writer.beginElement("instance_effect");
+			writer.attribute("url", "#"+mat_name+"-effect");
+			writer.endElement();
 
-			root->LinkEndChild(materialNode);
+			writer.endElement();
 		}
 	}
 
 
-	void SonicXNObject::writeMaterialBindDAE(TiXmlElement *root) {
-		TiXmlElement *bindMaterialRoot = new TiXmlElement("bind_material");
-		TiXmlElement *techniqueRoot = new TiXmlElement("technique_common");
+	void SonicXNObject::writeMaterialBindDAE(SonicDAEWriter &writer) {
+		writer.beginElement("bind_material");
+		writer.beginElement("technique_common");
 	
-		for (size_t i=0; i<material_tables.size(); i++) {
-			string mat_name=name+ToString(i);
-
-			TiXmlElement *instanceMaterial = new TiXmlElement("instance_material");
-			instanceMaterial->SetAttribute("symbol", mat_name);
-			instanceMaterial->SetAttribute("target", "#"+mat_name+"ID");
-			techniqueRoot->LinkEndChild(instanceMaterial);
-		}
-
-		for (size_t i=0; i<old_material_tables.size(); i++) {
-			string mat_name=name+ToString(i);
-
-			TiXmlElement *instanceMaterial = new TiXmlElement("instance_material");
-			instanceMaterial->SetAttribute("symbol", mat_name);
-			instanceMaterial->SetAttribute("target", "#"+mat_name+"ID");
-			techniqueRoot->LinkEndChild(instanceMaterial);
+		size_t material_count=material_tables.size() + old_material_tables.size();
+		for (size_t m=0; m<material_count; m++) {
+			string mat_name=name;
+			appendDAEIndex(mat_name, m < material_tables.size() ? m : m - material_tables.size());
+
+			writer.beginElement("instance_material");
+			writer.attribute("symbol", mat_name);
+			writer.attribute("target", "#"+mat_name+"ID");
+			writer.endElement();
 		}
 	
-		bindMaterialRoot->LinkEndChild(techniqueRoot);
-		root->LinkEndChild(bindMaterialRoot);
+		writer.endElement();
+		writer.endElement();
 	}
 
 
-	void SonicXNObject::writeEffectTextureDAE(TiXmlElement *root, string tex_name) {
-		TiXmlElement *newParam = new TiXmlElement("newparam");
-		newParam->SetAttribute("sid", tex_name+"-image-surface");
+	void SonicXNObject::writeEffectTextureDAE(SonicDAEWriter &writer, string tex_name) {
+		writer.beginElement("newparam");
+		writer.attribute("sid", tex_name+"-image-surface");
 
 		{
-			TiXmlElement *surface = new TiXmlElement("surface");
-			surface->SetAttribute("type", "2D");
+			writer.beginElement("surface");
+			writer.attribute("type", "2D");
 			{
-				TiXmlElement *newElem = new TiXmlElement("init_from");
-				TiXmlText *text = new TiXmlText(tex_name+"-image");
-				newElem->LinkEndChild(text);
-				surface->LinkEndChild(newElem);
+				writer.element("init_from", tex_name+"-image");
 			}
 
-			newParam->LinkEndChild(surface);
+			writer.endElement();
 		}
-		root->LinkEndChild(newParam);
+		writer.endElement();
 
 
-		newParam = new TiXmlElement("newparam");
-		newParam->SetAttribute("sid", tex_name+"-image-sampler");
+		writer.beginElement("newparam");
+		writer.attribute("sid", tex_name+"-image-sampler");
 		{
-			TiXmlElement *sampler = new TiXmlElement("sampler2D");
+			writer.beginElement("sampler2D");
 			{
-				TiXmlElement *newElem = new TiXmlElement("source");
-				TiXmlText *text = new TiXmlText(tex_name+"-image-surface");
-				newElem->LinkEndChild(text);
-				sampler->LinkEndChild(newElem);
+				writer.element("source", tex_name+"-image-surface");
 			}
 
-			newParam->LinkEndChild(sampler);
+			writer.endElement();
 		}
-		root->LinkEndChild(newParam);
+		writer.endElement();
 	}
 
-	void SonicXNObject::writeEffectTechniqueDAE(TiXmlElement *root, string tex_name) {
-		TiXmlElement *techniqueNode = new TiXmlElement("technique");
-		techniqueNode->SetAttribute("sid", "COMMON");
+	void SonicXNObject::writeEffectTechniqueDAE(SonicDAEWriter &writer, string tex_name) {
+		writer.beginElement("technique");
+		writer.attribute("sid", "COMMON");
 
-		TiXmlElement *phongNode = new TiXmlElement("phong");
+		writer.beginElement("phong");
 		{
 			// Diffuse parameter for the first texture
-			TiXmlElement *newElem = new TiXmlElement("diffuse");
-			TiXmlElement *textureElem = new TiXmlElement("texture");
-			textureElem->SetAttribute("texture", tex_name+"-image-sampler");
-			textureElem->SetAttribute("texcoord", "UVSET0");
-
-			TiXmlElement *colorElem = new TiXmlElement("color");
-			TiXmlText *text = new TiXmlText("1.000000 1.000000 1.000000 1");
-			colorElem->LinkEndChild(text);
-
-			newElem->LinkEndChild(textureElem);
-			newElem->LinkEndChild(colorElem);
-			phongNode->LinkEndChild(newElem);
+			writer.beginElement("diffuse");
+			writer.beginElement("texture");
+			writer.attribute("texture", tex_name+"-image-sampler");
+			writer.attribute("texcoord", "UVSET0");
+			writer.endElement();
+
+			writer.element("color", "1.000000 1.000000 1.000000 1");
+			writer.endElement();
 		}
-		techniqueNode->LinkEndChild(phongNode);
+		writer.endElement();
 
-		root->LinkEndChild(techniqueNode);
+		writer.endElement();
 	}
 
-	void SonicXNObject::writeEffectsDAE(TiXmlElement *root, SonicXNTexture *texture) {
+	void SonicXNObject::writeEffectsDAE(SonicDAEWriter &writer, SonicXNTexture *texture) {
 		for (size_t m=0; m<material_tables.size(); m++) {
-			string mat_name = name+ToString(m);
+			string mat_name = name;
+			appendDAEIndex(mat_name, m);
 
-			TiXmlElement *effectNode = new TiXmlElement("effect");
-			effectNode->SetAttribute("id", mat_name+"-effect");
-			effectNode->SetAttribute("name", mat_name+"-effect");
+			writer.beginElement("effect");
+			writer.attribute("id", mat_name+"-effect");
+			writer.attribute("name", mat_name+"-effect");
 
-			TiXmlElement *profileNode = new TiXmlElement("profile_COMMON");
+			writer.beginElement("profile_COMMON");
 			{
 				if (file_mode == MODE_ZNO) {
-					vector<SonicTextureUnitZNO *> texture_units_zno=material_tables[m]->texture_units_zno;
+					vector<SonicTextureUnitZNO *> &texture_units_zno=material_tables[m]->texture_units_zno;
 
 					for (size_t i=0; i<texture_units_zno.size(); i++) {
 						string tex_name=texture->getTexture(texture_units_zno[i]->index);
-						writeEffectTextureDAE(profileNode, tex_name);
+						writeEffectTextureDAE(writer, tex_name);
 					}
 					
 					if (texture_units_zno.size()) {
 						string tex_name=texture->getTexture(texture_units_zno[0]->index);
-						writeEffectTechniqueDAE(profileNode, tex_name);
+						writeEffectTechniqueDAE(writer, tex_name);
 					}
 				}
 				else {
-					vector<SonicTextureUnit *> texture_units=material_tables[m]->texture_units;
+					vector<SonicTextureUnit *> &texture_units=material_tables[m]->texture_units;
 
 					for (size_t i=0; i<texture_units.size(); i++) {
 						string tex_name=texture->getTexture(texture_units[i]->index);
-						writeEffectTextureDAE(profileNode, tex_name);
+						writeEffectTextureDAE(writer, tex_name);
 					}
 
 					if (texture_units.size()) {
 						string tex_name=texture->getTexture(texture_units[0]->index);
-						writeEffectTechniqueDAE(profileNode, tex_name);
+						writeEffectTechniqueDAE(writer, tex_name);
 					}
 				}
 			}
-			effectNode->LinkEndChild(profileNode);
-			root->LinkEndChild(effectNode);
+			writer.endElement();
+			writer.endElement();
 		}
 
 		for (size_t m=0; m<old_material_tables.size(); m++) {
-			string mat_name = name+ToString(m);
+			string mat_name = name;
+			appendDAEIndex(mat_name, m);
 
-			TiXmlElement *effectNode = new TiXmlElement("effect");
-			effectNode->SetAttribute("id", mat_name+"-effect");
-			effectNode->SetAttribute("name", mat_name+"-effect");
+			writer.beginElement("effect");
+			writer.attribute("id", mat_name+"-effect");
+			writer.attribute("name", mat_name+"-effect");
 
-			TiXmlElement *profileNode = new TiXmlElement("profile_COMMON");
+			writer.beginElement("profile_COMMON");
 			{
 				unsigned int texture_unit=old_material_tables[m]->texture_unit;
 				printf("Effect's texture unit is %d...\n", texture_unit);
@@ -1390,257 +1298,184 @@ namespace LibGens {
 				}
 
 				printf("Writing effect's texture with texture name %s...\n", tex_name.c_str());
-				writeEffectTextureDAE(profileNode, tex_name);
+				writeEffectTextureDAE(writer, tex_name);
 
 				printf("Writing effect's technique with texture name %s...\n", tex_name.c_str());
-				writeEffectTechniqueDAE(profileNode, tex_name);
+				writeEffectTechniqueDAE(writer, tex_name);
 			}
-			effectNode->LinkEndChild(profileNode);
-			root->LinkEndChild(effectNode);
+			writer.endElement();
+			writer.endElement();
 		}
 	}
 
 
-	void SonicXNMotion::writeDAE(TiXmlElement *root, SonicXNObject *object, SonicXNBones *bones, float unit_scale) {
+	void SonicXNMotion::writeBoneDAE(SonicDAEWriter &writer, SonicXNPose &pose, SonicXNObject *object, SonicXNBones *bones, size_t bone_index, float unit_scale) {
 		unsigned int frame_length_i=(int)end_frame;
 
-		for (size_t b=0; b<object->bones.size(); b++) {
-			SonicMotionControl *pos_motion_control = getPositionMotionControl(b);
-			SonicMotionControl *rot_motion_control = getAnglesMotionControl(b);
-			SonicMotionControl *pos_x_motion_control = getPositionXMotionControl(b);
-			SonicMotionControl *pos_y_motion_control = getPositionYMotionControl(b);
-			SonicMotionControl *pos_z_motion_control = getPositionZMotionControl(b);
-			SonicMotionControl *rot_x_motion_control = getAngleXMotionControl(b);
-			SonicMotionControl *rot_y_motion_control = getAngleYMotionControl(b);
-			SonicMotionControl *rot_z_motion_control = getAngleZMotionControl(b);
-			SonicMotionControl *rot_beta_x_motion_control = getAngleBetaXMotionControl(b);
-			SonicMotionControl *rot_beta_y_motion_control = getAngleBetaYMotionControl(b);
-			SonicMotionControl *rot_beta_z_motion_control = getAngleBetaZMotionControl(b);
-			SonicMotionControl *sca_x_motion_control = getScaleXMotionControl(b);
-			SonicMotionControl *sca_y_motion_control = getScaleYMotionControl(b);
-			SonicMotionControl *sca_z_motion_control = getScaleZMotionControl(b);
-
-			TiXmlElement *animationNode = new TiXmlElement("animation");
-			string bone_name=object->name+ToString(b);
-			if (bones) bone_name=bones->getName(b);
-
-			animationNode->SetAttribute("id", bone_name+"-anim");
-			animationNode->SetAttribute("name", bone_name);
-
-			TiXmlElement *animationSubNode = new TiXmlElement("animation");
-			{
-				TiXmlElement *matrixAnimationInputNode = new TiXmlElement("source");
-				matrixAnimationInputNode->SetAttribute("id", bone_name+"-Matrix-animation-input");
-				{
-					TiXmlElement *matrixAnimationInputArrayNode = new TiXmlElement("float_array");
-					matrixAnimationInputArrayNode->SetAttribute("id", bone_name+"-Matrix-animation-input-array");
-					matrixAnimationInputArrayNode->SetAttribute("count", frame_length_i);
-					string text="";
-					for (size_t i=0; i<frame_length_i; i++) {
-						text += ToString((float)i/30.0) + " ";
-					}
-					TiXmlText *pValue=new TiXmlText(text);
-					matrixAnimationInputArrayNode->LinkEndChild(pValue);
-					matrixAnimationInputNode->LinkEndChild(matrixAnimationInputArrayNode);
-
-
-					TiXmlElement *techniqueCommonNode = new TiXmlElement("technique_common");
-					TiXmlElement *accessorNode = new TiXmlElement("accessor");
-					accessorNode->SetAttribute("source", "#"+bone_name+"-Matrix-animation-input-array");
-					accessorNode->SetAttribute("count", frame_length_i);
-					TiXmlElement *paramNode = new TiXmlElement("param");
-					paramNode->SetAttribute("name", "TIME");
-					paramNode->SetAttribute("type", "float");
-					accessorNode->LinkEndChild(paramNode);
-					techniqueCommonNode->LinkEndChild(accessorNode);
-					matrixAnimationInputNode->LinkEndChild(techniqueCommonNode);
-				}
-				animationSubNode->LinkEndChild(matrixAnimationInputNode);
-
-				TiXmlElement *matrixAnimationOutputTransformNode = new TiXmlElement("source");
-				matrixAnimationOutputTransformNode->SetAttribute("id", bone_name+"-Matrix-animation-output-transform");
-				{
-					TiXmlElement *matrixAnimationOutputArrayNode = new TiXmlElement("float_array");
-					matrixAnimationOutputArrayNode->SetAttribute("id", bone_name+"-Matrix-animation-output-transform-array");
-					matrixAnimationOutputArrayNode->SetAttribute("count", frame_length_i*16);
-
-					SonicBone *bone=object->bones[b];
-
-					// Set frame initial values
-					Vector3 position = bone->translation;
-					Vector3 scale = bone->scale;
-					Quaternion orientation = bone->orientation;
-
-					Matrix3 mr;
-					float bone_rot_x, bone_rot_y, bone_rot_z;
-					unsigned short rot_x_ref, rot_y_ref, rot_z_ref;
-					unsigned int rotation_flag=object->bones[b]->flag & 3840u;
-
-					bone_rot_x = bone->rotation_x * LIBGENS_MATH_INT32_TO_RAD;
-					bone_rot_y = bone->rotation_y * LIBGENS_MATH_INT32_TO_RAD;
-					bone_rot_z = bone->rotation_z * LIBGENS_MATH_INT32_TO_RAD;
-
-					rot_x_ref = (bone_rot_x / LIBGENS_MATH_PI * 32767.5f);
-					rot_y_ref = (bone_rot_y / LIBGENS_MATH_PI * 32767.5f);
-					rot_z_ref = (bone_rot_z / LIBGENS_MATH_PI * 32767.5f);
-
-					string text="";
-					for (size_t i=0; i<frame_length_i; i++) {
-						float rot_x=bone_rot_x;
-						float rot_y=bone_rot_y;
-						float rot_z=bone_rot_z;
-						
-						if (pos_x_motion_control) position.x = pos_x_motion_control->getFrameValue(i, position.x);
-						if (pos_y_motion_control) position.y = pos_y_motion_control->getFrameValue(i, position.y);
-						if (pos_z_motion_control) position.z = pos_z_motion_control->getFrameValue(i, position.z);
-
-						if (pos_motion_control) {
-							position = pos_motion_control->getFrameVector(i, position);
-						}
-
-						bool update_quaternion=false;
-						if (rot_x_motion_control) {
-							rot_x = rot_x_motion_control->getFrameValue(i, rot_x_ref) / 65535.0f * (LIBGENS_MATH_PI*2);
-							update_quaternion = true;
-						}
+		writer.beginElement("animation");
+		string bone_name;
+		if (bones) bone_name=bones->getName(bone_index);
+		else {
+			bone_name = object->name;
+			appendDAEIndex(bone_name, bone_index);
+		}
 
-						if (rot_y_motion_control) {
-							rot_y = rot_y_motion_control->getFrameValue(i, rot_y_ref) / 65535.0f * (LIBGENS_MATH_PI*2);
-							update_quaternion = true;
-						}
+		writer.attribute("id", bone_name+"-anim");
+		writer.attribute("name", bone_name);
 
-						if (rot_z_motion_control) {
-							rot_z = rot_z_motion_control->getFrameValue(i, rot_z_ref) / 65535.0f * (LIBGENS_MATH_PI*2);
-							update_quaternion = true;
-						}
+		writer.beginElement("animation");
+		{
+			writer.beginElement("source");
+			writer.attribute("id", bone_name+"-Matrix-animation-input");
+			{
+				writer.beginElement("float_array");
+				writer.attribute("id", bone_name+"-Matrix-animation-input-array");
+				writer.attribute("count", frame_length_i);
+				writer.beginText();
+				for (size_t i=0; i<frame_length_i; i++) {
+					writer.textFloat((float)(i/30.0));
+				}
+				writer.endElement();
+
+
+				writer.beginElement("technique_common");
+				writer.beginElement("accessor");
+				writer.attribute("source", "#"+bone_name+"-Matrix-animation-input-array");
+				writer.attribute("count", frame_length_i);
+				writer.beginElement("param");
+				writer.attribute("name", "TIME");
+				writer.attribute("type", "float");
+				writer.endElement();
+				writer.endElement();
+				writer.endElement();
+			}
+			writer.endElement();
 
-						if (rot_beta_x_motion_control) {
-							rot_x = rot_beta_x_motion_control->getFrameValue(i, rot_x_ref) / 65535.0f * (LIBGENS_MATH_PI*2);
-							update_quaternion = true;
-						}
+			writer.beginElement("source");
+			writer.attribute("id", bone_name+"-Matrix-animation-output-transform");
+			{
+				writer.beginElement("float_array");
+				writer.attribute("id", bone_name+"-Matrix-animation-output-transform-array");
+				writer.attribute("count", frame_length_i*16);
 
-						if (rot_beta_y_motion_control) {
-							rot_y = rot_beta_y_motion_control->getFrameValue(i, rot_y_ref) / 65535.0f * (LIBGENS_MATH_PI*2);
-							update_quaternion = true;
-						}
+				writer.beginText();
+				for (size_t i=0; i<frame_length_i; i++) {
+					Matrix4 m=pose.evaluateBone(bone_index, i, unit_scale);
 
-						if (rot_beta_z_motion_control) {
-							rot_z = rot_beta_z_motion_control->getFrameValue(i, rot_z_ref) / 65535.0f * (LIBGENS_MATH_PI*2);
-							update_quaternion = true;
+					for (size_t x=0; x<4; x++) {
+						for (size_t y=0; y<4; y++) {
+							writer.textFloat(m[x][y]);
 						}
+					}
+				}
+				writer.endElement();
+
+
+				writer.beginElement("technique_common");
+				writer.beginElement("accessor");
+				writer.attribute("source", "#"+bone_name+"-Matrix-animation-output-transform-array");
+				writer.attribute("count", frame_length_i);
+				writer.attribute("stride", 16);
+				writer.beginElement("param");
+				writer.attribute("type", "float4x4");
+				writer.endElement();
+				writer.endElement();
+				writer.endElement();
+			}
+			writer.endElement();
 
-						if (rot_motion_control) {
-							Vector3 rotation_vector = rot_motion_control->getFrameVector(i, Vector3(rot_x, rot_y, rot_z));
-							rot_x = rotation_vector.x  / 65535.0f * (LIBGENS_MATH_PI*2);
-							rot_y = rotation_vector.y  / 65535.0f * (LIBGENS_MATH_PI*2);
-							rot_z = rotation_vector.z  / 65535.0f * (LIBGENS_MATH_PI*2);
-							update_quaternion = true;
-						}
-						
-						if (sca_x_motion_control) scale.x    = sca_x_motion_control->getFrameValue(i, scale.x);
-						if (sca_y_motion_control) scale.y    = sca_y_motion_control->getFrameValue(i, scale.y);
-						if (sca_z_motion_control) scale.z    = sca_z_motion_control->getFrameValue(i, scale.z);
-						
-						if (update_quaternion) {
-							if (rotation_flag != 0u) {
-								if (rotation_flag != 256u) {
-									if (rotation_flag != 1024u) mr.fromEulerAnglesZYX(rot_z, rot_y, rot_x);
-									else mr.fromEulerAnglesYXZ(rot_z, rot_y, rot_x);
-								}
-								else mr.fromEulerAnglesYZX(rot_z, rot_y, rot_x);
-							}
-							else mr.fromEulerAnglesZYX(rot_z, rot_y, rot_x);
+			writer.beginElement("source");
+			writer.attribute("id", bone_name+"-Interpolations");
+			{
+				writer.beginElement("Name_array");
+				writer.attribute("id", bone_name+"-Interpolations-array");
+				writer.attribute("count", frame_length_i);
 
-							orientation.fromRotationMatrix(mr);
-						}
-						
-
-						Matrix4 m;
-						m.makeTransform(position*unit_scale, scale, orientation);
-						
-						for (size_t x=0; x<4; x++) {
-							for (size_t y=0; y<4; y++) {
-								text += ToString(m[x][y]) + " ";
-							}
-						}
-					}
+				writer.beginText();
+				for (size_t i=0; i<frame_length_i; i++) {
+					writer.text("LINEAR ");
+				}
+				writer.endElement();
+
+
+				writer.beginElement("technique_common");
+				writer.beginElement("accessor");
+				writer.attribute("source", "#"+bone_name+"-Interpolations-array");
+				writer.attribute("count", frame_length_i);
+				writer.beginElement("param");
+				writer.attribute("type", "name");
+				writer.endElement();
+				writer.endElement();
+				writer.endElement();
+			}
+			writer.endElement();
 
-					TiXmlText *pValue=new TiXmlText(text);
-					matrixAnimationOutputArrayNode->LinkEndChild(pValue);
-					matrixAnimationOutputTransformNode->LinkEndChild(matrixAnimationOutputArrayNode);
-
-
-					TiXmlElement *techniqueCommonNode = new TiXmlElement("technique_common");
-					TiXmlElement *accessorNode = new TiXmlElement("accessor");
-					accessorNode->SetAttribute("source", "#"+bone_name+"-Matrix-animation-output-transform-array");
-					accessorNode->SetAttribute("count", frame_length_i);
-					accessorNode->SetAttribute("stride", 16);
-					TiXmlElement *paramNode = new TiXmlElement("param");
-					paramNode->SetAttribute("type", "float4x4");
-					accessorNode->LinkEndChild(paramNode);
-					techniqueCommonNode->LinkEndChild(accessorNode);
-					matrixAnimationOutputTransformNode->LinkEndChild(techniqueCommonNode);
+			writer.beginElement("sampler");
+			writer.attribute("id", bone_name+"-Matrix-animation-transform");
+			{
+				const char *semantics[3]={ "INPUT", "OUTPUT", "INTERPOLATION" };
+				string sources[3]={ "-Matrix-animation-input", "-Matrix-animation-output-transform", "-Interpolations" };
+
+				for (size_t i=0; i<3; i++) {
+					writer.beginElement("input");
+					writer.attribute("semantic", semantics[i]);
+					writer.attribute("source", "#"+bone_name+sources[i]);
+					writer.endElement();
 				}
-				animationSubNode->LinkEndChild(matrixAnimationOutputTransformNode);
+			}
+			writer.endElement();
 
-				TiXmlElement *interpolationsNode = new TiXmlElement("source");
-				interpolationsNode->SetAttribute("id", bone_name+"-Interpolations");
-				{
-					TiXmlElement *interpolationsArrayNode = new TiXmlElement("Name_array");
-					interpolationsArrayNode->SetAttribute("id", bone_name+"-Interpolations-array");
-					interpolationsArrayNode->SetAttribute("count", frame_length_i);
+			writer.beginElement("channel");
+			writer.attribute("source", "#"+bone_name+"-Matrix-animation-transform");
+			writer.attribute("target", bone_name+"/matrix");
+			writer.endElement();
+		}
+		writer.endElement();
 
-					string text="";
-					for (size_t i=0; i<frame_length_i; i++) {
-						text += "LINEAR ";
-					}
-					TiXmlText *pValue=new TiXmlText(text);
-					interpolationsArrayNode->LinkEndChild(pValue);
-					interpolationsNode->LinkEndChild(interpolationsArrayNode);
-
-
-					TiXmlElement *techniqueCommonNode = new TiXmlElement("technique_common");
-					TiXmlElement *accessorNode = new TiXmlElement("accessor");
-					accessorNode->SetAttribute("source", "#"+bone_name+"-Interpolations-array");
-					accessorNode->SetAttribute("count", frame_length_i);
-					TiXmlElement *paramNode = new TiXmlElement("param");
-					paramNode->SetAttribute("type", "name");
-					accessorNode->LinkEndChild(paramNode);
-					techniqueCommonNode->LinkEndChild(accessorNode);
-					interpolationsNode->LinkEndChild(techniqueCommonNode);
-				}
-				animationSubNode->LinkEndChild(interpolationsNode);
+		writer.endElement();
+	}
 
-				TiXmlElement *matrixAnimationTransformNode = new TiXmlElement("sampler");
-				matrixAnimationTransformNode->SetAttribute("id", bone_name+"-Matrix-animation-transform");
-				{
-					TiXmlElement *input = new TiXmlElement("input");
-					TiXmlElement *output = new TiXmlElement("input");
-					TiXmlElement *interpolation = new TiXmlElement("input");
+	void SonicXNMotion::writeDAE(SonicDAEWriter &writer, SonicXNObject *object, SonicXNBones *bones, float unit_scale, unsigned int thread_count) {
+		size_t bone_count=object->bones.size();
 
-					input->SetAttribute("semantic", "INPUT");
-					output->SetAttribute("semantic", "OUTPUT");
-					interpolation->SetAttribute("semantic", "INTERPOLATION");
+		if (!thread_count) thread_count = std::thread::hardware_concurrency();
+		if (!thread_count) thread_count = 1;
+		thread_count = std::min(thread_count, (unsigned int) bone_count);
 
-					input->SetAttribute("source", "#"+bone_name+"-Matrix-animation-input");
-					output->SetAttribute("source", "#"+bone_name+"-Matrix-animation-output-transform");
-					interpolation->SetAttribute("source", "#"+bone_name+"-Interpolations");
+		// Bones are sampled independently into their own fragments. Poses keep per bone state and
+		// key cursors, so every worker gets its own, created here since they build the bone hierarchy.
+		vector<SonicXNPose *> poses;
+		for (unsigned int t=0; t<thread_count; t++) {
+			poses.push_back(new SonicXNPose(this, object));
+		}
+
+		vector<SonicDAEWriter *> fragments;
+		for (size_t b=0; b<bone_count; b++) {
+			fragments.push_back(new SonicDAEWriter(writer.getDepth()));
+		}
 
-					matrixAnimationTransformNode->LinkEndChild(input);
-					matrixAnimationTransformNode->LinkEndChild(output);
-					matrixAnimationTransformNode->LinkEndChild(interpolation);
+		std::atomic<size_t> next_bone(0);
+		vector<std::thread> threads;
+		for (unsigned int t=0; t<thread_count; t++) {
+			SonicXNPose *pose=poses[t];
+			threads.push_back(std::thread([&, pose]() {
+				for (size_t b=next_bone++; b<bone_count; b=next_bone++) {
+					writeBoneDAE(*fragments[b], *pose, object, bones, b, unit_scale);
 				}
+			}));
+		}
 
-				animationSubNode->LinkEndChild(matrixAnimationTransformNode);
+		for (size_t t=0; t<threads.size(); t++) {
+			threads[t].join();
+		}
 
-				TiXmlElement *channelNode = new TiXmlElement("channel");
-				channelNode->SetAttribute("source", "#"+bone_name+"-Matrix-animation-transform");
-				channelNode->SetAttribute("target", bone_name+"/matrix");
-				animationSubNode->LinkEndChild(channelNode);
-			}
-			animationNode->LinkEndChild(animationSubNode);
+		for (size_t b=0; b<bone_count; b++) {
+			writer.append(*fragments[b]);
+			delete fragments[b];
+		}
 
-			root->LinkEndChild(animationNode);
+		for (size_t t=0; t<poses.size(); t++) {
+			delete poses[t];
 		}
 	}
 }
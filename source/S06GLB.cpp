@@ -0,0 +1,739 @@
+//=========================================================================
+//	  Copyright (c) 2016 SonicGLvl
+//
+//    This file is part of SonicGLvl, a community-created free level editor 
+//    for the PC version of Sonic Generations.
+//
+//    SonicGLvl is free software: you can redistribute it and/or modify
+//    it under the terms of the GNU General Public License as published by
+//    the Free Software Foundation, either version 3 of the License, or
+//    (at your option) any later version.
+//
+//    SonicGLvl is distributed in the hope that it will be useful,
+//    but WITHOUT ANY WARRANTY; without even the implied warranty of
+//    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+//    
+//
+//    Read AUTHORS.txt, LICENSE.txt and COPYRIGHT.txt for more details.
+//=========================================================================
+
+#include "LibGens.h"
+#include "S06Common.h"
+#include "S06XnFile.h"
+
+namespace LibGens {
+	size_t SonicGLBWriter::add(string array, const string &object) {
+		vector<string> &objects=arrays[array];
+		objects.push_back(object);
+		return objects.size()-1;
+	}
+
+	size_t SonicGLBWriter::count(string array) {
+		map<string, vector<string> >::iterator it=arrays.find(array);
+		if (it == arrays.end()) return 0;
+		return it->second.size();
+	}
+
+	size_t SonicGLBWriter::addAccessor(const void *values, size_t count, unsigned int component_type, const char *type, unsigned int target, bool normalized) {
+		size_t component_size=4;
+		if (component_type == LIBGENS_GLB_COMPONENT_UNSIGNED_SHORT) component_size = 2;
+		if (component_type == LIBGENS_GLB_COMPONENT_UNSIGNED_BYTE) component_size = 1;
+
+		size_t components=1;
+		if (!strcmp(type, "VEC2")) components = 2;
+		if (!strcmp(type, "VEC3")) components = 3;
+		if (!strcmp(type, "VEC4")) components = 4;
+		if (!strcmp(type, "MAT4")) components = 16;
+
+		// Every view starts 4 byte aligned, which covers all component types
+		data.resize((data.size() + 3) & ~((size_t) 3), 0);
+		size_t offset=data.size();
+		size_t size=count * components * component_size;
+		data.insert(data.end(), (const unsigned char *) values, (const unsigned char *) values + size);
+
+		string view="{\"buffer\":0,\"byteOffset\":";
+		appendInt(view, offset);
+		view += ",\"byteLength\":";
+		appendInt(view, size);
+		if (target != LIBGENS_GLB_TARGET_NONE) {
+			view += ",\"target\":";
+			appendInt(view, target);
+		}
+		view += "}";
+		size_t view_index=add("bufferViews", view);
+
+		string accessor="{\"bufferView\":";
+		appendInt(accessor, view_index);
+		accessor += ",\"componentType\":";
+		appendInt(accessor, component_type);
+		if (normalized) accessor += ",\"normalized\":true";
+		accessor += ",\"count\":";
+		appendInt(accessor, count);
+		accessor += ",\"type\":\"";
+		accessor += type;
+		accessor += "\"}";
+		return add("accessors", accessor);
+	}
+
+	size_t SonicGLBWriter::addFloatAccessor(const vector<float> &values, const char *type, size_t components, unsigned int target, bool bounds) {
+		size_t count=values.size() / components;
+		size_t index=addAccessor(values.size() ? &values[0] : NULL, count, LIBGENS_GLB_COMPONENT_FLOAT, type, target);
+		if (!bounds || !count) return index;
+
+		// Positions and animation inputs need their bounds declared
+		float min[4], max[4];
+		for (size_t c=0; c<components; c++) {
+			min[c] = max[c] = values[c];
+		}
+
+		for (size_t i=1; i<count; i++) {
+			for (size_t c=0; c<components; c++) {
+				min[c] = std::min(min[c], values[i*components + c]);
+				max[c] = std::max(max[c], values[i*components + c]);
+			}
+		}
+
+		string &accessor=arrays["accessors"][index];
+		accessor.erase(accessor.size()-1);
+		accessor += ",\"min\":";
+		appendFloats(accessor, min, components);
+		accessor += ",\"max\":";
+		appendFloats(accessor, max, components);
+		accessor += "}";
+		return index;
+	}
+
+	static void writeGLBInt32(FILE *file, unsigned int value) {
+		unsigned char bytes[4]={ (unsigned char) value, (unsigned char) (value >> 8), (unsigned char) (value >> 16), (unsigned char) (value >> 24) };
+		fwrite(bytes, 1, 4, file);
+	}
+
+	bool SonicGLBWriter::save(string filename) {
+		string json="{\"asset\":{\"version\":\"2.0\",\"generator\":\"LibS06 - glTF Exporter\"}";
+		if (count("scenes")) json += ",\"scene\":0";
+
+		for (map<string, vector<string> >::iterator it=arrays.begin(); it!=arrays.end(); it++) {
+			json += ",";
+			appendString(json, it->first);
+			json += ":[";
+			for (size_t i=0; i<it->second.size(); i++) {
+				if (i) json += ",";
+				json += it->second[i];
+			}
+			json += "]";
+		}
+
+		data.resize((data.size() + 3) & ~((size_t) 3), 0);
+		if (data.size()) {
+			json += ",\"buffers\":[{\"byteLength\":";
+			appendInt(json, data.size());
+			json += "}]";
+		}
+		json += "}";
+
+		// Chunks are padded to 4 bytes, JSON with spaces and binary data with zeros
+		json.resize((json.size() + 3) & ~((size_t) 3), ' ');
+
+		FILE *file=fopen(filename.c_str(), "wb");
+		if (!file) {
+			Error::addMessage(Error::NULL_REFERENCE, string(LIBGENS_S06_XNFILE_ERROR_MESSAGE_WRITE_GLB_FILE) + filename);
+			return false;
+		}
+
+		size_t total_size=12 + 8 + json.size() + (data.size() ? 8 + data.size() : 0);
+		writeGLBInt32(file, 0x46546C67);
+		writeGLBInt32(file, 2);
+		writeGLBInt32(file, total_size);
+
+		writeGLBInt32(file, json.size());
+		writeGLBInt32(file, 0x4E4F534A);
+		fwrite(json.c_str(), 1, json.size(), file);
+
+		if (data.size()) {
+			writeGLBInt32(file, data.size());
+			writeGLBInt32(file, 0x004E4942);
+			fwrite(&data[0], 1, data.size(), file);
+		}
+
+		fclose(file);
+		return true;
+	}
+
+	void SonicGLBWriter::appendString(string &json, const string &value) {
+		json += "\"";
+		for (size_t i=0; i<value.size(); i++) {
+			unsigned char c=value[i];
+			if ((c == '\"') || (c == '\\')) {
+				json += '\\';
+				json += c;
+			}
+			else if (c < 0x20) {
+				char escape[8];
+				sprintf(escape, "\\u%04x", c);
+				json += escape;
+			}
+			else json += c;
+		}
+		json += "\"";
+	}
+
+	void SonicGLBWriter::appendFloat(string &json, float value) {
+		// JSON has no infinities or NaN
+		if ((value != value) || (value - value != 0.0f)) value = 0.0f;
+
+		char number[LIBGENS_NUMBER_BUFFER_SIZE];
+		json.append(number, SonicNumberFormat::writeFloat(number, value));
+	}
+
+	void SonicGLBWriter::appendInt(string &json, long long value) {
+		char number[LIBGENS_NUMBER_BUFFER_SIZE];
+		json.append(number, SonicNumberFormat::writeInt(number, value));
+	}
+
+	void SonicGLBWriter::appendFloats(string &json, const float *values, size_t count) {
+		json += "[";
+		for (size_t i=0; i<count; i++) {
+			if (i) json += ",";
+			appendFloat(json, values[i]);
+		}
+		json += "]";
+	}
+
+
+	void SonicGLBWriter::decomposeTransform(Matrix4 &m, float *translation, float *rotation, float *scale) {
+		float r[3][3];
+		for (size_t c=0; c<3; c++) {
+			translation[c] = m[c][3];
+			scale[c] = sqrt(m[0][c]*m[0][c] + m[1][c]*m[1][c] + m[2][c]*m[2][c]);
+
+			float inverse_scale=(scale[c] > 0.0f) ? 1.0f / scale[c] : 0.0f;
+			for (size_t x=0; x<3; x++) r[x][c] = m[x][c] * inverse_scale;
+		}
+
+		float trace=r[0][0] + r[1][1] + r[2][2];
+		if (trace > 0.0f) {
+			float s=sqrt(trace + 1.0f) * 2.0f;
+			rotation[3] = 0.25f * s;
+			rotation[0] = (r[2][1] - r[1][2]) / s;
+			rotation[1] = (r[0][2] - r[2][0]) / s;
+			rotation[2] = (r[1][0] - r[0][1]) / s;
+		}
+		else if ((r[0][0] > r[1][1]) && (r[0][0] > r[2][2])) {
+			float s=sqrt(1.0f + r[0][0] - r[1][1] - r[2][2]) * 2.0f;
+			rotation[3] = (r[2][1] - r[1][2]) / s;
+			rotation[0] = 0.25f * s;
+			rotation[1] = (r[0][1] + r[1][0]) / s;
+			rotation[2] = (r[0][2] + r[2][0]) / s;
+		}
+		else if (r[1][1] > r[2][2]) {
+			float s=sqrt(1.0f + r[1][1] - r[0][0] - r[2][2]) * 2.0f;
+			rotation[3] = (r[0][2] - r[2][0]) / s;
+			rotation[0] = (r[0][1] + r[1][0]) / s;
+			rotation[1] = 0.25f * s;
+			rotation[2] = (r[1][2] + r[2][1]) / s;
+		}
+		else {
+			float s=sqrt(1.0f + r[2][2] - r[0][0] - r[1][1]) * 2.0f;
+			rotation[3] = (r[1][0] - r[0][1]) / s;
+			rotation[0] = (r[0][2] + r[2][0]) / s;
+			rotation[1] = (r[1][2] + r[2][1]) / s;
+			rotation[2] = 0.25f * s;
+		}
+
+		float length=sqrt(rotation[0]*rotation[0] + rotation[1]*rotation[1] + rotation[2]*rotation[2] + rotation[3]*rotation[3]);
+		if (length > 0.0f) {
+			for (size_t i=0; i<4; i++) rotation[i] /= length;
+		}
+		else {
+			rotation[0] = rotation[1] = rotation[2] = 0.0f;
+			rotation[3] = 1.0f;
+		}
+	}
+
+	void SonicXNFile::saveGLB(string filename, float unit_scale) {
+		SonicGLBWriter writer;
+
+		SonicXNObject *object=getObject();
+		SonicXNMotion *motion=getMotion();
+
+		vector<string> texture_names=exportTextures(filename);
+
+		if (object) {
+			printf("Writing GLB object...\n");
+			size_t bone_node=object->writeGLB(writer, texture_names, unit_scale);
+
+			if (motion) {
+				printf("Writing GLB motion...\n");
+				motion->writeGLB(writer, object, bone_node, unit_scale);
+			}
+		}
+
+		writer.save(filename);
+	}
+
+
+	size_t SonicXNObject::writeGLB(SonicGLBWriter &writer, vector<string> &texture_names, float unit_scale) {
+		writeMaterialsGLB(writer, texture_names);
+
+		string primitives="";
+		writeMeshesGLB(writer, primitives, unit_scale);
+
+		size_t bone_node=writeBonesGLB(writer, unit_scale);
+
+		string scene="{\"nodes\":[";
+		bool first=true;
+		for (size_t b=0; b<bones.size(); b++) {
+			if (bones[b]->parent_index < bones.size()) continue;
+
+			if (!first) scene += ",";
+			writer.appendInt(scene, bone_node + b);
+			first = false;
+		}
+
+		if (primitives.size()) {
+			string mesh="{\"name\":";
+			writer.appendString(mesh, name);
+			mesh += ",\"primitives\":[" + primitives + "]}";
+			size_t mesh_index=writer.add("meshes", mesh);
+
+			string node="{\"name\":";
+			writer.appendString(node, name);
+			node += ",\"mesh\":";
+			writer.appendInt(node, mesh_index);
+			if (bones.size()) {
+				node += ",\"skin\":";
+				writer.appendInt(node, writer.count("skins")-1);
+			}
+			node += "}";
+
+			if (!first) scene += ",";
+			writer.appendInt(scene, writer.add("nodes", node));
+		}
+
+		scene += "]}";
+		if (bones.size() || primitives.size()) writer.add("scenes", scene);
+		return bone_node;
+	}
+
+	// Relative URI of an exported texture, percent encoding everything but unreserved characters
+	static string textureURIGLB(const string &texture_name) {
+		string uri="textures/";
+		for (size_t i=0; i<texture_name.size(); i++) {
+			unsigned char c=texture_name[i];
+			if (isalnum(c) || (c == '-') || (c == '.') || (c == '_') || (c == '~')) uri += c;
+			else {
+				char escape[4];
+				sprintf(escape, "%%%02X", c);
+				uri += escape;
+			}
+		}
+		return uri;
+	}
+
+	void SonicXNObject::writeMaterialsGLB(SonicGLBWriter &writer, vector<string> &texture_names) {
+		// One texture per texture section entry, so texture unit indices can be used directly
+		if (texture_names.size()) writer.add("samplers", "{\"magFilter\":9729,\"minFilter\":9987}");
+
+		for (size_t i=0; i<texture_names.size(); i++) {
+			string image="{\"uri\":";
+			writer.appendString(image, textureURIGLB(texture_names[i]));
+			image += "}";
+
+			string texture_object="{\"sampler\":0,\"source\":";
+			writer.appendInt(texture_object, writer.add("images", image));
+			texture_object += "}";
+			writer.add("textures", texture_object);
+		}
+
+		// Submeshes index whichever material list the file format uses
+		size_t material_count=material_tables.size() ? material_tables.size() : old_material_tables.size();
+		for (size_t m=0; m<material_count; m++) {
+			int texture_index=-1;
+
+			if (material_tables.size()) {
+				if ((file_mode == MODE_ZNO) && material_tables[m]->texture_units_zno.size()) texture_index = material_tables[m]->texture_units_zno[0]->index;
+				if ((file_mode != MODE_ZNO) && material_tables[m]->texture_units.size()) texture_index = material_tables[m]->texture_units[0]->index;
+			}
+			else texture_index = old_material_tables[m]->texture_unit;
+
+			string material="{\"name\":";
+			writer.appendString(material, name + ToString(m));
+			material += ",\"pbrMetallicRoughness\":{";
+			if ((texture_index >= 0) && ((size_t) texture_index < texture_names.size())) {
+				material += "\"baseColorTexture\":{\"index\":";
+				writer.appendInt(material, texture_index);
+				material += "},";
+			}
+			material += "\"metallicFactor\":0}}";
+			writer.add("materials", material);
+		}
+	}
+
+	// Attribute streams of one primitive's vertices, ready to go into the binary chunk
+	class SonicGLBVertexStreams {
+		public:
+			vector<float> positions;
+			vector<float> normals;
+			vector<float> uvs;
+			vector<float> uvs_2;
+			vector<float> colors;
+			vector<unsigned short> joints;
+			vector<float> weights;
+
+			void addNormal(Vector3 normal) {
+				// glTF requires unit normals
+				float length=normal.length();
+				if (length > 0.0f) normal = normal / length;
+				else normal = Vector3(0.0f, 1.0f, 0.0f);
+
+				normals.push_back(normal.x);
+				normals.push_back(normal.y);
+				normals.push_back(normal.z);
+			}
+
+			void addInfluences(const int *bone_indices, const float *bone_weights, size_t count) {
+				float total=0.0f;
+				for (size_t k=0; k<count; k++) {
+					if (bone_indices[k] >= 0) total += bone_weights[k];
+				}
+
+				for (size_t k=0; k<4; k++) {
+					bool valid=(k < count) && (bone_indices[k] >= 0) && (total > 0.0f);
+					joints.push_back(valid ? bone_indices[k] : 0);
+					weights.push_back(valid ? bone_weights[k] / total : 0.0f);
+				}
+
+				// Unweighted vertices follow the first bone
+				if (total <= 0.0f) weights[weights.size()-4] = 1.0f;
+			}
+
+			string write(SonicGLBWriter &writer) {
+				string attributes="{\"POSITION\":";
+				writer.appendInt(attributes, writer.addFloatAccessor(positions, "VEC3", 3, LIBGENS_GLB_TARGET_ARRAY_BUFFER, true));
+
+				const char *semantics[4]={ "NORMAL", "TEXCOORD_0", "TEXCOORD_1", "COLOR_0" };
+				const char *types[4]={ "VEC3", "VEC2", "VEC2", "VEC4" };
+				size_t components[4]={ 3, 2, 2, 4 };
+				vector<float> *streams[4]={ &normals, &uvs, &uvs_2, &colors };
+
+				for (size_t i=0; i<4; i++) {
+					if (!streams[i]->size()) continue;
+
+					attributes += ",\"";
+					attributes += semantics[i];
+					attributes += "\":";
+					writer.appendInt(attributes, writer.addFloatAccessor(*streams[i], types[i], components[i], LIBGENS_GLB_TARGET_ARRAY_BUFFER));
+				}
+
+				if (joints.size()) {
+					attributes += ",\"JOINTS_0\":";
+					writer.appendInt(attributes, writer.addAccessor(&joints[0], joints.size()/4, LIBGENS_GLB_COMPONENT_UNSIGNED_SHORT, "VEC4", LIBGENS_GLB_TARGET_ARRAY_BUFFER));
+					attributes += ",\"WEIGHTS_0\":";
+					writer.appendInt(attributes, writer.addFloatAccessor(weights, "VEC4", 4, LIBGENS_GLB_TARGET_ARRAY_BUFFER));
+				}
+
+				attributes += "}";
+				return attributes;
+			}
+	};
+
+	static void addGLBPrimitive(SonicGLBWriter &writer, string &primitives, const string &attributes, vector<unsigned int> &indices, unsigned int material_index, size_t material_count) {
+		if (!indices.size()) return;
+
+		string primitive="{\"attributes\":" + attributes + ",\"indices\":";
+		writer.appendInt(primitive, writer.addAccessor(&indices[0], indices.size(), LIBGENS_GLB_COMPONENT_UNSIGNED_INT, "SCALAR", LIBGENS_GLB_TARGET_ELEMENT_ARRAY_BUFFER));
+		if (material_index < material_count) {
+			primitive += ",\"material\":";
+			writer.appendInt(primitive, material_index);
+		}
+		primitive += "}";
+
+		if (primitives.size()) primitives += ",";
+		primitives += primitive;
+	}
+
+	void SonicXNObject::writeMeshesGLB(SonicGLBWriter &writer, string &primitives, float unit_scale) {
+		size_t material_count=material_tables.size() ? material_tables.size() : old_material_tables.size();
+		bool skinned=(bones.size() > 0);
+
+		vector<int> matrix_to_bone;
+		buildMatrixToBone(matrix_to_bone);
+
+		// XNO and ZNO: the vertex tables are shared by the submeshes that use them, so their
+		// attributes are written once and only the indices are per primitive
+		vector<string> table_attributes(vertex_tables.size());
+		for (size_t i=0; i<vertex_tables.size(); i++) {
+			vector<SonicVertex *> &vertices=vertex_tables[i]->vertices;
+			vector<unsigned int> &bone_table=vertex_tables[i]->bone_table;
+			if (!vertices.size()) continue;
+
+			SonicGLBVertexStreams streams;
+			for (size_t v=0; v<vertices.size(); v++) {
+				SonicVertex *vertex=vertices[v];
+				Color color(vertex->rgba);
+
+				float position[3]={ vertex->position.x * unit_scale, vertex->position.y * unit_scale, vertex->position.z * unit_scale };
+				float uv[2]={ vertex->uv[0].x, vertex->uv[0].y };
+				float uv_2[2]={ vertex->uv[1].x, vertex->uv[1].y };
+				float rgba[4]={ color.r, color.g, color.b, color.a };
+
+				streams.positions.insert(streams.positions.end(), position, position+3);
+				streams.addNormal(vertex->normal);
+				streams.uvs.insert(streams.uvs.end(), uv, uv+2);
+				streams.uvs_2.insert(streams.uvs_2.end(), uv_2, uv_2+2);
+				streams.colors.insert(streams.colors.end(), rgba, rgba+4);
+
+				if (skinned) {
+					int bone_indices[4]={ 0, -1, -1, -1 };
+					float bone_weights[4]={ 1.0f, 0.0f, 0.0f, 0.0f };
+
+					if (bone_table.size()) {
+						for (size_t k=0; k<4; k++) {
+							bone_indices[k] = -1;
+							bone_weights[k] = vertex->bone_weights_f[k];
+							if ((bone_weights[k] > 0.0f) && (vertex->bone_indices[k] < bone_table.size()) && (bone_table[vertex->bone_indices[k]] < matrix_to_bone.size())) {
+								bone_indices[k] = matrix_to_bone[bone_table[vertex->bone_indices[k]]];
+							}
+						}
+					}
+
+					streams.addInfluences(bone_indices, bone_weights, 4);
+				}
+			}
+
+			table_attributes[i] = streams.write(writer);
+		}
+
+		for (size_t m=0; m<meshes.size(); m++) {
+			for (size_t s=0; s<meshes[m]->submeshes.size(); s++) {
+				SonicSubmesh *submesh=meshes[m]->submeshes[s];
+
+				if (file_mode == MODE_GNO) {
+					if ((submesh->vertex_index >= vertex_resource_tables.size()) || (submesh->indices_index >= polygon_tables.size())) continue;
+
+					// GNO points index each attribute separately, so every distinct combination becomes a vertex
+					SonicVertexResourceTable *table=vertex_resource_tables[submesh->vertex_index];
+					vector<SonicPolygon *> &faces=polygon_tables[submesh->indices_index]->faces;
+
+					std::unordered_map<string, unsigned int> point_indices;
+					SonicGLBVertexStreams streams;
+					vector<unsigned int> indices;
+
+					for (size_t f=0; f<faces.size(); f++) {
+						SonicPolygonPoint *points=faces[f]->points;
+						if ((points[0].position_index >= table->positions.size()) || (points[1].position_index >= table->positions.size()) || (points[2].position_index >= table->positions.size())) continue;
+
+						for (size_t p=0; p<3; p++) {
+							SonicPolygonPoint &point=points[p];
+
+							unsigned short key_values[5]={ point.position_index, point.normal_index, point.uv_index, point.uv2_index, point.color_index };
+							string key((const char *) key_values, sizeof(key_values));
+
+							std::pair<std::unordered_map<string, unsigned int>::iterator, bool> result=point_indices.insert(std::make_pair(key, (unsigned int) (streams.positions.size()/3)));
+							indices.push_back(result.first->second);
+							if (!result.second) continue;
+
+							Vector3 position=table->positions[point.position_index] * unit_scale;
+							streams.positions.push_back(position.x);
+							streams.positions.push_back(position.y);
+							streams.positions.push_back(position.z);
+
+							if (table->normals.size()) {
+								streams.addNormal((point.normal_index < table->normals.size()) ? table->normals[point.normal_index] : Vector3(1.0f, 0.0f, 0.0f));
+							}
+
+							if (table->uvs.size()) {
+								Vector2 uv=(point.uv_index < table->uvs.size()) ? table->uvs[point.uv_index] : Vector2();
+								streams.uvs.push_back(uv.x);
+								streams.uvs.push_back(uv.y);
+							}
+
+							if (table->uvs_2.size()) {
+								Vector2 uv=(point.uv2_index < table->uvs_2.size()) ? table->uvs_2[point.uv2_index] : Vector2();
+								streams.uvs_2.push_back(uv.x);
+								streams.uvs_2.push_back(uv.y);
+							}
+
+							if (table->colors.size()) {
+								Color color=(point.color_index < table->colors.size()) ? table->colors[point.color_index] : Color(1.0, 1.0, 1.0, 1.0);
+								streams.colors.push_back(color.r);
+								streams.colors.push_back(color.g);
+								streams.colors.push_back(color.b);
+								streams.colors.push_back(color.a);
+							}
+
+							if (skinned) {
+								// Blended vertices use their bone data, the rest follow the submesh's matrix
+								int bone_indices[2]={ matrix_to_bone[submesh->matrix_index & 0xFFFF], -1 };
+								float bone_weights[2]={ 1.0f, 0.0f };
+
+								if (point.position_index < table->bones.size()) {
+									SonicVertexBoneData &bone_data=table->bones[point.position_index];
+									bone_indices[0] = matrix_to_bone[bone_data.bone_1];
+									bone_indices[1] = matrix_to_bone[bone_data.bone_2];
+									bone_weights[0] = bone_data.weight / 16384.0f;
+									bone_weights[1] = 1.0f - bone_weights[0];
+								}
+
+								streams.addInfluences(bone_indices, bone_weights, 2);
+							}
+						}
+					}
+
+					if (!streams.positions.size()) continue;
+					addGLBPrimitive(writer, primitives, streams.write(writer), indices, submesh->material_index, material_count);
+				}
+				else {
+					if ((submesh->vertex_index >= vertex_tables.size()) || (submesh->indices_index >= index_tables.size())) continue;
+					if (!table_attributes[submesh->vertex_index].size()) continue;
+
+					size_t vertex_count=vertex_tables[submesh->vertex_index]->vertices.size();
+					vector<Vector3> &indices_vector=index_tables[submesh->indices_index]->indices_vector;
+					vector<unsigned int> indices;
+					indices.reserve(indices_vector.size()*3);
+
+					for (size_t i=0; i<indices_vector.size(); i++) {
+						unsigned int face[3]={ (unsigned int) indices_vector[i].x, (unsigned int) indices_vector[i].y, (unsigned int) indices_vector[i].z };
+						if ((face[0] >= vertex_count) || (face[1] >= vertex_count) || (face[2] >= vertex_count)) continue;
+						indices.insert(indices.end(), face, face+3);
+					}
+
+					addGLBPrimitive(writer, primitives, table_attributes[submesh->vertex_index], indices, submesh->material_index, material_count);
+				}
+			}
+		}
+	}
+
+	size_t SonicXNObject::writeBonesGLB(SonicGLBWriter &writer, float unit_scale) {
+		size_t bone_node=writer.count("nodes");
+		if (!bones.size()) return bone_node;
+
+		vector< vector<size_t> > children(bones.size());
+		for (size_t b=0; b<bones.size(); b++) {
+			unsigned short parent=bones[b]->parent_index;
+			if ((parent < bones.size()) && (parent != b)) children[parent].push_back(b);
+		}
+
+		string joints="";
+		vector<float> inverse_bind_matrices;
+		inverse_bind_matrices.reserve(bones.size()*16);
+
+		for (size_t b=0; b<bones.size(); b++) {
+			SonicBone *bone=bones[b];
+			string bone_name=(bones_names ? bones_names->getName(b) : name+ToString(b));
+
+			float translation[3]={ bone->translation.x * unit_scale, bone->translation.y * unit_scale, bone->translation.z * unit_scale };
+			float rotation[4]={ bone->orientation.x, bone->orientation.y, bone->orientation.z, bone->orientation.w };
+			float scale[3]={ bone->scale.x, bone->scale.y, bone->scale.z };
+
+			string node="{\"name\":";
+			writer.appendString(node, bone_name);
+			node += ",\"translation\":";
+			writer.appendFloats(node, translation, 3);
+			node += ",\"rotation\":";
+			writer.appendFloats(node, rotation, 4);
+			node += ",\"scale\":";
+			writer.appendFloats(node, scale, 3);
+			if (children[b].size()) {
+				node += ",\"children\":[";
+				for (size_t c=0; c<children[b].size(); c++) {
+					if (c) node += ",";
+					writer.appendInt(node, bone_node + children[b][c]);
+				}
+				node += "]";
+			}
+			node += "}";
+			writer.add("nodes", node);
+
+			if (b) joints += ",";
+			writer.appendInt(joints, bone_node + b);
+
+			// Bones store the inverse bind matrix transposed, glTF wants it column major
+			Matrix4 m=bone->matrix.transpose();
+			for (size_t c=0; c<4; c++) {
+				for (size_t r=0; r<4; r++) {
+					inverse_bind_matrices.push_back(((c == 3) && (r < 3)) ? m[r][c] * unit_scale : m[r][c]);
+				}
+			}
+		}
+
+		string skin="{\"inverseBindMatrices\":";
+		writer.appendInt(skin, writer.addFloatAccessor(inverse_bind_matrices, "MAT4", 16, LIBGENS_GLB_TARGET_NONE));
+		skin += ",\"joints\":[" + joints + "]}";
+		writer.add("skins", skin);
+		return bone_node;
+	}
+
+	void SonicXNMotion::writeGLB(SonicGLBWriter &writer, SonicXNObject *object, size_t bone_node, float unit_scale) {
+		size_t bone_count=object->bones.size();
+		if (!bone_count) return;
+
+		float frame_rate=(fps > 0.0f) ? fps : 30.0f;
+		size_t frame_count=(end_frame > 0.0f) ? (size_t) end_frame + 1 : 1;
+
+		vector<float> times(frame_count);
+		for (size_t i=0; i<frame_count; i++) {
+			times[i] = i / frame_rate;
+		}
+		size_t input=writer.addFloatAccessor(times, "SCALAR", 1, LIBGENS_GLB_TARGET_NONE, true);
+
+		SonicXNPose pose(this, object);
+
+		string samplers="";
+		string channels="";
+		const char *paths[3]={ "translation", "rotation", "scale" };
+		const char *types[3]={ "VEC3", "VEC4", "VEC3" };
+		size_t components[3]={ 3, 4, 3 };
+
+		for (size_t b=0; b<bone_count; b++) {
+			vector<float> outputs[3];
+			for (size_t c=0; c<3; c++) {
+				outputs[c].reserve(frame_count * components[c]);
+			}
+
+			for (size_t i=0; i<frame_count; i++) {
+				Matrix4 m=pose.evaluateBone(b, i, unit_scale);
+
+				float translation[3], rotation[4], scale[3];
+				SonicGLBWriter::decomposeTransform(m, translation, rotation, scale);
+
+				// Keep consecutive quaternions in the same hemisphere so linear interpolation takes the short way
+				if (i) {
+					float *previous=&outputs[1][outputs[1].size()-4];
+					if (previous[0]*rotation[0] + previous[1]*rotation[1] + previous[2]*rotation[2] + previous[3]*rotation[3] < 0.0f) {
+						for (size_t k=0; k<4; k++) rotation[k] = -rotation[k];
+					}
+				}
+
+				outputs[0].insert(outputs[0].end(), translation, translation+3);
+				outputs[1].insert(outputs[1].end(), rotation, rotation+4);
+				outputs[2].insert(outputs[2].end(), scale, scale+3);
+			}
+
+			for (size_t c=0; c<3; c++) {
+				size_t sampler_index=b*3 + c;
+
+				if (sampler_index) samplers += ",";
+				samplers += "{\"input\":";
+				writer.appendInt(samplers, input);
+				samplers += ",\"interpolation\":\"LINEAR\",\"output\":";
+				writer.appendInt(samplers, writer.addFloatAccessor(outputs[c], types[c], components[c], LIBGENS_GLB_TARGET_NONE));
+				samplers += "}";
+
+				if (sampler_index) channels += ",";
+				channels += "{\"sampler\":";
+				writer.appendInt(channels, sampler_index);
+				channels += ",\"target\":{\"node\":";
+				writer.appendInt(channels, bone_node + b);
+				channels += ",\"path\":\"";
+				channels += paths[c];
+				channels += "\"}}";
+			}
+		}
+
+		string animation="{\"name\":";
+		writer.appendString(animation, object->name);
+		animation += ",\"samplers\":[" + samplers + "],\"channels\":[" + channels + "]}";
+		writer.add("animations", animation);
+	}
+}
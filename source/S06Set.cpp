@@ -18,6 +18,8 @@
 //=========================================================================
 
 #include "LibGens.h"
+#include <algorithm>
+#include <unordered_set>
 #include "S06Set.h"
 
 namespace LibGens {
@@ -30,15 +32,32 @@ namespace LibGens {
 		}
 	}
 
-	SonicSetObjectParameter::SonicSetObjectParameter(SonicSetObjectParameter *clone) {
-		value_f = clone->value_f;
-		value_s = clone->value_s;
-		value_i = clone->value_i;
-		value_v = clone->value_v;
-		type    = clone->type;
+	size_t SonicSetParameterPool::append(SonicSetParameterPool *source, size_t start, size_t count) {
+		size_t destination=allocate(count);
+
+		for (size_t i=0; i<count; i++) {
+			SonicSetObjectParameter &parameter=parameters[destination + i];
+			parameter = source->parameters[start + i];
+
+			if ((source != this) && (parameter.type == LIBGENS_S06_SET_PARAMETER_STRING)) {
+				parameter.value_s = internString(source->strings[parameter.value_s]);
+			}
+		}
+
+		return destination;
 	}
 
-	void SonicSetObjectParameter::read(File *file) {
+	unsigned int SonicSetParameterPool::internString(const string &value) {
+		unordered_map<string, unsigned int>::iterator it=string_ids.find(value);
+		if (it != string_ids.end()) return it->second;
+
+		unsigned int index=strings.size();
+		strings.push_back(value);
+		string_ids[value] = index;
+		return index;
+	}
+
+	void SonicSetObjectParameter::read(File *file, SonicSetParameterPool *pool) {
 		if (!file) {
 			Error::addMessage(Error::NULL_REFERENCE, LIBGENS_S06_SET_ERROR_MESSAGE_NULL_FILE);
 			return;
@@ -68,11 +87,18 @@ namespace LibGens {
 			file->readInt32BEA(&address);
 			file->readInt32BE(&total);
 			file->goToAddress(address);
-			file->readString(&value_s);
+
+			string value;
+			file->readString(&value);
+			value_s = pool->internString(value);
 		}
 		// Vector3
 		else if (type == 4) {
-			value_v.read(file);
+			Vector3 value;
+			value.read(file);
+			value_v[0] = value.x;
+			value_v[1] = value.y;
+			value_v[2] = value.z;
 		}
 		// Target another object
 		else if (type == 6) {
@@ -81,7 +107,7 @@ namespace LibGens {
 	}
 
 	
-	void SonicSetObjectParameter::write(File *file, SonicStringTable *string_table) {
+	void SonicSetObjectParameter::write(File *file, SonicStringTable *string_table, SonicSetParameterPool *pool) {
 		if (!file) {
 			Error::addMessage(Error::NULL_REFERENCE, LIBGENS_S06_SET_ERROR_MESSAGE_WRITE_NULL_FILE);
 			return;
@@ -103,15 +129,17 @@ namespace LibGens {
 			file->writeNull(12);
 		}
 		else if (type == 3) {
-			string_table->writeString(file, value_s);
+			const string &value=pool->getString(value_s);
+			string_table->writeString(file, value);
 			unsigned int total=1;
-			unsigned int size=value_s.size()+1;
+			unsigned int size=value.size()+1;
 			file->writeInt32BE(&total);
 			file->writeNull(4);
 			file->writeInt32BE(&size);
 		}
 		else if (type == 4) {
-			value_v.write(file);
+			Vector3 value(value_v[0], value_v[1], value_v[2]);
+			value.write(file);
 			file->writeNull(4);
 		}
 		else if (type == 6) {
@@ -129,14 +157,39 @@ namespace LibGens {
 		unknown = clone->unknown;
 		unknown_2 = clone->unknown_2;
 
-		for (size_t i=0; i<clone->parameters.size(); i++) {
-			SonicSetObjectParameter *parameter = new SonicSetObjectParameter(clone->parameters[i]);
-			parameters.push_back(parameter);
+		// Clones start outside of any set, with their own copy of the parameters
+		owned_pool = new SonicSetParameterPool();
+		parameter_pool = owned_pool;
+		parameter_count = clone->parameter_pool ? clone->parameter_count : 0;
+		parameter_start = parameter_count ? owned_pool->append(clone->parameter_pool, clone->parameter_start, parameter_count) : 0;
+	}
+
+	void SonicSetObject::setParameterPool(SonicSetParameterPool *pool) {
+		if (pool == parameter_pool) return;
+
+		if (parameter_count) {
+			parameter_start = pool->append(parameter_pool, parameter_start, parameter_count);
+		}
+		parameter_pool = pool;
+
+		if (owned_pool) {
+			delete owned_pool;
+			owned_pool = NULL;
+		}
+	}
+
+	void SonicSetObject::detachParameters() {
+		if (owned_pool) return;
+
+		owned_pool = new SonicSetParameterPool();
+		if (parameter_count) {
+			parameter_start = owned_pool->append(parameter_pool, parameter_start, parameter_count);
 		}
+		parameter_pool = owned_pool;
 	}
 
 	
-	void SonicSetObject::read(File *file) {
+	void SonicSetObject::read(File *file, SonicSetParameterPool *pool) {
 		if (!file) {
 			Error::addMessage(Error::NULL_REFERENCE, LIBGENS_S06_SET_ERROR_MESSAGE_NULL_FILE);
 			return;
@@ -176,12 +229,13 @@ namespace LibGens {
 
 		}
 
+		parameter_pool = pool;
+		parameter_start = pool->allocate(parameter_total);
+		parameter_count = parameter_total;
+
 		for (size_t i=0; i<parameter_total; i++) {
 			file->goToAddress(parameter_address + i*20);
-
-			SonicSetObjectParameter *parameter = new SonicSetObjectParameter();
-			parameter->read(file);
-			parameters.push_back(parameter);
+			pool->getParameter(parameter_start + i)->read(file, pool);
 		}
 	}
 
@@ -203,7 +257,7 @@ namespace LibGens {
 		position.write(file);
 		file->writeFloat32BE(&unknown_2);
 		rotation.write(file);
-		unsigned int parameter_total=parameters.size();
+		unsigned int parameter_total=parameter_count;
 		file->writeInt32BE(&parameter_total);
 		file->writeNull(4);
 	}
@@ -216,7 +270,7 @@ namespace LibGens {
 
 		file->goToAddress(file_address+60);
 
-		if (parameters.size() > 0) {
+		if (parameter_count > 0) {
 			file->writeInt32BEA(&parameter_address);
 		}
 	}
@@ -338,10 +392,12 @@ namespace LibGens {
 		for (size_t i=0; i<object_total; i++) {
 			file->goToAddress(object_address + i*64);
 			SonicSetObject *object=new SonicSetObject();
-			object->read(file);
+			object->read(file, &parameter_pool);
 			objects.push_back(object);
 		}
 
+		index.build(objects);
+		reindexObjects();
 
 		for (size_t i=0; i<group_total; i++) {
 			file->goToAddress(group_address + i*16);
@@ -400,10 +456,10 @@ namespace LibGens {
 		size_t object_table_address=file->getCurrentAddress();
 		for (size_t i=0; i<object_total; i++) objects[i]->write(file, &string_table);
 		for (size_t i=0; i<object_total; i++) {
-			vector<SonicSetObjectParameter *> parameters=objects[i]->getParameters();
+			SonicSetParameterSpan parameters=objects[i]->getParameters();
 			objects[i]->setAddress(file->getCurrentAddress());
 			for (size_t j=0; j<parameters.size(); j++) {
-				parameters[j]->write(file, &string_table);
+				parameters[j].write(file, &string_table, &parameter_pool);
 			}
 		}
 		for (size_t i=0; i<object_total; i++) objects[i]->writeFixed(file);
@@ -442,29 +498,167 @@ namespace LibGens {
 		file->writeInt32BE(&table_size);
 	}
 
-	void SonicSet::fixDuplicateNames() {
+	static bool eraseObject(vector<SonicSetObject *> &bucket, SonicSetObject *object) {
+		vector<SonicSetObject *>::iterator it=std::find(bucket.begin(), bucket.end(), object);
+		if (it == bucket.end()) return false;
+
+		bucket.erase(it);
+		return true;
+	}
+
+	void SonicSet::indexObject(SonicSetObject *object) {
+		string type=object->getType();
+		unordered_map<string, size_t>::iterator it=type_ids.find(type);
+
+		size_t type_id=0;
+		if (it == type_ids.end()) {
+			type_id = type_names.size();
+			type_ids[type] = type_id;
+			type_names.push_back(type);
+			type_objects.push_back(vector<SonicSetObject *>());
+		}
+		else {
+			type_id = it->second;
+		}
+
+		type_objects[type_id].push_back(object);
+		name_objects[object->getName()].push_back(object);
+	}
+
+	void SonicSet::unindexObject(SonicSetObject *object) {
+		unordered_map<string, size_t>::iterator type_it=type_ids.find(object->getType());
+		if (type_it != type_ids.end()) {
+			eraseObject(type_objects[type_it->second], object);
+		}
+
+		unordered_map<string, vector<SonicSetObject *> >::iterator name_it=name_objects.find(object->getName());
+		if (name_it != name_objects.end()) {
+			eraseObject(name_it->second, object);
+			if (name_it->second.empty()) name_objects.erase(name_it);
+		}
+	}
+
+	void SonicSet::reindexObjects() {
+		for (size_t i=0; i<type_objects.size(); i++) {
+			type_objects[i].clear();
+		}
+		name_objects.clear();
+
+		for (size_t i=0; i<objects.size(); i++) {
+			indexObject(objects[i]);
+		}
+	}
+
+	const vector<SonicSetObject *> &SonicSet::getObjectsByType(string type) {
+		static const vector<SonicSetObject *> empty;
+
+		unordered_map<string, size_t>::iterator it=type_ids.find(type);
+		return (it != type_ids.end()) ? type_objects[it->second] : empty;
+	}
+
+	const vector<SonicSetObject *> &SonicSet::getObjectsByName(string name) {
+		static const vector<SonicSetObject *> empty;
+
+		unordered_map<string, vector<SonicSetObject *> >::iterator it=name_objects.find(name);
+		return (it != name_objects.end()) ? it->second : empty;
+	}
+
+	SonicSetObject *SonicSet::getObject(string name) {
+		unordered_map<string, vector<SonicSetObject *> >::iterator it=name_objects.find(name);
+		return (it != name_objects.end()) ? it->second.front() : NULL;
+	}
+
+	void SonicSet::renameObject(SonicSetObject *object, string name) {
+		if (!object) return;
+
+		bool indexed=false;
+		unordered_map<string, vector<SonicSetObject *> >::iterator it=name_objects.find(object->getName());
+		if (it != name_objects.end()) {
+			indexed = eraseObject(it->second, object);
+			if (it->second.empty()) name_objects.erase(it);
+		}
+
+		object->setName(name);
+		if (indexed) name_objects[name].push_back(object);
+	}
+
+	void SonicSet::removeObject(SonicSetObject *object) {
+		vector<SonicSetObject *>::iterator it=std::find(objects.begin(), objects.end(), object);
+		if (it == objects.end()) return;
+
+		objects.erase(it);
+		index.remove(object);
+		unindexObject(object);
+		object->detachParameters();
+		compactParameters();
+	}
+
+	void SonicSet::removeObjects(const vector<SonicSetObject *> &remove_objects) {
+		unordered_set<SonicSetObject *> removed(remove_objects.begin(), remove_objects.end());
+		size_t count=0;
+
 		for (size_t i=0; i<objects.size(); i++) {
-			bool found=true;
-			string object_name = objects[i]->getName();
-			size_t index = 0;
-
-			while (found) {
-				found = false;
-				for (size_t j=0; j<i; j++) {
-					if (objects[j]->getName() == object_name) {
-						found = true;
-						break;
-					}
-				}
-
-				if (!found) {
-					objects[i]->setName(object_name);
-				}
-				else {
-					object_name = objects[i]->getType() + ToString(index);
-					index++;
-				}
+			SonicSetObject *object=objects[i];
+			if (removed.count(object)) {
+				index.remove(object);
+				object->detachParameters();
 			}
+			else objects[count++] = object;
 		}
+
+		objects.resize(count);
+		reindexObjects();
+		compactParameters();
+	}
+
+	void SonicSet::compactParameters() {
+		size_t used=0;
+		for (size_t i=0; i<objects.size(); i++) {
+			used += objects[i]->parameter_count;
+		}
+
+		// Rebuilding is linear in the pool, so wait until half of it is unused to keep removals amortized
+		if (parameter_pool.size() <= used*2) return;
+
+		SonicSetParameterPool compacted;
+
+		vector<size_t> starts(objects.size(), 0);
+		for (size_t i=0; i<objects.size(); i++) {
+			SonicSetObject *object=objects[i];
+			if (object->parameter_count) starts[i] = compacted.append(&parameter_pool, object->parameter_start, object->parameter_count);
+		}
+
+		parameter_pool.swap(compacted);
+		for (size_t i=0; i<objects.size(); i++) {
+			objects[i]->parameter_start = starts[i];
+		}
+	}
+
+	void SonicSet::fixDuplicateNames() {
+		// Each object keeps its name unless an earlier object already uses it, then it takes the first
+		// free type name. Taken names only accumulate, so each type's counter resumes where it stopped.
+		unordered_set<string> taken;
+		taken.reserve(objects.size() * 2);
+		vector<size_t> type_counters(type_names.size(), 0);
+		bool renamed=false;
+
+		for (size_t i=0; i<objects.size(); i++) {
+			SonicSetObject *object=objects[i];
+			if (taken.insert(object->getName()).second) continue;
+
+			string type=object->getType();
+			size_t type_id=type_ids[type];
+			string object_name;
+
+			do {
+				object_name = type + ToString(type_counters[type_id]);
+				type_counters[type_id]++;
+			} while (!taken.insert(object_name).second);
+
+			object->setName(object_name);
+			renamed = true;
+		}
+
+		if (renamed) reindexObjects();
 	}
 };
\ No newline at end of file
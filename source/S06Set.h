@@ -20,6 +20,7 @@
 #pragma once
 
 #include "S06Common.h"
+#include <unordered_map>
 
 #define LIBGENS_S06_SET_ERROR_MESSAGE_NULL_FILE       "Trying to read set data from unreferenced file."
 #define LIBGENS_S06_SET_ERROR_MESSAGE_WRITE_NULL_FILE "Trying to write set data to an unreferenced file."
@@ -35,26 +36,34 @@
 #define LIBGENS_S06_SET_PARAMETER_VECTOR3             4
 #define LIBGENS_S06_SET_PARAMETER_ID                  6
 
+#define LIBGENS_S06_SET_INDEX_DEFAULT_MARGIN          10.0f
+
 
 namespace LibGens {
+	class SonicSetParameterPool;
+	class SonicSet;
+
+	// Parameters are stored by value in their set's pool, strings by their index in the pool's string table
 	class SonicSetObjectParameter {
-		friend SonicSetObjectParameter;
+		friend SonicSetParameterPool;
 
 		protected:
 			unsigned int type;
-			float value_f;
-			string value_s;
-			unsigned int value_i;
-			Vector3 value_v;
+			union {
+				unsigned int value_i;
+				float value_f;
+				unsigned int value_s;
+				float value_v[3];
+			};
 		public:
 			SonicSetObjectParameter() {
+				type = 0;
+				value_v[0] = value_v[1] = value_v[2] = 0.0f;
 			}
 
-			SonicSetObjectParameter(SonicSetObjectParameter *clone);
-
-			void read(File *file);
+			void read(File *file, SonicSetParameterPool *pool);
 
-			void write(File *file, SonicStringTable *string_table);
+			void write(File *file, SonicStringTable *string_table, SonicSetParameterPool *pool);
 
 			unsigned int getType() {
 				return type;
@@ -72,7 +81,7 @@ namespace LibGens {
 				return value_f;
 			}
 
-			string getValueString() {
+			unsigned int getValueStringIndex() {
 				return value_s;
 			}
 
@@ -81,12 +90,99 @@ namespace LibGens {
 			}
 
 			Vector3 getValueVector() {
-				return value_v;
+				return Vector3(value_v[0], value_v[1], value_v[2]);
+			}
+	};
+
+	// Flat parameter storage shared by all objects of a set. Objects only hold a range into it. Removed
+	// objects take their range with them, and the set compacts the pool once most of it is unused.
+	class SonicSetParameterPool {
+		protected:
+			vector<SonicSetObjectParameter> parameters;
+			vector<string> strings;
+			unordered_map<string, unsigned int> string_ids;
+		public:
+			SonicSetParameterPool() {
+			}
+
+			size_t allocate(size_t count) {
+				size_t start=parameters.size();
+				parameters.resize(start + count);
+				return start;
+			}
+
+			// Appends a copy of a range from this pool or another one, returns where it starts
+			size_t append(SonicSetParameterPool *source, size_t start, size_t count);
+
+			SonicSetObjectParameter *getParameter(size_t index) {
+				return &parameters[index];
+			}
+
+			unsigned int internString(const string &value);
+
+			const string &getString(unsigned int index) {
+				return strings[index];
+			}
+
+			size_t size() {
+				return parameters.size();
+			}
+
+			void clear() {
+				parameters.clear();
+				strings.clear();
+				string_ids.clear();
+			}
+
+			void swap(SonicSetParameterPool &other) {
+				parameters.swap(other.parameters);
+				strings.swap(other.strings);
+				string_ids.swap(other.string_ids);
+			}
+	};
+
+	// View of an object's parameters. Adding objects to a set or removing them can move every parameter
+	// of that set, so take a new span afterwards instead of keeping one around.
+	class SonicSetParameterSpan {
+		protected:
+			SonicSetObjectParameter *data;
+			size_t count;
+			SonicSetParameterPool *pool;
+		public:
+			SonicSetParameterSpan(SonicSetObjectParameter *data_p, size_t count_p, SonicSetParameterPool *pool_p) {
+				data = data_p;
+				count = count_p;
+				pool = pool_p;
+			}
+
+			size_t size() {
+				return count;
+			}
+
+			bool empty() {
+				return !count;
+			}
+
+			SonicSetObjectParameter &operator[](size_t index) {
+				return data[index];
+			}
+
+			SonicSetObjectParameter *begin() {
+				return data;
+			}
+
+			SonicSetObjectParameter *end() {
+				return data + count;
+			}
+
+			const string &getValueString(size_t index) {
+				return pool->getString(data[index].getValueStringIndex());
 			}
 	};
 
 	class SonicSetObject {
 		friend SonicSetObject;
+		friend SonicSet;
 
 		protected:
 			Vector3 position;
@@ -97,19 +193,48 @@ namespace LibGens {
 
 			float unknown;
 			float unknown_2;
-			vector<SonicSetObjectParameter *> parameters;
+			SonicSetParameterPool *parameter_pool;
+			size_t parameter_start;
+			size_t parameter_count;
+
+			// Parameters of an object outside of a set, so they don't depend on a set's pool
+			SonicSetParameterPool *owned_pool;
 
 			size_t file_address;
 			size_t parameter_address;
+
+			// Moves the parameters into another pool, used when the object joins a set
+			void setParameterPool(SonicSetParameterPool *pool);
+
+			// Moves the parameters into owned_pool, used when the object leaves a set
+			void detachParameters();
+
+			// Only the set renames objects, so its name index can't go stale
+			void setName(string v) {
+				name = v;
+			}
 		public:
 			SonicSetObject() {
+				parameter_pool = NULL;
+				parameter_start = 0;
+				parameter_count = 0;
+				owned_pool = NULL;
 			}
 
-			void read(File *file);
+			~SonicSetObject() {
+				delete owned_pool;
+			}
+
+			void read(File *file, SonicSetParameterPool *pool);
 			SonicSetObject(SonicSetObject *clone);
 
-			vector<SonicSetObjectParameter *> getParameters() {
-				return parameters;
+			SonicSetParameterSpan getParameters() {
+				if (!parameter_count) return SonicSetParameterSpan(NULL, 0, parameter_pool);
+				return SonicSetParameterSpan(parameter_pool->getParameter(parameter_start), parameter_count, parameter_pool);
+			}
+
+			SonicSetParameterPool *getParameterPool() {
+				return parameter_pool;
 			}
 
 			void setAddress(size_t v) {
@@ -143,10 +268,6 @@ namespace LibGens {
 				return name;
 			}
 
-			void setName(string v) {
-				name = v;
-			}
-
 			float getUnknown() {
 				return unknown;
 			}
@@ -182,13 +303,99 @@ namespace LibGens {
 	};
 
 
+	// Dynamic bounding volume tree over set object positions, each object being a sphere with a per-type
+	// radius. Leaves are enlarged by a margin so small moves only touch the leaf, and subtrees are rotated
+	// to stay height balanced. Queries append to the caller's vector, which can be reused across frames.
+	class SonicSetIndex {
+		protected:
+			struct Node {
+				float box_min[3];
+				float box_max[3];
+				float center[3];
+				float radius;
+				int height;
+				int parent;
+				int left;
+				int right;
+				SonicSetObject *object;
+			};
+
+			vector<Node> nodes;
+			int root;
+			int free_list;
+			unordered_map<SonicSetObject *, int> leaves;
+			map<string, float> type_radius;
+			float default_radius;
+			float margin;
+
+			int allocateNode();
+			void freeNode(int node);
+			void setLeaf(int node, SonicSetObject *object);
+			void insertLeaf(int leaf);
+			void removeLeaf(int leaf);
+			void combine(int node, int left, int right);
+			int rotate(int node);
+			void refit(int node);
+			int buildRange(vector<int> &items, size_t start, size_t end);
+		public:
+			SonicSetIndex() {
+				root = -1;
+				free_list = -1;
+				default_radius = 0.0f;
+				margin = LIBGENS_S06_SET_INDEX_DEFAULT_MARGIN;
+			}
+
+			void build(const vector<SonicSetObject *> &objects);
+			void insert(SonicSetObject *object);
+			void remove(SonicSetObject *object);
+
+			// Call after changing the position or type of an indexed object
+			void update(SonicSetObject *object);
+
+			void clear();
+
+			size_t size() {
+				return leaves.size();
+			}
+
+			void setDefaultRadius(float v);
+			void setTypeRadius(string type, float v);
+			float getRadius(SonicSetObject *object);
+
+			void setMargin(float v) {
+				margin = v;
+			}
+
+			void queryBox(const Vector3 &box_min, const Vector3 &box_max, vector<SonicSetObject *> &results);
+			void querySphere(const Vector3 &center, float radius, vector<SonicSetObject *> &results);
+
+			// Planes are (a, b, c, d) with normals pointing inside, a point is inside when ax+by+cz+d >= 0
+			void queryFrustum(const float planes[6][4], vector<SonicSetObject *> &results);
+
+			// Closest objects by distance to their sphere, appended nearest first
+			void queryNearest(const Vector3 &point, size_t count, vector<SonicSetObject *> &results, float max_distance=-1.0f);
+	};
+
 	class SonicSet {
 		protected:
 			vector<SonicSetObject *> objects;
+			SonicSetIndex index;
+			SonicSetParameterPool parameter_pool;
+
+			// Types are interned once per set, objects are bucketed by type id and by name
+			unordered_map<string, size_t> type_ids;
+			vector<string> type_names;
+			vector<vector<SonicSetObject *> > type_objects;
+			unordered_map<string, vector<SonicSetObject *> > name_objects;
 			vector<SonicSetGroup *>  groups;
 			unsigned int table_size;
 			string name;
 			SonicStringTable string_table;
+
+			void indexObject(SonicSetObject *object);
+			void unindexObject(SonicSetObject *object);
+			void reindexObjects();
+			void compactParameters();
 		public:
 			SonicSet() {
 
@@ -203,22 +410,59 @@ namespace LibGens {
 				name = v;
 			}
 
-			vector<SonicSetObject *> getObjects() {
+			const vector<SonicSetObject *> &getObjects() {
 				return objects;
 			}
 
+			SonicSetIndex *getIndex() {
+				return &index;
+			}
+
 			void addObject(SonicSetObject *object) {
 				if (!object) return;
 
+				object->setParameterPool(&parameter_pool);
 				objects.push_back(object);
+				index.insert(object);
+				indexObject(object);
+			}
+
+			// Removes objects from the set without deleting them, their parameters are copied out of the set
+			void removeObject(SonicSetObject *object);
+			void removeObjects(const vector<SonicSetObject *> &remove_objects);
+
+			// Objects are renamed through a set so its name index stays in sync. Objects outside of this
+			// set, like fresh clones, are only renamed.
+			void renameObject(SonicSetObject *object, string name);
+
+			const vector<string> &getTypes() {
+				return type_names;
+			}
+
+			const vector<SonicSetObject *> &getObjectsByType(string type);
+			const vector<SonicSetObject *> &getObjectsByName(string name);
+			SonicSetObject *getObject(string name);
+
+			void moveObject(SonicSetObject *object, Vector3 position) {
+				if (!object) return;
+
+				object->setPosition(position);
+				index.update(object);
 			}
 
+			// Removed objects own their parameters, so the pool only holds the deleted ones here
 			void deleteObjects() {
 				for (size_t i=0; i<objects.size(); i++) {
 					delete objects[i];
 				}
 
 				objects.clear();
+				index.clear();
+				parameter_pool.clear();
+				type_ids.clear();
+				type_names.clear();
+				type_objects.clear();
+				name_objects.clear();
 			}
 
 			void fixDuplicateNames();
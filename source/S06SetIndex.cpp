@@ -0,0 +1,530 @@
+//=========================================================================
+//	  Copyright (c) 2016 SonicGLvl
+//
+//    This file is part of SonicGLvl, a community-created free level editor 
+//    for the PC version of Sonic Generations.
+//
+//    SonicGLvl is free software: you can redistribute it and/or modify
+//    it under the terms of the GNU General Public License as published by
+//    the Free Software Foundation, either version 3 of the License, or
+//    (at your option) any later version.
+//
+//    SonicGLvl is distributed in the hope that it will be useful,
+//    but WITHOUT ANY WARRANTY; without even the implied warranty of
+//    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+//    
+//
+//    Read AUTHORS.txt, LICENSE.txt and COPYRIGHT.txt for more details.
+//=========================================================================
+
+
+#include "LibGens.h"
+#include <algorithm>
+#include <queue>
+#include "S06Set.h"
+
+namespace LibGens {
+	static float boxArea(const float *box_min, const float *box_max) {
+		float x=box_max[0]-box_min[0], y=box_max[1]-box_min[1], z=box_max[2]-box_min[2];
+		return 2.0f * (x*y + y*z + z*x);
+	}
+
+	static float unionArea(const float *a_min, const float *a_max, const float *b_min, const float *b_max) {
+		float box_min[3], box_max[3];
+		for (size_t k=0; k<3; k++) {
+			box_min[k] = std::min(a_min[k], b_min[k]);
+			box_max[k] = std::max(a_max[k], b_max[k]);
+		}
+		return boxArea(box_min, box_max);
+	}
+
+	static bool boxContains(const float *outer_min, const float *outer_max, const float *inner_min, const float *inner_max) {
+		for (size_t k=0; k<3; k++) {
+			if ((inner_min[k] < outer_min[k]) || (inner_max[k] > outer_max[k])) return false;
+		}
+		return true;
+	}
+
+	static float boxDistanceSquared(const float *box_min, const float *box_max, const float *point) {
+		float distance=0.0f;
+		for (size_t k=0; k<3; k++) {
+			float d=0.0f;
+			if (point[k] < box_min[k]) d = box_min[k] - point[k];
+			else if (point[k] > box_max[k]) d = point[k] - box_max[k];
+			distance += d*d;
+		}
+		return distance;
+	}
+
+	int SonicSetIndex::allocateNode() {
+		int node=free_list;
+		if (node != -1) {
+			free_list = nodes[node].parent;
+		}
+		else {
+			node = nodes.size();
+			nodes.push_back(Node());
+		}
+
+		nodes[node].parent = nodes[node].left = nodes[node].right = -1;
+		nodes[node].object = NULL;
+		nodes[node].radius = 0.0f;
+		nodes[node].height = 0;
+		return node;
+	}
+
+	void SonicSetIndex::freeNode(int node) {
+		nodes[node].parent = free_list;
+		nodes[node].object = NULL;
+		free_list = node;
+	}
+
+	void SonicSetIndex::setLeaf(int node, SonicSetObject *object) {
+		Vector3 position=object->getPosition();
+		float radius=getRadius(object);
+
+		Node &leaf=nodes[node];
+		leaf.object = object;
+		leaf.center[0] = position.x;
+		leaf.center[1] = position.y;
+		leaf.center[2] = position.z;
+		leaf.radius = radius;
+
+		for (size_t k=0; k<3; k++) {
+			leaf.box_min[k] = leaf.center[k] - radius - margin;
+			leaf.box_max[k] = leaf.center[k] + radius + margin;
+		}
+	}
+
+	void SonicSetIndex::combine(int node, int left, int right) {
+		Node &parent=nodes[node];
+		const Node &a=nodes[left];
+		const Node &b=nodes[right];
+
+		for (size_t k=0; k<3; k++) {
+			parent.box_min[k] = std::min(a.box_min[k], b.box_min[k]);
+			parent.box_max[k] = std::max(a.box_max[k], b.box_max[k]);
+		}
+		parent.height = std::max(a.height, b.height) + 1;
+	}
+
+	int SonicSetIndex::rotate(int node) {
+		if (nodes[node].left == -1) return node;
+
+		// Lift the taller child above the node, the node keeps the shorter grandchild of the lifted one
+		int left=nodes[node].left;
+		int right=nodes[node].right;
+		int balance=nodes[right].height - nodes[left].height;
+		if ((balance <= 1) && (balance >= -1)) return node;
+
+		bool right_up=(balance > 1);
+		int up=right_up ? right : left;
+		int first=nodes[up].left;
+		int second=nodes[up].right;
+		int keep=(nodes[first].height > nodes[second].height) ? first : second;
+		int give=(keep == first) ? second : first;
+
+		int parent=nodes[node].parent;
+		nodes[up].parent = parent;
+		nodes[node].parent = up;
+		if (parent == -1) {
+			root = up;
+		}
+		else if (nodes[parent].left == node) {
+			nodes[parent].left = up;
+		}
+		else {
+			nodes[parent].right = up;
+		}
+
+		nodes[up].left = node;
+		nodes[up].right = keep;
+		if (right_up) nodes[node].right = give;
+		else nodes[node].left = give;
+		nodes[give].parent = node;
+
+		combine(node, nodes[node].left, nodes[node].right);
+		combine(up, node, keep);
+		return up;
+	}
+
+	void SonicSetIndex::refit(int node) {
+		while (node != -1) {
+			node = rotate(node);
+			combine(node, nodes[node].left, nodes[node].right);
+			node = nodes[node].parent;
+		}
+	}
+
+	void SonicSetIndex::insertLeaf(int leaf) {
+		if (root == -1) {
+			root = leaf;
+			nodes[leaf].parent = -1;
+			return;
+		}
+
+		// Walk down towards the sibling that grows the total surface area the least
+		const float *leaf_min=nodes[leaf].box_min;
+		const float *leaf_max=nodes[leaf].box_max;
+
+		int sibling=root;
+		while (nodes[sibling].left != -1) {
+			const Node &node=nodes[sibling];
+			float area=boxArea(node.box_min, node.box_max);
+			float combined_area=unionArea(node.box_min, node.box_max, leaf_min, leaf_max);
+
+			// Cost of pairing with this node, and the cost pushed down to either child
+			float cost=2.0f * combined_area;
+			float inherited=2.0f * (combined_area - area);
+
+			float child_cost[2];
+			int children[2]={ node.left, node.right };
+			for (size_t c=0; c<2; c++) {
+				const Node &child=nodes[children[c]];
+				child_cost[c] = unionArea(child.box_min, child.box_max, leaf_min, leaf_max) + inherited;
+				if (child.left != -1) child_cost[c] -= boxArea(child.box_min, child.box_max);
+			}
+
+			if ((cost < child_cost[0]) && (cost < child_cost[1])) break;
+			sibling = (child_cost[0] <= child_cost[1]) ? node.left : node.right;
+		}
+
+		int old_parent=nodes[sibling].parent;
+		int parent=allocateNode();
+		nodes[parent].parent = old_parent;
+		nodes[parent].left = sibling;
+		nodes[parent].right = leaf;
+		nodes[sibling].parent = parent;
+		nodes[leaf].parent = parent;
+
+		if (old_parent == -1) {
+			root = parent;
+		}
+		else if (nodes[old_parent].left == sibling) {
+			nodes[old_parent].left = parent;
+		}
+		else {
+			nodes[old_parent].right = parent;
+		}
+
+		refit(parent);
+	}
+
+	void SonicSetIndex::removeLeaf(int leaf) {
+		if (leaf == root) {
+			root = -1;
+			return;
+		}
+
+		int parent=nodes[leaf].parent;
+		int grand_parent=nodes[parent].parent;
+		int sibling=(nodes[parent].left == leaf) ? nodes[parent].right : nodes[parent].left;
+
+		// The sibling takes the place of the parent
+		if (grand_parent == -1) {
+			root = sibling;
+			nodes[sibling].parent = -1;
+		}
+		else {
+			if (nodes[grand_parent].left == parent) nodes[grand_parent].left = sibling;
+			else nodes[grand_parent].right = sibling;
+			nodes[sibling].parent = grand_parent;
+			refit(grand_parent);
+		}
+
+		freeNode(parent);
+	}
+
+	int SonicSetIndex::buildRange(vector<int> &items, size_t start, size_t end) {
+		if (end - start == 1) return items[start];
+
+		// Split at the median centroid along the longest axis of the centroids
+		float center_min[3], center_max[3];
+		for (size_t k=0; k<3; k++) {
+			center_min[k] = center_max[k] = nodes[items[start]].center[k];
+		}
+
+		for (size_t i=start+1; i<end; i++) {
+			const float *center=nodes[items[i]].center;
+			for (size_t k=0; k<3; k++) {
+				center_min[k] = std::min(center_min[k], center[k]);
+				center_max[k] = std::max(center_max[k], center[k]);
+			}
+		}
+
+		size_t axis=0;
+		for (size_t k=1; k<3; k++) {
+			if (center_max[k] - center_min[k] > center_max[axis] - center_min[axis]) axis = k;
+		}
+
+		size_t middle=start + (end - start) / 2;
+		std::nth_element(items.begin() + start, items.begin() + middle, items.begin() + end, [&](int a, int b) {
+			return nodes[a].center[axis] < nodes[b].center[axis];
+		});
+
+		int left=buildRange(items, start, middle);
+		int right=buildRange(items, middle, end);
+
+		int node=allocateNode();
+		nodes[node].left = left;
+		nodes[node].right = right;
+		nodes[left].parent = node;
+		nodes[right].parent = node;
+		combine(node, left, right);
+		return node;
+	}
+
+	void SonicSetIndex::build(const vector<SonicSetObject *> &objects) {
+		clear();
+		if (objects.empty()) return;
+
+		nodes.reserve(objects.size() * 2);
+		leaves.reserve(objects.size());
+
+		vector<int> items;
+		items.reserve(objects.size());
+		for (size_t i=0; i<objects.size(); i++) {
+			SonicSetObject *object=objects[i];
+			if (!object || leaves.count(object)) continue;
+
+			int leaf=allocateNode();
+			setLeaf(leaf, object);
+			leaves[object] = leaf;
+			items.push_back(leaf);
+		}
+
+		if (items.empty()) return;
+
+		root = buildRange(items, 0, items.size());
+		nodes[root].parent = -1;
+	}
+
+	void SonicSetIndex::insert(SonicSetObject *object) {
+		if (!object || leaves.count(object)) return;
+
+		int leaf=allocateNode();
+		setLeaf(leaf, object);
+		leaves[object] = leaf;
+		insertLeaf(leaf);
+	}
+
+	void SonicSetIndex::remove(SonicSetObject *object) {
+		unordered_map<SonicSetObject *, int>::iterator it=leaves.find(object);
+		if (it == leaves.end()) return;
+
+		int leaf=it->second;
+		leaves.erase(it);
+		removeLeaf(leaf);
+		freeNode(leaf);
+	}
+
+	void SonicSetIndex::update(SonicSetObject *object) {
+		unordered_map<SonicSetObject *, int>::iterator it=leaves.find(object);
+		if (it == leaves.end()) return;
+
+		int leaf=it->second;
+		float old_min[3], old_max[3];
+		for (size_t k=0; k<3; k++) {
+			old_min[k] = nodes[leaf].box_min[k];
+			old_max[k] = nodes[leaf].box_max[k];
+		}
+
+		// Keep the old enlarged box while the object still fits inside it
+		setLeaf(leaf, object);
+
+		float tight_min[3], tight_max[3];
+		for (size_t k=0; k<3; k++) {
+			tight_min[k] = nodes[leaf].center[k] - nodes[leaf].radius;
+			tight_max[k] = nodes[leaf].center[k] + nodes[leaf].radius;
+		}
+
+		if (boxContains(old_min, old_max, tight_min, tight_max)) {
+			for (size_t k=0; k<3; k++) {
+				nodes[leaf].box_min[k] = old_min[k];
+				nodes[leaf].box_max[k] = old_max[k];
+			}
+			return;
+		}
+
+		removeLeaf(leaf);
+		insertLeaf(leaf);
+	}
+
+	void SonicSetIndex::clear() {
+		nodes.clear();
+		leaves.clear();
+		root = -1;
+		free_list = -1;
+	}
+
+	void SonicSetIndex::setDefaultRadius(float v) {
+		default_radius = v;
+
+		for (unordered_map<SonicSetObject *, int>::iterator it=leaves.begin(); it!=leaves.end(); it++) {
+			update(it->first);
+		}
+	}
+
+	void SonicSetIndex::setTypeRadius(string type, float v) {
+		type_radius[type] = v;
+
+		for (unordered_map<SonicSetObject *, int>::iterator it=leaves.begin(); it!=leaves.end(); it++) {
+			if (it->first->getType() == type) update(it->first);
+		}
+	}
+
+	float SonicSetIndex::getRadius(SonicSetObject *object) {
+		if (type_radius.empty()) return default_radius;
+
+		map<string, float>::iterator it=type_radius.find(object->getType());
+		return (it != type_radius.end()) ? it->second : default_radius;
+	}
+
+	void SonicSetIndex::queryBox(const Vector3 &box_min, const Vector3 &box_max, vector<SonicSetObject *> &results) {
+		if (root == -1) return;
+
+		float query_min[3]={ box_min.x, box_min.y, box_min.z };
+		float query_max[3]={ box_max.x, box_max.y, box_max.z };
+
+		vector<int> stack;
+		stack.reserve(64);
+		stack.push_back(root);
+
+		while (!stack.empty()) {
+			const Node &node=nodes[stack.back()];
+			stack.pop_back();
+
+			bool overlap=true;
+			for (size_t k=0; k<3; k++) {
+				if ((node.box_min[k] > query_max[k]) || (node.box_max[k] < query_min[k])) {
+					overlap = false;
+					break;
+				}
+			}
+			if (!overlap) continue;
+
+			if (node.left == -1) {
+				if (boxDistanceSquared(query_min, query_max, node.center) <= node.radius * node.radius) results.push_back(node.object);
+			}
+			else {
+				stack.push_back(node.left);
+				stack.push_back(node.right);
+			}
+		}
+	}
+
+	void SonicSetIndex::querySphere(const Vector3 &center, float radius, vector<SonicSetObject *> &results) {
+		if (root == -1) return;
+
+		float point[3]={ center.x, center.y, center.z };
+
+		vector<int> stack;
+		stack.reserve(64);
+		stack.push_back(root);
+
+		while (!stack.empty()) {
+			const Node &node=nodes[stack.back()];
+			stack.pop_back();
+
+			if (boxDistanceSquared(node.box_min, node.box_max, point) > radius * radius) continue;
+
+			if (node.left == -1) {
+				float x=node.center[0]-point[0], y=node.center[1]-point[1], z=node.center[2]-point[2];
+				float reach=radius + node.radius;
+				if (x*x + y*y + z*z <= reach * reach) results.push_back(node.object);
+			}
+			else {
+				stack.push_back(node.left);
+				stack.push_back(node.right);
+			}
+		}
+	}
+
+	void SonicSetIndex::queryFrustum(const float planes[6][4], vector<SonicSetObject *> &results) {
+		if (root == -1) return;
+
+		vector<int> stack;
+		stack.reserve(64);
+		stack.push_back(root);
+
+		while (!stack.empty()) {
+			const Node &node=nodes[stack.back()];
+			stack.pop_back();
+
+			bool outside=false;
+			for (size_t p=0; (p<6) && !outside; p++) {
+				const float *plane=planes[p];
+
+				if (node.left == -1) {
+					outside = (plane[0]*node.center[0] + plane[1]*node.center[1] + plane[2]*node.center[2] + plane[3]) < -node.radius;
+				}
+				else {
+					// Corner of the box furthest along the plane normal
+					float x=(plane[0] >= 0.0f) ? node.box_max[0] : node.box_min[0];
+					float y=(plane[1] >= 0.0f) ? node.box_max[1] : node.box_min[1];
+					float z=(plane[2] >= 0.0f) ? node.box_max[2] : node.box_min[2];
+					outside = (plane[0]*x + plane[1]*y + plane[2]*z + plane[3]) < 0.0f;
+				}
+			}
+			if (outside) continue;
+
+			if (node.left == -1) {
+				results.push_back(node.object);
+			}
+			else {
+				stack.push_back(node.left);
+				stack.push_back(node.right);
+			}
+		}
+	}
+
+	void SonicSetIndex::queryNearest(const Vector3 &point, size_t count, vector<SonicSetObject *> &results, float max_distance) {
+		if ((root == -1) || !count) return;
+
+		float query[3]={ point.x, point.y, point.z };
+		typedef pair<float, int> Entry;
+
+		// Nodes are visited closest box first, and the best candidates are kept in a max heap
+		// so the search stops once no box can beat the furthest of them
+		std::priority_queue<Entry, vector<Entry>, std::greater<Entry> > pending;
+		std::priority_queue<Entry> best;
+		float limit=(max_distance >= 0.0f) ? max_distance * max_distance : -1.0f;
+
+		pending.push(Entry(boxDistanceSquared(nodes[root].box_min, nodes[root].box_max, query), root));
+
+		while (!pending.empty()) {
+			Entry entry=pending.top();
+			pending.pop();
+
+			if ((limit >= 0.0f) && (entry.first > limit)) break;
+			if ((best.size() == count) && (entry.first >= best.top().first)) break;
+
+			const Node &node=nodes[entry.second];
+			if (node.left == -1) {
+				float x=node.center[0]-query[0], y=node.center[1]-query[1], z=node.center[2]-query[2];
+				float distance=std::max(sqrt(x*x + y*y + z*z) - node.radius, 0.0f);
+				distance *= distance;
+
+				if ((limit >= 0.0f) && (distance > limit)) continue;
+				if (best.size() < count) {
+					best.push(Entry(distance, entry.second));
+				}
+				else if (distance < best.top().first) {
+					best.pop();
+					best.push(Entry(distance, entry.second));
+				}
+			}
+			else {
+				pending.push(Entry(boxDistanceSquared(nodes[node.left].box_min, nodes[node.left].box_max, query), node.left));
+				pending.push(Entry(boxDistanceSquared(nodes[node.right].box_min, nodes[node.right].box_max, query), node.right));
+			}
+		}
+
+		size_t start=results.size();
+		results.resize(start + best.size());
+		for (size_t i=results.size(); i>start; i--) {
+			results[i-1] = nodes[best.top().second].object;
+			best.pop();
+		}
+	}
+};
@@ -18,6 +18,7 @@
 //=========================================================================
 
 #include "LibGens.h"
+#include <algorithm>
 #include "S06Common.h"
 #include "S06Text.h"
 
@@ -47,45 +48,44 @@ namespace LibGens {
 		file->goToAddress(id_address);
 		file->readString(&id);
 
-		value = "";
-		for (size_t i=0; i<65535; i++) {
-			file->goToAddress(value_address + i*2 + 1);
-			unsigned char c=0;
-			file->readUChar(&c);
-			if (c) value += c;
-			else break;
+		// Read the text in chunks until its null unit shows up, then convert it in one go. The buffer
+		// starts zeroed so reading past the end of the file also terminates the text.
+		vector<unsigned char> buffer;
+		size_t length=0;
+		file->goToAddress(value_address);
+
+		while (length < LIBGENS_S06_TEXT_MAX_LENGTH) {
+			size_t start=buffer.size();
+			buffer.resize(start + LIBGENS_S06_TEXT_READ_CHUNK*2, 0);
+			file->read(&buffer[start], LIBGENS_S06_TEXT_READ_CHUNK*2);
+
+			size_t units=std::min(buffer.size()/2, (size_t) LIBGENS_S06_TEXT_MAX_LENGTH);
+			while ((length < units) && (buffer[length*2] || buffer[length*2+1])) length++;
+			if (length < units) break;
 		}
+
+		value = "";
+		SonicUnicode::decodeUTF16BE(buffer.data(), length, value);
 	}
 
 	
-	void SonicTextEntry::write(File *file, SonicStringTable *string_table) {
+	void SonicTextEntry::write(File *file, SonicStringTable *string_table, size_t value_address) {
 		if (!file) {
 			Error::addMessage(Error::NULL_REFERENCE, LIBGENS_S06_TEXT_ERROR_MESSAGE_WRITE_NULL_FILE);
 			return;
 		}
 
-		size_t header_address=file->getCurrentAddress();
-		file_address = header_address;
-
 		string_table->writeString(file, id);
-		file->writeNull(8);
+		file->writeInt32BEA(&value_address);
+		file->writeNull(4);
 	}
 
-	void SonicTextEntry::writeFixed(File *file) {
-		file->goToAddress(file_address + 4);
-		file->writeInt32BEA(&parameter_address);
-	}
-
-	void SonicTextEntry::writeValues(File *file) {
-		parameter_address = file->getCurrentAddress();
-
-		for (size_t i=0; i<value.size(); i++) {
-			unsigned char c=value[i];
-			file->writeNull(1);
-			file->writeUChar(&c);
-		}
-
-		file->writeNull(2);
+	size_t SonicTextEntry::encodeValue(vector<unsigned char> &buffer) {
+		size_t start=buffer.size();
+		SonicUnicode::encodeUTF16BE(value, buffer);
+		buffer.push_back(0);
+		buffer.push_back(0);
+		return buffer.size() - start;
 	}
 
 
@@ -100,11 +100,8 @@ namespace LibGens {
 
 		
 		unsigned int file_size=0;
-		size_t banana_table_address=0;
 		file->setRootNodeAddress(32);
 		file->readInt32BE(&file_size);
-		file->readInt32BEA(&banana_table_address);
-		file->readInt32BE(&table_size);
 
 		file->goToAddress(36);
 		size_t name_address=0;
@@ -116,17 +113,17 @@ namespace LibGens {
 		unsigned int entries_total=0;
 		file->readInt32BE(&entries_total);
 
+		entries.reserve(entries_total);
+		entry_indices.reserve(entries_total);
+
 		for (size_t i=0; i<entries_total; i++) {
 			file->goToAddress(44 + i*12);
 
 			SonicTextEntry *entry=new SonicTextEntry();
 			entry->read(file);
+			entry_indices.insert(make_pair(entry->getID(), entries.size()));
 			entries.push_back(entry);
 		}
-		
-		file->goToAddress(banana_table_address);
-		table = new char[table_size];
-		file->read(table, table_size);
 	}
 
 	
@@ -145,11 +142,11 @@ namespace LibGens {
 			return;
 		}
 
+		string_table.clear();
+
 		file->setRootNodeAddress(32);
 
-		file->writeNull(8);
-		file->writeInt32BE(&table_size);
-		file->writeNull(10);
+		file->writeNull(22);
 		string header="1BBINA";
 		file->writeString(&header);
 		file->fixPadding(32);
@@ -161,24 +158,128 @@ namespace LibGens {
 		string_table.writeString(file, name);
 		unsigned int entries_total=entries.size();
 		file->writeInt32BE(&entries_total);
-		
-		for (size_t i=0; i<entries_total; i++) entries[i]->write(file, &string_table);
-		for (size_t i=0; i<entries_total; i++) entries[i]->writeValues(file);
-		for (size_t i=0; i<entries_total; i++) entries[i]->writeFixed(file);
-		file->goToEnd();
+
+		// Values are encoded up front so every entry can point at its value as it's written,
+		// then all of them follow the entries in a single write
+		vector<unsigned char> values;
+		vector<size_t> value_offsets(entries_total);
+		for (size_t i=0; i<entries_total; i++) {
+			value_offsets[i] = values.size();
+			entries[i]->encodeValue(values);
+		}
+
+		size_t values_address=file->getCurrentAddress() + entries_total*12;
+		for (size_t i=0; i<entries_total; i++) entries[i]->write(file, &string_table, values_address + value_offsets[i]);
+		if (values.size()) file->write(&values[0], values.size());
 
 		string_table.write(file);
 		file->goToEnd();
 
 		// End
 		file->fixPadding(16);
-		size_t table_address=file->getCurrentAddress();
-		file->write(table, table_size);
-		unsigned int file_size=file->getFileSize();
+		size_t table_address=file->getCurrentAddress() - 32;
+		file->sortAddressTable();
+		file->writeAddressTableBBIN();
+		file->fixPadding(8);
 
+		unsigned int file_size=file->getFileSize();
+		unsigned int table_size=(file_size - 32) - table_address;
 		file->goToAddress(0);
 		file->writeInt32BE(&file_size);
-		file->writeInt32BEA(&table_address);
+		file->writeInt32BE(&table_address);
+		file->writeInt32BE(&table_size);
+	}
+
+	bool SonicText::setValue(string id, string value) {
+		SonicTextEntry *entry=getEntry(id);
+		if (!entry) return false;
+
+		entry->setValue(value);
+		return true;
 	}
 
-};
\ No newline at end of file
+	SonicTextEntry *SonicText::insertEntry(string id, string value) {
+		SonicTextEntry *entry=getEntry(id);
+		if (entry) {
+			entry->setValue(value);
+			return entry;
+		}
+
+		entry = new SonicTextEntry(id, value);
+		entry_indices[id] = entries.size();
+		entries.push_back(entry);
+		return entry;
+	}
+
+	size_t SonicText::setValues(const vector<pair<string, string> > &values, bool insert_missing) {
+		size_t updated=0;
+
+		for (size_t i=0; i<values.size(); i++) {
+			if (insert_missing) {
+				insertEntry(values[i].first, values[i].second);
+				updated++;
+			}
+			else if (setValue(values[i].first, values[i].second)) {
+				updated++;
+			}
+		}
+
+		return updated;
+	}
+
+	static string unescapeTableValue(const char *start, const char *end) {
+		string value;
+		value.reserve(end - start);
+
+		for (const char *c=start; c<end; c++) {
+			if ((*c != '\\') || (c+1 == end)) {
+				value += *c;
+				continue;
+			}
+
+			c++;
+			if (*c == 'n') value += '\n';
+			else if (*c == 't') value += '\t';
+			else value += *c;
+		}
+
+		return value;
+	}
+
+	size_t SonicText::applyTable(string filename, bool insert_missing) {
+		File file(filename, LIBGENS_FILE_READ_BINARY);
+		if (!file.valid()) {
+			Error::addMessage(Error::FILE_NOT_FOUND, string(LIBGENS_S06_TEXT_ERROR_MESSAGE_READ_TABLE_FILE) + filename);
+			return 0;
+		}
+
+		vector<char> data(file.getFileSize());
+		if (data.size()) file.read(&data[0], data.size());
+		file.close();
+
+		vector<pair<string, string> > values;
+		const char *c=data.size() ? &data[0] : NULL;
+		const char *end=c + data.size();
+
+		// Skip a UTF-8 byte order mark
+		if ((data.size() >= 3) && ((unsigned char) c[0] == 0xEF) && ((unsigned char) c[1] == 0xBB) && ((unsigned char) c[2] == 0xBF)) c += 3;
+
+		while (c < end) {
+			const char *line_end=(const char *) memchr(c, '\n', end - c);
+			if (!line_end) line_end = end;
+
+			const char *line=c;
+			c = (line_end < end) ? line_end + 1 : end;
+
+			if ((line_end > line) && (line_end[-1] == '\r')) line_end--;
+			if ((line == line_end) || (*line == '#')) continue;
+
+			const char *tab=(const char *) memchr(line, '\t', line_end - line);
+			if (!tab) continue;
+
+			values.push_back(make_pair(string(line, tab), unescapeTableValue(tab + 1, line_end)));
+		}
+
+		return setValues(values, insert_missing);
+	}
+};
@@ -21,23 +21,38 @@
 
 #define LIBGENS_S06_TEXT_ERROR_MESSAGE_NULL_FILE         "Trying to read text data from unreferenced file."
 #define LIBGENS_S06_TEXT_ERROR_MESSAGE_WRITE_NULL_FILE   "Trying to write text data to an unreferenced file."
+#define LIBGENS_S06_TEXT_ERROR_MESSAGE_READ_TABLE_FILE   "Couldn't open text table for reading: "
+
+#define LIBGENS_S06_TEXT_MAX_LENGTH                      65535
+#define LIBGENS_S06_TEXT_READ_CHUNK                      256
 
 namespace LibGens {
 	class SonicTextEntry {
 		protected:
 			string id;
 			string value;
-
-			size_t file_address;
-			size_t parameter_address;
 		public:
 			SonicTextEntry() {
 			}
 
+			SonicTextEntry(string id_p, string value_p) {
+				id = id_p;
+				value = value_p;
+			}
+
 			void read(File *file);
-			void write(File *file, SonicStringTable *string_table);
-			void writeFixed(File *file);
-			void writeValues(File *file);
+			void write(File *file, SonicStringTable *string_table, size_t value_address);
+
+			// Appends the value as null terminated UTF-16BE, returns its size in bytes
+			size_t encodeValue(vector<unsigned char> &buffer);
+
+			string getID() {
+				return id;
+			}
+
+			string getValue() {
+				return value;
+			}
 
 			void setValue(string v) {
 				value = v;
@@ -46,15 +61,43 @@ namespace LibGens {
 
 	class SonicText {
 		protected:
-			char *table;
-			unsigned int table_size;
 			string name;
 			vector<SonicTextEntry *> entries;
+			unordered_map<string, size_t> entry_indices;
 			SonicStringTable string_table;
 		public:
+			SonicText() {
+			}
+
 			SonicText(string filename);
 			void read(File *file);
 			void save(string filename);
 			void write(File *file);
+
+			void setName(string v) {
+				name = v;
+			}
+
+			const vector<SonicTextEntry *> &getEntries() {
+				return entries;
+			}
+
+			SonicTextEntry *getEntry(string id) {
+				unordered_map<string, size_t>::iterator it=entry_indices.find(id);
+				return (it != entry_indices.end()) ? entries[it->second] : NULL;
+			}
+
+			// Returns false if there's no entry with that id
+			bool setValue(string id, string value);
+
+			// Sets the value of the entry, adding it at the end if it doesn't exist yet
+			SonicTextEntry *insertEntry(string id, string value);
+
+			// Applies id and value pairs in order, returns how many entries were updated or added
+			size_t setValues(const vector<pair<string, string> > &values, bool insert_missing=false);
+
+			// Applies a UTF-8 table file with one "id<tab>value" pair per line. Values may escape
+			// \n, \t and \\, empty lines and lines starting with # are skipped.
+			size_t applyTable(string filename, bool insert_missing=false);
 	};
 };
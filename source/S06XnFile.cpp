@@ -22,6 +22,22 @@
 #include "S06XnFile.h"
 
 namespace LibGens {
+	const unsigned char xno_constant_floats[80] = { 
+										   0x00 ,0x00 ,0x80 ,0x3F ,0x00 ,0x00 ,0x80 ,0x3F ,0x00 ,0x00 ,0x80 ,0x3F ,0x00 ,0x00 ,0x80 ,0x3F 
+										  ,0x00 ,0x00 ,0x80 ,0x3F ,0x00 ,0x00 ,0x80 ,0x3F ,0x00 ,0x00 ,0x80 ,0x3F ,0x00 ,0x00 ,0x80 ,0x3F 
+										  ,0x00 ,0x00 ,0x00 ,0x00 ,0x00 ,0x00 ,0x00 ,0x00 ,0x00 ,0x00 ,0x00 ,0x00 ,0x00 ,0x00 ,0x80 ,0x3F 
+										  ,0x00 ,0x00 ,0x00 ,0x00 ,0x00 ,0x00 ,0x00 ,0x00 ,0x00 ,0x00 ,0x00 ,0x00 ,0x00 ,0x00 ,0x80 ,0x3F 
+										  ,0xFF ,0xFF ,0xFF ,0x40 ,0x00 ,0x00 ,0x00 ,0x00 ,0x00 ,0x00 ,0x00 ,0x00 ,0x00 ,0x00 ,0x00 ,0x00 
+										 };
+
+	const unsigned char xno_constant_ints[64] =   { 
+										   0x01 ,0x00 ,0x00 ,0x00 ,0x02 ,0x03 ,0x00 ,0x00 ,0x03 ,0x03 ,0x00 ,0x00 ,0x00 ,0x00 ,0x00 ,0x00 
+										  ,0x06 ,0x80 ,0x00 ,0x00 ,0x00 ,0x00 ,0x00 ,0x00 ,0x01 ,0x00 ,0x00 ,0x00 ,0x04 ,0x02 ,0x00 ,0x00 
+										  ,0x00 ,0x00 ,0x00 ,0x00 ,0x01 ,0x00 ,0x00 ,0x00 ,0x03 ,0x02 ,0x00 ,0x00 ,0x01 ,0x00 ,0x00 ,0x00 
+										  ,0x00 ,0x00 ,0x00 ,0x00 ,0x00 ,0x00 ,0x00 ,0x00 ,0x00 ,0x00 ,0x00 ,0x00 ,0x00 ,0x00 ,0x00 ,0x00 
+										 };
+
+
 	SonicXNFile::SonicXNFile(XNFileMode file_mode_parameter) {
 		info=NULL;
 		offset_table=NULL;
@@ -496,4 +512,126 @@ namespace LibGens {
 		section->setBigEndian(big_endian);
 		sections.push_back(section);
 	}
-}
\ No newline at end of file
+
+
+	SonicMaterialTable *SonicXNFile::addMaterialTable() {
+		SonicXNObject *object=getObject();
+		if (!object) return NULL;
+
+		SonicMaterialTable *sonic_material_table = new SonicMaterialTable();
+
+		sonic_material_table->data_block_1_length = 20;
+		sonic_material_table->data_block_2_length = 16;
+
+		memcpy(sonic_material_table->first_floats, xno_constant_floats, 80);
+		memcpy(sonic_material_table->first_ints, xno_constant_ints, 64);
+		sonic_material_table->flag_table = 0x1000030;
+		sonic_material_table->user_flag = 0;
+
+		object->material_tables.push_back(sonic_material_table);
+		return sonic_material_table;
+	}
+
+	void SonicXNFile::addMaterialTexture(SonicMaterialTable *sonic_material_table, string texture_name) {
+		SonicXNTexture *texture=getTexture();
+		if (!texture || !sonic_material_table) return;
+
+		size_t pos=texture_name.find(".png");
+		if (pos == string::npos) pos=texture_name.find(".PNG");
+		if (pos != string::npos) {
+			texture_name.replace(pos, 4, ".dds");
+		}
+
+		unsigned int texture_index = texture->addTexture(texture_name);
+
+		SonicTextureUnit *texture_unit = new SonicTextureUnit();
+		texture_unit->flag_f = 2.187562f;
+		texture_unit->index = texture_index;
+		texture_unit->flag = 0x80000000;
+		texture_unit->flag_2_f = 1.0f;
+		texture_unit->flag_2 = 0x010004;
+		texture_unit->flag_3_f = 0.0f;
+		texture_unit->flag_3 = 0;
+		sonic_material_table->texture_units.push_back(texture_unit);
+	}
+
+	void SonicXNFile::addMaterialEffect(string material_name) {
+		SonicXNEffect *effect = getEffect();
+		if (!effect) return;
+
+		string shader_name = "Billboard03.fx";
+		string sub_shader_name = "Billboard03";
+
+		size_t shader_name_pos = material_name.find_first_of("@");
+		size_t sub_shader_name_pos = material_name.find_last_of("@");
+
+		// One @ Symbol was found at least
+		if (shader_name_pos != string::npos) {
+			shader_name_pos += 1;
+			sub_shader_name_pos += 1;
+
+			// Verify if there's more than one @ symbol
+			if (shader_name_pos != sub_shader_name_pos) {
+				shader_name = material_name.substr(shader_name_pos, sub_shader_name_pos-shader_name_pos-1);
+				sub_shader_name = material_name.substr(sub_shader_name_pos, material_name.size()-sub_shader_name_pos);
+			}
+			// There's only one @ symbol, auto-generate .fx name
+			else {
+				sub_shader_name = material_name.substr(shader_name_pos, material_name.size()-shader_name_pos);
+				shader_name = sub_shader_name + ".fx";
+			}
+		}
+
+		size_t material_effect_shader_index = effect->addMaterialShader(shader_name);
+		size_t material_effect_index = effect->addMaterialName(sub_shader_name, material_effect_shader_index);
+		effect->addExtra(material_effect_index);
+	}
+
+	void SonicXNFile::addSubmeshes(SonicMesh *sonic_mesh, vector<SonicVertex *> &vertices, vector<unsigned int> &indices, unsigned int material_index, const char *material_name) {
+		SonicXNObject  *object=getObject();
+		if (!object) return;
+
+		// Split into submeshes that fit the skinning palette
+		vector< vector<SonicVertex *> > vertices_output;
+		vector< vector<unsigned int> > indices_output;
+		vector< vector<unsigned int> > bone_tables_output;
+		unsigned int max_skinning_bones=32;
+		SonicVertexTable::splitByBonePalette(vertices, indices, max_skinning_bones, vertices_output, indices_output, bone_tables_output);
+
+		for (size_t split=0; split<vertices_output.size(); split++){
+			// Per submesh add a reference to the effect file based on the material names
+			// Also add any new effect names
+			if (material_name) addMaterialEffect(material_name);
+
+			// Create submesh per split
+			unsigned int sonic_vertex_index=object->vertex_tables.size();
+			SonicVertexTable *sonic_vertex_table=new SonicVertexTable();
+			sonic_vertex_table->vertices = vertices_output[split];
+			sonic_vertex_table->vertex_size = 52;
+			sonic_vertex_table->flag_1 = 0x01740B;
+			sonic_vertex_table->flag_2 = 0x115A;
+			sonic_vertex_table->bone_table = bone_tables_output[split];
+			object->vertex_tables.push_back(sonic_vertex_table);
+
+			unsigned int sonic_index_index=object->index_tables.size();
+			SonicIndexTable *sonic_index_table=new SonicIndexTable();
+			sonic_index_table->flag = 0x4810;
+			object->index_tables.push_back(sonic_index_table);
+
+			sonic_index_table->setTriangles(indices_output[split]);
+
+			SonicSubmesh *sonic_submesh=new SonicSubmesh();
+			sonic_submesh->node_index   = 0x36;
+			sonic_submesh->matrix_index = 0xFFFFFFFF;
+			sonic_submesh->center.x = 0.0f;
+			sonic_submesh->center.y = 0.0f;
+			sonic_submesh->center.z = 0.0f;
+			sonic_submesh->radius   = 0.0f; // Filled by calculateBounds once the import finishes
+			sonic_submesh->material_index  = material_index;
+			sonic_submesh->vertex_index    = sonic_vertex_index;
+			sonic_submesh->indices_index   = sonic_index_index;
+			sonic_submesh->indices_index_2 = sonic_index_index;
+			sonic_mesh->submeshes.push_back(sonic_submesh);
+		}
+	}
+};
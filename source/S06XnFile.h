@@ -20,9 +20,13 @@
 #pragma once
 
 #include "FBX.h"
+#include <unordered_map>
 
 #define LIBGENS_S06_XNINFO_ERROR_MESSAGE_NULL_FILE         "Trying to read xninfo data from unreferenced file."
 #define LIBGENS_S06_XNINFO_ERROR_MESSAGE_WRITE_NULL_FILE   "Trying to write xninfo data to an unreferenced file."
+#define LIBGENS_S06_XNFILE_ERROR_MESSAGE_WRITE_GLB_FILE   "Couldn't open GLB file for writing: "
+#define LIBGENS_S06_XNFILE_ERROR_MESSAGE_READ_GLTF_FILE   "Couldn't open glTF file for reading: "
+#define LIBGENS_S06_XNFILE_ERROR_MESSAGE_INVALID_GLTF     "Invalid glTF file: "
 
 #define LIBGENS_XNSECTION_HEADER_INFO_XNO              "NXIF"
 #define LIBGENS_XNSECTION_HEADER_TEXTURE_XNO           "NXTL"
@@ -97,6 +101,45 @@
 #define LIBGENS_XNMOTION_TYPE_Y_SCALE_LINEAR           0x10001
 #define LIBGENS_XNMOTION_TYPE_Z_SCALE_LINEAR           0x20001
 
+#define LIBGENS_XNMOTION_KEY_NONE                      0
+#define LIBGENS_XNMOTION_KEY_FLOAT                     1
+#define LIBGENS_XNMOTION_KEY_INT                       2
+#define LIBGENS_XNMOTION_KEY_INT_BETA                  3
+#define LIBGENS_XNMOTION_KEY_FLOATS                    4
+#define LIBGENS_XNMOTION_KEY_ANGLES                    5
+#define LIBGENS_XNMOTION_KEY_FLOATS_GROUP              6
+
+#define LIBGENS_XNPOSE_CHANNEL_POSITION                0
+#define LIBGENS_XNPOSE_CHANNEL_ANGLES                  1
+#define LIBGENS_XNPOSE_CHANNEL_POSITION_X              2
+#define LIBGENS_XNPOSE_CHANNEL_POSITION_Y              3
+#define LIBGENS_XNPOSE_CHANNEL_POSITION_Z              4
+#define LIBGENS_XNPOSE_CHANNEL_ANGLE_X                 5
+#define LIBGENS_XNPOSE_CHANNEL_ANGLE_Y                 6
+#define LIBGENS_XNPOSE_CHANNEL_ANGLE_Z                 7
+#define LIBGENS_XNPOSE_CHANNEL_ANGLE_BETA_X            8
+#define LIBGENS_XNPOSE_CHANNEL_ANGLE_BETA_Y            9
+#define LIBGENS_XNPOSE_CHANNEL_ANGLE_BETA_Z            10
+#define LIBGENS_XNPOSE_CHANNEL_SCALE_X                 11
+#define LIBGENS_XNPOSE_CHANNEL_SCALE_Y                 12
+#define LIBGENS_XNPOSE_CHANNEL_SCALE_Z                 13
+#define LIBGENS_XNPOSE_CHANNEL_COUNT                   14
+
+#define LIBGENS_DAE_WRITER_TAG_OPEN                    0
+#define LIBGENS_DAE_WRITER_ELEMENTS                    1
+#define LIBGENS_DAE_WRITER_TEXT                        2
+#define LIBGENS_DAE_WRITER_BUFFER_SIZE                 0x40000
+
+#define LIBGENS_GLB_COMPONENT_BYTE                     5120
+#define LIBGENS_GLB_COMPONENT_UNSIGNED_BYTE            5121
+#define LIBGENS_GLB_COMPONENT_SHORT                    5122
+#define LIBGENS_GLB_COMPONENT_UNSIGNED_SHORT           5123
+#define LIBGENS_GLB_COMPONENT_UNSIGNED_INT             5125
+#define LIBGENS_GLB_COMPONENT_FLOAT                    5126
+#define LIBGENS_GLB_TARGET_NONE                        0
+#define LIBGENS_GLB_TARGET_ARRAY_BUFFER                34962
+#define LIBGENS_GLB_TARGET_ELEMENT_ARRAY_BUFFER        34963
+
 namespace LibGens {
 	enum XNFileMode {
 		MODE_AUTODETECT,
@@ -109,6 +152,77 @@ namespace LibGens {
 	};
 
 	class SonicXNObject;
+	class SonicXNPose;
+
+	// Forward-only XML writer used by the COLLADA exporter. Elements go straight to a buffered file
+	// instead of a TiXmlDocument, formatted exactly the way TinyXML prints the same tree. An element
+	// holds either child elements or a single text, and numbers go through SonicNumberFormat.
+	// A writer without a file collects a fragment in memory, indented for the depth it was created
+	// with, so parts of a document can be generated on other threads and appended in order.
+	class SonicDAEWriter {
+		protected:
+			FILE *file;
+			size_t depth;
+			string buffer;
+			string encoded;
+			vector<string> tags;
+			vector<unsigned char> states;
+
+			void closeTag(unsigned char state);
+		public:
+			SonicDAEWriter(size_t depth_p=0);
+			~SonicDAEWriter();
+
+			bool open(string filename);
+			void close();
+			void flush();
+
+			void declaration(string version);
+			void append(SonicDAEWriter &fragment);
+
+			size_t getDepth() {
+				return depth + tags.size();
+			}
+
+			void beginElement(const char *tag);
+			void attribute(const char *name, const string &value);
+			void attribute(const char *name, long long value);
+			void endElement();
+			void element(const char *tag, const string &value);
+			void elementFloat(const char *tag, float value);
+
+			void beginText();
+			void text(const string &value);
+			void textFloat(float value);
+			void textInt(long long value);
+	};
+
+	// Collects the JSON arrays and the binary chunk of a glTF 2.0 binary file. Every data block is
+	// copied into the binary chunk as is, getting its own buffer view and accessor. Objects are
+	// added to the top level arrays as JSON text and referenced by the index add returns.
+	class SonicGLBWriter {
+		protected:
+			vector<unsigned char> data;
+			map<string, vector<string> > arrays;
+		public:
+			SonicGLBWriter() {
+			}
+
+			size_t add(string array, const string &object);
+			size_t count(string array);
+			size_t addAccessor(const void *values, size_t count, unsigned int component_type, const char *type, unsigned int target, bool normalized=false);
+			size_t addFloatAccessor(const vector<float> &values, const char *type, size_t components, unsigned int target, bool bounds=false);
+			bool save(string filename);
+
+			static void appendString(string &json, const string &value);
+			static void appendFloat(string &json, float value);
+			static void appendInt(string &json, long long value);
+			static void appendFloats(string &json, const float *values, size_t count);
+
+			// Splits an affine transform into translation, rotation and scale, the way glTF stores nodes.
+			// The rotation comes out as an x, y, z, w quaternion.
+			static void decomposeTransform(Matrix4 &m, float *translation, float *rotation, float *scale);
+	};
 
 	class SonicXNSection {
 		protected:
@@ -370,6 +484,18 @@ namespace LibGens {
 
 			void read(File *file, unsigned int vertex_size, bool big_endian, unsigned int vertex_flag, XNFileMode file_mode);
 			void write(File *file, unsigned int vertex_size, bool big_endian, unsigned int vertex_flag, XNFileMode file_mode);
+			void writeENO(File *file, bool big_endian, unsigned int vertex_flag);
+			// Hash and comparison of the fields written with a layout, for sharing buffers through a SonicXNWritePool
+			void appendHash(size_t &hash, unsigned int vertex_flag, XNFileMode file_mode);
+			bool equalsLayout(SonicVertex &vertex, unsigned int vertex_flag, XNFileMode file_mode);
+
+			// Fills decoded with what read() gives back for this vertex once written with the layout
+			void decodeLayout(SonicVertex &decoded, unsigned int vertex_flag, XNFileMode file_mode);
+
+			static unsigned int packNormal360(Vector3 n);
+			static Vector3 unpackNormal360(unsigned int value);
+			static unsigned short packHalf(float value);
+			static float unpackHalf(unsigned short value);
 
 			void copy(SonicVertex &vertex) {
 				position = vertex.position;
@@ -404,6 +530,61 @@ namespace LibGens {
 			}
 	};
 
+	// Remembers where blocks of data were already written in a file, keyed by their contents,
+	// so identical blocks can point to a single copy.
+	class SonicXNWritePool {
+		protected:
+			std::unordered_map<string, size_t> addresses;
+			std::unordered_multimap<size_t, const void *> blocks;
+		public:
+			SonicXNWritePool() {
+			}
+
+			bool find(const string &key, size_t &address) {
+				std::unordered_map<string, size_t>::iterator it=addresses.find(key);
+				if (it == addresses.end()) return false;
+
+				address = it->second;
+				return true;
+			}
+
+			void add(const string &key, size_t address) {
+				addresses.insert(std::make_pair(key, address));
+			}
+
+			static void appendKey(string &key, const void *data, size_t size) {
+				key.append((const char *) data, size);
+			}
+
+			// Vertex and index buffers are too big to copy into keys, they're found by a hash of their
+			// contents instead. Every block added with the same hash is a candidate, which the caller
+			// compares against its own data before reusing the candidate's address.
+			void findBlocks(size_t hash, vector<const void *> &candidates) {
+				candidates.clear();
+
+				std::pair<std::unordered_multimap<size_t, const void *>::iterator, std::unordered_multimap<size_t, const void *>::iterator> range=blocks.equal_range(hash);
+				for (std::unordered_multimap<size_t, const void *>::iterator it=range.first; it != range.second; it++) {
+					candidates.push_back(it->second);
+				}
+			}
+
+			void addBlock(size_t hash, const void *block) {
+				blocks.insert(std::make_pair(hash, block));
+			}
+
+			// FNV-1a over the bytes
+			static void appendHash(size_t &hash, const void *data, size_t size) {
+				const unsigned char *bytes=(const unsigned char *) data;
+				for (size_t i=0; i<size; i++) {
+					hash = (hash ^ bytes[i]) * (size_t) 1099511628211ULL;
+				}
+			}
+
+			static size_t initialHash() {
+				return (size_t) 14695981039346656037ULL;
+			}
+	};
+
 	class SonicTextureUnitZNO {
 		public:
 			unsigned int flag;
@@ -418,6 +599,7 @@ namespace LibGens {
 
 			void read(File *file, bool big_endian);
 			void write(File *file);
+			void appendKey(string &key);
 	};
 
 	class SonicTextureUnit {
@@ -433,6 +615,7 @@ namespace LibGens {
 			void read(File *file, bool big_endian);
 			void write(File *file);
 			bool compare(SonicTextureUnit *t);
+			void appendKey(string &key);
 	};
 
 	class SonicMaterialColor {
@@ -448,6 +631,7 @@ namespace LibGens {
 			void read(File *file, XNFileMode file_mode, bool big_endian);
 			void write(File *file, XNFileMode file_mode);
 			bool compare(SonicMaterialColor *color);
+			void appendKey(string &key);
 	};
 
 	class SonicMaterialProperties {
@@ -499,6 +683,16 @@ namespace LibGens {
 			bool compareDataBlock2(SonicMaterialTable *table, XNFileMode file_mode);
 			bool compareTextureUnits(SonicMaterialTable *table, XNFileMode file_mode);
 
+			// Contents of each block as written, for sharing them through a SonicXNWritePool.
+			// Texture units can be shared by any table whose units are a prefix of another's,
+			// so writeTextureUnitsPooled registers every prefix.
+			string getDataBlock1Key(XNFileMode file_mode);
+			string getDataBlock2Key(XNFileMode file_mode);
+			string getTextureUnitsKey(XNFileMode file_mode, size_t unit_count);
+			void writeDataBlock1Pooled(File *file, XNFileMode file_mode, SonicXNWritePool &pool);
+			void writeDataBlock2Pooled(File *file, XNFileMode file_mode, SonicXNWritePool &pool);
+			void writeTextureUnitsPooled(File *file, XNFileMode file_mode, SonicXNWritePool &pool);
+
 			size_t getAddress() {
 				return head_address;
 			}
@@ -613,11 +807,36 @@ namespace LibGens {
 
 			void read(File *file, XNFileMode file_mode, bool big_endian);
 			void writeVertices(File *file, XNFileMode file_mode);
+			void writeVerticesPooled(File *file, XNFileMode file_mode, SonicXNWritePool &pool);
 			void writeTable(File *file);
 			void writeTableFixed(File *file);
 			void write(File *file);
 
 			void setScale(float scale);
+
+			// Smallest layout the readers accept for this table's data. Unused streams are dropped,
+			// and single bone ENO tables switch to the packed normal / half float UV layout.
+			// compactLayout only applies it after round tripping every vertex through read().
+			static unsigned int getVertexSize(unsigned int flag, XNFileMode file_mode);
+			unsigned int calculateCompactFlag(XNFileMode file_mode);
+			bool validateLayout(unsigned int flag, XNFileMode file_mode);
+			bool compactLayout(XNFileMode file_mode);
+
+			// Splits a skinned triangle list into groups whose bone palettes fit in max_bones.
+			// Input vertices must reference global matrix indices through bone_indices; the output
+			// vertices reference their group's bone table instead. Ownership of the input vertices
+			// is transferred to the output lists.
+			static void splitByBonePalette(vector<SonicVertex *> &vertices, vector<unsigned int> &indices, unsigned int max_bones,
+										   vector< vector<SonicVertex *> > &vertices_output, vector< vector<unsigned int> > &indices_output,
+										   vector< vector<unsigned int> > &bone_tables_output);
+
+			// Quadric error simplification through half-edge collapses. Vertices split by UV or normal
+			// seams are welded by position so seams and borders stay intact, and collapses between
+			// differently skinned vertices are penalized. The output indexes the same vertex list.
+			// Targets should be decreasing: each level continues collapsing from the previous one,
+			// and triangles_output gets one triangle list per target.
+			static void simplifyTriangles(vector<SonicVertex *> &vertices, vector<unsigned int> &triangles, vector<size_t> &target_triangles,
+										  vector< vector<unsigned int> > &triangles_output);
 	};
 
 	class SonicIndexTable {
@@ -636,11 +855,54 @@ namespace LibGens {
 
 			void read(File *file, bool big_endian);
 			void writeIndices(File *file);
+			void writeIndicesPooled(File *file, SonicXNWritePool &pool);
+
+			// Decodes the strips into a triangle list, skipping degenerate triangles.
+			void getTriangles(vector<unsigned int> &triangles);
+
+			// Replaces the strips with a stripified version of the triangle list.
+			void setTriangles(vector<unsigned int> &triangles);
 			void writeTable(File *file);
 			void write(File *file);
 	};
 
 
+	class SonicPointCloud {
+		public:
+			vector<float> x;
+			vector<float> y;
+			vector<float> z;
+
+			SonicPointCloud() {
+			}
+
+			void addPoint(float px, float py, float pz);
+			void addPoint(Vector3 point);
+			void calculateBox(Vector3 &box_min, Vector3 &box_max);
+			void calculateSphere(Vector3 &center, float &radius);
+			Vector3 calculateExtents(Vector3 center);
+			size_t findFarthest(float cx, float cy, float cz);
+	};
+
+
+	// Output of SonicXNObject::skinVertices for one vertex table, xyz per vertex in the table's order
+	class SonicSkinnedVertices {
+		public:
+			vector<float> positions;
+			vector<float> normals;
+			vector<float> tangents;
+	};
+
+
+	// Output of SonicXNObject::generateLODs for one ratio, the triangle list of every index table in order.
+	// Index tables that can't be simplified keep their original triangles.
+	class SonicLODLevel {
+		public:
+			float ratio;
+			vector< vector<unsigned int> > triangles;
+	};
+
+
 	class SonicSubmesh {
 		public:
 			Vector3 center;
@@ -729,6 +991,42 @@ namespace LibGens {
 			void write(File *file);
 
 			void setScale(float scale);
+
+			// Sets the local transform of an imported bone, along with the XYZ angles and current_matrix
+			void setTransform(Vector3 translation_p, Quaternion orientation_p, Vector3 scale_p);
+	};
+
+	// Affine bone matrices kept as one array per element of their top 3 rows, elements[r*4+c] holding row r
+	// and column c of every bone; the bottom row is always 0 0 0 1. The bones of one hierarchy level don't
+	// depend on each other, so matrices are composed, concatenated and inverted four bones per SSE vector.
+	class SonicBoneMatrices {
+		public:
+			vector<float> elements[12];
+
+			SonicBoneMatrices() {
+			}
+
+			// Resizes to count bones, all of them identity
+			void resize(size_t count);
+
+			size_t size() const {
+				return elements[0].size();
+			}
+
+			void set(size_t index, const Matrix4 &matrix);
+			Matrix4 get(size_t index) const;
+			void getAll(vector<Matrix4> &matrices) const;
+
+			// Composes every matrix like Matrix4::makeTransform, with the translation scaled by unit_scale. The
+			// arguments point to the x, y and z arrays of translation and scale, and the x, y, z and w ones of orientation.
+			void compose(const float *const *translation, const float *const *orientation, const float *const *scale, float unit_scale);
+
+			// Sets each of the count bones in level to its parent's matrix times its matrix in locals. Bones whose
+			// parent is out of range or themselves take the local one. Parents must be final before their level.
+			void concatenate(const SonicBoneMatrices &locals, const vector<unsigned short> &parents, const unsigned short *level, size_t count);
+
+			// Inverts every matrix into inverses through the cofactors of its 3x3 part, singular ones come out as zero
+			void invert(SonicBoneMatrices &inverses) const;
 	};
 
 	class SonicXNBones : public SonicXNSection {
@@ -762,74 +1060,32 @@ namespace LibGens {
 			}
 	};
 
-	class SonicFrameValue {
-		public:
-			float frame;
-			float value;
-
-			void read(File *file, bool big_endian);
-			void write(File *file);
-	};
-
-	class SonicFrameValueIntBeta {
+	// Position of the last sample inside a motion control's keys. Sampling frames in increasing
+	// order through the same cursor only steps forward instead of searching the keys again.
+	class SonicMotionCursor {
 		public:
-			float frame;
-			unsigned short value;
-
-			void read(File *file, bool big_endian);
-			void write(File *file);
-	};
-
-	class SonicFrameValueInt {
-		public:
-			unsigned short frame;
-			unsigned short value;
-
-			void read(File *file, bool big_endian);
-			void write(File *file);
-	};
-
-	class SonicFrameValueFloatsGroup {
-		public:
-			float frame;
-			unsigned int flag;
-			float unknown_1;
-			float unknown_2;
-			float unknown_3;
-			float unknown_4;
-
-			void read(File *file, bool big_endian);
-			void write(File *file);
-	};
+			size_t key;
 
-	class SonicFrameValueFloats {
-		public:
-			float frame;
-			Vector3 value;
-
-			void read(File *file, bool big_endian);
-			void write(File *file);
-	};
-
-	class SonicFrameValueAngles {
-		public:
-			unsigned short frame;
-			unsigned short value_x;
-			unsigned short value_y;
-			unsigned short value_z;
+			SonicMotionCursor() {
+				key = 0;
+			}
 
-			void read(File *file, bool big_endian);
-			void write(File *file);
+			void reset() {
+				key = 0;
+			}
 	};
 
 	class SonicMotionControl {
 		public:
-			vector<SonicFrameValue *> frame_values;
-			vector<SonicFrameValueInt *> frame_values_int;
-			vector<SonicFrameValueIntBeta *> frame_values_int_beta;
-			vector<SonicFrameValueFloats *> frame_values_floats;
-			vector<SonicFrameValueAngles *> frame_values_angles;
-			vector<SonicFrameValueFloatsGroup *> frame_values_floats_groups;
+			// Keys are stored as parallel arrays, one frame per key in key_frames and the values
+			// in the array matching getKeyType(). 16-bit frames are widened to float, which is exact.
+			vector<float> key_frames;
+			vector<float> key_values;
+			vector<unsigned short> key_values_int;
+			vector<Vector3> key_values_floats;
+			vector<unsigned short> key_values_angles;
+			vector<unsigned int> key_flags;
+			vector<float> key_values_groups;
 
 			unsigned int bone_index;
 			unsigned int type;
@@ -846,43 +1102,47 @@ namespace LibGens {
 			}
 
 			Vector3 getFrameVector(float frame, Vector3 reference);
+			Vector3 getFrameVector(float frame, Vector3 reference, SonicMotionCursor &cursor);
 			float getFrameValue(float frame, float reference);
+			float getFrameValue(float frame, float reference, SonicMotionCursor &cursor);
 
 			void read(File *file, bool big_endian);
 			void write(File *file);
 			void writeFrameValues(File *file);
 
+			unsigned int getKeyType();
+
+			size_t getKeyCount() {
+				return key_frames.size();
+			}
+
 			float getFirstFrameValue() {
-				SonicFrameValue *frame_value=(frame_values.size() ? frame_values[0] : NULL);
-				if (frame_value) return frame_value->value;
+				if (key_values.size()) return key_values[0];
 				else return 0.0f;
 			}
 
 			unsigned short getFirstFrameValueInt() {
-				SonicFrameValueInt *frame_value=(frame_values_int.size() ? frame_values_int[0] : NULL);
-				if (frame_value) return frame_value->value;
+				if (key_values_int.size()) return key_values_int[0];
 				else return 0;
 			}
 
 			bool onlyOneFrameValue() {
-				if (element_size == 16) {
-					return (frame_values_floats.size()==1);
-				}
-				else if (element_size == 8) {
-					if (type == LIBGENS_XNMOTION_TYPE_ANGLES_LINEAR) return (frame_values_angles.size()==1);
-					else return (frame_values.size()==1);
-				}
-				else if (element_size == 4) {
-					return (frame_values_int.size()==1);
+				if ((element_size == 16) || (element_size == 8) || (element_size == 4)) {
+					return (key_frames.size()==1);
 				}
 
 				return false;
 			}
 
+			void updateKeyRange();
 			void optimize();
 			void optimizeInt();
 			void optimizeAngles();
 
+			// Drops every key that interpolating the kept ones reproduces within the tolerance.
+			// angle_epsilon applies to the 16-bit angle channels, in 1/65536ths of a turn.
+			size_t reduceKeys(float epsilon, float angle_epsilon);
+
 			void setScale(float scale);
 	};
 
@@ -899,7 +1159,12 @@ namespace LibGens {
 
 			void read(File *file);
 			void writeBody(File *file);
-			void writeDAE(TiXmlElement *root, SonicXNObject *object, SonicXNBones *bones, float unit_scale);
+			void writeBoneDAE(SonicDAEWriter &writer, SonicXNPose &pose, SonicXNObject *object, SonicXNBones *bones, size_t bone_index, float unit_scale);
+			void writeDAE(SonicDAEWriter &writer, SonicXNObject *object, SonicXNBones *bones, float unit_scale, unsigned int thread_count=0);
+
+			// Samples every bone at each frame into linear translation, rotation and scale channels
+			// targeting the bone nodes, which start at bone_node.
+			void writeGLB(SonicGLBWriter &writer, SonicXNObject *object, size_t bone_node, float unit_scale);
 
 			float getFPS() {
 				return fps;
@@ -917,6 +1182,10 @@ namespace LibGens {
 				fps = v;
 			}
 
+			vector<SonicMotionControl *> &getMotionControls() {
+				return motion_controls;
+			}
+
 			void pushMotionControl(SonicMotionControl *motion_control);
 			void clearMotionControls();
 			void deleteMotionControl(SonicMotionControl *motion_control);
@@ -924,6 +1193,9 @@ namespace LibGens {
 										float bone_scale_x, float bone_scale_y, float bone_scale_z, 
 										unsigned short bone_rot_x, unsigned short bone_rot_y, unsigned short bone_rot_z);
 
+			// Runs SonicMotionControl::reduceKeys over every control in parallel and returns the kept key ratio
+			float reduceKeys(float epsilon, float angle_epsilon, unsigned int thread_count=0);
+
 			SonicMotionControl *getMotionControl(unsigned int type, unsigned int bone_index);
 			SonicMotionControl *getPositionMotionControl(unsigned int bone_index);
 			SonicMotionControl *getAnglesMotionControl(unsigned int bone_index);
@@ -969,6 +1241,9 @@ namespace LibGens {
 			unsigned int bone_matrix_count;
 			unsigned int header_flag;
 
+			vector<unsigned short> bone_hierarchy;
+			vector<size_t> bone_hierarchy_levels;
+
 			SonicXNTexture *texture;
 			SonicXNEffect *effect;
 			SonicXNBones *bones_names;
@@ -987,18 +1262,58 @@ namespace LibGens {
 			void writeBody(File *file);
 			bool getBoneIndexByName(string name_search, unsigned int &index);
 
-			void writeMaterialDAE(TiXmlElement *root);
-			void writeMaterialBindDAE(TiXmlElement *root);
-			void writeEffectsDAE(TiXmlElement *root, SonicXNTexture *texture);
-			void writeEffectTextureDAE(TiXmlElement *root, string tex_name);
-			void writeEffectTechniqueDAE(TiXmlElement *root, string tex_name);
-			void writeBonesDAE(TiXmlElement *root, size_t current, float unit_scale);
-			void writeControllerDAE(TiXmlElement *root, float unit_scale);
-			void writeMeshesDAE(TiXmlElement *root, float unit_scale);
-			void writeDAE(TiXmlElement *root, bool only_bones=false, float unit_scale=1.0f);
-
-			void calculateMaxBoneDepth(size_t parent, size_t depth=0);
-			void calculateBoneMatrixCount();
+			void writeMaterialDAE(SonicDAEWriter &writer);
+			void writeMaterialBindDAE(SonicDAEWriter &writer);
+			void writeEffectsDAE(SonicDAEWriter &writer, SonicXNTexture *texture);
+			void writeEffectTextureDAE(SonicDAEWriter &writer, string tex_name);
+			void writeEffectTechniqueDAE(SonicDAEWriter &writer, string tex_name);
+			void writeBonesDAE(SonicDAEWriter &writer, size_t current, float unit_scale);
+			void writeControllerDAE(SonicDAEWriter &writer, float unit_scale);
+			void writeMeshesDAE(SonicDAEWriter &writer, float unit_scale);
+			void writeDAE(SonicDAEWriter &writer, bool only_bones=false, float unit_scale=1.0f);
+
+			// Writes the materials, a mesh with a primitive per submesh and the skeleton with its skin.
+			// Texture i of the texture section maps to glTF texture i, with texture_names as image files.
+			// Returns the index of the first bone node, the bones follow it in order.
+			size_t writeGLB(SonicGLBWriter &writer, vector<string> &texture_names, float unit_scale=1.0f);
+			void writeMaterialsGLB(SonicGLBWriter &writer, vector<string> &texture_names);
+			void writeMeshesGLB(SonicGLBWriter &writer, string &primitives, float unit_scale);
+			size_t writeBonesGLB(SonicGLBWriter &writer, float unit_scale);
+
+			// Sorts the bones parents first into bone_hierarchy, with bone_hierarchy_levels holding where each
+			// depth level starts. Also updates bone_max_depth and bone_matrix_count. Reading, importing and
+			// writing the object call it, anything else editing the bones has to call it again.
+			void buildBoneHierarchy();
+
+			// The parents first order of buildBoneHierarchy, computed into the arguments without touching the object.
+			void sortBoneHierarchy(vector<unsigned short> &hierarchy, vector<size_t> &levels, unsigned int &max_depth);
+
+			// Maps every skinning matrix index to the first bone using it, or -1. Bones with the 0xFFFF
+			// index have no skinning matrix and are left out.
+			void buildMatrixToBone(vector<int> &matrix_to_bone);
+
+			// Rebuilds the bounding spheres and boxes of the object, its submeshes and its bones
+			// from the current vertex data. Bone volumes are stored in each bone's bind space.
+			void calculateBounds();
+			void calculateSubmeshBounds();
+			void calculateBoneBounds();
+
+			// Simplifies every submesh to each ratio of its triangles without changing the object, one level
+			// per ratio in levels. Runs a thread per submesh at a time; thread_count 0 uses all available cores.
+			void generateLODs(vector<float> &ratios, vector<SonicLODLevel> &levels, unsigned int thread_count=0);
+
+			// Replaces the triangles of every index table with the ones of a level, drops the vertices
+			// it no longer uses and refreshes the submesh bounds. Meant for saving a LOD from a loaded copy.
+			void applyLOD(SonicLODLevel &level);
+			void removeUnusedVertices();
+
+			// Skins every vertex table through its bone_table palette into output, one entry per table.
+			// bone_matrices holds the world matrix of each bone, like the bind pose or SonicXNPose::world_matrices.getAll.
+			// Runs a thread per table at a time; thread_count 0 uses all available cores.
+			void skinVertices(vector<Matrix4> &bone_matrices, vector<SonicSkinnedVertices> &output, unsigned int thread_count=0);
+
+			// Switches every vertex table to its smallest validated layout before saving.
+			void compactVertexLayouts();
 
 			void setNames(string v) {
 				name = v;
@@ -1009,12 +1324,58 @@ namespace LibGens {
 
 			void setScale(float scale);
 			void setBoneScale(unsigned short current_index, float scale, bool dont_scale=false);
-			void calculateSkinningMatrix(unsigned short current_index, LibGens::Matrix4 parent_matrix);
 			void calculateSkinningMatrices();
 			void calculateSkinningIDs();
 	};
 
 
+	// Evaluates a motion on every bone of an object in one call. Controls are matched to bones
+	// once on construction, and each bone channel keeps its own cursor, so playing frames in
+	// order never searches the keys again. Channels and matrices are kept per bone in separate arrays.
+	class SonicXNPose {
+		protected:
+			SonicXNMotion *motion;
+			SonicXNObject *object;
+			vector<SonicMotionControl *> controls;
+			vector<SonicMotionCursor> cursors;
+			vector<unsigned short> order;
+			vector<size_t> levels;
+			vector<unsigned short> parents;
+
+			// Samples the channels of a single bone into the arrays, without building its matrix
+			void sampleBone(size_t bone_index, float frame);
+		public:
+			vector<float> translation_x;
+			vector<float> translation_y;
+			vector<float> translation_z;
+			vector<float> rotation_x;
+			vector<float> rotation_y;
+			vector<float> rotation_z;
+			vector<float> scale_x;
+			vector<float> scale_y;
+			vector<float> scale_z;
+			vector<float> orientation_x;
+			vector<float> orientation_y;
+			vector<float> orientation_z;
+			vector<float> orientation_w;
+
+			SonicBoneMatrices local_matrices;
+			SonicBoneMatrices world_matrices;
+
+			SonicXNPose(SonicXNMotion *motion_p, SonicXNObject *object_p);
+
+			// Updates the channels and local matrix of a single bone and returns the matrix.
+			Matrix4 evaluateBone(size_t bone_index, float frame, float unit_scale=1.0f);
+
+			// Samples every bone, then composes the local matrices and concatenates the world ones
+			// one hierarchy level at a time, four bones per SSE vector.
+			void evaluate(float frame, float unit_scale=1.0f);
+
+			// Rewinds the cursors when playback restarts from the beginning.
+			void reset();
+	};
+
+
 	class SonicXNOffsetTable : public SonicXNSection {
 		protected:
 			vector<size_t> addresses;
@@ -1069,6 +1430,9 @@ namespace LibGens {
 			string header_bones;
 			string header_object;
 			string header_motion;
+
+			// Bone of every FBX node linked by a skin cluster, filled by importFBX
+			map<FbxNode *, unsigned int> fbx_bones;
 		public:
 			SonicXNFile(string filename, XNFileMode file_mode_parameter=MODE_AUTODETECT);
 
@@ -1227,15 +1591,32 @@ namespace LibGens {
 			
 			void setFileMode(XNFileMode target_file_mode);
 			void saveDAE(string filename, bool only_animation=false, float unit_scale=1.0f);
+			void saveGLB(string filename, float unit_scale=1.0f);
+
+			// Copies the textures next to an exported file into its textures folder, with .gvr
+			// textures switched to the .png files they're converted to. Returns the file names.
+			vector<string> exportTextures(string filename);
 
 			void setHeaders();
 
 			void importFBX(FBX *fbx);
+			void addFBXBones(FbxScene *lScene);
 			void addFBXNode(FbxNode *lNode);
 			void addFBXMaterial(FbxSurfaceMaterial *lMaterial);
 			void addFBXMaterialProperty(FbxProperty *lProperty, SonicMaterialTable *sonic_material_table);
 			void addFBXSubmesh(FbxNode *lNode, FbxMesh *lMesh, SonicMesh *sonic_mesh, int material_index, int material_base_index, bool single_material, FbxAMatrix transform_matrix);
 
+			// Imports the meshes, materials and skins of a glTF 2.0 file, either a .glb or a .gltf with
+			// embedded or external buffers. Missing sections are created.
+			void importGLTF(string filename, float unit_scale=1.0f);
+
+			// Shared by the importers. Submeshes are split by bone palette, and get an effect entry
+			// named after the material unless material_name is NULL.
+			SonicMaterialTable *addMaterialTable();
+			void addMaterialTexture(SonicMaterialTable *sonic_material_table, string texture_name);
+			void addMaterialEffect(string material_name);
+			void addSubmeshes(SonicMesh *sonic_mesh, vector<SonicVertex *> &vertices, vector<unsigned int> &indices, unsigned int material_index, const char *material_name);
+
 			void createTextureSection();
 			void createEffectSection();
 			void createBoneSection();
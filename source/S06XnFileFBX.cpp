@@ -21,21 +21,74 @@
 #include "S06XnFile.h"
 
 namespace LibGens {
-	const unsigned char xno_constant_floats[80] = { 
-										   0x00 ,0x00 ,0x80 ,0x3F ,0x00 ,0x00 ,0x80 ,0x3F ,0x00 ,0x00 ,0x80 ,0x3F ,0x00 ,0x00 ,0x80 ,0x3F 
-										  ,0x00 ,0x00 ,0x80 ,0x3F ,0x00 ,0x00 ,0x80 ,0x3F ,0x00 ,0x00 ,0x80 ,0x3F ,0x00 ,0x00 ,0x80 ,0x3F 
-										  ,0x00 ,0x00 ,0x00 ,0x00 ,0x00 ,0x00 ,0x00 ,0x00 ,0x00 ,0x00 ,0x00 ,0x00 ,0x00 ,0x00 ,0x80 ,0x3F 
-										  ,0x00 ,0x00 ,0x00 ,0x00 ,0x00 ,0x00 ,0x00 ,0x00 ,0x00 ,0x00 ,0x00 ,0x00 ,0x00 ,0x00 ,0x80 ,0x3F 
-										  ,0xFF ,0xFF ,0xFF ,0x40 ,0x00 ,0x00 ,0x00 ,0x00 ,0x00 ,0x00 ,0x00 ,0x00 ,0x00 ,0x00 ,0x00 ,0x00 
-										 };
-
-	const unsigned char xno_constant_ints[64] =   { 
-										   0x01 ,0x00 ,0x00 ,0x00 ,0x02 ,0x03 ,0x00 ,0x00 ,0x03 ,0x03 ,0x00 ,0x00 ,0x00 ,0x00 ,0x00 ,0x00 
-										  ,0x06 ,0x80 ,0x00 ,0x00 ,0x00 ,0x00 ,0x00 ,0x00 ,0x01 ,0x00 ,0x00 ,0x00 ,0x04 ,0x02 ,0x00 ,0x00 
-										  ,0x00 ,0x00 ,0x00 ,0x00 ,0x01 ,0x00 ,0x00 ,0x00 ,0x03 ,0x02 ,0x00 ,0x00 ,0x01 ,0x00 ,0x00 ,0x00 
-										  ,0x00 ,0x00 ,0x00 ,0x00 ,0x00 ,0x00 ,0x00 ,0x00 ,0x00 ,0x00 ,0x00 ,0x00 ,0x00 ,0x00 ,0x00 ,0x00 
-										 };
+	// FBX matrices keep the translation in the last row. Axes get converted the same way as the
+	// vertices, (x, y, z) becoming (x, z, -y).
+	static void convertFBXMatrix(const FbxAMatrix &fbx_matrix, Matrix4 &matrix) {
+		const int axes[4]={ 0, 2, 1, 3 };
+		const float signs[4]={ 1.0f, 1.0f, -1.0f, 1.0f };
+
+		for (size_t r=0; r<4; r++) {
+			for (size_t c=0; c<4; c++) {
+				matrix[r][c] = signs[r] * signs[c] * fbx_matrix.Get(axes[r], axes[c]);
+			}
+		}
+	}
+
+	// Four heaviest influences of every control point from the mesh's skin clusters, normalized.
+	// Returns how many influences past the fourth were dropped.
+	static size_t getFBXSkinWeights(FbxMesh *lMesh, map<FbxNode *, unsigned int> &fbx_bones, vector<unsigned char> &bone_indices, vector<float> &bone_weights) {
+		int control_points_count=lMesh->GetControlPointsCount();
+		bone_indices.assign(control_points_count*4, 0);
+		bone_weights.assign(control_points_count*4, 0.0f);
+		size_t dropped=0;
+
+		for (int d=0; d<lMesh->GetDeformerCount(FbxDeformer::eSkin); d++) {
+			FbxSkin *lSkin=(FbxSkin *) lMesh->GetDeformer(d, FbxDeformer::eSkin);
+
+			for (int c=0; c<lSkin->GetClusterCount(); c++) {
+				FbxCluster *lCluster=lSkin->GetCluster(c);
+				map<FbxNode *, unsigned int>::iterator it=fbx_bones.find(lCluster->GetLink());
+				if ((it == fbx_bones.end()) || (it->second >= 256)) continue;
+
+				int *control_point_indices=lCluster->GetControlPointIndices();
+				double *control_point_weights=lCluster->GetControlPointWeights();
+				for (int i=0; i<lCluster->GetControlPointIndicesCount(); i++) {
+					int point=control_point_indices[i];
+					float weight=control_point_weights[i];
+					if ((point < 0) || (point >= control_points_count) || (weight <= 0.0f)) continue;
+
+					// Slots stay sorted by weight, so the lightest influence is the one that falls off
+					unsigned char *indices=&bone_indices[point*4];
+					float *weights=&bone_weights[point*4];
+					if (weights[3] > 0.0f) dropped++;
+
+					for (size_t k=0; k<4; k++) {
+						if (weight <= weights[k]) continue;
+
+						for (size_t m=3; m>k; m--) {
+							indices[m] = indices[m-1];
+							weights[m] = weights[m-1];
+						}
+						indices[k] = it->second;
+						weights[k] = weight;
+						break;
+					}
+				}
+			}
+		}
 
+		for (int point=0; point<control_points_count; point++) {
+			float *weights=&bone_weights[point*4];
+			float total=weights[0] + weights[1] + weights[2] + weights[3];
+
+			if (total > 0.0f) {
+				for (size_t k=0; k<4; k++) weights[k] /= total;
+			}
+			else weights[0] = 1.0f;
+		}
+
+		return dropped;
+	}
 
 	void SonicXNFile::importFBX(FBX *fbx) {
 		FbxScene *lScene = fbx->getScene();
@@ -47,10 +100,10 @@ namespace LibGens {
 			SonicBone *sonic_bone=new SonicBone();
 			sonic_bone->zero();
 			object->bones.push_back(sonic_bone);
-
-			object->aabb.reset();
 		}
 
+		addFBXBones(lScene);
+
 		// This function show how to cycle through scene elements in a linear way.
 		const int lNodeCount = lScene->GetSrcObjectCount<FbxNode>();
 		FbxStatus lStatus;
@@ -61,14 +114,99 @@ namespace LibGens {
 			addFBXNode(lNode);
 		}
 
-		// Build Center and Radius
+		// Build Bone Hierarchy and Bounding Volumes
 		if (object) {
-			object->center = object->aabb.center();
-			object->radius = object->aabb.sizeMax();
+			object->buildBoneHierarchy();
+			object->calculateBounds();
 		}
 	}
 
 
+	void SonicXNFile::addFBXBones(FbxScene *lScene) {
+		SonicXNObject *object=getObject();
+		if (!object) return;
+
+		SonicXNBones *bones_section=getBones();
+		fbx_bones.clear();
+
+		// One bone per node linked by a skin cluster, with the node's global matrix at bind time
+		vector<FbxNode *> bone_nodes;
+		vector<FbxAMatrix> bind_matrices;
+		size_t bone_base=object->bones.size();
+
+		const int lNodeCount = lScene->GetSrcObjectCount<FbxNode>();
+		for (int lIndex=0; lIndex<lNodeCount; lIndex++) {
+			FbxMesh *lMesh = lScene->GetSrcObject<FbxNode>(lIndex)->GetMesh();
+			if (!lMesh) continue;
+
+			for (int d=0; d<lMesh->GetDeformerCount(FbxDeformer::eSkin); d++) {
+				FbxSkin *lSkin=(FbxSkin *) lMesh->GetDeformer(d, FbxDeformer::eSkin);
+
+				for (int c=0; c<lSkin->GetClusterCount(); c++) {
+					FbxCluster *lCluster=lSkin->GetCluster(c);
+					FbxNode *lLink=lCluster->GetLink();
+					if (!lLink || fbx_bones.count(lLink)) continue;
+
+					FbxAMatrix bind_matrix;
+					lCluster->GetTransformLinkMatrix(bind_matrix);
+
+					fbx_bones[lLink] = bone_base + bone_nodes.size();
+					bone_nodes.push_back(lLink);
+					bind_matrices.push_back(bind_matrix);
+				}
+			}
+		}
+
+		if (bone_base + bone_nodes.size() > 256) {
+			Error::addMessage(Error::WARNING, "Vertices can only reference the first 256 bones, influences of the remaining FBX bones will be dropped.");
+		}
+
+		for (size_t b=0; b<bone_nodes.size(); b++) {
+			// Bones without a skinned ancestor hang from the root bone
+			FbxNode *lParent=bone_nodes[b]->GetParent();
+			while (lParent && !fbx_bones.count(lParent)) lParent = lParent->GetParent();
+
+			unsigned int parent=lParent ? fbx_bones[lParent] : 0;
+			FbxAMatrix local_matrix=lParent ? bind_matrices[parent - bone_base].Inverse() * bind_matrices[b] : bind_matrices[b];
+
+			SonicBone *bone=new SonicBone();
+			bone->zero();
+			bone->flag &= ~3840u;
+			bone->matrix_index = bone_base + b;
+			bone->parent_index = parent;
+
+			// Bones store the inverse bind matrix transposed, which is the FBX layout
+			convertFBXMatrix(bind_matrices[b].Inverse(), bone->matrix);
+
+			FbxVector4 translation=local_matrix.GetT();
+			FbxQuaternion rotation=local_matrix.GetQ();
+			FbxVector4 scale=local_matrix.GetS();
+
+			Quaternion orientation;
+			orientation.x = rotation[0];
+			orientation.y = rotation[2];
+			orientation.z = -rotation[1];
+			orientation.w = rotation[3];
+			bone->setTransform(Vector3(translation[0], translation[2], -translation[1]), orientation, Vector3(scale[0], scale[2], scale[1]));
+			object->bones.push_back(bone);
+
+			if (bones_section) bones_section->addBone(bone_nodes[b]->GetName(), bone_base + b);
+		}
+
+		// Children and siblings links, in the same order as the bones
+		for (size_t b=bone_base; b<object->bones.size(); b++) {
+			unsigned short parent=object->bones[b]->parent_index;
+			if (parent >= object->bones.size()) continue;
+
+			if (object->bones[parent]->child_index == 0xFFFF) object->bones[parent]->child_index = b;
+			else {
+				SonicBone *sibling=object->bones[object->bones[parent]->child_index];
+				while (sibling->sibling_index != 0xFFFF) sibling = object->bones[sibling->sibling_index];
+				sibling->sibling_index = b;
+			}
+		}
+	}
+
 	void SonicXNFile::addFBXNode(FbxNode *lNode) {
 		if (!lNode) return;
 
@@ -113,8 +251,6 @@ namespace LibGens {
 		SonicXNObject  *object=getObject();
 		if (!object) return;
 
-		SonicXNEffect *effect = getEffect();
-
 		FbxAMatrix rotation_matrix = transform_matrix;
 		rotation_matrix.SetT(FbxVector4(0.0, 0.0, 0.0, 0.0));
 		rotation_matrix.SetS(FbxVector4(1.0, 1.0, 1.0, 1.0));
@@ -152,6 +288,14 @@ namespace LibGens {
 			FbxVector4 *control_points=lMesh->GetControlPoints();
 			int vertex_color_count = lMesh->GetElementVertexColorCount();
 
+			// Skinned vertices keep their bind pose, which the mesh's global transform is assumed to be
+			vector<unsigned char> skin_indices;
+			vector<float> skin_weights;
+			size_t dropped_weights=getFBXSkinWeights(lMesh, fbx_bones, skin_indices, skin_weights);
+			if (dropped_weights) {
+				Error::addMessage(Error::WARNING, ToString(dropped_weights) + " bone influences past the fourth of a vertex were dropped from FBX mesh " + ToString(lNode->GetName()) + ".");
+			}
+
 			for (int lPolygonIndex = 0; lPolygonIndex < lPolygonCount; ++lPolygonIndex) {
 				if (lMaterialIndice) {
 					const int lMaterialIndex = lMaterialIndice->GetAt(lPolygonIndex);
@@ -176,8 +320,10 @@ namespace LibGens {
 						v->position = Vector3(control_point[0], control_point[2], -control_point[1]);
 						v->normal   = Vector3(normal[0], normal[2], -normal[1]);
 
-						// Add to AABB
-						object->aabb.addPoint(v->position);
+						for (size_t k=0; k<4; k++) {
+							v->bone_indices[k] = skin_indices[control_point_index*4 + k];
+							v->bone_weights_f[k] = skin_weights[control_point_index*4 + k];
+						}
 
 						FbxStringList uv_sets;
 						lMesh->GetUVSetNames(uv_sets);
@@ -246,109 +392,10 @@ namespace LibGens {
 		}
 		
 
-		vector< vector<SonicVertex *> > vertices_output;
-		vector< vector<unsigned int> > indices_output;
-		unsigned int max_skinning_bones=32;
-		// Temporary Workaround for submesh splitting, just add existing tables
-		vertices_output.push_back(new_vertices);
-		indices_output.push_back(new_indices);
-
-		for (size_t split=0; split<vertices_output.size(); split++){
-			// Per submesh add a reference to the effect file based on the material names
-			// Also add any new effect names
-			if (effect) {
-				FbxSurfaceMaterial *lMaterial=lNode->GetMaterial(material_index);
-
-				if (lMaterial) {
-					string material_name = ToString(lMaterial->GetName());
-
-					string shader_name = "Billboard03.fx";
-					string sub_shader_name = "Billboard03";
-
-					size_t shader_name_pos = material_name.find_first_of("@");
-					size_t sub_shader_name_pos = material_name.find_last_of("@");
-
-					// One @ Symbol was found at least
-					if (shader_name_pos != string::npos) {
-						shader_name_pos += 1;
-						sub_shader_name_pos += 1;
-
-						// Verify if there's more than one @ symbol
-						if (shader_name_pos != sub_shader_name_pos) {
-							shader_name = material_name.substr(shader_name_pos, sub_shader_name_pos-shader_name_pos-1);
-							sub_shader_name = material_name.substr(sub_shader_name_pos, material_name.size()-sub_shader_name_pos);
-						}
-						// There's only one @ symbol, auto-generate .fx name
-						else {
-							sub_shader_name = material_name.substr(shader_name_pos, material_name.size()-shader_name_pos);
-							shader_name = sub_shader_name + ".fx";
-						}
-					}
-
-					size_t material_effect_shader_index = effect->addMaterialShader(shader_name);
-					size_t material_effect_index = effect->addMaterialName(sub_shader_name, material_effect_shader_index);
-					effect->addExtra(material_effect_index);
-				}
-			}
-
-			// Create submesh per split
-			unsigned int sonic_vertex_index=object->vertex_tables.size();
-			SonicVertexTable *sonic_vertex_table=new SonicVertexTable();
-			sonic_vertex_table->vertices = vertices_output[split];
-			sonic_vertex_table->vertex_size = 52;
-			sonic_vertex_table->flag_1 = 0x01740B;
-			sonic_vertex_table->flag_2 = 0x115A;
-			sonic_vertex_table->bone_table.push_back(0); // FIXME: Fake Skinning
-			object->vertex_tables.push_back(sonic_vertex_table);
-
-			unsigned int sonic_index_index=object->index_tables.size();
-			SonicIndexTable *sonic_index_table=new SonicIndexTable();
-			sonic_index_table->flag = 0x4810;
-			object->index_tables.push_back(sonic_index_table);
-
-			triangle_stripper::indices tri_indices;
-			for (size_t i=0; i<indices_output[split].size(); i+=3) {
-				tri_indices.push_back(indices_output[split][i]);
-				tri_indices.push_back(indices_output[split][i+1]);
-				tri_indices.push_back(indices_output[split][i+2]);
-			}
-
-			triangle_stripper::tri_stripper stripper(tri_indices);
-			stripper.SetCacheSize(0);
-			stripper.SetBackwardSearch(false);
-			triangle_stripper::primitive_vector out_vector;
-			stripper.Strip(&out_vector);
-
-			for (size_t i=0; i<out_vector.size(); i+=1) {
-				if (out_vector[i].Type == triangle_stripper::TRIANGLE_STRIP) {
-					for (size_t j=0; j<out_vector[i].Indices.size(); j++) {
-						sonic_index_table->indices.push_back(out_vector[i].Indices[j]);
-					}
-					sonic_index_table->strip_sizes.push_back(out_vector[i].Indices.size());
-				}
-				else {
-					for (size_t j=0; j<out_vector[i].Indices.size(); j+=3) {
-						sonic_index_table->indices.push_back(out_vector[i].Indices[j]);
-						sonic_index_table->indices.push_back(out_vector[i].Indices[j+1]);
-						sonic_index_table->indices.push_back(out_vector[i].Indices[j+2]);
-						sonic_index_table->strip_sizes.push_back(3);
-					}
-				}
-			}
-
-			SonicSubmesh *sonic_submesh=new SonicSubmesh();
-			sonic_submesh->node_index   = 0x36;
-			sonic_submesh->matrix_index = 0xFFFFFFFF;
-			sonic_submesh->center.x = 0.0f;
-			sonic_submesh->center.y = 0.0f;
-			sonic_submesh->center.z = 0.0f;
-			sonic_submesh->radius   = 0.0f;
-			sonic_submesh->material_index  = sonic_material_index + material_base_index;
-			sonic_submesh->vertex_index    = sonic_vertex_index;
-			sonic_submesh->indices_index   = sonic_index_index;
-			sonic_submesh->indices_index_2 = sonic_index_index;
-			sonic_mesh->submeshes.push_back(sonic_submesh);
-		}
+		// Per submesh add a reference to the effect file based on the material name
+		FbxSurfaceMaterial *lMaterial=lNode->GetMaterial(material_index);
+		string material_name = (lMaterial ? ToString(lMaterial->GetName()) : "");
+		addSubmeshes(sonic_mesh, new_vertices, new_indices, sonic_material_index + material_base_index, lMaterial ? material_name.c_str() : NULL);
 	}
 
 
@@ -362,23 +409,7 @@ namespace LibGens {
 			if (lTexture) {
 				string texture_name = File::nameFromFilename(ToString(lTexture->GetFileName()));
 
-				size_t pos=texture_name.find(".png");
-				if (pos == string::npos) pos=texture_name.find(".PNG");
-				if (pos != string::npos) {
-					texture_name.replace(pos, 4, ".dds");
-				}
-
-				unsigned int texture_index = texture->addTexture(texture_name);
-
-				SonicTextureUnit *texture_unit = new SonicTextureUnit();
-				texture_unit->flag_f = 2.187562f;
-				texture_unit->index = texture_index;
-				texture_unit->flag = 0x80000000;
-				texture_unit->flag_2_f = 1.0f;
-				texture_unit->flag_2 = 0x010004;
-				texture_unit->flag_3_f = 0.0f;
-				texture_unit->flag_3 = 0;
-				sonic_material_table->texture_units.push_back(texture_unit);
+				addMaterialTexture(sonic_material_table, texture_name);
 			}
 		}
 	}
@@ -390,15 +421,7 @@ namespace LibGens {
 		
 		if (texture && object) {
 			// Set up Material Table
-			SonicMaterialTable *sonic_material_table = new SonicMaterialTable();
-
-			sonic_material_table->data_block_1_length = 20;
-			sonic_material_table->data_block_2_length = 16;
-
-			memcpy(sonic_material_table->first_floats, xno_constant_floats, 80);
-			memcpy(sonic_material_table->first_ints, xno_constant_ints, 64);
-			sonic_material_table->flag_table = 0x1000030;
-			sonic_material_table->user_flag = 0;
+			SonicMaterialTable *sonic_material_table = addMaterialTable();
 
 			// Scan for textures
 			for (size_t i=0; i<10; i++) {
@@ -420,9 +443,6 @@ namespace LibGens {
 					if (lProperty.IsValid()) addFBXMaterialProperty(&lProperty, sonic_material_table);
 				}
 			}
-
-			// Push to object material tables
-			object->material_tables.push_back(sonic_material_table);
 		}
 	}
 
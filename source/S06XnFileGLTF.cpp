@@ -0,0 +1,1003 @@
+//=========================================================================
+//	  Copyright (c) 2016 SonicGLvl
+//
+//    This file is part of SonicGLvl, a community-created free level editor
+//    for the PC version of Sonic Generations.
+//
+//    SonicGLvl is free software: you can redistribute it and/or modify
+//    it under the terms of the GNU General Public License as published by
+//    the Free Software Foundation, either version 3 of the License, or
+//    (at your option) any later version.
+//
+//    SonicGLvl is distributed in the hope that it will be useful,
+//    but WITHOUT ANY WARRANTY; without even the implied warranty of
+//    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+//
+//
+//    Read AUTHORS.txt, LICENSE.txt and COPYRIGHT.txt for more details.
+//=========================================================================
+
+#include "LibGens.h"
+#include <algorithm>
+#include "S06XnFile.h"
+
+#define LIBGENS_GLTF_MAX_DEPTH      256
+#define LIBGENS_GLTF_UNASSIGNED     0xFFFFFFFF
+
+namespace LibGens {
+	// Parsed glTF JSON. Objects keep their keys and values as two parallel lists in file order.
+	class SonicGLTFValue {
+		public:
+			char type;
+			double number;
+			string text;
+			vector<string> keys;
+			vector<SonicGLTFValue> values;
+
+			SonicGLTFValue() {
+				type = 0;
+				number = 0.0;
+			}
+	};
+
+	// All lookups accept NULL, so chains of optional properties don't need checks at every step
+	static const SonicGLTFValue *gltfMember(const SonicGLTFValue *value, const char *key) {
+		if (!value || (value->type != 'o')) return NULL;
+
+		for (size_t i=0; i<value->keys.size(); i++) {
+			if (value->keys[i] == key) return &value->values[i];
+		}
+		return NULL;
+	}
+
+	static const SonicGLTFValue *gltfElement(const SonicGLTFValue *value, size_t index) {
+		if (!value || (value->type != 'a') || (index >= value->values.size())) return NULL;
+		return &value->values[index];
+	}
+
+	static size_t gltfCount(const SonicGLTFValue *value) {
+		if (!value || (value->type != 'a')) return 0;
+		return value->values.size();
+	}
+
+	static double gltfNumber(const SonicGLTFValue *value, const char *key, double default_value) {
+		const SonicGLTFValue *member=gltfMember(value, key);
+		if (!member || (member->type != 'n')) return default_value;
+		return member->number;
+	}
+
+	static int gltfIndex(const SonicGLTFValue *value, const char *key) {
+		double number=gltfNumber(value, key, -1.0);
+		if ((number < 0.0) || (number > 0x7FFFFFFF)) return -1;
+		return (int) number;
+	}
+
+	// Byte offsets, lengths and strides, false if the member is negative or too large for a buffer
+	static bool gltfSize(const SonicGLTFValue *value, const char *key, size_t &size) {
+		double number=gltfNumber(value, key, 0.0);
+		if ((number < 0.0) || (number > 0xFFFFFFFFu)) return false;
+		size = (size_t) number;
+		return true;
+	}
+
+	static string gltfString(const SonicGLTFValue *value, const char *key) {
+		const SonicGLTFValue *member=gltfMember(value, key);
+		if (!member || (member->type != 's')) return "";
+		return member->text;
+	}
+
+	static void gltfFloats(const SonicGLTFValue *value, const char *key, float *output, size_t count) {
+		const SonicGLTFValue *member=gltfMember(value, key);
+		if (gltfCount(member) != count) return;
+
+		for (size_t i=0; i<count; i++) {
+			if (member->values[i].type == 'n') output[i] = member->values[i].number;
+		}
+	}
+
+
+	// Recursive descent JSON parser. The text must be null terminated.
+	class SonicGLTFParser {
+		protected:
+			const char *current;
+			size_t depth;
+
+			void skipSpace() {
+				while ((*current == ' ') || (*current == '\t') || (*current == '\n') || (*current == '\r')) current++;
+			}
+
+			static void appendUTF8(string &text, unsigned int code) {
+				if (code < 0x80) text += (char) code;
+				else if (code < 0x800) {
+					text += (char) (0xC0 | (code >> 6));
+					text += (char) (0x80 | (code & 0x3F));
+				}
+				else if (code < 0x10000) {
+					text += (char) (0xE0 | (code >> 12));
+					text += (char) (0x80 | ((code >> 6) & 0x3F));
+					text += (char) (0x80 | (code & 0x3F));
+				}
+				else {
+					text += (char) (0xF0 | (code >> 18));
+					text += (char) (0x80 | ((code >> 12) & 0x3F));
+					text += (char) (0x80 | ((code >> 6) & 0x3F));
+					text += (char) (0x80 | (code & 0x3F));
+				}
+			}
+
+			bool parseHex(unsigned int &code) {
+				code = 0;
+				for (size_t i=0; i<4; i++) {
+					char c=*current++;
+					code <<= 4;
+					if ((c >= '0') && (c <= '9')) code |= c - '0';
+					else if ((c >= 'a') && (c <= 'f')) code |= c - 'a' + 10;
+					else if ((c >= 'A') && (c <= 'F')) code |= c - 'A' + 10;
+					else return false;
+				}
+				return true;
+			}
+
+			bool parseString(string &text) {
+				if (*current != '"') return false;
+				current++;
+
+				while (*current != '"') {
+					char c=*current++;
+					if (!c) return false;
+
+					if (c != '\\') {
+						text += c;
+						continue;
+					}
+
+					c = *current++;
+					if (c == 'b') text += '\b';
+					else if (c == 'f') text += '\f';
+					else if (c == 'n') text += '\n';
+					else if (c == 'r') text += '\r';
+					else if (c == 't') text += '\t';
+					else if (c == 'u') {
+						unsigned int code=0;
+						if (!parseHex(code)) return false;
+
+						// Characters outside the basic plane come as a surrogate pair
+						if ((code >= 0xD800) && (code < 0xDC00) && (current[0] == '\\') && (current[1] == 'u')) {
+							current += 2;
+							unsigned int low=0;
+							if (!parseHex(low)) return false;
+							code = 0x10000 + ((code - 0xD800) << 10) + (low - 0xDC00);
+						}
+						appendUTF8(text, code);
+					}
+					else if (c) text += c;
+					else return false;
+				}
+
+				current++;
+				return true;
+			}
+
+			bool parseLiteral(const char *literal) {
+				size_t length=strlen(literal);
+				if (strncmp(current, literal, length)) return false;
+				current += length;
+				return true;
+			}
+		public:
+			SonicGLTFParser(const char *text) {
+				current = text;
+				depth = 0;
+			}
+
+			bool parse(SonicGLTFValue &value) {
+				skipSpace();
+
+				char c=*current;
+				if (c == '{') {
+					if (++depth > LIBGENS_GLTF_MAX_DEPTH) return false;
+					value.type = 'o';
+					current++;
+					skipSpace();
+
+					if (*current == '}') current++;
+					else {
+						while (true) {
+							skipSpace();
+							value.keys.push_back("");
+							if (!parseString(value.keys.back())) return false;
+
+							skipSpace();
+							if (*current++ != ':') return false;
+
+							value.values.push_back(SonicGLTFValue());
+							if (!parse(value.values.back())) return false;
+
+							skipSpace();
+							c = *current++;
+							if (c == '}') break;
+							if (c != ',') return false;
+						}
+					}
+					depth--;
+				}
+				else if (c == '[') {
+					if (++depth > LIBGENS_GLTF_MAX_DEPTH) return false;
+					value.type = 'a';
+					current++;
+					skipSpace();
+
+					if (*current == ']') current++;
+					else {
+						while (true) {
+							value.values.push_back(SonicGLTFValue());
+							if (!parse(value.values.back())) return false;
+
+							skipSpace();
+							c = *current++;
+							if (c == ']') break;
+							if (c != ',') return false;
+						}
+					}
+					depth--;
+				}
+				else if (c == '"') {
+					value.type = 's';
+					return parseString(value.text);
+				}
+				else if (c == 't') {
+					value.type = 'b';
+					value.number = 1.0;
+					return parseLiteral("true");
+				}
+				else if (c == 'f') {
+					value.type = 'b';
+					return parseLiteral("false");
+				}
+				else if (c == 'n') {
+					return parseLiteral("null");
+				}
+				else {
+					char *end=NULL;
+					value.type = 'n';
+					value.number = strtod(current, &end);
+					if (end == current) return false;
+					current = end;
+				}
+
+				return true;
+			}
+	};
+
+
+	// Strided view of an accessor, read straight out of the loaded buffers
+	class SonicGLTFAccessor {
+		public:
+			const unsigned char *data;
+			size_t count;
+			size_t components;
+			size_t component_size;
+			size_t stride;
+			unsigned int component_type;
+			bool normalized;
+
+			SonicGLTFAccessor() {
+				data = NULL;
+				count = components = component_size = stride = 0;
+				component_type = 0;
+				normalized = false;
+			}
+
+			float getFloat(size_t index, size_t component) const {
+				const unsigned char *source=data + index*stride + component*component_size;
+
+				if (component_type == LIBGENS_GLB_COMPONENT_FLOAT) {
+					float value;
+					memcpy(&value, source, sizeof(float));
+					return value;
+				}
+				else if (component_type == LIBGENS_GLB_COMPONENT_BYTE) {
+					signed char value=*source;
+					return normalized ? std::max(value / 127.0f, -1.0f) : value;
+				}
+				else if (component_type == LIBGENS_GLB_COMPONENT_UNSIGNED_BYTE) {
+					return normalized ? *source / 255.0f : *source;
+				}
+				else if (component_type == LIBGENS_GLB_COMPONENT_SHORT) {
+					short value;
+					memcpy(&value, source, sizeof(short));
+					return normalized ? std::max(value / 32767.0f, -1.0f) : value;
+				}
+				else if (component_type == LIBGENS_GLB_COMPONENT_UNSIGNED_SHORT) {
+					unsigned short value;
+					memcpy(&value, source, sizeof(unsigned short));
+					return normalized ? value / 65535.0f : value;
+				}
+
+				unsigned int value;
+				memcpy(&value, source, sizeof(unsigned int));
+				return value;
+			}
+
+			unsigned int getIndex(size_t index, size_t component) const {
+				const unsigned char *source=data + index*stride + component*component_size;
+
+				if (component_type == LIBGENS_GLB_COMPONENT_UNSIGNED_BYTE) return *source;
+				else if (component_type == LIBGENS_GLB_COMPONENT_UNSIGNED_SHORT) {
+					unsigned short value;
+					memcpy(&value, source, sizeof(unsigned short));
+					return value;
+				}
+				else if (component_type == LIBGENS_GLB_COMPONENT_UNSIGNED_INT) {
+					unsigned int value;
+					memcpy(&value, source, sizeof(unsigned int));
+					return value;
+				}
+
+				return LIBGENS_GLTF_UNASSIGNED;
+			}
+	};
+
+	static bool getGLTFAccessor(const SonicGLTFValue &root, vector< vector<unsigned char> > &buffers, int accessor_index, SonicGLTFAccessor &accessor) {
+		const SonicGLTFValue *accessor_value=gltfElement(gltfMember(&root, "accessors"), accessor_index);
+		if (!accessor_value) return false;
+
+		if (gltfMember(accessor_value, "sparse")) {
+			Error::addMessage(Error::WARNING, "Sparse glTF accessors aren't supported, accessor " + ToString(accessor_index) + " will be skipped.");
+			return false;
+		}
+
+		const SonicGLTFValue *view=gltfElement(gltfMember(&root, "bufferViews"), gltfIndex(accessor_value, "bufferView"));
+		int buffer_index=gltfIndex(view, "buffer");
+		if ((buffer_index < 0) || ((size_t) buffer_index >= buffers.size())) return false;
+
+		accessor.component_type = gltfIndex(accessor_value, "componentType");
+		const SonicGLTFValue *normalized=gltfMember(accessor_value, "normalized");
+		accessor.normalized = normalized && (normalized->type == 'b') && (normalized->number != 0.0);
+		int count=gltfIndex(accessor_value, "count");
+		if (count <= 0) {
+			Error::addMessage(Error::WARNING, "glTF accessor " + ToString(accessor_index) + " has no valid element count.");
+			return false;
+		}
+		accessor.count = count;
+
+		switch (accessor.component_type) {
+			case LIBGENS_GLB_COMPONENT_BYTE:
+			case LIBGENS_GLB_COMPONENT_UNSIGNED_BYTE:
+				accessor.component_size = 1;
+				break;
+			case LIBGENS_GLB_COMPONENT_SHORT:
+			case LIBGENS_GLB_COMPONENT_UNSIGNED_SHORT:
+				accessor.component_size = 2;
+				break;
+			case LIBGENS_GLB_COMPONENT_UNSIGNED_INT:
+			case LIBGENS_GLB_COMPONENT_FLOAT:
+				accessor.component_size = 4;
+				break;
+			default:
+				return false;
+		}
+
+		string type=gltfString(accessor_value, "type");
+		if (type == "SCALAR") accessor.components = 1;
+		else if (type == "VEC2") accessor.components = 2;
+		else if (type == "VEC3") accessor.components = 3;
+		else if (type == "VEC4") accessor.components = 4;
+		else if (type == "MAT4") accessor.components = 16;
+		else return false;
+
+		size_t element_size=accessor.components * accessor.component_size;
+		size_t view_offset=0, view_length=0, offset=0;
+		bool valid=gltfSize(view, "byteOffset", view_offset) && gltfSize(view, "byteLength", view_length) &&
+				   gltfSize(accessor_value, "byteOffset", offset) && gltfSize(view, "byteStride", accessor.stride);
+		if (!accessor.stride) accessor.stride = element_size;
+
+		// Every element has to fit inside both the view and the buffer. Checked by subtraction
+		// so large counts or offsets can't wrap around past the bounds.
+		vector<unsigned char> &buffer=buffers[buffer_index];
+		valid = valid && (view_offset <= buffer.size()) && (view_length <= buffer.size() - view_offset);
+		valid = valid && (offset <= view_length) && (element_size <= view_length - offset);
+		valid = valid && (accessor.count-1 <= (view_length - offset - element_size) / accessor.stride);
+		if (!valid) {
+			Error::addMessage(Error::WARNING, "glTF accessor " + ToString(accessor_index) + " is out of its buffer's bounds.");
+			return false;
+		}
+
+		accessor.data = &buffer[view_offset + offset];
+		return true;
+	}
+
+
+	static bool readGLTFFile(const string &filename, vector<unsigned char> &data) {
+		FILE *file=fopen(filename.c_str(), "rb");
+		if (!file) return false;
+
+		fseek(file, 0, SEEK_END);
+		long size=ftell(file);
+		fseek(file, 0, SEEK_SET);
+
+		data.resize(size > 0 ? size : 0);
+		bool result=!data.size() || (fread(&data[0], 1, data.size(), file) == data.size());
+		fclose(file);
+		return result;
+	}
+
+	static unsigned int readGLTFInt32(const unsigned char *data) {
+		return data[0] | (data[1] << 8) | (data[2] << 16) | ((unsigned int) data[3] << 24);
+	}
+
+	static void decodeGLTFBase64(const string &text, size_t start, vector<unsigned char> &data) {
+		unsigned int bits=0;
+		size_t bit_count=0;
+
+		for (size_t i=start; i<text.size(); i++) {
+			char c=text[i];
+			unsigned int value=0;
+			if ((c >= 'A') && (c <= 'Z')) value = c - 'A';
+			else if ((c >= 'a') && (c <= 'z')) value = c - 'a' + 26;
+			else if ((c >= '0') && (c <= '9')) value = c - '0' + 52;
+			else if ((c == '+') || (c == '-')) value = 62;
+			else if ((c == '/') || (c == '_')) value = 63;
+			else if (c == '=') break;
+			else continue;
+
+			bits = (bits << 6) | value;
+			bit_count += 6;
+			if (bit_count >= 8) {
+				bit_count -= 8;
+				data.push_back((bits >> bit_count) & 0xFF);
+			}
+		}
+	}
+
+	static string decodeGLTFURI(const string &uri) {
+		string text="";
+		for (size_t i=0; i<uri.size(); i++) {
+			if ((uri[i] == '%') && (i+2 < uri.size())) {
+				char hex[3]={ uri[i+1], uri[i+2], 0 };
+				char *end=NULL;
+				long value=strtol(hex, &end, 16);
+				if (end == hex+2) {
+					text += (char) value;
+					i += 2;
+					continue;
+				}
+			}
+			text += uri[i];
+		}
+		return text;
+	}
+
+
+	// Node transforms in the file's space. The local matrix is kept next to the TRS values so
+	// bones without any folded ancestors can reuse them as is.
+	struct SonicGLTFNode {
+		float translation[3];
+		float rotation[4];
+		float scale[3];
+		Matrix4 local;
+		Matrix4 global;
+		int parent;
+		int bone;
+		bool has_matrix;
+	};
+
+	static Matrix4 makeGLTFMatrix(const float *translation, const float *rotation, const float *scale) {
+		Quaternion orientation;
+		orientation.x = rotation[0];
+		orientation.y = rotation[1];
+		orientation.z = rotation[2];
+		orientation.w = rotation[3];
+
+		Matrix4 m;
+		m.makeTransform(Vector3(translation[0], translation[1], translation[2]), Vector3(scale[0], scale[1], scale[2]), orientation);
+		return m;
+	}
+
+	void SonicXNFile::importGLTF(string filename, float unit_scale) {
+		vector<unsigned char> file_data;
+		if (!readGLTFFile(filename, file_data)) {
+			Error::addMessage(Error::NULL_REFERENCE, string(LIBGENS_S06_XNFILE_ERROR_MESSAGE_READ_GLTF_FILE) + filename);
+			return;
+		}
+
+		string gltf_folder=filename;
+		size_t slash=gltf_folder.find_last_of("\\/");
+		if (slash != string::npos) gltf_folder.erase(slash+1);
+		else gltf_folder = "";
+
+		// Binary files carry the JSON and the first buffer as chunks, text files are all JSON
+		string json="";
+		vector< vector<unsigned char> > buffers;
+		vector<unsigned char> binary_chunk;
+		bool binary_file=(file_data.size() >= 12) && (readGLTFInt32(&file_data[0]) == 0x46546C67);
+
+		if (binary_file) {
+			size_t position=12;
+			while (position + 8 <= file_data.size()) {
+				size_t chunk_size=readGLTFInt32(&file_data[position]);
+				unsigned int chunk_type=readGLTFInt32(&file_data[position+4]);
+				position += 8;
+				if (chunk_size > file_data.size() - position) break;
+
+				if (chunk_type == 0x4E4F534A) json.assign((const char *) &file_data[position], chunk_size);
+				else if ((chunk_type == 0x004E4942) && !binary_chunk.size()) binary_chunk.assign(file_data.begin() + position, file_data.begin() + position + chunk_size);
+				position += chunk_size;
+			}
+		}
+		else json.assign(file_data.begin(), file_data.end());
+		file_data.clear();
+
+		SonicGLTFValue root;
+		SonicGLTFParser parser(json.c_str());
+		if (!json.size() || !parser.parse(root) || (root.type != 'o')) {
+			Error::addMessage(Error::NULL_REFERENCE, string(LIBGENS_S06_XNFILE_ERROR_MESSAGE_INVALID_GLTF) + filename);
+			return;
+		}
+
+		const SonicGLTFValue *buffers_value=gltfMember(&root, "buffers");
+		buffers.resize(gltfCount(buffers_value));
+		for (size_t b=0; b<buffers.size(); b++) {
+			const SonicGLTFValue *buffer=gltfElement(buffers_value, b);
+			string uri=gltfString(buffer, "uri");
+
+			if (!uri.size()) {
+				if (b == 0) buffers[b].swap(binary_chunk);
+			}
+			else if (uri.compare(0, 5, "data:") == 0) {
+				size_t comma=uri.find(',');
+				if ((comma != string::npos) && (uri.rfind(";base64", comma) != string::npos)) decodeGLTFBase64(uri, comma+1, buffers[b]);
+			}
+			else if (!readGLTFFile(gltf_folder + decodeGLTFURI(uri), buffers[b])) {
+				Error::addMessage(Error::WARNING, string(LIBGENS_S06_XNFILE_ERROR_MESSAGE_READ_GLTF_FILE) + gltf_folder + decodeGLTFURI(uri));
+			}
+		}
+
+		// Set up the sections the import fills, before the object so it picks them up
+		if (!getObject()) {
+			if (!getTexture()) createTextureSection();
+			if (!getEffect()) createEffectSection();
+			if (!getBones()) createBoneSection();
+			createObjectSection();
+		}
+
+		SonicXNObject  *object=getObject();
+		SonicXNTexture *texture=getTexture();
+		SonicXNBones   *bones_section=getBones();
+
+		// Node transforms, parents first
+		const SonicGLTFValue *nodes_value=gltfMember(&root, "nodes");
+		size_t node_count=gltfCount(nodes_value);
+		vector<SonicGLTFNode> nodes(node_count);
+
+		for (size_t n=0; n<node_count; n++) {
+			const SonicGLTFValue *node_value=gltfElement(nodes_value, n);
+			SonicGLTFNode &node=nodes[n];
+			node.parent = -1;
+			node.bone = -1;
+
+			float identity[16]={ 1.0f, 0.0f, 0.0f, 0.0f, 0.0f, 1.0f, 0.0f, 0.0f, 0.0f, 0.0f, 1.0f, 0.0f, 0.0f, 0.0f, 0.0f, 1.0f };
+			float matrix[16];
+			memcpy(matrix, identity, sizeof(matrix));
+			gltfFloats(node_value, "matrix", matrix, 16);
+			node.has_matrix = (memcmp(matrix, identity, sizeof(matrix)) != 0);
+
+			if (node.has_matrix) {
+				for (size_t r=0; r<4; r++) {
+					for (size_t c=0; c<4; c++) {
+						node.local[r][c] = matrix[c*4 + r];
+					}
+				}
+				SonicGLBWriter::decomposeTransform(node.local, node.translation, node.rotation, node.scale);
+			}
+			else {
+				float defaults[10]={ 0.0f, 0.0f, 0.0f, 0.0f, 0.0f, 0.0f, 1.0f, 1.0f, 1.0f, 1.0f };
+				memcpy(node.translation, defaults, sizeof(node.translation));
+				memcpy(node.rotation, defaults+3, sizeof(node.rotation));
+				memcpy(node.scale, defaults+7, sizeof(node.scale));
+				gltfFloats(node_value, "translation", node.translation, 3);
+				gltfFloats(node_value, "rotation", node.rotation, 4);
+				gltfFloats(node_value, "scale", node.scale, 3);
+				node.local = makeGLTFMatrix(node.translation, node.rotation, node.scale);
+			}
+		}
+
+		for (size_t n=0; n<node_count; n++) {
+			const SonicGLTFValue *children=gltfMember(gltfElement(nodes_value, n), "children");
+			for (size_t c=0; c<gltfCount(children); c++) {
+				const SonicGLTFValue *child=gltfElement(children, c);
+				size_t child_index=(child->type == 'n') ? (size_t) child->number : node_count;
+				if ((child_index < node_count) && (child_index != n) && (nodes[child_index].parent == -1)) nodes[child_index].parent = n;
+			}
+		}
+
+		vector<size_t> node_order;
+		vector<bool> node_visited(node_count, false);
+		for (size_t n=0; n<node_count; n++) {
+			if (nodes[n].parent != -1) continue;
+
+			vector<size_t> stack(1, n);
+			while (stack.size()) {
+				size_t current=stack.back();
+				stack.pop_back();
+				if (node_visited[current]) continue;
+				node_visited[current] = true;
+				node_order.push_back(current);
+
+				int parent=nodes[current].parent;
+				nodes[current].global = (parent != -1) ? nodes[parent].global * nodes[current].local : nodes[current].local;
+
+				const SonicGLTFValue *children=gltfMember(gltfElement(nodes_value, current), "children");
+				for (size_t c=0; c<gltfCount(children); c++) {
+					const SonicGLTFValue *child=gltfElement(children, c);
+					size_t child_index=(child->type == 'n') ? (size_t) child->number : node_count;
+					if ((child_index < node_count) && (nodes[child_index].parent == (int) current)) stack.push_back(child_index);
+				}
+			}
+		}
+
+		// Parent cycles never reach a root, drop their links so the rest of the import can't loop
+		for (size_t n=0; n<node_count; n++) {
+			if (!node_visited[n]) {
+				nodes[n].parent = -1;
+				nodes[n].global = nodes[n].local;
+			}
+		}
+
+		// One bone per joint across every skin, in the order skins list them
+		const SonicGLTFValue *skins_value=gltfMember(&root, "skins");
+		size_t bone_base=object->bones.size();
+		vector<size_t> bone_nodes;
+
+		for (size_t s=0; s<gltfCount(skins_value); s++) {
+			const SonicGLTFValue *skin=gltfElement(skins_value, s);
+			const SonicGLTFValue *joints=gltfMember(skin, "joints");
+
+			SonicGLTFAccessor inverse_bind_matrices;
+			int inverse_bind_index=gltfIndex(skin, "inverseBindMatrices");
+			if (inverse_bind_index != -1) getGLTFAccessor(root, buffers, inverse_bind_index, inverse_bind_matrices);
+
+			for (size_t j=0; j<gltfCount(joints); j++) {
+				const SonicGLTFValue *joint=gltfElement(joints, j);
+				size_t node_index=(joint->type == 'n') ? (size_t) joint->number : node_count;
+				if ((node_index >= node_count) || (nodes[node_index].bone != -1)) continue;
+
+				nodes[node_index].bone = bone_base + bone_nodes.size();
+				bone_nodes.push_back(node_index);
+
+				SonicBone *bone=new SonicBone();
+				bone->zero();
+
+				// Bones store the inverse bind matrix transposed, which is glTF's column major layout read by rows
+				if (inverse_bind_matrices.data && (j < inverse_bind_matrices.count) && (inverse_bind_matrices.components == 16)) {
+					for (size_t r=0; r<4; r++) {
+						for (size_t c=0; c<4; c++) {
+							bone->matrix[r][c] = inverse_bind_matrices.getFloat(j, r*4 + c) * (((r == 3) && (c < 3)) ? unit_scale : 1.0f);
+						}
+					}
+				}
+
+				object->bones.push_back(bone);
+			}
+		}
+
+		if (bone_base + bone_nodes.size() > 256) {
+			Error::addMessage(Error::WARNING, "Vertices can only reference the first 256 bones, influences of the remaining glTF joints will be dropped.");
+		}
+
+		for (size_t b=0; b<bone_nodes.size(); b++) {
+			size_t node_index=bone_nodes[b];
+			SonicBone *bone=object->bones[bone_base + b];
+
+			// Nodes between a joint and its closest joint ancestor get folded into the joint's transform
+			int parent=nodes[node_index].parent;
+			while ((parent != -1) && (nodes[parent].bone == -1)) parent = nodes[parent].parent;
+
+			float translation[3], rotation[4], scale[3];
+			if (nodes[node_index].parent == parent) {
+				memcpy(translation, nodes[node_index].translation, sizeof(translation));
+				memcpy(rotation, nodes[node_index].rotation, sizeof(rotation));
+				memcpy(scale, nodes[node_index].scale, sizeof(scale));
+			}
+			else {
+				Matrix4 m=nodes[node_index].local;
+				for (int ancestor=nodes[node_index].parent; ancestor != parent; ancestor=nodes[ancestor].parent) {
+					m = nodes[ancestor].local * m;
+				}
+				SonicGLBWriter::decomposeTransform(m, translation, rotation, scale);
+			}
+
+			bone->flag &= ~3840u;
+			bone->matrix_index = bone_base + b;
+			bone->parent_index = (parent != -1) ? nodes[parent].bone : 0xFFFF;
+
+			Quaternion orientation;
+			orientation.x = rotation[0];
+			orientation.y = rotation[1];
+			orientation.z = rotation[2];
+			orientation.w = rotation[3];
+			bone->setTransform(Vector3(translation[0], translation[1], translation[2]) * unit_scale, orientation, Vector3(scale[0], scale[1], scale[2]));
+
+			if (bones_section) {
+				string bone_name=gltfString(gltfElement(nodes_value, node_index), "name");
+				bones_section->addBone(bone_name.size() ? bone_name : "Bone" + ToString(bone_base + b), bone_base + b);
+			}
+		}
+
+		// Children and siblings links, in the same order as the bones
+		for (size_t b=bone_base; b<object->bones.size(); b++) {
+			unsigned short parent=object->bones[b]->parent_index;
+			if (parent >= object->bones.size()) continue;
+
+			if (object->bones[parent]->child_index == 0xFFFF) object->bones[parent]->child_index = b;
+			else {
+				SonicBone *sibling=object->bones[object->bones[parent]->child_index];
+				while (sibling->sibling_index != 0xFFFF) sibling = object->bones[sibling->sibling_index];
+				sibling->sibling_index = b;
+			}
+		}
+
+		// Same single root bone as the FBX import when there's nothing to skin to
+		if (!object->bones.size()) {
+			SonicBone *sonic_bone=new SonicBone();
+			sonic_bone->zero();
+			object->bones.push_back(sonic_bone);
+
+			// The exporters look the bone names up by index
+			if (bones_section) bones_section->addBone("Root", 0);
+		}
+
+		// Materials are converted the first time a primitive uses them
+		const SonicGLTFValue *materials_value=gltfMember(&root, "materials");
+		const SonicGLTFValue *textures_value=gltfMember(&root, "textures");
+		const SonicGLTFValue *images_value=gltfMember(&root, "images");
+		vector<int> material_map(gltfCount(materials_value) + 1, -1);
+
+		const SonicGLTFValue *meshes_value=gltfMember(&root, "meshes");
+		for (size_t o=0; o<node_order.size(); o++) {
+			size_t node_index=node_order[o];
+			const SonicGLTFValue *node_value=gltfElement(nodes_value, node_index);
+			const SonicGLTFValue *mesh_value=gltfElement(meshes_value, gltfIndex(node_value, "mesh"));
+			const SonicGLTFValue *primitives=gltfMember(mesh_value, "primitives");
+			if (!gltfCount(primitives)) continue;
+
+			// Skinned meshes are already in the bind space, the rest get their node's transform baked in
+			const SonicGLTFValue *joints=gltfMember(gltfElement(skins_value, gltfIndex(node_value, "skin")), "joints");
+			vector<int> joint_bones(gltfCount(joints), -1);
+			for (size_t j=0; j<joint_bones.size(); j++) {
+				const SonicGLTFValue *joint=gltfElement(joints, j);
+				size_t joint_node=(joint->type == 'n') ? (size_t) joint->number : node_count;
+				if (joint_node < node_count) joint_bones[j] = nodes[joint_node].bone;
+			}
+
+			// Normals use the cofactor matrix so non uniform scales keep them perpendicular
+			Matrix4 &m=nodes[node_index].global;
+			float normal_matrix[3][3];
+			for (size_t r=0; r<3; r++) {
+				for (size_t c=0; c<3; c++) {
+					size_t r1=(r+1)%3, r2=(r+2)%3, c1=(c+1)%3, c2=(c+2)%3;
+					normal_matrix[r][c] = m[r1][c1]*m[r2][c2] - m[r1][c2]*m[r2][c1];
+				}
+			}
+			float determinant=m[0][0]*normal_matrix[0][0] + m[0][1]*normal_matrix[0][1] + m[0][2]*normal_matrix[0][2];
+
+			SonicMesh *sonic_mesh=new SonicMesh();
+			sonic_mesh->flag = 513;
+
+			for (size_t p=0; p<gltfCount(primitives); p++) {
+				const SonicGLTFValue *primitive=gltfElement(primitives, p);
+				const SonicGLTFValue *attributes=gltfMember(primitive, "attributes");
+
+				if (gltfNumber(primitive, "mode", 4.0) != 4.0) {
+					Error::addMessage(Error::WARNING, "Only triangle lists are supported, skipping a primitive on glTF mesh " + gltfString(mesh_value, "name") + ".");
+					continue;
+				}
+
+				SonicGLTFAccessor positions, normals, tangents, colors, bone_joints, bone_weights, uvs[4];
+				if (!getGLTFAccessor(root, buffers, gltfIndex(attributes, "POSITION"), positions) || (positions.components != 3)) continue;
+
+				bool has_normals=getGLTFAccessor(root, buffers, gltfIndex(attributes, "NORMAL"), normals) && (normals.components == 3) && (normals.count >= positions.count);
+				bool has_tangents=getGLTFAccessor(root, buffers, gltfIndex(attributes, "TANGENT"), tangents) && (tangents.components == 4) && (tangents.count >= positions.count);
+				bool has_colors=getGLTFAccessor(root, buffers, gltfIndex(attributes, "COLOR_0"), colors) && (colors.components >= 3) && (colors.count >= positions.count);
+				bool skinned=joint_bones.size() && getGLTFAccessor(root, buffers, gltfIndex(attributes, "JOINTS_0"), bone_joints) && getGLTFAccessor(root, buffers, gltfIndex(attributes, "WEIGHTS_0"), bone_weights) &&
+							 (bone_joints.components == 4) && (bone_weights.components == 4) && (bone_joints.count >= positions.count) && (bone_weights.count >= positions.count);
+
+				bool has_uvs[4];
+				for (size_t set=0; set<4; set++) {
+					string semantic="TEXCOORD_" + ToString(set);
+					has_uvs[set] = getGLTFAccessor(root, buffers, gltfIndex(attributes, semantic.c_str()), uvs[set]) && (uvs[set].components == 2) && (uvs[set].count >= positions.count);
+				}
+
+				// Triangle list, skipping faces with indices out of range
+				vector<unsigned int> indices;
+				SonicGLTFAccessor index_accessor;
+				int index_accessor_index=gltfIndex(primitive, "indices");
+				if (index_accessor_index != -1) {
+					if (!getGLTFAccessor(root, buffers, index_accessor_index, index_accessor) || (index_accessor.components != 1)) continue;
+
+					indices.reserve(index_accessor.count);
+					for (size_t i=0; i+2<index_accessor.count; i+=3) {
+						unsigned int face[3]={ index_accessor.getIndex(i, 0), index_accessor.getIndex(i+1, 0), index_accessor.getIndex(i+2, 0) };
+						if ((face[0] >= positions.count) || (face[1] >= positions.count) || (face[2] >= positions.count)) continue;
+						indices.insert(indices.end(), face, face+3);
+					}
+				}
+				else {
+					indices.resize(positions.count - positions.count%3);
+					for (size_t i=0; i<indices.size(); i++) indices[i] = i;
+				}
+
+				// Mirroring transforms turn the faces inside out
+				if (!skinned && (determinant < 0.0f)) {
+					for (size_t i=0; i<indices.size(); i+=3) std::swap(indices[i+1], indices[i+2]);
+				}
+
+				// Only vertices used by a face get converted, numbered in the order the faces use them
+				vector<unsigned int> remap(positions.count, LIBGENS_GLTF_UNASSIGNED);
+				vector<SonicVertex *> vertices;
+				for (size_t i=0; i<indices.size(); i++) {
+					unsigned int index=indices[i];
+					if (remap[index] != LIBGENS_GLTF_UNASSIGNED) {
+						indices[i] = remap[index];
+						continue;
+					}
+
+					remap[index] = indices[i] = vertices.size();
+
+					SonicVertex *v=new SonicVertex();
+					v->zero();
+
+					float position[3]={ positions.getFloat(index, 0), positions.getFloat(index, 1), positions.getFloat(index, 2) };
+					float normal[3]={ 0.0f, 0.0f, 0.0f };
+					float tangent[4]={ 0.0f, 0.0f, 0.0f, 1.0f };
+					if (has_normals) for (size_t c=0; c<3; c++) normal[c] = normals.getFloat(index, c);
+					if (has_tangents) for (size_t c=0; c<4; c++) tangent[c] = tangents.getFloat(index, c);
+
+					if (skinned) {
+						v->position = Vector3(position[0], position[1], position[2]);
+						v->normal = Vector3(normal[0], normal[1], normal[2]);
+						v->tangent = Vector3(tangent[0], tangent[1], tangent[2]);
+
+						float total=0.0f;
+						for (size_t k=0; k<4; k++) {
+							unsigned int joint=bone_joints.getIndex(index, k);
+							float weight=bone_weights.getFloat(index, k);
+							int bone_index=(joint < joint_bones.size()) ? joint_bones[joint] : -1;
+
+							if ((weight > 0.0f) && (bone_index >= 0) && (bone_index < 256)) {
+								v->bone_indices[k] = bone_index;
+								v->bone_weights_f[k] = weight;
+								total += weight;
+							}
+							else {
+								v->bone_indices[k] = 0;
+								v->bone_weights_f[k] = 0.0f;
+							}
+						}
+
+						if (total > 0.0f) {
+							for (size_t k=0; k<4; k++) v->bone_weights_f[k] /= total;
+						}
+						else {
+							v->bone_indices[0] = 0;
+							v->bone_weights_f[0] = 1.0f;
+						}
+					}
+					else {
+						float transformed[3][3];
+						for (size_t r=0; r<3; r++) {
+							transformed[0][r] = m[r][0]*position[0] + m[r][1]*position[1] + m[r][2]*position[2] + m[r][3];
+							transformed[1][r] = normal_matrix[r][0]*normal[0] + normal_matrix[r][1]*normal[1] + normal_matrix[r][2]*normal[2];
+							transformed[2][r] = m[r][0]*tangent[0] + m[r][1]*tangent[1] + m[r][2]*tangent[2];
+						}
+
+						v->position = Vector3(transformed[0][0], transformed[0][1], transformed[0][2]);
+						v->normal = Vector3(transformed[1][0], transformed[1][1], transformed[1][2]);
+						v->tangent = Vector3(transformed[2][0], transformed[2][1], transformed[2][2]);
+						if (determinant < 0.0f) v->normal = v->normal * -1.0f;
+						if (v->normal.length() > 0.0f) v->normal.normalise();
+					}
+
+					v->position = v->position * unit_scale;
+
+					for (size_t set=0; set<4; set++) {
+						if (has_uvs[set]) v->uv[set] = Vector2(uvs[set].getFloat(index, 0), uvs[set].getFloat(index, 1));
+					}
+
+					if (has_colors) {
+						for (size_t c=0; c<colors.components; c++) {
+							float value=std::min(std::max(colors.getFloat(index, c), 0.0f), 1.0f);
+							v->rgba[c] = value * 255.0f + 0.5f;
+						}
+					}
+
+					// Tangent sign flips the binormal for mirrored UVs
+					if (has_tangents && (v->tangent.length() > 0.0f)) {
+						v->tangent.normalise();
+						v->binormal = v->tangent.crossProduct(v->normal) * (tangent[3] < 0.0f ? -1.0f : 1.0f);
+					}
+					else v->binormal = Vector3(0.0f, 0.0f, 0.0f);
+
+					vertices.push_back(v);
+				}
+
+				if (!vertices.size()) continue;
+
+				// Smooth normals from the faces when the file has none
+				if (!has_normals) {
+					for (size_t i=0; i<indices.size(); i+=3) {
+						SonicVertex *face[3]={ vertices[indices[i]], vertices[indices[i+1]], vertices[indices[i+2]] };
+						Vector3 edge_1=Vector3(face[1]->position.x - face[0]->position.x, face[1]->position.y - face[0]->position.y, face[1]->position.z - face[0]->position.z);
+						Vector3 edge_2=Vector3(face[2]->position.x - face[0]->position.x, face[2]->position.y - face[0]->position.y, face[2]->position.z - face[0]->position.z);
+						Vector3 face_normal=edge_1.crossProduct(edge_2);
+
+						for (size_t j=0; j<3; j++) {
+							face[j]->normal = Vector3(face[j]->normal.x + face_normal.x, face[j]->normal.y + face_normal.y, face[j]->normal.z + face_normal.z);
+						}
+					}
+
+					for (size_t i=0; i<vertices.size(); i++) {
+						if (vertices[i]->normal.length() > 0.0f) vertices[i]->normal.normalise();
+					}
+				}
+
+				// Same tangent guess as the FBX import for vertices without one
+				for (size_t i=0; i<vertices.size(); i++) {
+					SonicVertex *v=vertices[i];
+					if (v->binormal.length() > 0.0f) continue;
+
+					Vector3 c1 = v->normal.crossProduct(Vector3(0.0, 0.0, 1.0));
+					Vector3 c2 = v->normal.crossProduct(Vector3(0.0, 1.0, 0.0));
+					if(c1.length() > c2.length()) v->tangent = c1;
+					else v->tangent = c2;
+					v->tangent.normalise();
+					v->binormal = v->tangent.crossProduct(v->normal);
+				}
+
+				// Material, with the last slot of the map standing for primitives without one
+				size_t material_count=gltfCount(materials_value);
+				int material_index=gltfIndex(primitive, "material");
+				if ((material_index < 0) || ((size_t) material_index >= material_count)) material_index = material_count;
+
+				const SonicGLTFValue *material_value=gltfElement(materials_value, material_index);
+				string material_name=gltfString(material_value, "name");
+
+				if (material_map[material_index] == -1) {
+					material_map[material_index] = object->material_tables.size();
+					SonicMaterialTable *sonic_material_table=addMaterialTable();
+
+					const SonicGLTFValue *texture_infos[2]={ gltfMember(gltfMember(material_value, "pbrMetallicRoughness"), "baseColorTexture"), gltfMember(material_value, "normalTexture") };
+					for (size_t t=0; t<2; t++) {
+						int texture_index=gltfIndex(texture_infos[t], "index");
+						if (texture_index == -1) continue;
+
+						int image_index=gltfIndex(gltfElement(textures_value, texture_index), "source");
+						const SonicGLTFValue *image=gltfElement(images_value, image_index);
+						if (!image) continue;
+
+						string texture_name=gltfString(image, "uri");
+						if (texture_name.size() && (texture_name.compare(0, 5, "data:") != 0)) texture_name = File::nameFromFilename(decodeGLTFURI(texture_name));
+						else texture_name = gltfString(image, "name");
+						if (!texture_name.size()) texture_name = "texture" + ToString(image_index) + ".png";
+
+						addMaterialTexture(sonic_material_table, texture_name);
+					}
+				}
+
+				addSubmeshes(sonic_mesh, vertices, indices, material_map[material_index], material_name.c_str());
+			}
+
+			if (texture) {
+				for (size_t i=0; i<texture->getTextureUnitsSize(); i++) {
+					sonic_mesh->extras.push_back(i);
+				}
+			}
+
+			if (sonic_mesh->submeshes.size()) object->meshes.push_back(sonic_mesh);
+			else delete sonic_mesh;
+		}
+
+		object->buildBoneHierarchy();
+		object->calculateBounds();
+	}
+};
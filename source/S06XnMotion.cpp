@@ -18,74 +18,25 @@
 //=========================================================================
 
 #include "LibGens.h"
+#include <algorithm>
+#include <atomic>
+#include <thread>
 #include "S06XnFile.h"
 
 namespace LibGens {
-	void SonicFrameValue::read(File *file, bool big_endian) {
-		file->readFloat32E(&frame, big_endian);
-		file->readFloat32E(&value, big_endian);
-	}
-
-	void SonicFrameValue::write(File *file) {
-		file->writeFloat32(&frame);
-		file->writeFloat32(&value);
-	}
-
-	void SonicFrameValueFloats::read(File *file, bool big_endian) {
-		file->readFloat32E(&frame, big_endian);
-		value.read(file, big_endian);
-	}
-
-	void SonicFrameValueFloats::write(File *file) {
-		file->writeFloat32(&frame);
-		value.write(file);
-	}
-
-	void SonicFrameValueFloatsGroup::read(File *file, bool big_endian) {
-		file->readFloat32E(&frame, big_endian);
-		file->readInt32E(&flag, big_endian);
-		file->readFloat32E(&unknown_1, big_endian);
-		file->readFloat32E(&unknown_2, big_endian);
-		file->readFloat32E(&unknown_3, big_endian);
-		file->readFloat32E(&unknown_4, big_endian);
-	}
-
-	void SonicFrameValueFloatsGroup::write(File *file) {
-		// FIXME
-	}
-
-	void SonicFrameValueAngles::read(File *file, bool big_endian) {
-		file->readInt16E(&frame, big_endian);
-		file->readInt16E(&value_x, big_endian);
-		file->readInt16E(&value_y, big_endian);
-		file->readInt16E(&value_z, big_endian);
-	}
-
-	void SonicFrameValueAngles::write(File *file) {
-		file->writeInt16(&frame);
-		file->writeInt16(&value_x);
-		file->writeInt16(&value_y);
-		file->writeInt16(&value_z);
-	}
-
-	void SonicFrameValueIntBeta::read(File *file, bool big_endian) {
-		file->readFloat32E(&frame, big_endian);
-		file->readInt16E(&value, big_endian);
-	}
-
-	void SonicFrameValueIntBeta::write(File *file) {
-		file->writeFloat32(&frame);
-		file->writeInt16(&value);
-	}
-
-	void SonicFrameValueInt::read(File *file, bool big_endian) {
-		file->readInt16E(&frame, big_endian);
-		file->readInt16E(&value, big_endian);
-	}
+	unsigned int SonicMotionControl::getKeyType() {
+		if (element_size == 24) return LIBGENS_XNMOTION_KEY_FLOATS_GROUP;
+		else if (element_size == 16) return LIBGENS_XNMOTION_KEY_FLOATS;
+		else if (element_size == 8) {
+			if (type == LIBGENS_XNMOTION_TYPE_ANGLES_LINEAR) return LIBGENS_XNMOTION_KEY_ANGLES;
+			else if ((type == LIBGENS_XNMOTION_TYPE_X_ANGLE_BETA) || 
+				(type == LIBGENS_XNMOTION_TYPE_Y_ANGLE_BETA) || 
+				(type == LIBGENS_XNMOTION_TYPE_Z_ANGLE_BETA)) return LIBGENS_XNMOTION_KEY_INT_BETA;
+			else return LIBGENS_XNMOTION_KEY_FLOAT;
+		}
+		else if (element_size == 4) return LIBGENS_XNMOTION_KEY_INT;
 
-	void SonicFrameValueInt::write(File *file) {
-		file->writeInt16(&frame);
-		file->writeInt16(&value);
+		return LIBGENS_XNMOTION_KEY_NONE;
 	}
 
 	void SonicMotionControl::read(File *file, bool big_endian) {
@@ -128,51 +79,55 @@ namespace LibGens {
 		Error::printfMessage(Error::WARNING, "  Start: %d End: %f Start Key: %f End Key: %f", start_frame, end_frame, start_frame, end_frame);
 		Error::printfMessage(Error::WARNING, "  Elements: %d(%d) Elements Address: %d", element_count, element_size, address);
 
-		if (element_size == 24) {
-			for (size_t i=0; i<element_count; i++) {
-				file->goToAddress(address + i*element_size);
-				SonicFrameValueFloatsGroup *frame_value=new SonicFrameValueFloatsGroup();
-				frame_value->read(file, big_endian);
-				frame_values_floats_groups.push_back(frame_value);
-			}
-		}
-		else if (element_size == 16) {
-			for (size_t i=0; i<element_count; i++) {
-				file->goToAddress(address + i*element_size);
-				SonicFrameValueFloats *frame_value=new SonicFrameValueFloats();
-				frame_value->read(file, big_endian);
-				frame_values_floats.push_back(frame_value);
-			}
-		}
-		else if (element_size == 8) {
-			for (size_t i=0; i<element_count; i++) {
-				file->goToAddress(address + i*element_size);
-				if (type == LIBGENS_XNMOTION_TYPE_ANGLES_LINEAR) {
-					SonicFrameValueAngles *frame_value=new SonicFrameValueAngles();
-					frame_value->read(file, big_endian);
-					frame_values_angles.push_back(frame_value);
-				}
-				else if ((type == LIBGENS_XNMOTION_TYPE_X_ANGLE_BETA) || 
-					(type == LIBGENS_XNMOTION_TYPE_Y_ANGLE_BETA) || 
-					(type == LIBGENS_XNMOTION_TYPE_Z_ANGLE_BETA)) {
+		unsigned int key_type=getKeyType();
+		if (key_type == LIBGENS_XNMOTION_KEY_NONE) return;
 
-					SonicFrameValueIntBeta *frame_value_int_beta=new SonicFrameValueIntBeta();
-					frame_value_int_beta->read(file, big_endian);
-					frame_values_int_beta.push_back(frame_value_int_beta);
-				}
-				else {
-					SonicFrameValue *frame_value=new SonicFrameValue();
-					frame_value->read(file, big_endian);
-					frame_values.push_back(frame_value);
-				}
-			}
+		key_frames.resize(element_count);
+		if (key_type == LIBGENS_XNMOTION_KEY_FLOAT) key_values.resize(element_count);
+		else if ((key_type == LIBGENS_XNMOTION_KEY_INT) || (key_type == LIBGENS_XNMOTION_KEY_INT_BETA)) key_values_int.resize(element_count);
+		else if (key_type == LIBGENS_XNMOTION_KEY_FLOATS) key_values_floats.resize(element_count);
+		else if (key_type == LIBGENS_XNMOTION_KEY_ANGLES) key_values_angles.resize(element_count*3);
+		else if (key_type == LIBGENS_XNMOTION_KEY_FLOATS_GROUP) {
+			key_flags.resize(element_count);
+			key_values_groups.resize(element_count*4);
 		}
-		else if (element_size == 4) {
-			for (size_t i=0; i<element_count; i++) {
-				file->goToAddress(address + i*element_size);
-				SonicFrameValueInt *frame_value_int=new SonicFrameValueInt();
-				frame_value_int->read(file, big_endian);
-				frame_values_int.push_back(frame_value_int);
+
+		// Keys are packed back to back, so only the beta keys with their 2 bytes of padding need seeking
+		file->goToAddress(address);
+		for (size_t i=0; i<element_count; i++) {
+			unsigned short frame_int=0;
+
+			switch (key_type) {
+				case LIBGENS_XNMOTION_KEY_FLOAT:
+					file->readFloat32E(&key_frames[i], big_endian);
+					file->readFloat32E(&key_values[i], big_endian);
+					break;
+				case LIBGENS_XNMOTION_KEY_INT:
+					file->readInt16E(&frame_int, big_endian);
+					file->readInt16E(&key_values_int[i], big_endian);
+					key_frames[i] = frame_int;
+					break;
+				case LIBGENS_XNMOTION_KEY_INT_BETA:
+					file->goToAddress(address + i*element_size);
+					file->readFloat32E(&key_frames[i], big_endian);
+					file->readInt16E(&key_values_int[i], big_endian);
+					break;
+				case LIBGENS_XNMOTION_KEY_FLOATS:
+					file->readFloat32E(&key_frames[i], big_endian);
+					key_values_floats[i].read(file, big_endian);
+					break;
+				case LIBGENS_XNMOTION_KEY_ANGLES:
+					file->readInt16E(&frame_int, big_endian);
+					file->readInt16E(&key_values_angles[i*3], big_endian);
+					file->readInt16E(&key_values_angles[i*3+1], big_endian);
+					file->readInt16E(&key_values_angles[i*3+2], big_endian);
+					key_frames[i] = frame_int;
+					break;
+				case LIBGENS_XNMOTION_KEY_FLOATS_GROUP:
+					file->readFloat32E(&key_frames[i], big_endian);
+					file->readInt32E(&key_flags[i], big_endian);
+					for (size_t j=0; j<4; j++) file->readFloat32E(&key_values_groups[i*4+j], big_endian);
+					break;
 			}
 		}
 	}
@@ -181,38 +136,38 @@ namespace LibGens {
 	void SonicMotionControl::writeFrameValues(File *file) {
 		frame_value_address=file->getCurrentAddress();
 
-		if (element_size == 16) {
-			for (size_t i=0; i<frame_values_floats.size(); i++) {
-				frame_values_floats[i]->write(file);
-			}
-		}
-		else if (element_size == 8) {
-			if (type == LIBGENS_XNMOTION_TYPE_ANGLES_LINEAR) {
-				for (size_t i=0; i<frame_values_angles.size(); i++) {
-					frame_values_angles[i]->write(file);
-				}
-			}
-			else if ((type == LIBGENS_XNMOTION_TYPE_X_ANGLE_BETA) || 
-				(type == LIBGENS_XNMOTION_TYPE_Y_ANGLE_BETA) || 
-				(type == LIBGENS_XNMOTION_TYPE_Z_ANGLE_BETA)) {
+		unsigned int key_type=getKeyType();
+		for (size_t i=0; i<key_frames.size(); i++) {
+			unsigned short frame_int=key_frames[i];
 
-				for (size_t i=0; i<frame_values_int_beta.size(); i++) {
-					frame_values_int_beta[i]->write(file);
-				}
-			}
-			else {
-				for (size_t i=0; i<frame_values.size(); i++) {
-					frame_values[i]->write(file);
-				}
-			}
-		}
-		else if (element_size == 4) {
-			for (size_t i=0; i<frame_values_int.size(); i++) {
-				frame_values_int[i]->write(file);
+			switch (key_type) {
+				case LIBGENS_XNMOTION_KEY_FLOAT:
+					file->writeFloat32(&key_frames[i]);
+					file->writeFloat32(&key_values[i]);
+					break;
+				case LIBGENS_XNMOTION_KEY_INT:
+					file->writeInt16(&frame_int);
+					file->writeInt16(&key_values_int[i]);
+					break;
+				case LIBGENS_XNMOTION_KEY_INT_BETA:
+					file->writeFloat32(&key_frames[i]);
+					file->writeInt16(&key_values_int[i]);
+					break;
+				case LIBGENS_XNMOTION_KEY_FLOATS:
+					file->writeFloat32(&key_frames[i]);
+					key_values_floats[i].write(file);
+					break;
+				case LIBGENS_XNMOTION_KEY_ANGLES:
+					file->writeInt16(&frame_int);
+					file->writeInt16(&key_values_angles[i*3]);
+					file->writeInt16(&key_values_angles[i*3+1]);
+					file->writeInt16(&key_values_angles[i*3+2]);
+					break;
+				case LIBGENS_XNMOTION_KEY_FLOATS_GROUP:
+					// FIXME
+					break;
 			}
 		}
-		else {
-		}
 	}
 
 	void SonicMotionControl::write(File *file) {
@@ -225,13 +180,8 @@ namespace LibGens {
 		file->writeFloat32(&end_key_frame);
 		
 		unsigned int element_count=0;
-		if (element_size == 16)     element_count=frame_values_floats.size();
-		else if (element_size == 8) {
-			if (type == LIBGENS_XNMOTION_TYPE_ANGLES_LINEAR) element_count=frame_values_angles.size();
-			else if ((type == LIBGENS_XNMOTION_TYPE_X_ANGLE_BETA) || (type == LIBGENS_XNMOTION_TYPE_Y_ANGLE_BETA) || (type == LIBGENS_XNMOTION_TYPE_Z_ANGLE_BETA)) element_count=frame_values_int_beta.size();
-			else element_count=frame_values.size();
-		}
-		else if (element_size == 4) element_count=frame_values_int.size();
+		unsigned int key_type=getKeyType();
+		if ((key_type != LIBGENS_XNMOTION_KEY_NONE) && (key_type != LIBGENS_XNMOTION_KEY_FLOATS_GROUP)) element_count=key_frames.size();
 		file->writeInt32(&element_count);
 		file->writeInt32(&element_size);
 		file->writeInt32A(&frame_value_address);
@@ -291,367 +241,259 @@ namespace LibGens {
 		file->goToEnd();
 	}
 
-	Vector3 SonicMotionControl::getFrameVector(float frame, Vector3 reference) {
-		if (element_size == 16) {
-			SonicFrameValueFloats *frame_value_prev=NULL;
-			SonicFrameValueFloats *frame_value_next=NULL;
+	// Returns how many keys sit at or before frame, which makes the result the index of the next key.
+	// hint is the value returned for the previously sampled frame.
+	static size_t findFrameKey(const vector<float> &frames, float frame, size_t hint) {
+		size_t count=frames.size();
+		if (hint > count) hint = count;
 
-			for (size_t i=0; i<frame_values_floats.size(); i++) {
-				if (frame_values_floats[i]->frame <= frame) {
-					frame_value_prev = frame_values_floats[i];
-				}
-				else {
-					frame_value_next = frame_values_floats[i];
-					break;
-				}
-			}
+		// Playback only moves forward a key or two between samples, so try stepping first
+		for (size_t step=0; step<4; step++) {
+			bool after_prev=(hint == 0) || (frames[hint-1] <= frame);
+			bool before_next=(hint == count) || (frames[hint] > frame);
+			if (after_prev && before_next) return hint;
+			if (!after_prev || (hint == count)) break;
+			hint++;
+		}
 
-			if (frame_value_prev && frame_value_next) {
-				float time_diff  = frame_value_next->frame - frame_value_prev->frame;
-				Vector3 value_diff = frame_value_next->value - frame_value_prev->value;
-				float scale      = (frame - frame_value_prev->frame) / time_diff;
+		size_t low=0;
+		size_t high=count;
+		while (low < high) {
+			size_t middle=(low + high) / 2;
+			if (frames[middle] <= frame) low = middle + 1;
+			else high = middle;
+		}
+		return low;
+	}
 
-				return frame_value_prev->value + value_diff*scale;
-			}
-			else if (frame_value_prev) {
-				return frame_value_prev->value;
-			}
-			else if (frame_value_next) {
-				return frame_value_next->value;
+	// Interpolates between two angles in the 0-65535 range through the shortest way around
+	static float interpolateWrappedAngle(float start, float end, float scale) {
+		float range=65535.0f;
+		float difference = abs(end - start);
+		if (difference > range/2.0f) {
+			if (end > start) {
+				start += range;
 			}
 			else {
-				return reference;
+				end += range;
 			}
 		}
-		else if (element_size == 8) {
-			SonicFrameValueAngles *frame_value_prev=NULL;
-			SonicFrameValueAngles *frame_value_next=NULL;
-			
-			for (size_t i=0; i<frame_values_angles.size(); i++) {
-				if (frame_values_angles[i]->frame <= frame) {
-					frame_value_prev = frame_values_angles[i];
-				}
-				else {
-					frame_value_next = frame_values_angles[i];
-					break;
-				}
-			}
-
-			if (frame_value_prev && frame_value_next) {
-				float range=65535.0f;
-				float end=0.0f;
-				float start=0.0f;
 
-				float value_x=0;
-				float value_y=0;
-				float value_z=0;
-
-				for (size_t x=0; x<3; x++) {
-					float time_diff  = frame_value_next->frame - frame_value_prev->frame;
-					float scale      = (frame - frame_value_prev->frame) / time_diff;
+		float value = (start + ((end - start) * scale));
+		if (value > range) value -= range;
+		if (value < 0.0f)  value += range;
+		return value;
+	}
 
-					if (x==0) {
-						end = frame_value_next->value_x;
-						start = frame_value_prev->value_x;
-					}
-					if (x==1) {
-						end = frame_value_next->value_y;
-						start = frame_value_prev->value_y;
-					}
-					if (x==2) {
-						end = frame_value_next->value_z;
-						start = frame_value_prev->value_z;
-					}
-	
-					float difference = abs(end - start);
-					if (difference > range/2.0f) {
-						if (end > start) {
-							start += range;
-						}
-						else {
-							end += range;
-						}
-					}
-					
-					float result=(start + ((end - start) * scale));
-					if (x==0) value_x = result;
-					if (x==1) value_y = result;
-					if (x==2) value_z = result;
-				}
+	Vector3 SonicMotionControl::getFrameVector(float frame, Vector3 reference) {
+		SonicMotionCursor cursor;
+		return getFrameVector(frame, reference, cursor);
+	}
 
-				if (value_x > range) value_x -= range;
-				if (value_x < 0.0f)  value_x += range;
+	Vector3 SonicMotionControl::getFrameVector(float frame, Vector3 reference, SonicMotionCursor &cursor) {
+		unsigned int key_type=getKeyType();
+		if ((key_type != LIBGENS_XNMOTION_KEY_FLOATS) && (key_type != LIBGENS_XNMOTION_KEY_ANGLES)) return reference;
+		if (!key_frames.size()) return reference;
 
-				if (value_y > range) value_y -= range;
-				if (value_y < 0.0f)  value_y += range;
+		size_t next=cursor.key=findFrameKey(key_frames, frame, cursor.key);
+		size_t prev=(next > 0 ? next-1 : next);
+		if (next == key_frames.size()) next = prev;
 
-				if (value_z > range) value_z -= range;
-				if (value_z < 0.0f)  value_z += range;
+		if (key_type == LIBGENS_XNMOTION_KEY_FLOATS) {
+			if (prev == next) return key_values_floats[prev];
 
-				return Vector3(value_x, value_y, value_z);
-			}
-			else if (frame_value_prev) {
-				return Vector3(frame_value_prev->value_x, frame_value_prev->value_y, frame_value_prev->value_z);
-			}
-			else if (frame_value_next) {
-				return Vector3(frame_value_next->value_x, frame_value_next->value_y, frame_value_next->value_z);
-			}
-			else {
-				return reference;
-			}
+			float time_diff  = key_frames[next] - key_frames[prev];
+			Vector3 value_diff = key_values_floats[next] - key_values_floats[prev];
+			float scale      = (frame - key_frames[prev]) / time_diff;
+			return key_values_floats[prev] + value_diff*scale;
 		}
 		else {
-			return reference;
+			const unsigned short *value_prev=&key_values_angles[prev*3];
+			const unsigned short *value_next=&key_values_angles[next*3];
+			if (prev == next) return Vector3(value_prev[0], value_prev[1], value_prev[2]);
+
+			float time_diff  = key_frames[next] - key_frames[prev];
+			float scale      = (frame - key_frames[prev]) / time_diff;
+
+			float value_x = interpolateWrappedAngle(value_prev[0], value_next[0], scale);
+			float value_y = interpolateWrappedAngle(value_prev[1], value_next[1], scale);
+			float value_z = interpolateWrappedAngle(value_prev[2], value_next[2], scale);
+			return Vector3(value_x, value_y, value_z);
 		}
 	}
 
 
 	float SonicMotionControl::getFrameValue(float frame, float reference) {
-		if (element_size == 8) {
-			if ((type == LIBGENS_XNMOTION_TYPE_X_ANGLE_BETA) || 
-				(type == LIBGENS_XNMOTION_TYPE_Y_ANGLE_BETA) || 
-				(type == LIBGENS_XNMOTION_TYPE_Z_ANGLE_BETA)) {
-
-				SonicFrameValueIntBeta *frame_value_prev=NULL;
-				SonicFrameValueIntBeta *frame_value_next=NULL;
-			
-				for (size_t i=0; i<frame_values_int_beta.size(); i++) {
-					if (frame_values_int_beta[i]->frame <= frame) {
-						frame_value_prev = frame_values_int_beta[i];
-					}
-					else {
-						frame_value_next = frame_values_int_beta[i];
-						break;
-					}
-				}
+		SonicMotionCursor cursor;
+		return getFrameValue(frame, reference, cursor);
+	}
 
-				if (frame_value_prev && frame_value_next) {
-					float range=65535.0f;
-					float time_diff  = frame_value_next->frame - frame_value_prev->frame;
-					float end        = frame_value_next->value; 
-					float start      = frame_value_prev->value;
-					float scale      = (frame - frame_value_prev->frame) / time_diff;
-
-
-					float difference = abs(end - start);
-					if (difference > range/2.0f) {
-						if (end > start) {
-							start += range;
-						}
-						else {
-							end += range;
-						}
-					}
+	float SonicMotionControl::getFrameValue(float frame, float reference, SonicMotionCursor &cursor) {
+		unsigned int key_type=getKeyType();
+		if ((key_type != LIBGENS_XNMOTION_KEY_FLOAT) && (key_type != LIBGENS_XNMOTION_KEY_INT) && (key_type != LIBGENS_XNMOTION_KEY_INT_BETA)) return reference;
+		if (!key_frames.size()) return reference;
 
-					float value = (start + ((end - start) * scale));
-					if (value > range) value -= range;
-					if (value < 0.0f)  value += range;
-					return value;
-				}
-				else if (frame_value_prev) {
-					return frame_value_prev->value;
-				}
-				else if (frame_value_next) {
-					return frame_value_next->value;
-				}
-				else {
-					return reference;
-				}
-			}
-			else {
-				SonicFrameValue *frame_value_prev=NULL;
-				SonicFrameValue *frame_value_next=NULL;
+		size_t next=cursor.key=findFrameKey(key_frames, frame, cursor.key);
+		size_t prev=(next > 0 ? next-1 : next);
+		if (next == key_frames.size()) next = prev;
 
-				for (size_t i=0; i<frame_values.size(); i++) {
-					if (frame_values[i]->frame <= frame) {
-						frame_value_prev = frame_values[i];
-					}
-					else {
-						frame_value_next = frame_values[i];
-						break;
-					}
-				}
+		if (key_type == LIBGENS_XNMOTION_KEY_FLOAT) {
+			if (prev == next) return key_values[prev];
 
-				if (frame_value_prev && frame_value_next) {
-					float time_diff  = frame_value_next->frame - frame_value_prev->frame;
-					float value_diff = frame_value_next->value - frame_value_prev->value;
-					float scale      = (frame - frame_value_prev->frame) / time_diff;
+			float time_diff  = key_frames[next] - key_frames[prev];
+			float value_diff = key_values[next] - key_values[prev];
+			float scale      = (frame - key_frames[prev]) / time_diff;
+			return key_values[prev] + value_diff*scale;
+		}
+		else {
+			if (prev == next) return key_values_int[prev];
 
-					return frame_value_prev->value + value_diff*scale;
-				}
-				else if (frame_value_prev) {
-					return frame_value_prev->value;
-				}
-				else if (frame_value_next) {
-					return frame_value_next->value;
-				}
-				else {
-					return reference;
-				}
-			}
+			float time_diff  = key_frames[next] - key_frames[prev];
+			float scale      = (frame - key_frames[prev]) / time_diff;
+			return interpolateWrappedAngle(key_values_int[prev], key_values_int[next], scale);
 		}
-		else if (element_size == 4) {
-			SonicFrameValueInt *frame_value_prev=NULL;
-			SonicFrameValueInt *frame_value_next=NULL;
-			
-			for (size_t i=0; i<frame_values_int.size(); i++) {
-				if (frame_values_int[i]->frame <= frame) {
-					frame_value_prev = frame_values_int[i];
-				}
-				else {
-					frame_value_next = frame_values_int[i];
-					break;
-				}
-			}
+	}
 
-			if (frame_value_prev && frame_value_next) {
-				float range=65535.0f;
-				float time_diff  = frame_value_next->frame - frame_value_prev->frame;
-				float end        = frame_value_next->value; 
-				float start      = frame_value_prev->value;
-				float scale      = (frame - frame_value_prev->frame) / time_diff;
+	// Drops the middle key of every run of three equal values, plus the last key when it repeats
+	// the one before it. Keys are compacted in place in a single pass over the arrays.
+	template <class T> static void removeRedundantKeys(vector<float> &frames, vector<T> &values) {
+		size_t count=frames.size();
+		if (count < 2) return;
 
+		size_t last=0;
+		for (size_t i=1; i<count; i++) {
+			bool redundant=(values[i] == values[last]) && ((i+1 == count) || (values[i+1] == values[last]));
+			if (redundant) continue;
 
-				float difference = abs(end - start);
-				if (difference > range/2.0f) {
-					if (end > start) {
-						start += range;
-					}
-					else {
-						end += range;
-					}
-				}
-
-				float value = (start + ((end - start) * scale));
-				if (value > range) value -= range;
-				if (value < 0.0f)  value += range;
-				return value;
-			}
-			else if (frame_value_prev) {
-				return frame_value_prev->value;
-			}
-			else if (frame_value_next) {
-				return frame_value_next->value;
-			}
-			else {
-				return reference;
-			}
-		}
-		else {
-			return reference;
+			last++;
+			frames[last] = frames[i];
+			values[last] = values[i];
 		}
-	}
 
-	void SonicMotionControl::optimize() {
-		float start=999999.0f;
-		float end=0.0f;
-
-		vector<SonicFrameValue *>::iterator it=frame_values.begin();
-		while (it!=frame_values.end()) {
-			vector<SonicFrameValue *>::iterator next_element = it+1;
-			vector<SonicFrameValue *>::iterator next_element_2 = it+2;
-
-			if (start > (*it)->frame) start = (*it)->frame;
-			if (end < (*it)->frame) end = (*it)->frame;
-			
-			if (next_element != frame_values.end()) {
-				if (next_element_2 != frame_values.end()) {
-					if (((*it)->value == (*next_element)->value) && ((*it)->value == (*next_element_2)->value)) {
-						delete (*next_element);
-						frame_values.erase(next_element);
-						continue;
-					}
-				}
-				else {
-					if ((*it)->value == (*next_element)->value) {
-						delete (*next_element);
-						frame_values.erase(next_element);
-						continue;
-					}
-				}
-			}
-			
-			it++;
-		}
+		frames.resize(last+1);
+		values.resize(last+1);
+	}
 
-		if (frame_values.size() == 1) flag=0x20004;
+	void SonicMotionControl::updateKeyRange() {
+		if (key_frames.size() == 1) flag=0x20004;
 
-		if (!frame_values.size()) {
+		if (!key_frames.size()) {
 			start_key_frame = 0.0f;
 			end_key_frame   = end_frame;
 		}
 		else {
+			float start=999999.0f;
+			float end=0.0f;
+			for (size_t i=0; i<key_frames.size(); i++) {
+				if (start > key_frames[i]) start = key_frames[i];
+				if (end < key_frames[i]) end = key_frames[i];
+			}
+
 			start_key_frame = start;
 			end_key_frame   = end;
 		}
 	}
+
+	void SonicMotionControl::optimize() {
+		removeRedundantKeys(key_frames, key_values);
+		updateKeyRange();
+	}
 	
 	void SonicMotionControl::optimizeInt() {
-		float start=999999.0f;
-		float end=0.0f;
-		
-		vector<SonicFrameValueInt *>::iterator it=frame_values_int.begin();
-		while (it!=frame_values_int.end()) {
-			vector<SonicFrameValueInt *>::iterator next_element = it+1;
-			vector<SonicFrameValueInt *>::iterator next_element_2 = it+2;
-			
-			if (start > (*it)->frame) start = (*it)->frame;
-			if (end < (*it)->frame) end = (*it)->frame;
-			
-			if (next_element != frame_values_int.end()) {
-				if (next_element_2 != frame_values_int.end()) {
-					if (((*it)->value == (*next_element)->value) && ((*it)->value == (*next_element_2)->value)) {
-						delete (*next_element);
-						frame_values_int.erase(next_element);
-						continue;
-					}
-				}
-				else {
-					if ((*it)->value == (*next_element)->value) {
-						delete (*next_element);
-						frame_values_int.erase(next_element);
-						continue;
-					}
-				}
-			}
-			
-			it++;
-		}
+		removeRedundantKeys(key_frames, key_values_int);
+		updateKeyRange();
+	}
+	
+	void SonicMotionControl::optimizeAngles() {
+		updateKeyRange();
+	}
 
-		if (frame_values_int.size() == 1) flag=0x20004;
+	// Distance between two angles in the 0-65535 range, going the shortest way around
+	static float wrappedAngleDifference(float a, float b) {
+		float difference=abs(a - b);
+		return std::min(difference, 65535.0f - difference);
+	}
 
-		if (!frame_values_int.size()) {
-			start_key_frame = 0.0f;
-			end_key_frame   = end_frame;
+	// Error at key i when it's dropped and rebuilt by interpolating keys a and b the same way sampling does
+	static float interpolationError(SonicMotionControl *control, unsigned int key_type, size_t a, size_t b, size_t i) {
+		float time_diff = control->key_frames[b] - control->key_frames[a];
+		float scale = (time_diff > 0.0f) ? (control->key_frames[i] - control->key_frames[a]) / time_diff : 0.0f;
+
+		if (key_type == LIBGENS_XNMOTION_KEY_FLOAT) {
+			float value = control->key_values[a] + (control->key_values[b] - control->key_values[a]) * scale;
+			return abs(value - control->key_values[i]);
 		}
-		else {
-			start_key_frame = start;
-			end_key_frame   = end;
+		else if ((key_type == LIBGENS_XNMOTION_KEY_INT) || (key_type == LIBGENS_XNMOTION_KEY_INT_BETA)) {
+			float value = interpolateWrappedAngle(control->key_values_int[a], control->key_values_int[b], scale);
+			return wrappedAngleDifference(value, control->key_values_int[i]);
+		}
+		else if (key_type == LIBGENS_XNMOTION_KEY_FLOATS) {
+			Vector3 value = control->key_values_floats[a] + (control->key_values_floats[b] - control->key_values_floats[a]) * scale;
+			Vector3 difference = value - control->key_values_floats[i];
+			return std::max(abs(difference.x), std::max(abs(difference.y), abs(difference.z)));
+		}
+		else if (key_type == LIBGENS_XNMOTION_KEY_ANGLES) {
+			float error=0.0f;
+			for (size_t c=0; c<3; c++) {
+				float value = interpolateWrappedAngle(control->key_values_angles[a*3+c], control->key_values_angles[b*3+c], scale);
+				error = std::max(error, wrappedAngleDifference(value, control->key_values_angles[i*3+c]));
+			}
+			return error;
 		}
+
+		return 0.0f;
 	}
 
-	
-	void SonicMotionControl::optimizeAngles() {
-		float start=999999.0f;
-		float end=0.0f;
+	template <class T> static void compactKeys(vector<T> &values, const vector<bool> &keep, size_t stride) {
+		if (!values.size()) return;
 
-		vector<SonicFrameValueAngles *>::iterator it=frame_values_angles.begin();
-		while (it!=frame_values_angles.end()) {
-			if (start > (*it)->frame) start = (*it)->frame;
-			if (end < (*it)->frame) end = (*it)->frame;
-			it++;
+		size_t last=0;
+		for (size_t i=0; i<keep.size(); i++) {
+			if (!keep[i]) continue;
+
+			for (size_t c=0; c<stride; c++) values[last*stride + c] = values[i*stride + c];
+			last++;
 		}
+		values.resize(last*stride);
+	}
 
-		if (frame_values_angles.size() == 1) flag=0x20004;
+	size_t SonicMotionControl::reduceKeys(float epsilon, float angle_epsilon) {
+		unsigned int key_type=getKeyType();
+		size_t count=key_frames.size();
+		if ((key_type == LIBGENS_XNMOTION_KEY_NONE) || (key_type == LIBGENS_XNMOTION_KEY_FLOATS_GROUP) || (count < 2)) return count;
 
-		if (!frame_values_angles.size()) {
-			start_key_frame = 0.0f;
-			end_key_frame   = end_frame;
+		float tolerance=((key_type == LIBGENS_XNMOTION_KEY_FLOAT) || (key_type == LIBGENS_XNMOTION_KEY_FLOATS)) ? epsilon : angle_epsilon;
+		vector<bool> keep(count, false);
+
+		// A channel that never leaves the tolerance around its first key collapses into that key alone
+		bool constant=true;
+		for (size_t i=1; (i<count) && constant; i++) {
+			if (interpolationError(this, key_type, 0, 0, i) > tolerance) constant = false;
 		}
-		else {
-			start_key_frame = start;
-			end_key_frame   = end;
+
+		keep[0] = true;
+		if (!constant) {
+			// Grow each segment from the last kept key for as long as every key it covers stays in tolerance
+			keep[count-1] = true;
+			size_t anchor=0;
+			for (size_t end=2; end<count; end++) {
+				for (size_t i=anchor+1; i<end; i++) {
+					if (interpolationError(this, key_type, anchor, end, i) > tolerance) {
+						anchor = end-1;
+						keep[anchor] = true;
+						break;
+					}
+				}
+			}
 		}
+
+		compactKeys(key_frames, keep, 1);
+		compactKeys(key_values, keep, 1);
+		compactKeys(key_values_int, keep, 1);
+		compactKeys(key_values_floats, keep, 1);
+		compactKeys(key_values_angles, keep, 3);
+		updateKeyRange();
+		return key_frames.size();
 	}
 
 	void SonicMotionControl::setScale(float scale) {
@@ -660,12 +502,12 @@ namespace LibGens {
 			(type == LIBGENS_XNMOTION_TYPE_Z_COORDINATE_LINEAR) ||
 			(type == LIBGENS_XNMOTION_TYPE_COORDINATES_LINEAR)) {
 
-			for (size_t i=0; i<frame_values.size(); i++) {
-				frame_values[i]->value *= scale;
+			for (size_t i=0; i<key_values.size(); i++) {
+				key_values[i] *= scale;
 			}
 
-			for (size_t i=0; i<frame_values_floats.size(); i++) {
-				frame_values_floats[i]->value = frame_values_floats[i]->value * scale;
+			for (size_t i=0; i<key_values_floats.size(); i++) {
+				key_values_floats[i] = key_values_floats[i] * scale;
 			}
 		}
 	}
@@ -836,6 +678,40 @@ namespace LibGens {
 		
 	}
 
+	float SonicXNMotion::reduceKeys(float epsilon, float angle_epsilon, unsigned int thread_count) {
+		size_t keys_before=0;
+		for (size_t i=0; i<motion_controls.size(); i++) {
+			keys_before += motion_controls[i]->getKeyCount();
+		}
+
+		if (!thread_count) thread_count = std::thread::hardware_concurrency();
+		if (!thread_count) thread_count = 1;
+		thread_count = std::min(thread_count, (unsigned int) motion_controls.size());
+
+		std::atomic<size_t> next_control(0);
+		vector<std::thread> threads;
+		for (unsigned int t=0; t<thread_count; t++) {
+			threads.push_back(std::thread([&]() {
+				for (size_t c=next_control++; c<motion_controls.size(); c=next_control++) {
+					motion_controls[c]->reduceKeys(epsilon, angle_epsilon);
+				}
+			}));
+		}
+
+		for (size_t t=0; t<threads.size(); t++) {
+			threads[t].join();
+		}
+
+		size_t keys_after=0;
+		for (size_t i=0; i<motion_controls.size(); i++) {
+			keys_after += motion_controls[i]->getKeyCount();
+		}
+
+		float ratio=(keys_before ? (float)keys_after / (float)keys_before : 1.0f);
+		printf("Reduced %zu keys into %zu (%f%% of the original).\n", keys_before, keys_after, ratio*100.0f);
+		return ratio;
+	}
+
 	void SonicXNMotion::updateScaleMod(SonicXNObject *object) {
 		for (size_t i=0; i<motion_controls.size(); i++) {
 			motion_controls[i]->setScale(object->bones[motion_controls[i]->bone_index]->scale_animation_mod);
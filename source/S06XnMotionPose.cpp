@@ -0,0 +1,227 @@
+//=========================================================================
+//	  Copyright (c) 2016 SonicGLvl
+//
+//    This file is part of SonicGLvl, a community-created free level editor
+//    for the PC version of Sonic Generations.
+//
+//    SonicGLvl is free software: you can redistribute it and/or modify
+//    it under the terms of the GNU General Public License as published by
+//    the Free Software Foundation, either version 3 of the License, or
+//    (at your option) any later version.
+//
+//    SonicGLvl is distributed in the hope that it will be useful,
+//    but WITHOUT ANY WARRANTY; without even the implied warranty of
+//    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+//
+//
+//    Read AUTHORS.txt, LICENSE.txt and COPYRIGHT.txt for more details.
+//=========================================================================
+
+#include "LibGens.h"
+#include <algorithm>
+#include "S06XnFile.h"
+
+namespace LibGens {
+	SonicXNPose::SonicXNPose(SonicXNMotion *motion_p, SonicXNObject *object_p) {
+		motion = motion_p;
+		object = object_p;
+
+		size_t bone_count=object->bones.size();
+		controls.assign(bone_count * LIBGENS_XNPOSE_CHANNEL_COUNT, NULL);
+		cursors.assign(bone_count * LIBGENS_XNPOSE_CHANNEL_COUNT, SonicMotionCursor());
+
+		translation_x.assign(bone_count, 0.0f);
+		translation_y.assign(bone_count, 0.0f);
+		translation_z.assign(bone_count, 0.0f);
+		rotation_x.assign(bone_count, 0.0f);
+		rotation_y.assign(bone_count, 0.0f);
+		rotation_z.assign(bone_count, 0.0f);
+		scale_x.assign(bone_count, 1.0f);
+		scale_y.assign(bone_count, 1.0f);
+		scale_z.assign(bone_count, 1.0f);
+		orientation_x.assign(bone_count, 0.0f);
+		orientation_y.assign(bone_count, 0.0f);
+		orientation_z.assign(bone_count, 0.0f);
+		orientation_w.assign(bone_count, 1.0f);
+		local_matrices.resize(bone_count);
+		world_matrices.resize(bone_count);
+
+		// Resolve every (type, bone) pair in a single pass, keeping the first match like getMotionControl
+		const unsigned int channel_types[LIBGENS_XNPOSE_CHANNEL_COUNT]={
+			LIBGENS_XNMOTION_TYPE_COORDINATES_LINEAR,
+			LIBGENS_XNMOTION_TYPE_ANGLES_LINEAR,
+			LIBGENS_XNMOTION_TYPE_X_COORDINATE_LINEAR,
+			LIBGENS_XNMOTION_TYPE_Y_COORDINATE_LINEAR,
+			LIBGENS_XNMOTION_TYPE_Z_COORDINATE_LINEAR,
+			LIBGENS_XNMOTION_TYPE_X_ANGLE_LINEAR,
+			LIBGENS_XNMOTION_TYPE_Y_ANGLE_LINEAR,
+			LIBGENS_XNMOTION_TYPE_Z_ANGLE_LINEAR,
+			LIBGENS_XNMOTION_TYPE_X_ANGLE_BETA,
+			LIBGENS_XNMOTION_TYPE_Y_ANGLE_BETA,
+			LIBGENS_XNMOTION_TYPE_Z_ANGLE_BETA,
+			LIBGENS_XNMOTION_TYPE_X_SCALE_LINEAR,
+			LIBGENS_XNMOTION_TYPE_Y_SCALE_LINEAR,
+			LIBGENS_XNMOTION_TYPE_Z_SCALE_LINEAR
+		};
+
+		vector<SonicMotionControl *> &motion_controls=motion->getMotionControls();
+		for (size_t i=0; i<motion_controls.size(); i++) {
+			SonicMotionControl *motion_control=motion_controls[i];
+			if (motion_control->bone_index >= bone_count) continue;
+
+			for (size_t c=0; c<LIBGENS_XNPOSE_CHANNEL_COUNT; c++) {
+				if (motion_control->type == channel_types[c]) {
+					SonicMotionControl *&slot=controls[motion_control->bone_index * LIBGENS_XNPOSE_CHANNEL_COUNT + c];
+					if (!slot) slot = motion_control;
+					break;
+				}
+			}
+		}
+
+		// Parents always come before their children in the object's hierarchy, which is built when the object
+		// is read or imported. Bones added since then get sorted here, leaving the object untouched.
+		if (object->bone_hierarchy.size() == bone_count) {
+			order = object->bone_hierarchy;
+			levels = object->bone_hierarchy_levels;
+		}
+		else {
+			unsigned int max_depth=0;
+			object->sortBoneHierarchy(order, levels, max_depth);
+		}
+
+		parents.resize(bone_count);
+		for (size_t b=0; b<bone_count; b++) {
+			parents[b] = object->bones[b]->parent_index;
+		}
+	}
+
+	void SonicXNPose::reset() {
+		for (size_t i=0; i<cursors.size(); i++) {
+			cursors[i].reset();
+		}
+	}
+
+	void SonicXNPose::sampleBone(size_t bone_index, float frame) {
+		SonicBone *bone=object->bones[bone_index];
+		SonicMotionControl **bone_controls=&controls[bone_index * LIBGENS_XNPOSE_CHANNEL_COUNT];
+		SonicMotionCursor *bone_cursors=&cursors[bone_index * LIBGENS_XNPOSE_CHANNEL_COUNT];
+
+		Vector3 position = bone->translation;
+		Vector3 scale = bone->scale;
+		Quaternion orientation = bone->orientation;
+
+		float bone_rot_x = bone->rotation_x * LIBGENS_MATH_INT32_TO_RAD;
+		float bone_rot_y = bone->rotation_y * LIBGENS_MATH_INT32_TO_RAD;
+		float bone_rot_z = bone->rotation_z * LIBGENS_MATH_INT32_TO_RAD;
+
+		unsigned short rot_x_ref = (bone_rot_x / LIBGENS_MATH_PI * 32767.5f);
+		unsigned short rot_y_ref = (bone_rot_y / LIBGENS_MATH_PI * 32767.5f);
+		unsigned short rot_z_ref = (bone_rot_z / LIBGENS_MATH_PI * 32767.5f);
+
+		float rot_x=bone_rot_x;
+		float rot_y=bone_rot_y;
+		float rot_z=bone_rot_z;
+
+		SonicMotionControl *motion_control=NULL;
+		if ((motion_control = bone_controls[LIBGENS_XNPOSE_CHANNEL_POSITION_X])) position.x = motion_control->getFrameValue(frame, position.x, bone_cursors[LIBGENS_XNPOSE_CHANNEL_POSITION_X]);
+		if ((motion_control = bone_controls[LIBGENS_XNPOSE_CHANNEL_POSITION_Y])) position.y = motion_control->getFrameValue(frame, position.y, bone_cursors[LIBGENS_XNPOSE_CHANNEL_POSITION_Y]);
+		if ((motion_control = bone_controls[LIBGENS_XNPOSE_CHANNEL_POSITION_Z])) position.z = motion_control->getFrameValue(frame, position.z, bone_cursors[LIBGENS_XNPOSE_CHANNEL_POSITION_Z]);
+
+		if ((motion_control = bone_controls[LIBGENS_XNPOSE_CHANNEL_POSITION])) {
+			position = motion_control->getFrameVector(frame, position, bone_cursors[LIBGENS_XNPOSE_CHANNEL_POSITION]);
+		}
+
+		// Single axis angle channels, the beta variants override the linear ones
+		bool update_quaternion=false;
+		float *rotations[3]={ &rot_x, &rot_y, &rot_z };
+		unsigned short references[3]={ rot_x_ref, rot_y_ref, rot_z_ref };
+		const size_t angle_channels[6]={
+			LIBGENS_XNPOSE_CHANNEL_ANGLE_X, LIBGENS_XNPOSE_CHANNEL_ANGLE_Y, LIBGENS_XNPOSE_CHANNEL_ANGLE_Z,
+			LIBGENS_XNPOSE_CHANNEL_ANGLE_BETA_X, LIBGENS_XNPOSE_CHANNEL_ANGLE_BETA_Y, LIBGENS_XNPOSE_CHANNEL_ANGLE_BETA_Z
+		};
+
+		for (size_t i=0; i<6; i++) {
+			size_t channel=angle_channels[i];
+			if ((motion_control = bone_controls[channel])) {
+				*rotations[i%3] = motion_control->getFrameValue(frame, references[i%3], bone_cursors[channel]) / 65535.0f * (LIBGENS_MATH_PI*2);
+				update_quaternion = true;
+			}
+		}
+
+		if ((motion_control = bone_controls[LIBGENS_XNPOSE_CHANNEL_ANGLES])) {
+			Vector3 rotation_vector = motion_control->getFrameVector(frame, Vector3(rot_x, rot_y, rot_z), bone_cursors[LIBGENS_XNPOSE_CHANNEL_ANGLES]);
+			rot_x = rotation_vector.x  / 65535.0f * (LIBGENS_MATH_PI*2);
+			rot_y = rotation_vector.y  / 65535.0f * (LIBGENS_MATH_PI*2);
+			rot_z = rotation_vector.z  / 65535.0f * (LIBGENS_MATH_PI*2);
+			update_quaternion = true;
+		}
+
+		if ((motion_control = bone_controls[LIBGENS_XNPOSE_CHANNEL_SCALE_X])) scale.x = motion_control->getFrameValue(frame, scale.x, bone_cursors[LIBGENS_XNPOSE_CHANNEL_SCALE_X]);
+		if ((motion_control = bone_controls[LIBGENS_XNPOSE_CHANNEL_SCALE_Y])) scale.y = motion_control->getFrameValue(frame, scale.y, bone_cursors[LIBGENS_XNPOSE_CHANNEL_SCALE_Y]);
+		if ((motion_control = bone_controls[LIBGENS_XNPOSE_CHANNEL_SCALE_Z])) scale.z = motion_control->getFrameValue(frame, scale.z, bone_cursors[LIBGENS_XNPOSE_CHANNEL_SCALE_Z]);
+
+		if (update_quaternion) {
+			// Rotation order comes from the bone flag: XYZ by default, XZY for 256 and ZXY for 1024
+			unsigned int rotation_flag=bone->flag & 3840u;
+			Matrix3 mr;
+
+			if (rotation_flag != 0u) {
+				if (rotation_flag != 256u) {
+					if (rotation_flag != 1024u) mr.fromEulerAnglesZYX(rot_z, rot_y, rot_x);
+					else mr.fromEulerAnglesYXZ(rot_z, rot_y, rot_x);
+				}
+				else mr.fromEulerAnglesYZX(rot_z, rot_y, rot_x);
+			}
+			else mr.fromEulerAnglesZYX(rot_z, rot_y, rot_x);
+
+			orientation.fromRotationMatrix(mr);
+		}
+
+		translation_x[bone_index] = position.x;
+		translation_y[bone_index] = position.y;
+		translation_z[bone_index] = position.z;
+		rotation_x[bone_index] = rot_x;
+		rotation_y[bone_index] = rot_y;
+		rotation_z[bone_index] = rot_z;
+		scale_x[bone_index] = scale.x;
+		scale_y[bone_index] = scale.y;
+		scale_z[bone_index] = scale.z;
+		orientation_x[bone_index] = orientation.x;
+		orientation_y[bone_index] = orientation.y;
+		orientation_z[bone_index] = orientation.z;
+		orientation_w[bone_index] = orientation.w;
+	}
+
+	Matrix4 SonicXNPose::evaluateBone(size_t bone_index, float frame, float unit_scale) {
+		sampleBone(bone_index, frame);
+
+		Vector3 position(translation_x[bone_index], translation_y[bone_index], translation_z[bone_index]);
+		Vector3 scale(scale_x[bone_index], scale_y[bone_index], scale_z[bone_index]);
+		Quaternion orientation(orientation_w[bone_index], orientation_x[bone_index], orientation_y[bone_index], orientation_z[bone_index]);
+
+		Matrix4 m;
+		m.makeTransform(position*unit_scale, scale, orientation);
+		local_matrices.set(bone_index, m);
+		return m;
+	}
+
+	void SonicXNPose::evaluate(float frame, float unit_scale) {
+		// Sampling branches on which channels each bone animates and searches its own keys, so it goes bone
+		// by bone. The matrices are the same math for every bone, and within a level no bone needs another.
+		size_t bone_count=object->bones.size();
+		if (!bone_count) return;
+
+		for (size_t b=0; b<bone_count; b++) {
+			sampleBone(b, frame);
+		}
+
+		const float *translation[3]={ translation_x.data(), translation_y.data(), translation_z.data() };
+		const float *orientation[4]={ orientation_x.data(), orientation_y.data(), orientation_z.data(), orientation_w.data() };
+		const float *scale[3]={ scale_x.data(), scale_y.data(), scale_z.data() };
+		local_matrices.compose(translation, orientation, scale, unit_scale);
+
+		for (size_t l=0; l+1<levels.size(); l++) {
+			world_matrices.concatenate(local_matrices, parents, order.data() + levels[l], levels[l+1] - levels[l]);
+		}
+	}
+};
@@ -161,24 +161,95 @@ namespace LibGens {
 			printf("\n");
 		}
 
-		
+		buildBoneHierarchy();
 	}
 
-	void SonicXNObject::calculateMaxBoneDepth(size_t parent, size_t depth) {
-		for (size_t i=0; i<bones.size(); i++) {
-			if (bones[i]->parent_index == parent) {
-				if ((depth+1) > bone_max_depth) bone_max_depth = depth+1;
-				calculateMaxBoneDepth(i, depth+1);
+	void SonicXNObject::buildBoneHierarchy() {
+		bone_matrix_count = 0;
+		for (size_t b=0; b<bones.size(); b++) {
+			if (bones[b]->matrix_index != 0xFFFF) bone_matrix_count++;
+		}
+
+		sortBoneHierarchy(bone_hierarchy, bone_hierarchy_levels, bone_max_depth);
+	}
+
+	void SonicXNObject::sortBoneHierarchy(vector<unsigned short> &hierarchy, vector<size_t> &levels, unsigned int &max_depth) {
+		size_t bone_count=bones.size();
+		hierarchy.clear();
+		levels.clear();
+		max_depth = 0;
+
+		// Children of every bone, packed contiguously after their parent's offset
+		vector<size_t> child_offsets(bone_count+1, 0);
+		for (size_t b=0; b<bone_count; b++) {
+			unsigned short parent=bones[b]->parent_index;
+			if ((parent < bone_count) && (parent != b)) child_offsets[parent+1]++;
+		}
+
+		for (size_t b=0; b<bone_count; b++) {
+			child_offsets[b+1] += child_offsets[b];
+		}
+
+		vector<unsigned short> children(child_offsets[bone_count]);
+		vector<size_t> child_cursors(child_offsets.begin(), child_offsets.end()-1);
+		for (size_t b=0; b<bone_count; b++) {
+			unsigned short parent=bones[b]->parent_index;
+			if ((parent < bone_count) && (parent != b)) children[child_cursors[parent]++] = b;
+		}
+
+		// Breadth first from the roots, so each level only depends on the ones before it.
+		// The stored depth counts levels below the first bone, which starts at 1.
+		vector<unsigned int> depths(bone_count, 0);
+		if (bone_count) depths[0] = 1;
+
+		hierarchy.reserve(bone_count);
+		for (size_t b=0; b<bone_count; b++) {
+			unsigned short parent=bones[b]->parent_index;
+			if ((parent >= bone_count) || (parent == b)) hierarchy.push_back(b);
+		}
+
+		size_t level_start=0;
+		levels.push_back(0);
+		while (level_start < hierarchy.size()) {
+			size_t level_end=hierarchy.size();
+			levels.push_back(level_end);
+
+			for (size_t i=level_start; i<level_end; i++) {
+				unsigned short b=hierarchy[i];
+				for (size_t c=child_offsets[b]; c<child_offsets[b+1]; c++) {
+					unsigned short child=children[c];
+					hierarchy.push_back(child);
+
+					if (depths[b]) {
+						depths[child] = depths[b] + 1;
+						if (depths[child] > max_depth) max_depth = depths[child];
+					}
+				}
 			}
+
+			level_start = level_end;
 		}
 	}
 
-	void SonicXNObject::calculateBoneMatrixCount() {
-		bone_matrix_count = 0;
+	void SonicXNObject::buildMatrixToBone(vector<int> &matrix_to_bone) {
+		matrix_to_bone.assign(0x10000, -1);
+		for (size_t b=0; b<bones.size(); b++) {
+			unsigned short matrix_index=bones[b]->matrix_index;
+			if ((matrix_index != 0xFFFF) && (matrix_to_bone[matrix_index] < 0)) matrix_to_bone[matrix_index] = b;
+		}
+	}
 
-		for (size_t i=0; i<bones.size(); i++) {
-			if (bones[i]->matrix_index != 0xFFFF) bone_matrix_count++;
+	void SonicXNObject::compactVertexLayouts() {
+		size_t size_before=0;
+		size_t size_after=0;
+
+		for (size_t i=0; i<vertex_tables.size(); i++) {
+			size_before += vertex_tables[i]->vertices.size() * vertex_tables[i]->vertex_size;
+			vertex_tables[i]->compactLayout(file_mode);
+			size_after += vertex_tables[i]->vertices.size() * vertex_tables[i]->vertex_size;
 		}
+
+		printf("Vertex buffers compacted from %zu to %zu bytes.\n", size_before, size_after);
 	}
 
 	void SonicXNObject::writeBody(File *file) {
@@ -202,60 +273,29 @@ namespace LibGens {
 		}
 
 		// Material Parts
+		SonicXNWritePool data_block_1_pool;
+		SonicXNWritePool data_block_2_pool;
+		SonicXNWritePool texture_units_pool;
+
 		if (file_mode == MODE_ZNO) {
 			for (size_t i=0; i<material_parts_count; i++) {
-				bool found=false;
-				for (int j=(int)i-1; j>=0; j--) {
-					if (material_tables[i]->compareDataBlock1(material_tables[j], file_mode)) {
-						material_tables[i]->data_block_1_address = material_tables[j]->data_block_1_address;
-						found = true;
-						break;
-					}
-				}
-				if (!found) material_tables[i]->writeDataBlock1(file, file_mode);
-
-
-				material_tables[i]->writeDataBlock2(file, file_mode);
-				material_tables[i]->writeTextureUnits(file, file_mode);
+				material_tables[i]->writeDataBlock1Pooled(file, file_mode, data_block_1_pool);
+				material_tables[i]->writeDataBlock2Pooled(file, file_mode, data_block_2_pool);
+				material_tables[i]->writeTextureUnitsPooled(file, file_mode, texture_units_pool);
 				material_tables[i]->writeTable(file, file_mode);
 			}
 		}
 		else {
 			for (size_t i=0; i<material_parts_count; i++) {
-				bool found=false;
-				for (int j=(int)i-1; j>=0; j--) {
-					if (material_tables[i]->compareDataBlock1(material_tables[j], file_mode)) {
-						material_tables[i]->data_block_1_address = material_tables[j]->data_block_1_address;
-						found = true;
-						break;
-					}
-				}
-				if (!found) material_tables[i]->writeDataBlock1(file, file_mode);
+				material_tables[i]->writeDataBlock1Pooled(file, file_mode, data_block_1_pool);
 			}
 
 			for (size_t i=0; i<material_parts_count; i++) {
-				bool found=false;
-				for (int j=(int)i-1; j>=0; j--) {
-					if (material_tables[i]->compareDataBlock2(material_tables[j], file_mode)) {
-						material_tables[i]->data_block_2_address = material_tables[j]->data_block_2_address;
-						found = true;
-						break;
-					}
-				}
-				if (!found) material_tables[i]->writeDataBlock2(file, file_mode);
+				material_tables[i]->writeDataBlock2Pooled(file, file_mode, data_block_2_pool);
 			}
 
 			for (size_t i=0; i<material_parts_count; i++) {
-				bool found=false;
-				found = false;
-				for (int j=(int)i-1; j>=0; j--) {
-					if (material_tables[i]->compareTextureUnits(material_tables[j], file_mode)) {
-						material_tables[i]->texture_units_address = material_tables[j]->texture_units_address;
-						found = true;
-						break;
-					}
-				}
-				if (!found) material_tables[i]->writeTextureUnits(file, file_mode);
+				material_tables[i]->writeTextureUnitsPooled(file, file_mode, texture_units_pool);
 			}
 
 			for (size_t i=0; i<material_parts_count; i++) {
@@ -281,8 +321,9 @@ namespace LibGens {
 
 
 		// Index Parts
+		SonicXNWritePool index_pool;
 		for (size_t i=0; i<index_tables.size(); i++) {
-			index_tables[i]->writeIndices(file);
+			index_tables[i]->writeIndicesPooled(file, index_pool);
 		}
 
 		for (size_t i=0; i<index_tables.size(); i++) {
@@ -306,11 +347,7 @@ namespace LibGens {
 		}
 
 		// Calculate bone parameters
-		bone_max_depth = 0;
-		if (bones.size()) {
-			calculateMaxBoneDepth(0, 1);
-		}
-		calculateBoneMatrixCount();
+		buildBoneHierarchy();
 
 		// Calculate texture parameters
 		if (texture) total_texture_count = texture->getTextureUnitsSize();
@@ -340,9 +377,10 @@ namespace LibGens {
 		}
 
 		// Vertex Buffer
+		SonicXNWritePool vertex_pool;
 		size_t vertex_buffer_address=file->getCurrentAddress();
 		for (size_t i=0; i<vertex_tables.size(); i++) {
-			vertex_tables[i]->writeVertices(file, file_mode);
+			vertex_tables[i]->writeVerticesPooled(file, file_mode, vertex_pool);
 		}
 
 		unsigned int vertex_buffer_size = file->getCurrentAddress() - vertex_buffer_address;
@@ -389,23 +427,32 @@ namespace LibGens {
 		setBoneScale(bone->sibling_index, scale);
 	}
 
-	void SonicXNObject::calculateSkinningMatrix(unsigned short current_index, LibGens::Matrix4 parent_matrix) {
-		if (current_index == 0xFFFF) return;
+	void SonicXNObject::calculateSkinningMatrices() {
+		buildBoneHierarchy();
 
-		SonicBone *bone=bones[current_index];
-		LibGens::Matrix4 result_matrix = parent_matrix * bone->current_matrix;
+		size_t bone_count=bones.size();
+		SonicBoneMatrices local_matrices, world_matrices, inverse_matrices;
+		local_matrices.resize(bone_count);
+		world_matrices.resize(bone_count);
 
-		bone->matrix = result_matrix;
-		bone->matrix = bone->matrix.transpose();
-		bone->matrix = bone->matrix.inverse();
+		vector<unsigned short> parents(bone_count);
+		for (size_t b=0; b<bone_count; b++) {
+			local_matrices.set(b, bones[b]->current_matrix);
+			parents[b] = bones[b]->parent_index;
+		}
 
-		calculateSkinningMatrix(bone->child_index, result_matrix);
-		calculateSkinningMatrix(bone->sibling_index, parent_matrix);
-	}
+		// Level by level, every parent's world matrix is final before its children read it
+		for (size_t l=0; l+1<bone_hierarchy_levels.size(); l++) {
+			size_t start=bone_hierarchy_levels[l];
+			world_matrices.concatenate(local_matrices, parents, bone_hierarchy.data() + start, bone_hierarchy_levels[l+1] - start);
+		}
 
-	void SonicXNObject::calculateSkinningMatrices() {
-		Matrix4 identity=Matrix4();
-		calculateSkinningMatrix(0, identity);
+		// Bones store the inverse transposed
+		world_matrices.invert(inverse_matrices);
+		for (size_t i=0; i<bone_hierarchy.size(); i++) {
+			unsigned short b=bone_hierarchy[i];
+			bones[b]->matrix = inverse_matrices.get(b).transpose();
+		}
 	}
 
 	void SonicXNObject::calculateSkinningIDs() {
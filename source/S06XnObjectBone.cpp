@@ -21,6 +21,11 @@
 #include <algorithm>
 #include "S06XnFile.h"
 
+#if defined(__SSE__) || defined(_M_X64) || (defined(_M_IX86_FP) && (_M_IX86_FP >= 1))
+#include <xmmintrin.h>
+#define LIBGENS_XNBONE_SSE
+#endif
+
 namespace LibGens {
 	void SonicBone::read(File *file, bool big_endian, XNFileMode file_mode) {
 		file->readInt32E(&flag, big_endian);
@@ -119,4 +124,277 @@ namespace LibGens {
 		child_index = 0xFFFF;
 		sibling_index = 0xFFFF;
 	}
+
+	void SonicBone::setTransform(Vector3 translation_p, Quaternion orientation_p, Vector3 scale_p) {
+		translation = translation_p;
+		orientation = orientation_p;
+		scale = scale_p;
+		current_matrix.makeTransform(translation, scale, orientation);
+
+		// Angles for the default XYZ order, where the rotation is Rz * Ry * Rx, in the file's 32 bit units
+		float x=orientation.x, y=orientation.y, z=orientation.z, w=orientation.w;
+		float r00=1.0f - 2.0f*(y*y + z*z);
+		float r01=2.0f*(x*y - w*z);
+		float r10=2.0f*(x*y + w*z);
+		float r11=1.0f - 2.0f*(x*x + z*z);
+		float r20=2.0f*(x*z - w*y);
+		float r21=2.0f*(y*z + w*x);
+		float r22=1.0f - 2.0f*(x*x + y*y);
+
+		float sin_y=std::min(std::max(-r20, -1.0f), 1.0f);
+		float euler[3]={ 0.0f, asin(sin_y), 0.0f };
+		if (fabs(sin_y) < 0.99999f) {
+			euler[0] = atan2(r21, r22);
+			euler[2] = atan2(r10, r00);
+		}
+		else euler[2] = atan2(-r01, r11);
+
+		unsigned int angles[3];
+		unsigned int full_turn=(unsigned int) (LIBGENS_MATH_PI*2 / LIBGENS_MATH_INT32_TO_RAD + 0.5f);
+		for (size_t i=0; i<3; i++) {
+			float angle=fmod(euler[i], LIBGENS_MATH_PI*2);
+			if (angle < 0.0f) angle += LIBGENS_MATH_PI*2;
+			angles[i] = ((unsigned int) (angle / LIBGENS_MATH_INT32_TO_RAD + 0.5f)) % full_turn;
+		}
+
+		rotation_x = angles[0];
+		rotation_y = angles[1];
+		rotation_z = angles[2];
+	}
+
+
+	// Kernels over count bones, each argument holding a pointer per matrix element (or component) into arrays
+	// with one value per bone. Four bones are done per SSE vector and the rest one by one.
+	static void multiplyAffine(const float *const *a, const float *const *b, float *const *out, size_t count) {
+		size_t i=0;
+
+#ifdef LIBGENS_XNBONE_SSE
+		for (; i+4<=count; i+=4) {
+			for (size_t r=0; r<3; r++) {
+				__m128 a0=_mm_loadu_ps(a[r*4]+i), a1=_mm_loadu_ps(a[r*4+1]+i), a2=_mm_loadu_ps(a[r*4+2]+i);
+				for (size_t c=0; c<4; c++) {
+					__m128 value=_mm_add_ps(_mm_mul_ps(a0, _mm_loadu_ps(b[c]+i)), _mm_mul_ps(a1, _mm_loadu_ps(b[4+c]+i)));
+					value = _mm_add_ps(value, _mm_mul_ps(a2, _mm_loadu_ps(b[8+c]+i)));
+					if (c == 3) value = _mm_add_ps(value, _mm_loadu_ps(a[r*4+3]+i));
+					_mm_storeu_ps(out[r*4+c]+i, value);
+				}
+			}
+		}
+#endif
+
+		for (; i<count; i++) {
+			for (size_t r=0; r<3; r++) {
+				for (size_t c=0; c<4; c++) {
+					float value=a[r*4][i]*b[c][i] + a[r*4+1][i]*b[4+c][i] + a[r*4+2][i]*b[8+c][i];
+					if (c == 3) value += a[r*4+3][i];
+					out[r*4+c][i] = value;
+				}
+			}
+		}
+	}
+
+	static void invertAffine(const float *const *m, float *const *out, size_t count) {
+		size_t i=0;
+
+#ifdef LIBGENS_XNBONE_SSE
+		__m128 zero=_mm_setzero_ps();
+		__m128 one=_mm_set1_ps(1.0f);
+		for (; i+4<=count; i+=4) {
+			__m128 e[12];
+			for (size_t k=0; k<12; k++) e[k] = _mm_loadu_ps(m[k]+i);
+
+			__m128 c00=_mm_sub_ps(_mm_mul_ps(e[5], e[10]), _mm_mul_ps(e[6], e[9]));
+			__m128 c01=_mm_sub_ps(_mm_mul_ps(e[6], e[8]), _mm_mul_ps(e[4], e[10]));
+			__m128 c02=_mm_sub_ps(_mm_mul_ps(e[4], e[9]), _mm_mul_ps(e[5], e[8]));
+			__m128 det=_mm_add_ps(_mm_add_ps(_mm_mul_ps(e[0], c00), _mm_mul_ps(e[1], c01)), _mm_mul_ps(e[2], c02));
+			__m128 inv_det=_mm_and_ps(_mm_cmpneq_ps(det, zero), _mm_div_ps(one, det));
+
+			__m128 r[9];
+			r[0] = _mm_mul_ps(c00, inv_det);
+			r[1] = _mm_mul_ps(_mm_sub_ps(_mm_mul_ps(e[2], e[9]), _mm_mul_ps(e[1], e[10])), inv_det);
+			r[2] = _mm_mul_ps(_mm_sub_ps(_mm_mul_ps(e[1], e[6]), _mm_mul_ps(e[2], e[5])), inv_det);
+			r[3] = _mm_mul_ps(c01, inv_det);
+			r[4] = _mm_mul_ps(_mm_sub_ps(_mm_mul_ps(e[0], e[10]), _mm_mul_ps(e[2], e[8])), inv_det);
+			r[5] = _mm_mul_ps(_mm_sub_ps(_mm_mul_ps(e[2], e[4]), _mm_mul_ps(e[0], e[6])), inv_det);
+			r[6] = _mm_mul_ps(c02, inv_det);
+			r[7] = _mm_mul_ps(_mm_sub_ps(_mm_mul_ps(e[1], e[8]), _mm_mul_ps(e[0], e[9])), inv_det);
+			r[8] = _mm_mul_ps(_mm_sub_ps(_mm_mul_ps(e[0], e[5]), _mm_mul_ps(e[1], e[4])), inv_det);
+
+			for (size_t row=0; row<3; row++) {
+				__m128 translation=_mm_add_ps(_mm_add_ps(_mm_mul_ps(r[row*3], e[3]), _mm_mul_ps(r[row*3+1], e[7])), _mm_mul_ps(r[row*3+2], e[11]));
+				_mm_storeu_ps(out[row*4]+i, r[row*3]);
+				_mm_storeu_ps(out[row*4+1]+i, r[row*3+1]);
+				_mm_storeu_ps(out[row*4+2]+i, r[row*3+2]);
+				_mm_storeu_ps(out[row*4+3]+i, _mm_sub_ps(zero, translation));
+			}
+		}
+#endif
+
+		for (; i<count; i++) {
+			float e[12];
+			for (size_t k=0; k<12; k++) e[k] = m[k][i];
+
+			float c00=e[5]*e[10] - e[6]*e[9];
+			float c01=e[6]*e[8] - e[4]*e[10];
+			float c02=e[4]*e[9] - e[5]*e[8];
+			float det=e[0]*c00 + e[1]*c01 + e[2]*c02;
+			float inv_det=(det != 0.0f) ? 1.0f / det : 0.0f;
+
+			float r[9];
+			r[0] = c00 * inv_det;
+			r[1] = (e[2]*e[9] - e[1]*e[10]) * inv_det;
+			r[2] = (e[1]*e[6] - e[2]*e[5]) * inv_det;
+			r[3] = c01 * inv_det;
+			r[4] = (e[0]*e[10] - e[2]*e[8]) * inv_det;
+			r[5] = (e[2]*e[4] - e[0]*e[6]) * inv_det;
+			r[6] = c02 * inv_det;
+			r[7] = (e[1]*e[8] - e[0]*e[9]) * inv_det;
+			r[8] = (e[0]*e[5] - e[1]*e[4]) * inv_det;
+
+			for (size_t row=0; row<3; row++) {
+				out[row*4][i] = r[row*3];
+				out[row*4+1][i] = r[row*3+1];
+				out[row*4+2][i] = r[row*3+2];
+				out[row*4+3][i] = -(r[row*3]*e[3] + r[row*3+1]*e[7] + r[row*3+2]*e[11]);
+			}
+		}
+	}
+
+	static void composeAffine(const float *const *t, const float *const *q, const float *const *s, float unit_scale, float *const *out, size_t count) {
+		size_t i=0;
+
+#ifdef LIBGENS_XNBONE_SSE
+		__m128 one=_mm_set1_ps(1.0f);
+		__m128 units=_mm_set1_ps(unit_scale);
+		for (; i+4<=count; i+=4) {
+			__m128 x=_mm_loadu_ps(q[0]+i), y=_mm_loadu_ps(q[1]+i), z=_mm_loadu_ps(q[2]+i), w=_mm_loadu_ps(q[3]+i);
+			__m128 tx=_mm_add_ps(x, x), ty=_mm_add_ps(y, y), tz=_mm_add_ps(z, z);
+			__m128 twx=_mm_mul_ps(tx, w), twy=_mm_mul_ps(ty, w), twz=_mm_mul_ps(tz, w);
+			__m128 txx=_mm_mul_ps(tx, x), txy=_mm_mul_ps(ty, x), txz=_mm_mul_ps(tz, x);
+			__m128 tyy=_mm_mul_ps(ty, y), tyz=_mm_mul_ps(tz, y), tzz=_mm_mul_ps(tz, z);
+
+			__m128 rotation[9]={
+				_mm_sub_ps(one, _mm_add_ps(tyy, tzz)), _mm_sub_ps(txy, twz), _mm_add_ps(txz, twy),
+				_mm_add_ps(txy, twz), _mm_sub_ps(one, _mm_add_ps(txx, tzz)), _mm_sub_ps(tyz, twx),
+				_mm_sub_ps(txz, twy), _mm_add_ps(tyz, twx), _mm_sub_ps(one, _mm_add_ps(txx, tyy))
+			};
+
+			__m128 scale[3]={ _mm_loadu_ps(s[0]+i), _mm_loadu_ps(s[1]+i), _mm_loadu_ps(s[2]+i) };
+			for (size_t r=0; r<3; r++) {
+				for (size_t c=0; c<3; c++) {
+					_mm_storeu_ps(out[r*4+c]+i, _mm_mul_ps(rotation[r*3+c], scale[c]));
+				}
+				_mm_storeu_ps(out[r*4+3]+i, _mm_mul_ps(_mm_loadu_ps(t[r]+i), units));
+			}
+		}
+#endif
+
+		for (; i<count; i++) {
+			float x=q[0][i], y=q[1][i], z=q[2][i], w=q[3][i];
+			float tx=x+x, ty=y+y, tz=z+z;
+			float twx=tx*w, twy=ty*w, twz=tz*w;
+			float txx=tx*x, txy=ty*x, txz=tz*x;
+			float tyy=ty*y, tyz=tz*y, tzz=tz*z;
+
+			float rotation[9]={
+				1.0f-(tyy+tzz), txy-twz, txz+twy,
+				txy+twz, 1.0f-(txx+tzz), tyz-twx,
+				txz-twy, tyz+twx, 1.0f-(txx+tyy)
+			};
+
+			for (size_t r=0; r<3; r++) {
+				for (size_t c=0; c<3; c++) {
+					out[r*4+c][i] = rotation[r*3+c] * s[c][i];
+				}
+				out[r*4+3][i] = t[r][i] * unit_scale;
+			}
+		}
+	}
+
+	void SonicBoneMatrices::resize(size_t count) {
+		for (size_t k=0; k<12; k++) {
+			elements[k].assign(count, ((k % 5) == 0) ? 1.0f : 0.0f);
+		}
+	}
+
+	void SonicBoneMatrices::set(size_t index, const Matrix4 &matrix) {
+		for (size_t k=0; k<12; k++) {
+			elements[k][index] = matrix[k/4][k%4];
+		}
+	}
+
+	Matrix4 SonicBoneMatrices::get(size_t index) const {
+		Matrix4 matrix;
+		for (size_t k=0; k<12; k++) {
+			matrix[k/4][k%4] = elements[k][index];
+		}
+
+		matrix[3][0] = matrix[3][1] = matrix[3][2] = 0.0f;
+		matrix[3][3] = 1.0f;
+		return matrix;
+	}
+
+	void SonicBoneMatrices::getAll(vector<Matrix4> &matrices) const {
+		matrices.resize(size());
+		for (size_t i=0; i<matrices.size(); i++) {
+			matrices[i] = get(i);
+		}
+	}
+
+	void SonicBoneMatrices::compose(const float *const *translation, const float *const *orientation, const float *const *scale, float unit_scale) {
+		float *out[12];
+		for (size_t k=0; k<12; k++) out[k] = elements[k].data();
+		composeAffine(translation, orientation, scale, unit_scale, out, size());
+	}
+
+	void SonicBoneMatrices::concatenate(const SonicBoneMatrices &locals, const vector<unsigned short> &parents, const unsigned short *level, size_t count) {
+		// The bones of a level are scattered, so each group of four is gathered into lanes first.
+		// Roots get an identity parent, and the last group repeats its last bone to fill the vector.
+		alignas(16) float parent[12][4];
+		alignas(16) float local[12][4];
+		alignas(16) float world[12][4];
+		const float *parent_rows[12], *local_rows[12];
+		float *world_rows[12];
+		for (size_t k=0; k<12; k++) {
+			parent_rows[k] = parent[k];
+			local_rows[k] = local[k];
+			world_rows[k] = world[k];
+		}
+
+		size_t bone_count=size();
+		for (size_t start=0; start<count; start+=4) {
+			size_t lanes=std::min((size_t) 4, count-start);
+			for (size_t l=0; l<4; l++) {
+				unsigned short b=level[start + std::min(l, lanes-1)];
+				unsigned short p=parents[b];
+				bool root=(p >= bone_count) || (p == b);
+
+				for (size_t k=0; k<12; k++) {
+					parent[k][l] = root ? (((k % 5) == 0) ? 1.0f : 0.0f) : elements[k][p];
+					local[k][l] = locals.elements[k][b];
+				}
+			}
+
+			multiplyAffine(parent_rows, local_rows, world_rows, 4);
+
+			for (size_t l=0; l<lanes; l++) {
+				unsigned short b=level[start + l];
+				for (size_t k=0; k<12; k++) {
+					elements[k][b] = world[k][l];
+				}
+			}
+		}
+	}
+
+	void SonicBoneMatrices::invert(SonicBoneMatrices &inverses) const {
+		inverses.resize(size());
+
+		const float *m[12];
+		float *out[12];
+		for (size_t k=0; k<12; k++) {
+			m[k] = elements[k].data();
+			out[k] = inverses.elements[k].data();
+		}
+		invertAffine(m, out, size());
+	}
 };
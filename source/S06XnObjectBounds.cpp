@@ -0,0 +1,359 @@
+//=========================================================================
+//	  Copyright (c) 2016 SonicGLvl
+//
+//    This file is part of SonicGLvl, a community-created free level editor 
+//    for the PC version of Sonic Generations.
+//
+//    SonicGLvl is free software: you can redistribute it and/or modify
+//    it under the terms of the GNU General Public License as published by
+//    the Free Software Foundation, either version 3 of the License, or
+//    (at your option) any later version.
+//
+//    SonicGLvl is distributed in the hope that it will be useful,
+//    but WITHOUT ANY WARRANTY; without even the implied warranty of
+//    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+//    
+//
+//    Read AUTHORS.txt, LICENSE.txt and COPYRIGHT.txt for more details.
+//=========================================================================
+
+#include "LibGens.h"
+#include <algorithm>
+#include "S06XnFile.h"
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && (_M_IX86_FP >= 2))
+#include <emmintrin.h>
+#define LIBGENS_XNBOUNDS_SSE2
+#endif
+
+namespace LibGens {
+	void SonicPointCloud::addPoint(float px, float py, float pz) {
+		x.push_back(px);
+		y.push_back(py);
+		z.push_back(pz);
+	}
+
+	void SonicPointCloud::addPoint(Vector3 point) {
+		addPoint(point.x, point.y, point.z);
+	}
+
+	void SonicPointCloud::calculateBox(Vector3 &box_min, Vector3 &box_max) {
+		size_t count=x.size();
+		if (!count) {
+			box_min = box_max = Vector3(0.0f, 0.0f, 0.0f);
+			return;
+		}
+
+		// Four points per step in independent lanes, folded together at the end
+		float min_x[4], min_y[4], min_z[4];
+		float max_x[4], max_y[4], max_z[4];
+		for (size_t l=0; l<4; l++) {
+			min_x[l] = max_x[l] = x[0];
+			min_y[l] = max_y[l] = y[0];
+			min_z[l] = max_z[l] = z[0];
+		}
+
+		const float *px=&x[0];
+		const float *py=&y[0];
+		const float *pz=&z[0];
+
+		size_t i=0;
+#ifdef LIBGENS_XNBOUNDS_SSE2
+		__m128 vmin_x=_mm_loadu_ps(min_x), vmin_y=_mm_loadu_ps(min_y), vmin_z=_mm_loadu_ps(min_z);
+		__m128 vmax_x=vmin_x, vmax_y=vmin_y, vmax_z=vmin_z;
+		for (; i+4<=count; i+=4) {
+			__m128 vx=_mm_loadu_ps(px+i), vy=_mm_loadu_ps(py+i), vz=_mm_loadu_ps(pz+i);
+			vmin_x = _mm_min_ps(vmin_x, vx);
+			vmin_y = _mm_min_ps(vmin_y, vy);
+			vmin_z = _mm_min_ps(vmin_z, vz);
+			vmax_x = _mm_max_ps(vmax_x, vx);
+			vmax_y = _mm_max_ps(vmax_y, vy);
+			vmax_z = _mm_max_ps(vmax_z, vz);
+		}
+
+		_mm_storeu_ps(min_x, vmin_x);
+		_mm_storeu_ps(min_y, vmin_y);
+		_mm_storeu_ps(min_z, vmin_z);
+		_mm_storeu_ps(max_x, vmax_x);
+		_mm_storeu_ps(max_y, vmax_y);
+		_mm_storeu_ps(max_z, vmax_z);
+#else
+		for (; i+4<=count; i+=4) {
+			for (size_t l=0; l<4; l++) {
+				min_x[l] = std::min(min_x[l], px[i+l]);
+				min_y[l] = std::min(min_y[l], py[i+l]);
+				min_z[l] = std::min(min_z[l], pz[i+l]);
+				max_x[l] = std::max(max_x[l], px[i+l]);
+				max_y[l] = std::max(max_y[l], py[i+l]);
+				max_z[l] = std::max(max_z[l], pz[i+l]);
+			}
+		}
+#endif
+
+		for (; i<count; i++) {
+			min_x[0] = std::min(min_x[0], px[i]);
+			min_y[0] = std::min(min_y[0], py[i]);
+			min_z[0] = std::min(min_z[0], pz[i]);
+			max_x[0] = std::max(max_x[0], px[i]);
+			max_y[0] = std::max(max_y[0], py[i]);
+			max_z[0] = std::max(max_z[0], pz[i]);
+		}
+
+		box_min = Vector3(std::min(std::min(min_x[0], min_x[1]), std::min(min_x[2], min_x[3])),
+						  std::min(std::min(min_y[0], min_y[1]), std::min(min_y[2], min_y[3])),
+						  std::min(std::min(min_z[0], min_z[1]), std::min(min_z[2], min_z[3])));
+
+		box_max = Vector3(std::max(std::max(max_x[0], max_x[1]), std::max(max_x[2], max_x[3])),
+						  std::max(std::max(max_y[0], max_y[1]), std::max(max_y[2], max_y[3])),
+						  std::max(std::max(max_z[0], max_z[1]), std::max(max_z[2], max_z[3])));
+	}
+
+	size_t SonicPointCloud::findFarthest(float cx, float cy, float cz) {
+		size_t count=x.size();
+		size_t farthest=0;
+		float farthest_distance=-1.0f;
+		size_t i=0;
+
+#ifdef LIBGENS_XNBOUNDS_SSE2
+		// Each lane keeps its own farthest point, ties go to the lowest index like the scalar loop
+		if (count >= 4) {
+			__m128 center_x=_mm_set1_ps(cx), center_y=_mm_set1_ps(cy), center_z=_mm_set1_ps(cz);
+			__m128 best=_mm_set1_ps(-1.0f);
+			__m128i best_index=_mm_setzero_si128();
+			__m128i index=_mm_setr_epi32(0, 1, 2, 3);
+			__m128i step=_mm_set1_epi32(4);
+
+			for (; i+4<=count; i+=4) {
+				__m128 dx=_mm_sub_ps(_mm_loadu_ps(&x[i]), center_x);
+				__m128 dy=_mm_sub_ps(_mm_loadu_ps(&y[i]), center_y);
+				__m128 dz=_mm_sub_ps(_mm_loadu_ps(&z[i]), center_z);
+				__m128 distance=_mm_add_ps(_mm_add_ps(_mm_mul_ps(dx, dx), _mm_mul_ps(dy, dy)), _mm_mul_ps(dz, dz));
+
+				__m128 greater=_mm_cmpgt_ps(distance, best);
+				__m128i greater_mask=_mm_castps_si128(greater);
+				best = _mm_or_ps(_mm_and_ps(greater, distance), _mm_andnot_ps(greater, best));
+				best_index = _mm_or_si128(_mm_and_si128(greater_mask, index), _mm_andnot_si128(greater_mask, best_index));
+				index = _mm_add_epi32(index, step);
+			}
+
+			float lane_distance[4];
+			int lane_index[4];
+			_mm_storeu_ps(lane_distance, best);
+			_mm_storeu_si128((__m128i *) lane_index, best_index);
+			for (size_t l=0; l<4; l++) {
+				if ((lane_distance[l] > farthest_distance) || ((lane_distance[l] == farthest_distance) && ((size_t) lane_index[l] < farthest))) {
+					farthest_distance = lane_distance[l];
+					farthest = lane_index[l];
+				}
+			}
+		}
+#endif
+
+		for (; i<count; i++) {
+			float dx=x[i]-cx;
+			float dy=y[i]-cy;
+			float dz=z[i]-cz;
+			float distance=dx*dx + dy*dy + dz*dz;
+			if (distance > farthest_distance) {
+				farthest_distance = distance;
+				farthest = i;
+			}
+		}
+
+		return farthest;
+	}
+
+	void SonicPointCloud::calculateSphere(Vector3 &center, float &radius) {
+		size_t count=x.size();
+		if (!count) {
+			center = Vector3(0.0f, 0.0f, 0.0f);
+			radius = 0.0f;
+			return;
+		}
+
+		// Ritter's bounding sphere: start from an approximate diameter, then grow it to cover outliers
+		size_t a=findFarthest(x[0], y[0], z[0]);
+		size_t b=findFarthest(x[a], y[a], z[a]);
+
+		float cx=(x[a]+x[b]) * 0.5f;
+		float cy=(y[a]+y[b]) * 0.5f;
+		float cz=(z[a]+z[b]) * 0.5f;
+		float dx=x[b]-x[a];
+		float dy=y[b]-y[a];
+		float dz=z[b]-z[a];
+		float r=sqrt(dx*dx + dy*dy + dz*dz) * 0.5f;
+		float r_squared=r*r;
+
+		// Every step grows the sphere the next one is tested against, so this pass stays scalar
+		for (size_t i=0; i<count; i++) {
+			dx = x[i]-cx;
+			dy = y[i]-cy;
+			dz = z[i]-cz;
+			float distance_squared=dx*dx + dy*dy + dz*dz;
+
+			if (distance_squared > r_squared) {
+				float distance=sqrt(distance_squared);
+				float new_r=(r + distance) * 0.5f;
+				float shift=(new_r - r) / distance;
+				cx += dx * shift;
+				cy += dy * shift;
+				cz += dz * shift;
+				r = new_r;
+				r_squared = r*r;
+			}
+		}
+
+		center = Vector3(cx, cy, cz);
+		radius = r;
+	}
+
+	Vector3 SonicPointCloud::calculateExtents(Vector3 center) {
+		Vector3 box_min, box_max;
+		calculateBox(box_min, box_max);
+
+		return Vector3(std::max(box_max.x - center.x, center.x - box_min.x),
+					   std::max(box_max.y - center.y, center.y - box_min.y),
+					   std::max(box_max.z - center.z, center.z - box_min.z));
+	}
+
+
+	void SonicXNObject::calculateBounds() {
+		SonicPointCloud object_cloud;
+
+		for (size_t i=0; i<vertex_tables.size(); i++) {
+			vector<SonicVertex *> &vertices=vertex_tables[i]->vertices;
+			for (size_t j=0; j<vertices.size(); j++) {
+				object_cloud.addPoint(vertices[j]->position);
+			}
+		}
+
+		for (size_t i=0; i<vertex_resource_tables.size(); i++) {
+			vector<Vector3> &positions=vertex_resource_tables[i]->positions;
+			for (size_t j=0; j<positions.size(); j++) {
+				object_cloud.addPoint(positions[j]);
+			}
+		}
+
+		Vector3 box_min, box_max;
+		object_cloud.calculateBox(box_min, box_max);
+		aabb.reset();
+		aabb.addPoint(box_min);
+		aabb.addPoint(box_max);
+
+		object_cloud.calculateSphere(center, radius);
+		bounding_box = object_cloud.calculateExtents(center);
+
+		calculateSubmeshBounds();
+		calculateBoneBounds();
+	}
+
+	void SonicXNObject::calculateSubmeshBounds() {
+		for (size_t m=0; m<meshes.size(); m++) {
+			for (size_t s=0; s<meshes[m]->submeshes.size(); s++) {
+				SonicSubmesh *submesh=meshes[m]->submeshes[s];
+				SonicPointCloud submesh_cloud;
+
+				if (file_mode == MODE_GNO) {
+					if (submesh->vertex_index < vertex_resource_tables.size()) {
+						vector<Vector3> &positions=vertex_resource_tables[submesh->vertex_index]->positions;
+						for (size_t i=0; i<positions.size(); i++) {
+							submesh_cloud.addPoint(positions[i]);
+						}
+					}
+				}
+				else if (submesh->vertex_index < vertex_tables.size()) {
+					vector<SonicVertex *> &vertices=vertex_tables[submesh->vertex_index]->vertices;
+
+					// Only the vertices the submesh actually draws count towards its volume
+					if (submesh->indices_index < index_tables.size()) {
+						vector<unsigned short> &indices=index_tables[submesh->indices_index]->indices;
+						vector<bool> added(vertices.size(), false);
+
+						for (size_t i=0; i<indices.size(); i++) {
+							unsigned short index=indices[i];
+							if ((index < vertices.size()) && !added[index]) {
+								added[index] = true;
+								submesh_cloud.addPoint(vertices[index]->position);
+							}
+						}
+					}
+					else {
+						for (size_t i=0; i<vertices.size(); i++) {
+							submesh_cloud.addPoint(vertices[i]->position);
+						}
+					}
+				}
+
+				submesh_cloud.calculateSphere(submesh->center, submesh->radius);
+			}
+		}
+	}
+
+	void SonicXNObject::calculateBoneBounds() {
+		if (!bones.size()) return;
+
+		// Matrix indices in the bone tables point to bones through their matrix_index
+		vector<int> matrix_to_bone;
+		buildMatrixToBone(matrix_to_bone);
+
+		vector<SonicPointCloud> bone_clouds(bones.size());
+
+		for (size_t i=0; i<vertex_tables.size(); i++) {
+			vector<unsigned int> &bone_table=vertex_tables[i]->bone_table;
+			vector<SonicVertex *> &vertices=vertex_tables[i]->vertices;
+
+			for (size_t j=0; j<vertices.size(); j++) {
+				for (size_t k=0; k<4; k++) {
+					if (vertices[j]->bone_weights_f[k] <= 0.0f) continue;
+
+					unsigned char palette_index=vertices[j]->bone_indices[k];
+					if (palette_index >= bone_table.size()) continue;
+
+					unsigned int matrix_index=bone_table[palette_index];
+					if (matrix_index >= matrix_to_bone.size()) continue;
+
+					int bone_index=matrix_to_bone[matrix_index];
+					if (bone_index >= 0) bone_clouds[bone_index].addPoint(vertices[j]->position);
+				}
+			}
+		}
+
+		for (size_t i=0; i<vertex_resource_tables.size(); i++) {
+			vector<SonicVertexBoneData> &bone_data=vertex_resource_tables[i]->bones;
+			vector<Vector3> &positions=vertex_resource_tables[i]->positions;
+
+			for (size_t j=0; (j<bone_data.size()) && (j<positions.size()); j++) {
+				int bone_1=matrix_to_bone[bone_data[j].bone_1];
+				int bone_2=matrix_to_bone[bone_data[j].bone_2];
+				if ((bone_data[j].weight > 0) && (bone_1 >= 0)) bone_clouds[bone_1].addPoint(positions[j]);
+				if ((bone_data[j].weight < 16384) && (bone_2 >= 0)) bone_clouds[bone_2].addPoint(positions[j]);
+			}
+		}
+
+		for (size_t b=0; b<bones.size(); b++) {
+			SonicBone *bone=bones[b];
+			SonicPointCloud &cloud=bone_clouds[b];
+
+			if (!cloud.x.size()) {
+				bone->center = Vector3(0.0f, 0.0f, 0.0f);
+				bone->radius = 0.0f;
+				bone->bounding_box = Vector3(0.0f, 0.0f, 0.0f);
+				continue;
+			}
+
+			// Move the points to the bone's space, the stored matrix is the transposed inverse bind pose
+			Matrix4 m=bone->matrix.transpose();
+			for (size_t i=0; i<cloud.x.size(); i++) {
+				float px=cloud.x[i];
+				float py=cloud.y[i];
+				float pz=cloud.z[i];
+				cloud.x[i] = m[0][0]*px + m[0][1]*py + m[0][2]*pz + m[0][3];
+				cloud.y[i] = m[1][0]*px + m[1][1]*py + m[1][2]*pz + m[1][3];
+				cloud.z[i] = m[2][0]*px + m[2][1]*py + m[2][2]*pz + m[2][3];
+			}
+
+			cloud.calculateSphere(bone->center, bone->radius);
+			bone->bounding_box = cloud.calculateExtents(bone->center);
+		}
+	}
+};
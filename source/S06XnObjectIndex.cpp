@@ -93,6 +93,79 @@ namespace LibGens {
 
 	
 
+	void SonicIndexTable::getTriangles(vector<unsigned int> &triangles) {
+		size_t additional_index=0;
+		for (size_t m=0; m<strip_sizes.size(); m++) {
+			for (size_t i=additional_index+2; (i<additional_index+strip_sizes[m]) && (i<indices.size()); i++) {
+				unsigned short index_1=indices[i-2];
+				unsigned short index_2=indices[i-1];
+				unsigned short index_3=indices[i];
+
+				if ((index_1 == index_2) || (index_2 == index_3) || (index_1 == index_3)) {
+					continue;
+				}
+
+				if ((i-additional_index)%2 == 0) {
+					triangles.push_back(index_1);
+					triangles.push_back(index_2);
+					triangles.push_back(index_3);
+				}
+				else {
+					triangles.push_back(index_3);
+					triangles.push_back(index_2);
+					triangles.push_back(index_1);
+				}
+			}
+
+			additional_index += strip_sizes[m];
+		}
+	}
+
+	void SonicIndexTable::setTriangles(vector<unsigned int> &triangles) {
+		indices.clear();
+		strip_sizes.clear();
+		indices_vector.clear();
+
+		triangle_stripper::indices tri_indices;
+		for (size_t i=0; i+2<triangles.size(); i+=3) {
+			tri_indices.push_back(triangles[i]);
+			tri_indices.push_back(triangles[i+1]);
+			tri_indices.push_back(triangles[i+2]);
+		}
+
+		if (!tri_indices.size()) return;
+
+		triangle_stripper::tri_stripper stripper(tri_indices);
+		stripper.SetCacheSize(0);
+		stripper.SetBackwardSearch(false);
+		triangle_stripper::primitive_vector out_vector;
+		stripper.Strip(&out_vector);
+
+		for (size_t i=0; i<out_vector.size(); i+=1) {
+			if (out_vector[i].Type == triangle_stripper::TRIANGLE_STRIP) {
+				for (size_t j=0; j<out_vector[i].Indices.size(); j++) {
+					indices.push_back(out_vector[i].Indices[j]);
+				}
+				strip_sizes.push_back(out_vector[i].Indices.size());
+			}
+			else {
+				for (size_t j=0; j<out_vector[i].Indices.size(); j+=3) {
+					indices.push_back(out_vector[i].Indices[j]);
+					indices.push_back(out_vector[i].Indices[j+1]);
+					indices.push_back(out_vector[i].Indices[j+2]);
+					strip_sizes.push_back(3);
+				}
+			}
+		}
+
+		// The exporters read the decoded triangles, keep them in step with the new strips
+		vector<unsigned int> strip_triangles;
+		getTriangles(strip_triangles);
+		for (size_t i=0; i+2<strip_triangles.size(); i+=3) {
+			indices_vector.push_back(Vector3(strip_triangles[i], strip_triangles[i+1], strip_triangles[i+2]));
+		}
+	}
+
 	void SonicIndexTable::writeIndices(File *file) {
 		strip_sizes_address_data = file->getCurrentAddress();
 		for (size_t i=0; i<strip_sizes.size(); i++) {
@@ -108,6 +181,28 @@ namespace LibGens {
 		file->fixPadding(4);
 	}
 
+	void SonicIndexTable::writeIndicesPooled(File *file, SonicXNWritePool &pool) {
+		size_t hash=SonicXNWritePool::initialHash();
+		unsigned int strip_count=strip_sizes.size();
+		SonicXNWritePool::appendHash(hash, &strip_count, 4);
+		if (strip_sizes.size()) SonicXNWritePool::appendHash(hash, &strip_sizes[0], strip_sizes.size()*2);
+		if (indices.size()) SonicXNWritePool::appendHash(hash, &indices[0], indices.size()*2);
+
+		vector<const void *> candidates;
+		pool.findBlocks(hash, candidates);
+		for (size_t c=0; c<candidates.size(); c++) {
+			SonicIndexTable *table=(SonicIndexTable *) candidates[c];
+			if ((table->strip_sizes == strip_sizes) && (table->indices == indices)) {
+				strip_sizes_address_data = table->strip_sizes_address_data;
+				indices_address_data = table->indices_address_data;
+				return;
+			}
+		}
+
+		writeIndices(file);
+		pool.addBlock(hash, this);
+	}
+
 	void SonicIndexTable::writeTable(File *file) {
 		indices_table_address = file->getCurrentAddress();
 
@@ -47,6 +47,19 @@ namespace LibGens {
 		file->writeNull(20);
 	}
 
+	void SonicTextureUnitZNO::appendKey(string &key) {
+		SonicXNWritePool::appendKey(key, &flag, 4);
+		SonicXNWritePool::appendKey(key, &index, 4);
+		SonicXNWritePool::appendKey(key, &enviroment_mode, 4);
+		SonicXNWritePool::appendKey(key, &offset.x, 4);
+		SonicXNWritePool::appendKey(key, &offset.y, 4);
+		SonicXNWritePool::appendKey(key, &scale.x, 4);
+		SonicXNWritePool::appendKey(key, &scale.y, 4);
+		SonicXNWritePool::appendKey(key, &wrap_s, 4);
+		SonicXNWritePool::appendKey(key, &wrap_t, 4);
+		SonicXNWritePool::appendKey(key, &lod_bias, 4);
+	}
+
 	void SonicMaterialColor::read(File *file, XNFileMode file_mode, bool big_endian) {
 		file->readInt32E(&flag, big_endian);
 		ambient.read(file, big_endian);
@@ -79,6 +92,20 @@ namespace LibGens {
 		return true;
 	}
 
+	void SonicMaterialColor::appendKey(string &key) {
+		Color *color_list[4]={ &ambient, &diffuse, &specular, &emission };
+
+		SonicXNWritePool::appendKey(key, &flag, 4);
+		for (size_t i=0; i<4; i++) {
+			SonicXNWritePool::appendKey(key, &color_list[i]->r, sizeof(color_list[i]->r));
+			SonicXNWritePool::appendKey(key, &color_list[i]->g, sizeof(color_list[i]->g));
+			SonicXNWritePool::appendKey(key, &color_list[i]->b, sizeof(color_list[i]->b));
+			SonicXNWritePool::appendKey(key, &color_list[i]->a, sizeof(color_list[i]->a));
+		}
+		SonicXNWritePool::appendKey(key, &shininess, 4);
+		SonicXNWritePool::appendKey(key, &specular_intensity, 4);
+	}
+
 	void SonicMaterialProperties::read(File *file, XNFileMode file_mode, bool big_endian) {
 		file->read(data, 28);
 	}
@@ -125,6 +152,16 @@ namespace LibGens {
 		return true;
 	}
 
+	void SonicTextureUnit::appendKey(string &key) {
+		SonicXNWritePool::appendKey(key, &flag_f, 4);
+		SonicXNWritePool::appendKey(key, &index, 4);
+		SonicXNWritePool::appendKey(key, &flag, 4);
+		SonicXNWritePool::appendKey(key, &flag_2_f, 4);
+		SonicXNWritePool::appendKey(key, &flag_2, 4);
+		SonicXNWritePool::appendKey(key, &flag_3_f, 4);
+		SonicXNWritePool::appendKey(key, &flag_3, 4);
+	}
+
 	void SonicMaterialTable::read(File *file, XNFileMode file_mode, bool big_endian) {
 		size_t table_address=0;
 		colors=NULL;
@@ -308,4 +345,61 @@ namespace LibGens {
 
 		return true;
 	}
+
+	string SonicMaterialTable::getDataBlock1Key(XNFileMode file_mode) {
+		string key;
+		if (file_mode == MODE_ZNO) {
+			if (colors) colors->appendKey(key);
+		}
+		else {
+			SonicXNWritePool::appendKey(key, first_floats, data_block_1_length*4);
+		}
+		return key;
+	}
+
+	string SonicMaterialTable::getDataBlock2Key(XNFileMode file_mode) {
+		string key;
+		if (file_mode == MODE_ZNO) {
+			if (properties) SonicXNWritePool::appendKey(key, properties->data, 28);
+		}
+		else {
+			SonicXNWritePool::appendKey(key, first_ints, data_block_2_length*4);
+		}
+		return key;
+	}
+
+	string SonicMaterialTable::getTextureUnitsKey(XNFileMode file_mode, size_t unit_count) {
+		string key;
+		for (size_t i=0; i<unit_count; i++) {
+			if (file_mode == MODE_ZNO) texture_units_zno[i]->appendKey(key);
+			else texture_units[i]->appendKey(key);
+		}
+		return key;
+	}
+
+	void SonicMaterialTable::writeDataBlock1Pooled(File *file, XNFileMode file_mode, SonicXNWritePool &pool) {
+		string key=getDataBlock1Key(file_mode);
+		if (pool.find(key, data_block_1_address)) return;
+
+		writeDataBlock1(file, file_mode);
+		pool.add(key, data_block_1_address);
+	}
+
+	void SonicMaterialTable::writeDataBlock2Pooled(File *file, XNFileMode file_mode, SonicXNWritePool &pool) {
+		string key=getDataBlock2Key(file_mode);
+		if (pool.find(key, data_block_2_address)) return;
+
+		writeDataBlock2(file, file_mode);
+		pool.add(key, data_block_2_address);
+	}
+
+	void SonicMaterialTable::writeTextureUnitsPooled(File *file, XNFileMode file_mode, SonicXNWritePool &pool) {
+		size_t unit_count=(file_mode == MODE_ZNO ? texture_units_zno.size() : texture_units.size());
+		if (pool.find(getTextureUnitsKey(file_mode, unit_count), texture_units_address)) return;
+
+		writeTextureUnits(file, file_mode);
+		for (size_t i=0; i<=unit_count; i++) {
+			pool.add(getTextureUnitsKey(file_mode, i), texture_units_address);
+		}
+	}
 };
@@ -0,0 +1,712 @@
+//=========================================================================
+//	  Copyright (c) 2016 SonicGLvl
+//
+//    This file is part of SonicGLvl, a community-created free level editor
+//    for the PC version of Sonic Generations.
+//
+//    SonicGLvl is free software: you can redistribute it and/or modify
+//    it under the terms of the GNU General Public License as published by
+//    the Free Software Foundation, either version 3 of the License, or
+//    (at your option) any later version.
+//
+//    SonicGLvl is distributed in the hope that it will be useful,
+//    but WITHOUT ANY WARRANTY; without even the implied warranty of
+//    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+//
+//
+//    Read AUTHORS.txt, LICENSE.txt and COPYRIGHT.txt for more details.
+//=========================================================================
+
+#include "LibGens.h"
+#include <algorithm>
+#include <atomic>
+#include <functional>
+#include <queue>
+#include <thread>
+#include "S06XnFile.h"
+
+namespace LibGens {
+	// Symmetric 4x4 error quadric, stored as its upper triangle
+	struct SonicSimplifyQuadric {
+		double a2, ab, ac, ad;
+		double b2, bc, bd;
+		double c2, cd;
+		double d2;
+
+		SonicSimplifyQuadric() {
+			a2 = ab = ac = ad = b2 = bc = bd = c2 = cd = d2 = 0.0;
+		}
+
+		void addPlane(double a, double b, double c, double d, double weight) {
+			a2 += a*a*weight; ab += a*b*weight; ac += a*c*weight; ad += a*d*weight;
+			b2 += b*b*weight; bc += b*c*weight; bd += b*d*weight;
+			c2 += c*c*weight; cd += c*d*weight;
+			d2 += d*d*weight;
+		}
+
+		void add(const SonicSimplifyQuadric &q) {
+			a2 += q.a2; ab += q.ab; ac += q.ac; ad += q.ad;
+			b2 += q.b2; bc += q.bc; bd += q.bd;
+			c2 += q.c2; cd += q.cd;
+			d2 += q.d2;
+		}
+
+		double evaluate(const double *p) const {
+			double x=p[0], y=p[1], z=p[2];
+			double error = a2*x*x + 2*ab*x*y + 2*ac*x*z + 2*ad*x
+			             + b2*y*y + 2*bc*y*z + 2*bd*y
+			             + c2*z*z + 2*cd*z
+			             + d2;
+			return (error > 0.0 ? error : 0.0);
+		}
+	};
+
+	// Cheapest collapse of a position, queued with the position's version at the time it was found
+	struct SonicSimplifyCollapse {
+		double cost;
+		unsigned int from;
+		unsigned int to;
+		unsigned int version;
+
+		bool operator>(const SonicSimplifyCollapse &c) const {
+			return cost > c.cost;
+		}
+	};
+
+	typedef std::priority_queue<SonicSimplifyCollapse, vector<SonicSimplifyCollapse>, std::greater<SonicSimplifyCollapse> > SonicSimplifyQueue;
+
+	// Working state for one simplification run. Positions are welded so that vertices split by
+	// UV or normal seams move together; the split vertices sharing a position are its wedges.
+	class SonicSimplifier {
+		public:
+			vector<SonicVertex *> &vertices;
+			vector<unsigned int> triangles;
+			vector<bool> triangle_alive;
+			size_t triangle_count;
+
+			vector<unsigned int> vertex_position;
+			vector<double> positions;
+			vector<bool> position_alive;
+			vector<bool> position_border;
+			vector<bool> position_locked;
+			vector< vector<unsigned int> > position_triangles;
+			vector<SonicSimplifyQuadric> quadrics;
+			vector<unsigned int> position_version;
+			SonicSimplifyQueue collapses;
+
+			// Scratch buffers for evaluating one collapse
+			vector<unsigned int> wedge_from;
+			vector<unsigned int> wedge_to;
+			vector<unsigned int> neighbours_from;
+			vector<unsigned int> neighbours_to;
+
+			SonicSimplifier(vector<SonicVertex *> &vertices_p, vector<unsigned int> &triangles_p) : vertices(vertices_p), triangles(triangles_p) {
+			}
+
+			static unsigned long long edgeKey(unsigned int a, unsigned int b) {
+				if (a > b) std::swap(a, b);
+				return ((unsigned long long)a << 32) | b;
+			}
+
+			const double *position(unsigned int p) const {
+				return &positions[p*3];
+			}
+
+			static void triangleNormal(const double *p0, const double *p1, const double *p2, double *n) {
+				double e1[3]={ p1[0]-p0[0], p1[1]-p0[1], p1[2]-p0[2] };
+				double e2[3]={ p2[0]-p0[0], p2[1]-p0[1], p2[2]-p0[2] };
+				n[0] = e1[1]*e2[2] - e1[2]*e2[1];
+				n[1] = e1[2]*e2[0] - e1[0]*e2[2];
+				n[2] = e1[0]*e2[1] - e1[1]*e2[0];
+			}
+
+			static double skinDistance(SonicVertex *a, SonicVertex *b) {
+				double distance=0.0;
+
+				for (size_t i=0; i<4; i++) {
+					if (a->bone_weights_f[i] <= 0.0f) continue;
+
+					float other=0.0f;
+					for (size_t j=0; j<4; j++) {
+						if ((b->bone_weights_f[j] > 0.0f) && (b->bone_indices[j] == a->bone_indices[i])) other += b->bone_weights_f[j];
+					}
+					distance += fabs(a->bone_weights_f[i] - other);
+				}
+
+				for (size_t j=0; j<4; j++) {
+					if (b->bone_weights_f[j] <= 0.0f) continue;
+
+					bool found=false;
+					for (size_t i=0; i<4; i++) {
+						if ((a->bone_weights_f[i] > 0.0f) && (a->bone_indices[i] == b->bone_indices[j])) found = true;
+					}
+					if (!found) distance += b->bone_weights_f[j];
+				}
+
+				return distance;
+			}
+
+			void build() {
+				size_t vertex_count=vertices.size();
+				triangle_count = triangles.size()/3;
+				triangle_alive.assign(triangle_count, true);
+
+				// Weld vertices by exact position
+				vector<unsigned int> order(vertex_count);
+				for (size_t i=0; i<vertex_count; i++) order[i] = i;
+
+				struct PositionLess {
+					vector<SonicVertex *> &v;
+					PositionLess(vector<SonicVertex *> &v_p) : v(v_p) {}
+					bool operator()(unsigned int a, unsigned int b) const {
+						const Vector3 &pa=v[a]->position;
+						const Vector3 &pb=v[b]->position;
+						if (pa.x != pb.x) return pa.x < pb.x;
+						if (pa.y != pb.y) return pa.y < pb.y;
+						return pa.z < pb.z;
+					}
+				};
+				std::sort(order.begin(), order.end(), PositionLess(vertices));
+
+				vertex_position.assign(vertex_count, 0);
+				unsigned int position_count=0;
+				for (size_t i=0; i<vertex_count; i++) {
+					if (i && (PositionLess(vertices)(order[i-1], order[i]))) position_count++;
+					vertex_position[order[i]] = position_count;
+				}
+				if (vertex_count) position_count++;
+
+				// Normalize to the unit box so errors are comparable across meshes
+				AABB box;
+				box.reset();
+				for (size_t i=0; i<vertex_count; i++) box.addPoint(vertices[i]->position);
+				double scale=box.sizeMax();
+				scale = (scale > 0.0 ? 1.0/scale : 1.0);
+
+				positions.assign(position_count*3, 0.0);
+				for (size_t i=0; i<vertex_count; i++) {
+					double *p=&positions[vertex_position[i]*3];
+					p[0] = vertices[i]->position.x * scale;
+					p[1] = vertices[i]->position.y * scale;
+					p[2] = vertices[i]->position.z * scale;
+				}
+
+				position_alive.assign(position_count, true);
+				position_border.assign(position_count, false);
+				position_locked.assign(position_count, false);
+				position_triangles.assign(position_count, vector<unsigned int>());
+				quadrics.assign(position_count, SonicSimplifyQuadric());
+
+				// Count edges on welded positions (borders) and on split vertices (seams)
+				map<unsigned long long, unsigned int> position_edges;
+				map<unsigned long long, unsigned int> vertex_edges;
+				for (size_t t=0; t<triangles.size()/3; t++) {
+					unsigned int *v=&triangles[t*3];
+					unsigned int p[3]={ vertex_position[v[0]], vertex_position[v[1]], vertex_position[v[2]] };
+
+					if ((p[0] == p[1]) || (p[1] == p[2]) || (p[0] == p[2])) {
+						triangle_alive[t] = false;
+						triangle_count--;
+						continue;
+					}
+
+					for (size_t k=0; k<3; k++) {
+						position_edges[edgeKey(p[k], p[(k+1)%3])]++;
+						vertex_edges[edgeKey(v[k], v[(k+1)%3])]++;
+						position_triangles[p[k]].push_back(t);
+					}
+				}
+
+				const double border_weight=10.0;
+				vector<unsigned int> border_edge_count(position_count, 0);
+
+				for (size_t t=0; t<triangles.size()/3; t++) {
+					if (!triangle_alive[t]) continue;
+
+					unsigned int *v=&triangles[t*3];
+					unsigned int p[3]={ vertex_position[v[0]], vertex_position[v[1]], vertex_position[v[2]] };
+
+					double n[3];
+					triangleNormal(position(p[0]), position(p[1]), position(p[2]), n);
+					double length=sqrt(n[0]*n[0] + n[1]*n[1] + n[2]*n[2]);
+					if (length <= 0.0) continue;
+					n[0] /= length; n[1] /= length; n[2] /= length;
+
+					const double *p0=position(p[0]);
+					double d=-(n[0]*p0[0] + n[1]*p0[1] + n[2]*p0[2]);
+					for (size_t k=0; k<3; k++) {
+						quadrics[p[k]].addPlane(n[0], n[1], n[2], d, length*0.5);
+					}
+
+					// Borders and seams get a perpendicular plane so they keep their shape
+					for (size_t k=0; k<3; k++) {
+						unsigned int a=p[k];
+						unsigned int b=p[(k+1)%3];
+						bool border=(position_edges[edgeKey(a, b)] == 1);
+						bool seam=(vertex_edges[edgeKey(v[k], v[(k+1)%3])] == 1);
+						if (!border && !seam) continue;
+
+						if (border) {
+							position_border[a] = position_border[b] = true;
+							border_edge_count[a]++;
+							border_edge_count[b]++;
+						}
+
+						const double *pa=position(a);
+						const double *pb=position(b);
+						double e[3]={ pb[0]-pa[0], pb[1]-pa[1], pb[2]-pa[2] };
+						double m[3]={ e[1]*n[2] - e[2]*n[1], e[2]*n[0] - e[0]*n[2], e[0]*n[1] - e[1]*n[0] };
+						double m_length=sqrt(m[0]*m[0] + m[1]*m[1] + m[2]*m[2]);
+						if (m_length <= 0.0) continue;
+						m[0] /= m_length; m[1] /= m_length; m[2] /= m_length;
+
+						double md=-(m[0]*pa[0] + m[1]*pa[1] + m[2]*pa[2]);
+						double weight=(e[0]*e[0] + e[1]*e[1] + e[2]*e[2]) * border_weight;
+						quadrics[a].addPlane(m[0], m[1], m[2], md, weight);
+						quadrics[b].addPlane(m[0], m[1], m[2], md, weight);
+					}
+				}
+
+				// Non-manifold border vertices can't be collapsed safely
+				for (size_t p=0; p<position_count; p++) {
+					if (border_edge_count[p] > 2) position_locked[p] = true;
+				}
+			}
+
+			void collectNeighbours(unsigned int p, vector<unsigned int> &neighbours) {
+				neighbours.clear();
+				for (size_t i=0; i<position_triangles[p].size(); i++) {
+					unsigned int t=position_triangles[p][i];
+					if (!triangle_alive[t]) continue;
+
+					for (size_t k=0; k<3; k++) {
+						unsigned int q=vertex_position[triangles[t*3+k]];
+						if (q != p) neighbours.push_back(q);
+					}
+				}
+
+				std::sort(neighbours.begin(), neighbours.end());
+				neighbours.erase(std::unique(neighbours.begin(), neighbours.end()), neighbours.end());
+			}
+
+			// Error of moving position from onto position to, without the skinning penalty
+			double quadricCost(unsigned int from, unsigned int to) {
+				SonicSimplifyQuadric quadric=quadrics[from];
+				quadric.add(quadrics[to]);
+				return quadric.evaluate(position(to));
+			}
+
+			// Checks a collapse of position from onto position to and returns its cost, or a negative
+			// value if it would tear a seam, damage a border, change the topology or flip a triangle.
+			// On success wedge_from/wedge_to hold the vertex remapping for the collapse.
+			double evaluate(unsigned int from, unsigned int to) {
+				const double skin_weight_penalty=0.01;
+
+				wedge_from.clear();
+				wedge_to.clear();
+				size_t shared_triangles=0;
+
+				// Every split vertex at from needs a counterpart at to along a shared edge
+				vector<unsigned int> &from_triangles=position_triangles[from];
+				for (size_t i=0; i<from_triangles.size(); i++) {
+					unsigned int t=from_triangles[i];
+					if (!triangle_alive[t]) continue;
+
+					unsigned int *v=&triangles[t*3];
+					int from_corner=-1, to_corner=-1;
+					for (size_t k=0; k<3; k++) {
+						if (vertex_position[v[k]] == from) from_corner = k;
+						if (vertex_position[v[k]] == to) to_corner = k;
+					}
+					if (to_corner < 0) continue;
+
+					shared_triangles++;
+
+					bool found=false;
+					for (size_t w=0; w<wedge_from.size(); w++) {
+						if (wedge_from[w] == v[from_corner]) {
+							if (wedge_to[w] != v[to_corner]) return -1.0;
+							found = true;
+						}
+					}
+
+					if (!found) {
+						wedge_from.push_back(v[from_corner]);
+						wedge_to.push_back(v[to_corner]);
+					}
+				}
+
+				if (!shared_triangles) return -1.0;
+
+				for (size_t i=0; i<from_triangles.size(); i++) {
+					unsigned int t=from_triangles[i];
+					if (!triangle_alive[t]) continue;
+
+					for (size_t k=0; k<3; k++) {
+						unsigned int v=triangles[t*3+k];
+						if (vertex_position[v] != from) continue;
+						if (std::find(wedge_from.begin(), wedge_from.end(), v) == wedge_from.end()) return -1.0;
+					}
+				}
+
+				// Borders may only slide along themselves
+				if (position_border[from] && (shared_triangles != 1)) return -1.0;
+
+				// Link condition keeps the surface manifold
+				collectNeighbours(from, neighbours_from);
+				collectNeighbours(to, neighbours_to);
+				size_t common=0;
+				for (size_t i=0, j=0; (i<neighbours_from.size()) && (j<neighbours_to.size());) {
+					if (neighbours_from[i] < neighbours_to[j]) i++;
+					else if (neighbours_from[i] > neighbours_to[j]) j++;
+					else {
+						common++;
+						i++;
+						j++;
+					}
+				}
+				if (common != shared_triangles) return -1.0;
+
+				// Reject collapses that fold triangles over
+				for (size_t i=0; i<from_triangles.size(); i++) {
+					unsigned int t=from_triangles[i];
+					if (!triangle_alive[t]) continue;
+
+					const double *p[3];
+					const double *p_new[3];
+					bool shared=false;
+					for (size_t k=0; k<3; k++) {
+						unsigned int q=vertex_position[triangles[t*3+k]];
+						if (q == to) shared = true;
+						p[k] = position(q);
+						p_new[k] = (q == from ? position(to) : p[k]);
+					}
+					if (shared) continue;
+
+					double n[3], n_new[3];
+					triangleNormal(p[0], p[1], p[2], n);
+					triangleNormal(p_new[0], p_new[1], p_new[2], n_new);
+					double dot=n[0]*n_new[0] + n[1]*n_new[1] + n[2]*n_new[2];
+					double length=sqrt(n[0]*n[0] + n[1]*n[1] + n[2]*n[2]) * sqrt(n_new[0]*n_new[0] + n_new[1]*n_new[1] + n_new[2]*n_new[2]);
+					if ((length <= 0.0) || (dot < length*0.2)) return -1.0;
+				}
+
+				double cost=quadricCost(from, to);
+
+				for (size_t w=0; w<wedge_from.size(); w++) {
+					cost += skinDistance(vertices[wedge_from[w]], vertices[wedge_to[w]]) * skin_weight_penalty;
+				}
+
+				return cost;
+			}
+
+			void collapse(unsigned int from, unsigned int to) {
+				vector<unsigned int> &from_triangles=position_triangles[from];
+				for (size_t i=0; i<from_triangles.size(); i++) {
+					unsigned int t=from_triangles[i];
+					if (!triangle_alive[t]) continue;
+
+					unsigned int *v=&triangles[t*3];
+					bool shared=false;
+					for (size_t k=0; k<3; k++) {
+						if (vertex_position[v[k]] == to) shared = true;
+					}
+
+					if (shared) {
+						triangle_alive[t] = false;
+						triangle_count--;
+						continue;
+					}
+
+					for (size_t k=0; k<3; k++) {
+						if (vertex_position[v[k]] != from) continue;
+						for (size_t w=0; w<wedge_from.size(); w++) {
+							if (wedge_from[w] == v[k]) {
+								v[k] = wedge_to[w];
+								break;
+							}
+						}
+					}
+
+					position_triangles[to].push_back(t);
+				}
+
+				from_triangles.clear();
+				quadrics[to].add(quadrics[from]);
+				position_alive[from] = false;
+
+				// Drop dead triangles so adjacency lists don't grow without bound
+				vector<unsigned int> &to_triangles=position_triangles[to];
+				size_t alive=0;
+				for (size_t i=0; i<to_triangles.size(); i++) {
+					if (triangle_alive[to_triangles[i]]) to_triangles[alive++] = to_triangles[i];
+				}
+				to_triangles.resize(alive);
+			}
+
+			// Queues the cheapest valid collapse of a position, if it has one
+			void queueCollapse(unsigned int p) {
+				if (!position_alive[p] || position_locked[p]) return;
+
+				vector<unsigned int> neighbours;
+				collectNeighbours(p, neighbours);
+
+				SonicSimplifyCollapse best;
+				best.cost = -1.0;
+				for (size_t i=0; i<neighbours.size(); i++) {
+					// The penalties only add to the quadric error, so the full checks can be skipped
+					if ((best.cost >= 0.0) && (quadricCost(p, neighbours[i]) >= best.cost)) continue;
+
+					double cost=evaluate(p, neighbours[i]);
+					if ((cost >= 0.0) && ((best.cost < 0.0) || (cost < best.cost))) {
+						best.cost = cost;
+						best.from = p;
+						best.to = neighbours[i];
+					}
+				}
+
+				if (best.cost < 0.0) return;
+				best.version = position_version[p];
+				collapses.push(best);
+			}
+
+			void start() {
+				position_version.assign(position_alive.size(), 0);
+				for (unsigned int p=0; p<position_alive.size(); p++) {
+					queueCollapse(p);
+				}
+			}
+
+			// Collapses the cheapest edges until target_triangles are left or nothing can be collapsed.
+			// Entries go stale when their position changes, those are skipped by version. Collapses
+			// further away can still change whether an entry is valid, so it's checked again when
+			// popped and requeued with its new best collapse if it no longer holds.
+			void run(size_t target_triangles) {
+				vector<unsigned int> neighbours;
+
+				while ((triangle_count > target_triangles) && !collapses.empty()) {
+					SonicSimplifyCollapse candidate=collapses.top();
+					collapses.pop();
+
+					unsigned int from=candidate.from;
+					unsigned int to=candidate.to;
+					if (!position_alive[from] || (candidate.version != position_version[from])) continue;
+
+					double cost=evaluate(from, to);
+					if ((cost < 0.0) || (cost > candidate.cost)) {
+						position_version[from]++;
+						queueCollapse(from);
+						continue;
+					}
+
+					collapse(from, to);
+
+					// The merged quadric and neighbourhood change the costs around to
+					collectNeighbours(to, neighbours);
+					neighbours.push_back(to);
+					for (size_t n=0; n<neighbours.size(); n++) {
+						position_version[neighbours[n]]++;
+						queueCollapse(neighbours[n]);
+					}
+				}
+			}
+	};
+
+
+	void SonicVertexTable::simplifyTriangles(vector<SonicVertex *> &vertices, vector<unsigned int> &triangles, vector<size_t> &target_triangles, vector< vector<unsigned int> > &triangles_output) {
+		SonicSimplifier simplifier(vertices, triangles);
+		simplifier.build();
+		simplifier.start();
+
+		triangles_output.resize(target_triangles.size());
+		for (size_t l=0; l<target_triangles.size(); l++) {
+			simplifier.run(target_triangles[l]);
+
+			vector<unsigned int> &output=triangles_output[l];
+			output.clear();
+			for (size_t t=0; t<simplifier.triangle_alive.size(); t++) {
+				if (!simplifier.triangle_alive[t]) continue;
+
+				output.push_back(simplifier.triangles[t*3]);
+				output.push_back(simplifier.triangles[t*3+1]);
+				output.push_back(simplifier.triangles[t*3+2]);
+			}
+		}
+	}
+
+
+	void SonicXNObject::generateLODs(vector<float> &ratios, vector<SonicLODLevel> &levels, unsigned int thread_count) {
+		if (file_mode == MODE_GNO) {
+			Error::addMessage(Error::WARNING, "Simplification isn't supported for GNO objects.");
+			return;
+		}
+
+		// Ratios are simplified largest first so every level continues from the previous one
+		vector<size_t> order(ratios.size());
+		for (size_t r=0; r<ratios.size(); r++) order[r] = r;
+		std::stable_sort(order.begin(), order.end(), [&](size_t a, size_t b) { return ratios[a] > ratios[b]; });
+
+		struct SimplifyJob {
+			SonicVertexTable *vertex_table;
+			vector<unsigned int> triangles;
+			vector<size_t> target_triangles;
+			vector< vector<unsigned int> > triangles_output;
+		};
+
+		// One job per index table, as long as it's only drawn with a single vertex table
+		vector<SimplifyJob> jobs(index_tables.size());
+		vector<size_t> job_indices;
+		vector<int> index_vertex_table(index_tables.size(), -1);
+		for (size_t m=0; m<meshes.size(); m++) {
+			for (size_t s=0; s<meshes[m]->submeshes.size(); s++) {
+				SonicSubmesh *submesh=meshes[m]->submeshes[s];
+				if ((submesh->indices_index >= index_tables.size()) || (submesh->vertex_index >= vertex_tables.size())) continue;
+
+				int &vertex_index=index_vertex_table[submesh->indices_index];
+				if (vertex_index == -1) vertex_index = submesh->vertex_index;
+				else if (vertex_index != (int)submesh->vertex_index) vertex_index = -2;
+			}
+		}
+
+		for (size_t i=0; i<index_tables.size(); i++) {
+			SimplifyJob &job=jobs[i];
+			index_tables[i]->getTriangles(job.triangles);
+			if (index_vertex_table[i] < 0) continue;
+
+			job.vertex_table = vertex_tables[index_vertex_table[i]];
+			for (size_t r=0; r<order.size(); r++) {
+				job.target_triangles.push_back((size_t)((job.triangles.size()/3) * ratios[order[r]]));
+			}
+			job_indices.push_back(i);
+		}
+
+		if (!thread_count) thread_count = std::thread::hardware_concurrency();
+		if (!thread_count) thread_count = 1;
+		thread_count = std::min(thread_count, (unsigned int) job_indices.size());
+
+		std::atomic<size_t> next_job(0);
+		vector<std::thread> threads;
+		for (unsigned int t=0; t<thread_count; t++) {
+			threads.push_back(std::thread([&]() {
+				for (size_t j=next_job++; j<job_indices.size(); j=next_job++) {
+					SimplifyJob &job=jobs[job_indices[j]];
+					SonicVertexTable::simplifyTriangles(job.vertex_table->vertices, job.triangles, job.target_triangles, job.triangles_output);
+				}
+			}));
+		}
+
+		for (size_t t=0; t<threads.size(); t++) {
+			threads[t].join();
+		}
+
+		size_t triangles_before=0;
+		for (size_t i=0; i<jobs.size(); i++) {
+			triangles_before += jobs[i].triangles.size()/3;
+		}
+
+		levels.resize(ratios.size());
+		for (size_t r=0; r<order.size(); r++) {
+			SonicLODLevel &level=levels[order[r]];
+			level.ratio = ratios[order[r]];
+			level.triangles.resize(jobs.size());
+
+			size_t triangles_after=0;
+			for (size_t i=0; i<jobs.size(); i++) {
+				level.triangles[i] = (jobs[i].triangles_output.size() ? jobs[i].triangles_output[r] : jobs[i].triangles);
+				triangles_after += level.triangles[i].size()/3;
+			}
+
+			printf("Simplified %zu triangles into %zu for ratio %f.\n", triangles_before, triangles_after, level.ratio);
+		}
+	}
+
+
+	void SonicXNObject::applyLOD(SonicLODLevel &level) {
+		if (level.triangles.size() != index_tables.size()) {
+			Error::addMessage(Error::WARNING, "LOD level has " + ToString(level.triangles.size()) + " index tables but the object has " + ToString(index_tables.size()) + ". It won't be applied.");
+			return;
+		}
+
+		vector<unsigned int> triangles;
+		for (size_t i=0; i<index_tables.size(); i++) {
+			triangles.clear();
+			index_tables[i]->getTriangles(triangles);
+			if (triangles == level.triangles[i]) continue;
+
+			index_tables[i]->setTriangles(level.triangles[i]);
+		}
+
+		removeUnusedVertices();
+		calculateSubmeshBounds();
+	}
+
+
+	void SonicXNObject::removeUnusedVertices() {
+		if (file_mode == MODE_GNO) return;
+
+		for (size_t v=0; v<vertex_tables.size(); v++) {
+			vector<SonicVertex *> &vertices=vertex_tables[v]->vertices;
+
+			// Gather the index tables drawn with this vertex table, bail out if they're shared with another
+			vector<SonicIndexTable *> tables;
+			bool shared=false;
+			for (size_t m=0; m<meshes.size(); m++) {
+				for (size_t s=0; s<meshes[m]->submeshes.size(); s++) {
+					SonicSubmesh *submesh=meshes[m]->submeshes[s];
+					if (submesh->indices_index >= index_tables.size()) continue;
+
+					SonicIndexTable *index_table=index_tables[submesh->indices_index];
+					if (submesh->vertex_index == v) {
+						if (std::find(tables.begin(), tables.end(), index_table) == tables.end()) tables.push_back(index_table);
+					}
+				}
+			}
+
+			for (size_t m=0; m<meshes.size(); m++) {
+				for (size_t s=0; s<meshes[m]->submeshes.size(); s++) {
+					SonicSubmesh *submesh=meshes[m]->submeshes[s];
+					if ((submesh->vertex_index != v) && (submesh->indices_index < index_tables.size())) {
+						if (std::find(tables.begin(), tables.end(), index_tables[submesh->indices_index]) != tables.end()) shared = true;
+					}
+				}
+			}
+
+			if (!tables.size() || shared) continue;
+
+			vector<bool> used(vertices.size(), false);
+			for (size_t t=0; t<tables.size(); t++) {
+				for (size_t i=0; i<tables[t]->indices.size(); i++) {
+					if (tables[t]->indices[i] < used.size()) used[tables[t]->indices[i]] = true;
+				}
+			}
+
+			vector<unsigned short> remap(vertices.size(), 0);
+			size_t kept=0;
+			for (size_t i=0; i<vertices.size(); i++) {
+				if (used[i]) {
+					remap[i] = kept;
+					vertices[kept++] = vertices[i];
+				}
+				else {
+					delete vertices[i];
+				}
+			}
+			vertices.resize(kept);
+
+			for (size_t t=0; t<tables.size(); t++) {
+				for (size_t i=0; i<tables[t]->indices.size(); i++) {
+					if (tables[t]->indices[i] < remap.size()) tables[t]->indices[i] = remap[tables[t]->indices[i]];
+				}
+
+				vector<Vector3> &indices_vector=tables[t]->indices_vector;
+				for (size_t i=0; i<indices_vector.size(); i++) {
+					float *face[3]={ &indices_vector[i].x, &indices_vector[i].y, &indices_vector[i].z };
+					for (size_t c=0; c<3; c++) {
+						size_t index=(size_t) *face[c];
+						if (index < remap.size()) *face[c] = remap[index];
+					}
+				}
+			}
+		}
+	}
+};
@@ -0,0 +1,232 @@
+//=========================================================================
+//	  Copyright (c) 2016 SonicGLvl
+//
+//    This file is part of SonicGLvl, a community-created free level editor
+//    for the PC version of Sonic Generations.
+//
+//    SonicGLvl is free software: you can redistribute it and/or modify
+//    it under the terms of the GNU General Public License as published by
+//    the Free Software Foundation, either version 3 of the License, or
+//    (at your option) any later version.
+//
+//    SonicGLvl is distributed in the hope that it will be useful,
+//    but WITHOUT ANY WARRANTY; without even the implied warranty of
+//    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+//
+//
+//    Read AUTHORS.txt, LICENSE.txt and COPYRIGHT.txt for more details.
+//=========================================================================
+
+#include "LibGens.h"
+#include <algorithm>
+#include <atomic>
+#include <thread>
+#include "S06XnFile.h"
+
+#define LIBGENS_XNSKIN_BLOCK_SIZE 256
+
+#if defined(__SSE__) || defined(_M_X64) || (defined(_M_IX86_FP) && (_M_IX86_FP >= 1))
+#include <xmmintrin.h>
+#define LIBGENS_XNSKIN_SSE
+#endif
+
+namespace LibGens {
+	// Blended 3x4 matrices and inputs of a block of vertices, one array per component so four
+	// vertices load as one SSE vector with no gathers or branches.
+	struct alignas(16) SonicSkinBlock {
+		float m[12][LIBGENS_XNSKIN_BLOCK_SIZE];
+		float position[3][LIBGENS_XNSKIN_BLOCK_SIZE];
+		float normal[3][LIBGENS_XNSKIN_BLOCK_SIZE];
+		float tangent[3][LIBGENS_XNSKIN_BLOCK_SIZE];
+	};
+
+	// Rows of the blended matrices applied to v, four vertices at a time and the rest one by one
+	static void transformSkinRows(const SonicSkinBlock &block, const float (*v)[LIBGENS_XNSKIN_BLOCK_SIZE], bool translate, size_t count, float (*out)[LIBGENS_XNSKIN_BLOCK_SIZE]) {
+		for (size_t r=0; r<3; r++) {
+			const float *m0=block.m[r*4], *m1=block.m[r*4+1], *m2=block.m[r*4+2], *m3=block.m[r*4+3];
+			size_t i=0;
+
+#ifdef LIBGENS_XNSKIN_SSE
+			for (; i+4<=count; i+=4) {
+				__m128 value=_mm_add_ps(_mm_mul_ps(_mm_load_ps(m0+i), _mm_load_ps(v[0]+i)), _mm_mul_ps(_mm_load_ps(m1+i), _mm_load_ps(v[1]+i)));
+				value = _mm_add_ps(value, _mm_mul_ps(_mm_load_ps(m2+i), _mm_load_ps(v[2]+i)));
+				if (translate) value = _mm_add_ps(value, _mm_load_ps(m3+i));
+				_mm_store_ps(out[r]+i, value);
+			}
+#endif
+
+			for (; i<count; i++) {
+				out[r][i] = m0[i]*v[0][i] + m1[i]*v[1][i] + m2[i]*v[2][i];
+				if (translate) out[r][i] += m3[i];
+			}
+		}
+	}
+
+	static void normalizeSkinRows(float (*out)[LIBGENS_XNSKIN_BLOCK_SIZE], size_t count) {
+		size_t i=0;
+
+#ifdef LIBGENS_XNSKIN_SSE
+		__m128 zero=_mm_setzero_ps();
+		__m128 one=_mm_set1_ps(1.0f);
+		for (; i+4<=count; i+=4) {
+			__m128 x=_mm_load_ps(out[0]+i), y=_mm_load_ps(out[1]+i), z=_mm_load_ps(out[2]+i);
+			__m128 length_squared=_mm_add_ps(_mm_add_ps(_mm_mul_ps(x, x), _mm_mul_ps(y, y)), _mm_mul_ps(z, z));
+			__m128 scale=_mm_and_ps(_mm_cmpgt_ps(length_squared, zero), _mm_div_ps(one, _mm_sqrt_ps(length_squared)));
+			_mm_store_ps(out[0]+i, _mm_mul_ps(x, scale));
+			_mm_store_ps(out[1]+i, _mm_mul_ps(y, scale));
+			_mm_store_ps(out[2]+i, _mm_mul_ps(z, scale));
+		}
+#endif
+
+		for (; i<count; i++) {
+			float length_squared=out[0][i]*out[0][i] + out[1][i]*out[1][i] + out[2][i]*out[2][i];
+			float scale=(length_squared > 0.0f) ? 1.0f / sqrt(length_squared) : 0.0f;
+			out[0][i] *= scale;
+			out[1][i] *= scale;
+			out[2][i] *= scale;
+		}
+	}
+
+	static void storeSkinRows(float (*out)[LIBGENS_XNSKIN_BLOCK_SIZE], size_t count, float *output) {
+		for (size_t i=0; i<count; i++) {
+			output[i*3]   = out[0][i];
+			output[i*3+1] = out[1][i];
+			output[i*3+2] = out[2][i];
+		}
+	}
+
+	static void transformSkinBlock(SonicSkinBlock &block, size_t count, float *positions, float *normals, float *tangents) {
+		alignas(16) float out[3][LIBGENS_XNSKIN_BLOCK_SIZE];
+
+		transformSkinRows(block, block.position, true, count, out);
+		storeSkinRows(out, count, positions);
+
+		// Directions ignore the translation and get renormalized, since blending and scaling change their length
+		transformSkinRows(block, block.normal, false, count, out);
+		normalizeSkinRows(out, count);
+		storeSkinRows(out, count, normals);
+
+		transformSkinRows(block, block.tangent, false, count, out);
+		normalizeSkinRows(out, count);
+		storeSkinRows(out, count, tangents);
+	}
+
+	static void skinVertexTable(SonicVertexTable *vertex_table, const vector<float> &bone_skin, const vector<int> &matrix_to_bone, SonicSkinnedVertices &output) {
+		vector<SonicVertex *> &vertices=vertex_table->vertices;
+		vector<unsigned int> &bone_table=vertex_table->bone_table;
+
+		size_t vertex_count=vertices.size();
+		output.positions.resize(vertex_count*3);
+		output.normals.resize(vertex_count*3);
+		output.tangents.resize(vertex_count*3);
+
+		// Resolve the palette once, entries without a bone stay at identity
+		vector<float> palette(std::max(bone_table.size(), (size_t)1) * 12, 0.0f);
+		for (size_t p=0; p<palette.size()/12; p++) {
+			float *m=&palette[p*12];
+			m[0] = m[5] = m[10] = 1.0f;
+
+			if (p >= bone_table.size()) continue;
+			unsigned int matrix_index=bone_table[p];
+			if (matrix_index >= matrix_to_bone.size()) continue;
+
+			int bone_index=matrix_to_bone[matrix_index];
+			if (bone_index >= 0) std::copy(bone_skin.begin() + bone_index*12, bone_skin.begin() + bone_index*12 + 12, m);
+		}
+		size_t palette_size=palette.size()/12;
+
+		SonicSkinBlock block;
+		for (size_t start=0; start<vertex_count; start+=LIBGENS_XNSKIN_BLOCK_SIZE) {
+			size_t count=std::min((size_t)LIBGENS_XNSKIN_BLOCK_SIZE, vertex_count-start);
+
+			for (size_t i=0; i<count; i++) {
+				SonicVertex *vertex=vertices[start+i];
+
+				float weights[4];
+				unsigned char indices[4];
+				float weight_total=0.0f;
+				for (size_t k=0; k<4; k++) {
+					indices[k] = vertex->bone_indices[k];
+					weights[k] = ((vertex->bone_weights_f[k] > 0.0f) && (indices[k] < palette_size)) ? vertex->bone_weights_f[k] : 0.0f;
+					weight_total += weights[k];
+				}
+
+				// Unweighted vertices follow the first palette entry
+				if (weight_total <= 0.0f) {
+					weights[0] = weight_total = 1.0f;
+					if (indices[0] >= palette_size) indices[0] = 0;
+				}
+
+				float m[12]={ 0.0f };
+				for (size_t k=0; k<4; k++) {
+					if (weights[k] <= 0.0f) continue;
+
+					const float *source=&palette[indices[k] * 12];
+					float w=weights[k] / weight_total;
+					for (size_t c=0; c<12; c++) m[c] += source[c] * w;
+				}
+
+				for (size_t c=0; c<12; c++) block.m[c][i] = m[c];
+				block.position[0][i] = vertex->position.x;
+				block.position[1][i] = vertex->position.y;
+				block.position[2][i] = vertex->position.z;
+				block.normal[0][i] = vertex->normal.x;
+				block.normal[1][i] = vertex->normal.y;
+				block.normal[2][i] = vertex->normal.z;
+				block.tangent[0][i] = vertex->tangent.x;
+				block.tangent[1][i] = vertex->tangent.y;
+				block.tangent[2][i] = vertex->tangent.z;
+			}
+
+			transformSkinBlock(block, count, &output.positions[start*3], &output.normals[start*3], &output.tangents[start*3]);
+		}
+	}
+
+	void SonicXNObject::skinVertices(vector<Matrix4> &bone_matrices, vector<SonicSkinnedVertices> &output, unsigned int thread_count) {
+		output.resize(vertex_tables.size());
+
+		vector<int> matrix_to_bone;
+		buildMatrixToBone(matrix_to_bone);
+
+		// Skinning matrix of every bone, the posed world matrix applied after the inverse bind pose,
+		// which bones store transposed. Kept as the top 3 rows since the bottom one is constant.
+		// Bones past the end of bone_matrices have no pose, they keep their vertices in the bind pose
+		// instead of moving them into bone space.
+		if (bone_matrices.size() < bones.size()) {
+			Error::addMessage(Error::WARNING, "Skinning with " + ToString(bone_matrices.size()) + " bone matrices for " + ToString(bones.size()) + " bones. The rest stay in their bind pose.");
+		}
+
+		vector<float> bone_skin(bones.size() * 12, 0.0f);
+		for (size_t b=0; b<bones.size(); b++) {
+			if (b >= bone_matrices.size()) {
+				bone_skin[b*12] = bone_skin[b*12 + 5] = bone_skin[b*12 + 10] = 1.0f;
+				continue;
+			}
+
+			Matrix4 skin=bone_matrices[b] * bones[b]->matrix.transpose();
+			for (size_t r=0; r<3; r++) {
+				for (size_t c=0; c<4; c++) {
+					bone_skin[b*12 + r*4 + c] = skin[r][c];
+				}
+			}
+		}
+
+		if (!thread_count) thread_count = std::thread::hardware_concurrency();
+		if (!thread_count) thread_count = 1;
+		thread_count = std::min(thread_count, (unsigned int) vertex_tables.size());
+
+		std::atomic<size_t> next_table(0);
+		vector<std::thread> threads;
+		for (unsigned int t=0; t<thread_count; t++) {
+			threads.push_back(std::thread([&]() {
+				for (size_t i=next_table++; i<vertex_tables.size(); i=next_table++) {
+					skinVertexTable(vertex_tables[i], bone_skin, matrix_to_bone, output[i]);
+				}
+			}));
+		}
+
+		for (size_t t=0; t<threads.size(); t++) {
+			threads[t].join();
+		}
+	}
+};
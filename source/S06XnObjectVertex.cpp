@@ -20,6 +20,7 @@
 #include "LibGens.h"
 #include <algorithm>
 #include "S06XnFile.h"
+#include "half.h"
 
 namespace LibGens {
 	void SonicVertex::read(File *file, unsigned int vertex_size, bool big_endian, unsigned int vertex_flag, XNFileMode file_mode) {
@@ -119,6 +120,11 @@ namespace LibGens {
 	}
 
 	void SonicVertex::write(File *file, unsigned int vertex_size, bool big_endian, unsigned int vertex_flag, XNFileMode file_mode) {
+		if (file_mode == MODE_ENO) {
+			writeENO(file, big_endian, vertex_flag);
+			return;
+		}
+
 		// Position
 		if (vertex_flag & 0x1) {
 			position.write(file, big_endian);
@@ -171,6 +177,188 @@ namespace LibGens {
 			
 	}
 
+	void SonicVertex::writeENO(File *file, bool big_endian, unsigned int vertex_flag) {
+		position.write(file, big_endian);
+
+		if (vertex_flag == 0x310005) {
+			unsigned int packed_normal=packNormal360(normal);
+			if (big_endian) file->writeInt32BE(&packed_normal);
+			else file->writeInt32(&packed_normal);
+		}
+		else {
+			normal.write(file, big_endian);
+			file->writeNull(8);
+		}
+
+		for (size_t i=0; i<2; i++) {
+			unsigned short half_value=packHalf(i ? uv[0].y : uv[0].x);
+			if (big_endian) file->writeInt16BE(&half_value);
+			else file->writeInt16(&half_value);
+		}
+
+		if (vertex_flag == 0x317685) {
+			file->writeNull(8);
+		}
+	}
+
+	// Calls visitor with every field the vertex writes with a layout, in file order, so unused garbage
+	// never splits identical buffers
+	template <class Visitor> static void visitLayoutFields(SonicVertex *v, unsigned int vertex_flag, XNFileMode file_mode, Visitor &visitor) {
+		if (file_mode == MODE_ENO) {
+			visitor(&v->position, sizeof(Vector3));
+			visitor(&v->normal, sizeof(Vector3));
+			visitor(&v->uv[0], sizeof(Vector2));
+			return;
+		}
+
+		if (vertex_flag & 0x1)    visitor(&v->position, sizeof(Vector3));
+		if (vertex_flag & 0x7000) visitor(v->bone_weights_f, 12);
+		if (vertex_flag & 0x400)  visitor(v->bone_indices, 4);
+		if (vertex_flag & 0x2)    visitor(&v->normal, sizeof(Vector3));
+		if (vertex_flag & 0x8)    visitor(v->rgba, 4);
+		if (vertex_flag & 0x10)   visitor(v->rgba_2, 4);
+
+		size_t uv_channels = vertex_flag / (0x10000);
+		for (size_t i=0; (i<uv_channels) && (i<4); i++) {
+			visitor(&v->uv[i], sizeof(Vector2));
+		}
+
+		if (vertex_flag & 0x140) {
+			visitor(&v->tangent, sizeof(Vector3));
+			visitor(&v->binormal, sizeof(Vector3));
+		}
+	}
+
+	struct SonicVertexHashVisitor {
+		size_t &hash;
+
+		void operator()(const void *data, size_t size) {
+			SonicXNWritePool::appendHash(hash, data, size);
+		}
+	};
+
+	struct SonicVertexFieldsVisitor {
+		const void *data[16];
+		size_t size[16];
+		size_t count;
+
+		void operator()(const void *field_data, size_t field_size) {
+			data[count] = field_data;
+			size[count] = field_size;
+			count++;
+		}
+	};
+
+	void SonicVertex::appendHash(size_t &hash, unsigned int vertex_flag, XNFileMode file_mode) {
+		SonicVertexHashVisitor visitor={ hash };
+		visitLayoutFields(this, vertex_flag, file_mode, visitor);
+	}
+
+	bool SonicVertex::equalsLayout(SonicVertex &vertex, unsigned int vertex_flag, XNFileMode file_mode) {
+		SonicVertexFieldsVisitor fields={}, other_fields={};
+		visitLayoutFields(this, vertex_flag, file_mode, fields);
+		visitLayoutFields(&vertex, vertex_flag, file_mode, other_fields);
+
+		for (size_t i=0; i<fields.count; i++) {
+			if (memcmp(fields.data[i], other_fields.data[i], fields.size[i])) return false;
+		}
+		return true;
+	}
+
+	unsigned int SonicVertex::packNormal360(Vector3 n) {
+		// Each axis is a sign bit plus an 8 bit fraction added to -1 or 0, in 11/11/10 bit lanes
+		float axis[3]={ n.x, n.y, n.z };
+		unsigned int sign_bits[3]={ 0x00000400, 0x00200000, 0x80000000 };
+		unsigned int shifts[3]={ 2, 13, 23 };
+		unsigned int value=0;
+
+		for (size_t i=0; i<3; i++) {
+			float v=axis[i];
+			if (v < 0.0f) {
+				value |= sign_bits[i];
+				v += 1.0f;
+			}
+
+			int fraction=(int)floor(v * 256.0f + 0.5f);
+			if (fraction < 0) fraction = 0;
+			if (fraction > 255) fraction = 255;
+			value |= ((unsigned int) fraction) << shifts[i];
+		}
+
+		return value;
+	}
+
+	Vector3 SonicVertex::unpackNormal360(unsigned int value) {
+		unsigned int sign_bits[3]={ 0x00000400, 0x00200000, 0x80000000 };
+		unsigned int shifts[3]={ 2, 13, 23 };
+		float axis[3];
+
+		for (size_t i=0; i<3; i++) {
+			axis[i] = ((value >> shifts[i]) & 0xFF) / 256.0f;
+			if (value & sign_bits[i]) axis[i] -= 1.0f;
+		}
+
+		return Vector3(axis[0], axis[1], axis[2]);
+	}
+
+	unsigned short SonicVertex::packHalf(float value) {
+		uint32_t bits=0;
+		memcpy(&bits, &value, 4);
+		return half_from_float(bits);
+	}
+
+	float SonicVertex::unpackHalf(unsigned short value) {
+		uint32_t bits=half_to_float(value);
+		float result=0.0f;
+		memcpy(&result, &bits, 4);
+		return result;
+	}
+
+	void SonicVertex::decodeLayout(SonicVertex &decoded, unsigned int vertex_flag, XNFileMode file_mode) {
+		decoded.zero();
+
+		if (file_mode == MODE_ENO) {
+			decoded.position = position;
+			decoded.normal = (vertex_flag == 0x310005) ? unpackNormal360(packNormal360(normal)) : normal;
+			decoded.uv[0] = Vector2(unpackHalf(packHalf(uv[0].x)), unpackHalf(packHalf(uv[0].y)));
+			return;
+		}
+
+		// Same streams and defaults as read
+		if (vertex_flag & 0x1) decoded.position = position;
+
+		if (vertex_flag & 0x7000) {
+			for (size_t k=0; k<3; k++) decoded.bone_weights_f[k] = bone_weights_f[k];
+		}
+
+		if (vertex_flag & 0x400) {
+			for (size_t k=0; k<4; k++) decoded.bone_indices[k] = bone_indices[k];
+		}
+		else {
+			float total_weight=decoded.bone_weights_f[0] + decoded.bone_weights_f[1] + decoded.bone_weights_f[2];
+			decoded.bone_indices[1] = ((decoded.bone_weights_f[1] > 0.0f) ? 1 : 0);
+			decoded.bone_indices[2] = ((decoded.bone_weights_f[2] > 0.0f) ? 2 : 0);
+			decoded.bone_indices[3] = ((total_weight < 0.999f) ? 3 : 0);
+		}
+
+		if (vertex_flag & 0x2)  decoded.normal = normal;
+		if (vertex_flag & 0x8)  memcpy(decoded.rgba, rgba, 4);
+		if (vertex_flag & 0x10) memcpy(decoded.rgba_2, rgba_2, 4);
+
+		size_t uv_channels = vertex_flag / (0x10000);
+		for (size_t i=0; (i<uv_channels) && (i<4); i++) {
+			decoded.uv[i] = uv[i];
+		}
+
+		if (vertex_flag & 0x140) {
+			decoded.tangent = tangent;
+			decoded.binormal = binormal;
+		}
+
+		decoded.bone_weights_f[3] = 1.0 - decoded.bone_weights_f[0] - decoded.bone_weights_f[1] - decoded.bone_weights_f[2];
+		if (decoded.bone_weights_f[3] == 1.0) decoded.bone_weights_f[3] = 0.0;
+	}
+
 	void SonicVertexTable::read(File *file, XNFileMode file_mode, bool big_endian) {
 		unsigned int table_count=0;
 		size_t table_address=0;
@@ -241,6 +429,35 @@ namespace LibGens {
 		}
 	}
 
+	void SonicVertexTable::writeVerticesPooled(File *file, XNFileMode file_mode, SonicXNWritePool &pool) {
+		size_t hash=SonicXNWritePool::initialHash();
+		SonicXNWritePool::appendHash(hash, &flag_1, 4);
+		SonicXNWritePool::appendHash(hash, &vertex_size, 4);
+		for (size_t i=0; i<vertices.size(); i++) {
+			vertices[i]->appendHash(hash, flag_1, file_mode);
+		}
+
+		vector<const void *> candidates;
+		pool.findBlocks(hash, candidates);
+		for (size_t c=0; c<candidates.size(); c++) {
+			SonicVertexTable *table=(SonicVertexTable *) candidates[c];
+			if ((table->flag_1 != flag_1) || (table->vertex_size != vertex_size) || (table->vertices.size() != vertices.size())) continue;
+
+			bool same=true;
+			for (size_t i=0; (i<vertices.size()) && same; i++) {
+				same = vertices[i]->equalsLayout(*table->vertices[i], flag_1, file_mode);
+			}
+
+			if (same) {
+				vertex_buffer_address = table->vertex_buffer_address;
+				return;
+			}
+		}
+
+		writeVertices(file, file_mode);
+		pool.addBlock(hash, this);
+	}
+
 	void SonicVertexTable::writeTable(File *file) {
 		size_t bone_table_address = file->getCurrentAddress();
 		for (size_t i=0; i<bone_table.size(); i++) {
@@ -280,4 +497,387 @@ namespace LibGens {
 			vertices[i]->setScale(scale);
 		}
 	}
+
+	unsigned int SonicVertexTable::getVertexSize(unsigned int flag, XNFileMode file_mode) {
+		if (file_mode == MODE_ENO) {
+			if (flag == 0x310005) return 20;
+			if (flag == 0x317405) return 36;
+			if (flag == 0x317685) return 44;
+			return 0;
+		}
+
+		unsigned int size=0;
+		if (flag & 0x1)    size += 12;
+		if (flag & 0x7000) size += 12;
+		if (flag & 0x400)  size += 4;
+		if (flag & 0x2)    size += 12;
+		if (flag & 0x8)    size += 4;
+		if (flag & 0x10)   size += 4;
+		size += (flag / 0x10000) * 8;
+		if (flag & 0x140)  size += 24;
+		return size;
+	}
+
+	unsigned int SonicVertexTable::calculateCompactFlag(XNFileMode file_mode) {
+		if (file_mode == MODE_ENO) {
+			// The packed layout has no room for blending, so only single bone tables can use it
+			if (((flag_1 == 0x317405) || (flag_1 == 0x317685)) && (bone_table.size() <= 1)) return 0x310005;
+			return flag_1;
+		}
+
+		bool used_weights=false;
+		bool used_indices=false;
+		bool used_normal=false;
+		bool used_rgba=false;
+		bool used_rgba_2=false;
+		bool used_tangents=false;
+		size_t used_uvs=0;
+		Vector3 zero_vector(0.0f, 0.0f, 0.0f);
+
+		for (size_t i=0; i<vertices.size(); i++) {
+			SonicVertex *v=vertices[i];
+
+			// Without weights the reader assumes full weight on the first palette entry
+			if (v->bone_weights_f[0] < 0.999f) used_weights = true;
+
+			// Without indices the reader assumes weight k uses palette entry k
+			for (size_t k=0; k<4; k++) {
+				bool weighted=(k < 3 ? (v->bone_weights_f[k] > 0.0f) : (v->bone_weights_f[k] > 0.001f));
+				if (weighted && (v->bone_indices[k] != k)) used_indices = true;
+			}
+
+			if (v->normal != zero_vector) used_normal = true;
+			if ((v->rgba[0] != 0xFF) || (v->rgba[1] != 0xFF) || (v->rgba[2] != 0xFF) || (v->rgba[3] != 0xFF)) used_rgba = true;
+			if ((v->rgba_2[0] != 0xFF) || (v->rgba_2[1] != 0xFF) || (v->rgba_2[2] != 0xFF) || (v->rgba_2[3] != 0xFF)) used_rgba_2 = true;
+			if ((v->tangent != zero_vector) || (v->binormal != zero_vector)) used_tangents = true;
+
+			for (size_t u=0; u<4; u++) {
+				if ((v->uv[u].x != 0.0f) || (v->uv[u].y != 0.0f)) used_uvs = std::max(used_uvs, u+1);
+			}
+		}
+
+		// Streams can only be dropped, never added, so garbage in absent streams is never picked up
+		unsigned int flag=flag_1 & 0xFFFF;
+		if (!used_weights)  flag &= ~0x7000;
+		if (!used_indices)  flag &= ~0x400;
+		if (!used_normal)   flag &= ~0x2;
+		if (!used_rgba)     flag &= ~0x8;
+		if (!used_rgba_2)   flag &= ~0x10;
+		if (!used_tangents) flag &= ~0x140;
+
+		unsigned int uv_channels=std::min((unsigned int) used_uvs, flag_1 / 0x10000);
+		flag |= uv_channels * 0x10000;
+		return flag;
+	}
+
+	bool SonicVertexTable::validateLayout(unsigned int flag, XNFileMode file_mode) {
+		if (!getVertexSize(flag, file_mode)) return false;
+
+		const float normal_tolerance=(flag == 0x310005 ? 0.01f : 0.0f);
+		const float uv_tolerance=(file_mode == MODE_ENO ? 0.002f : 0.0f);
+		size_t uv_channels=(file_mode == MODE_ENO ? 1 : flag / 0x10000);
+
+		// Compare every vertex against what the reader would decode from the new layout
+		SonicVertex vertex;
+		for (size_t i=0; i<vertices.size(); i++) {
+			SonicVertex *original=vertices[i];
+			original->decodeLayout(vertex, flag, file_mode);
+
+			if (vertex.position != original->position) return false;
+
+			if ((fabs(vertex.normal.x - original->normal.x) > normal_tolerance) ||
+				(fabs(vertex.normal.y - original->normal.y) > normal_tolerance) ||
+				(fabs(vertex.normal.z - original->normal.z) > normal_tolerance)) return false;
+
+			for (size_t u=0; u<uv_channels; u++) {
+				float tolerance=uv_tolerance * std::max(1.0f, std::max((float)fabs(original->uv[u].x), (float)fabs(original->uv[u].y)));
+				if ((fabs(vertex.uv[u].x - original->uv[u].x) > tolerance) || (fabs(vertex.uv[u].y - original->uv[u].y) > tolerance)) return false;
+			}
+
+			if (file_mode != MODE_ENO) {
+				for (size_t k=0; k<4; k++) {
+					if ((k < 3) && (fabs(vertex.bone_weights_f[k] - original->bone_weights_f[k]) > 0.001f)) return false;
+					if ((original->bone_weights_f[k] > 0.001f) && (vertex.bone_indices[k] != original->bone_indices[k])) return false;
+				}
+
+				if ((flag & 0x8) && memcmp(vertex.rgba, original->rgba, 4)) return false;
+				if ((flag & 0x10) && memcmp(vertex.rgba_2, original->rgba_2, 4)) return false;
+				if ((flag & 0x140) && ((vertex.tangent != original->tangent) || (vertex.binormal != original->binormal))) return false;
+			}
+		}
+
+		return true;
+	}
+
+	bool SonicVertexTable::compactLayout(XNFileMode file_mode) {
+		unsigned int flag=calculateCompactFlag(file_mode);
+		if (flag == flag_1) return false;
+
+		if (!validateLayout(flag, file_mode)) {
+			printf("Vertex layout %x failed validation, keeping %x.\n", flag, flag_1);
+			return false;
+		}
+
+		flag_1 = flag;
+		vertex_size = getVertexSize(flag, file_mode);
+		return true;
+	}
+
+	// Bones influencing a triangle, sorted and unique. Unweighted vertices follow their first bone.
+	static void collectTriangleBones(SonicVertex **triangle, vector<unsigned char> &bone_set) {
+		bone_set.clear();
+
+		for (size_t j=0; j<3; j++) {
+			SonicVertex *v=triangle[j];
+			bool weighted=false;
+
+			for (size_t k=0; k<4; k++) {
+				if (v->bone_weights_f[k] > 0.0f) {
+					bone_set.push_back(v->bone_indices[k]);
+					weighted = true;
+				}
+			}
+
+			if (!weighted) bone_set.push_back(v->bone_indices[0]);
+		}
+
+		std::sort(bone_set.begin(), bone_set.end());
+		bone_set.erase(std::unique(bone_set.begin(), bone_set.end()), bone_set.end());
+	}
+
+	// Keeps the heaviest bone of each vertex and then the bones with the most weight over the triangle,
+	// up to max_bones. Weights of the dropped bones are removed and the rest renormalized, so vertices
+	// only ever lose bones and triangles sharing them can't grow past the limit again.
+	static void fitTriangleBones(SonicVertex **triangle, const vector<unsigned char> &bone_set, unsigned int max_bones) {
+		float bone_weights[256]={ 0.0f };
+		bool keep[256]={ false };
+		size_t kept=0;
+
+		for (size_t j=0; j<3; j++) {
+			SonicVertex *v=triangle[j];
+			int heaviest=-1;
+
+			for (size_t k=0; k<4; k++) {
+				if (v->bone_weights_f[k] <= 0.0f) continue;
+
+				bone_weights[v->bone_indices[k]] += v->bone_weights_f[k];
+				if ((heaviest == -1) || (v->bone_weights_f[k] > v->bone_weights_f[heaviest])) heaviest = k;
+			}
+
+			unsigned char bone=v->bone_indices[(heaviest != -1) ? heaviest : 0];
+			if (heaviest == -1) bone_weights[bone] += 1.0f;
+
+			if (!keep[bone] && (kept < max_bones)) {
+				keep[bone] = true;
+				kept++;
+			}
+		}
+
+		vector<unsigned char> by_weight(bone_set.begin(), bone_set.end());
+		std::stable_sort(by_weight.begin(), by_weight.end(), [&](unsigned char a, unsigned char b) { return bone_weights[a] > bone_weights[b]; });
+		for (size_t b=0; (b<by_weight.size()) && (kept<max_bones); b++) {
+			if (!keep[by_weight[b]]) {
+				keep[by_weight[b]] = true;
+				kept++;
+			}
+		}
+
+		for (size_t j=0; j<3; j++) {
+			SonicVertex *v=triangle[j];
+			bool weighted=false;
+			float total=0.0f;
+
+			for (size_t k=0; k<4; k++) {
+				if (v->bone_weights_f[k] <= 0.0f) continue;
+
+				weighted = true;
+				if (keep[v->bone_indices[k]]) total += v->bone_weights_f[k];
+				else v->bone_weights_f[k] = 0.0f;
+			}
+
+			if (total > 0.0f) {
+				for (size_t k=0; k<4; k++) v->bone_weights_f[k] /= total;
+			}
+			// Only with palettes under three bones, the vertex follows the heaviest bone left
+			else if (weighted || !keep[v->bone_indices[0]]) {
+				v->bone_indices[0] = by_weight[0];
+				v->bone_weights_f[0] = 1.0f;
+			}
+		}
+	}
+
+	void SonicVertexTable::splitByBonePalette(vector<SonicVertex *> &vertices, vector<unsigned int> &indices, unsigned int max_bones,
+											  vector< vector<SonicVertex *> > &vertices_output, vector< vector<unsigned int> > &indices_output,
+											  vector< vector<unsigned int> > &bone_tables_output) {
+		size_t triangle_count=indices.size()/3;
+
+		// Group triangles into clusters that share the exact same set of influencing bones
+		map<vector<unsigned char>, size_t> cluster_map;
+		vector< vector<unsigned char> > cluster_bones;
+		vector<size_t> cluster_triangles;
+		vector<size_t> triangle_clusters(triangle_count);
+
+		// Triangles with too many bones for one palette lose their lightest weights first
+		vector<unsigned char> bone_set;
+		size_t fitted_count=0;
+		for (size_t t=0; t<triangle_count; t++) {
+			SonicVertex *triangle[3]={ vertices[indices[t*3]], vertices[indices[t*3+1]], vertices[indices[t*3+2]] };
+			collectTriangleBones(triangle, bone_set);
+
+			if (bone_set.size() > max_bones) {
+				fitTriangleBones(triangle, bone_set, max_bones);
+				fitted_count++;
+			}
+		}
+
+		if (fitted_count) {
+			Error::addMessage(Error::WARNING, ToString(fitted_count) + " triangles used more than " + ToString(max_bones) + " bones. Their lightest bone weights were dropped to fit the palette.");
+		}
+
+		for (size_t t=0; t<triangle_count; t++) {
+			SonicVertex *triangle[3]={ vertices[indices[t*3]], vertices[indices[t*3+1]], vertices[indices[t*3+2]] };
+			collectTriangleBones(triangle, bone_set);
+
+			map<vector<unsigned char>, size_t>::iterator it=cluster_map.find(bone_set);
+			if (it == cluster_map.end()) {
+				it = cluster_map.insert(std::make_pair(bone_set, cluster_bones.size())).first;
+				cluster_bones.push_back(bone_set);
+				cluster_triangles.push_back(0);
+			}
+
+			triangle_clusters[t] = it->second;
+			cluster_triangles[it->second]++;
+		}
+
+		// Greedily pack clusters into groups. Each group is seeded with the biggest remaining bone set,
+		// and then grows with whichever cluster adds the fewest new bones, preferring clusters that share
+		// the most bones with the group since those tend to be neighbours sharing vertices.
+		size_t cluster_count=cluster_bones.size();
+		vector<int> cluster_groups(cluster_count, -1);
+		vector< vector<unsigned int> > group_bones;
+		size_t clusters_left=cluster_count;
+
+		while (clusters_left) {
+			bool in_group[256];
+			memset(in_group, 0, sizeof(in_group));
+			vector<unsigned int> bone_table;
+			int group_index=group_bones.size();
+
+			int seed=-1;
+			for (size_t c=0; c<cluster_count; c++) {
+				if (cluster_groups[c] != -1) continue;
+				if ((seed == -1) || (cluster_bones[c].size() > cluster_bones[seed].size()) || 
+					((cluster_bones[c].size() == cluster_bones[seed].size()) && (cluster_triangles[c] > cluster_triangles[seed]))) {
+					seed = c;
+				}
+			}
+
+			int current=seed;
+			while (current != -1) {
+				cluster_groups[current] = group_index;
+				clusters_left--;
+
+				for (size_t b=0; b<cluster_bones[current].size(); b++) {
+					unsigned char bone=cluster_bones[current][b];
+					if (!in_group[bone]) {
+						in_group[bone] = true;
+						bone_table.push_back(bone);
+					}
+				}
+
+				current = -1;
+				size_t best_new=0;
+				size_t best_shared=0;
+
+				for (size_t c=0; c<cluster_count; c++) {
+					if (cluster_groups[c] != -1) continue;
+
+					size_t new_bones=0;
+					for (size_t b=0; b<cluster_bones[c].size(); b++) {
+						if (!in_group[cluster_bones[c][b]]) new_bones++;
+					}
+
+					if (bone_table.size() + new_bones > max_bones) continue;
+
+					size_t shared_bones=cluster_bones[c].size() - new_bones;
+					if ((current == -1) || (new_bones < best_new) || ((new_bones == best_new) && (shared_bones > best_shared))) {
+						current = c;
+						best_new = new_bones;
+						best_shared = shared_bones;
+					}
+				}
+			}
+
+			std::sort(bone_table.begin(), bone_table.end());
+			group_bones.push_back(bone_table);
+		}
+
+		// Emit a vertex and index list per group, keeping the original triangle order.
+		// Vertices used by more than one group get duplicated, the first group reuses the original.
+		const unsigned int unassigned=0xFFFFFFFF;
+		vector<unsigned int> remap(vertices.size(), unassigned);
+		vector<bool> vertex_claimed(vertices.size(), false);
+
+		// Unweighted slots can point at any bone, so they are cleared to a valid palette entry
+		vector<unsigned char> global_bone_indices(vertices.size()*4, 0);
+		for (size_t i=0; i<vertices.size(); i++) {
+			for (size_t k=0; k<4; k++) {
+				if ((vertices[i]->bone_weights_f[k] > 0.0f) || (k == 0)) {
+					global_bone_indices[i*4 + k] = vertices[i]->bone_indices[k];
+				}
+			}
+		}
+
+		for (size_t g=0; g<group_bones.size(); g++) {
+			unsigned char local_index[256];
+			memset(local_index, 0, sizeof(local_index));
+			for (size_t b=0; b<group_bones[g].size(); b++) {
+				local_index[group_bones[g][b]] = b;
+			}
+
+			vector<SonicVertex *> group_vertices;
+			vector<unsigned int> group_indices;
+			vector<unsigned int> touched;
+
+			for (size_t t=0; t<triangle_count; t++) {
+				if (cluster_groups[triangle_clusters[t]] != (int)g) continue;
+
+				for (size_t j=0; j<3; j++) {
+					unsigned int index=indices[t*3+j];
+
+					if (remap[index] == unassigned) {
+						SonicVertex *v=vertices[index];
+						if (vertex_claimed[index]) {
+							v = new SonicVertex();
+							v->copy(*vertices[index]);
+						}
+						vertex_claimed[index] = true;
+
+						for (size_t k=0; k<4; k++) {
+							v->bone_indices[k] = local_index[global_bone_indices[index*4 + k]];
+						}
+
+						remap[index] = group_vertices.size();
+						touched.push_back(index);
+						group_vertices.push_back(v);
+					}
+
+					group_indices.push_back(remap[index]);
+				}
+			}
+
+			for (size_t i=0; i<touched.size(); i++) {
+				remap[touched[i]] = unassigned;
+			}
+
+			vertices_output.push_back(group_vertices);
+			indices_output.push_back(group_indices);
+			bone_tables_output.push_back(group_bones[g]);
+		}
+
+		// Vertices that no triangle references are dropped
+		for (size_t i=0; i<vertices.size(); i++) {
+			if (!vertex_claimed[i]) delete vertices[i];
+		}
+	}
 };
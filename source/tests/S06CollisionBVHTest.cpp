@@ -0,0 +1,267 @@
+//=========================================================================
+//	  Copyright (c) 2016 SonicGLvl
+//
+//    This file is part of SonicGLvl, a community-created free level editor 
+//    for the PC version of Sonic Generations.
+//
+//    SonicGLvl is free software: you can redistribute it and/or modify
+//    it under the terms of the GNU General Public License as published by
+//    the Free Software Foundation, either version 3 of the License, or
+//    (at your option) any later version.
+//
+//    SonicGLvl is distributed in the hope that it will be useful,
+//    but WITHOUT ANY WARRANTY; without even the implied warranty of
+//    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+//    
+//
+//    Read AUTHORS.txt, LICENSE.txt and COPYRIGHT.txt for more details.
+//=========================================================================
+
+
+#include "S06Test.h"
+#include "S06Collision.h"
+
+using namespace LibGens;
+
+static unsigned int test_seed=12345;
+
+static float randomTestFloat(float minimum, float maximum) {
+	test_seed = test_seed*1664525 + 1013904223;
+	return minimum + (maximum - minimum) * ((test_seed >> 8) / 16777216.0f);
+}
+
+static void addTestTriangle(SonicCollision &collision, Vector3 a, Vector3 b, Vector3 c, unsigned int collision_flag=0) {
+	SonicCollisionFace face;
+	face.v1 = collision.vertex_pool.size();
+	face.v2 = face.v1 + 1;
+	face.v3 = face.v1 + 2;
+	face.collision_flag = collision_flag;
+	collision.vertex_pool.push_back(a);
+	collision.vertex_pool.push_back(b);
+	collision.vertex_pool.push_back(c);
+	collision.face_pool.push_back(face);
+}
+
+static double dotTest(const double *a, const double *b) {
+	return a[0]*b[0] + a[1]*b[1] + a[2]*b[2];
+}
+
+// Reference queries in double precision over every face, without the tree
+static bool bruteRay(SonicCollision &collision, const SonicCollisionRay &ray, unsigned int ignore_flags, double &best) {
+	double length=sqrt(ray.direction.x*ray.direction.x + ray.direction.y*ray.direction.y + ray.direction.z*ray.direction.z);
+	double origin[3]={ ray.origin.x, ray.origin.y, ray.origin.z };
+	double direction[3]={ ray.direction.x / length, ray.direction.y / length, ray.direction.z / length };
+	best = (ray.max_distance >= 0.0f) ? ray.max_distance : 1e30;
+	bool hit=false;
+
+	for (size_t f=0; f<collision.face_pool.size(); f++) {
+		SonicCollisionFace &face=collision.face_pool[f];
+		if (face.collision_flag & ignore_flags) continue;
+
+		Vector3 &a=collision.vertex_pool[face.v1];
+		Vector3 &b=collision.vertex_pool[face.v2];
+		Vector3 &c=collision.vertex_pool[face.v3];
+		double e1[3]={ b.x-a.x, b.y-a.y, b.z-a.z };
+		double e2[3]={ c.x-a.x, c.y-a.y, c.z-a.z };
+		double s[3]={ origin[0]-a.x, origin[1]-a.y, origin[2]-a.z };
+		double p[3]={ direction[1]*e2[2] - direction[2]*e2[1], direction[2]*e2[0] - direction[0]*e2[2], direction[0]*e2[1] - direction[1]*e2[0] };
+		double q[3]={ s[1]*e1[2] - s[2]*e1[1], s[2]*e1[0] - s[0]*e1[2], s[0]*e1[1] - s[1]*e1[0] };
+		double determinant=dotTest(e1, p);
+		if (fabs(determinant) < 1e-12) continue;
+
+		double u=dotTest(s, p) / determinant;
+		double v=dotTest(direction, q) / determinant;
+		double t=dotTest(e2, q) / determinant;
+		if ((u >= 0.0) && (v >= 0.0) && (u + v <= 1.0) && (t >= 0.0) && (t <= best)) {
+			best = t;
+			hit = true;
+		}
+	}
+
+	return hit;
+}
+
+static double segmentDistanceSquared(const double *p, const double *a, const double *b) {
+	double ab[3]={ b[0]-a[0], b[1]-a[1], b[2]-a[2] };
+	double ap[3]={ p[0]-a[0], p[1]-a[1], p[2]-a[2] };
+	double t=std::max(0.0, std::min(1.0, dotTest(ap, ab) / std::max(dotTest(ab, ab), 1e-30)));
+	double d[3]={ ap[0]-ab[0]*t, ap[1]-ab[1]*t, ap[2]-ab[2]*t };
+	return dotTest(d, d);
+}
+
+static double bruteDistance(SonicCollision &collision, const Vector3 &point) {
+	double p[3]={ point.x, point.y, point.z };
+	double best=1e30;
+
+	for (size_t f=0; f<collision.face_pool.size(); f++) {
+		SonicCollisionFace &face=collision.face_pool[f];
+		Vector3 *corners[3]={ &collision.vertex_pool[face.v1], &collision.vertex_pool[face.v2], &collision.vertex_pool[face.v3] };
+		double v[3][3];
+		for (size_t i=0; i<3; i++) {
+			v[i][0] = corners[i]->x;
+			v[i][1] = corners[i]->y;
+			v[i][2] = corners[i]->z;
+		}
+
+		// Inside the prism over the face the distance is to the plane, otherwise to the nearest edge
+		double e1[3]={ v[1][0]-v[0][0], v[1][1]-v[0][1], v[1][2]-v[0][2] };
+		double e2[3]={ v[2][0]-v[0][0], v[2][1]-v[0][1], v[2][2]-v[0][2] };
+		double ap[3]={ p[0]-v[0][0], p[1]-v[0][1], p[2]-v[0][2] };
+		double d00=dotTest(e1, e1), d01=dotTest(e1, e2), d11=dotTest(e2, e2);
+		double d20=dotTest(ap, e1), d21=dotTest(ap, e2);
+		double denominator=d00*d11 - d01*d01;
+		double b1=(d11*d20 - d01*d21) / denominator;
+		double b2=(d00*d21 - d01*d20) / denominator;
+
+		double distance=1e30;
+		if ((b1 >= 0.0) && (b2 >= 0.0) && (b1 + b2 <= 1.0)) {
+			double d[3]={ ap[0]-e1[0]*b1-e2[0]*b2, ap[1]-e1[1]*b1-e2[1]*b2, ap[2]-e1[2]*b1-e2[2]*b2 };
+			distance = dotTest(d, d);
+		}
+		distance = std::min(distance, segmentDistanceSquared(p, v[0], v[1]));
+		distance = std::min(distance, segmentDistanceSquared(p, v[1], v[2]));
+		distance = std::min(distance, segmentDistanceSquared(p, v[2], v[0]));
+		best = std::min(best, distance);
+	}
+
+	return sqrt(best);
+}
+
+// A height field with a few thousand loose triangles floating above it
+static void buildTestCollision(SonicCollision &collision) {
+	for (size_t z=0; z<32; z++) {
+		for (size_t x=0; x<32; x++) {
+			Vector3 a(x*4.0f, sin(x*0.5f) * cos(z*0.3f) * 3.0f, z*4.0f);
+			Vector3 b((x+1)*4.0f, sin((x+1)*0.5f) * cos(z*0.3f) * 3.0f, z*4.0f);
+			Vector3 c(x*4.0f, sin(x*0.5f) * cos((z+1)*0.3f) * 3.0f, (z+1)*4.0f);
+			Vector3 d((x+1)*4.0f, sin((x+1)*0.5f) * cos((z+1)*0.3f) * 3.0f, (z+1)*4.0f);
+			addTestTriangle(collision, a, c, b);
+			addTestTriangle(collision, b, c, d);
+		}
+	}
+
+	for (size_t i=0; i<3000; i++) {
+		Vector3 center(randomTestFloat(0.0f, 128.0f), randomTestFloat(5.0f, 40.0f), randomTestFloat(0.0f, 128.0f));
+		Vector3 a=center + Vector3(randomTestFloat(-2.0f, 2.0f), randomTestFloat(-2.0f, 2.0f), randomTestFloat(-2.0f, 2.0f));
+		Vector3 b=center + Vector3(randomTestFloat(-2.0f, 2.0f), randomTestFloat(-2.0f, 2.0f), randomTestFloat(-2.0f, 2.0f));
+		Vector3 c=center + Vector3(randomTestFloat(-2.0f, 2.0f), randomTestFloat(-2.0f, 2.0f), randomTestFloat(-2.0f, 2.0f));
+		addTestTriangle(collision, a, b, c, (i % 7 == 0) ? 0x10 : 0);
+	}
+}
+
+static void testRays(SonicCollision &collision) {
+	vector<SonicCollisionRay> rays;
+	for (size_t i=0; i<2000; i++) {
+		Vector3 origin(randomTestFloat(-10.0f, 138.0f), randomTestFloat(-10.0f, 60.0f), randomTestFloat(-10.0f, 138.0f));
+		Vector3 direction(randomTestFloat(-1.0f, 1.0f), randomTestFloat(-1.0f, 1.0f), randomTestFloat(-1.0f, 1.0f));
+		rays.push_back(SonicCollisionRay(origin, direction, (i % 3 == 0) ? 30.0f : -1.0f));
+	}
+
+	size_t hit_count=0;
+	for (size_t i=0; i<rays.size(); i++) {
+		unsigned int ignore_flags=(i % 2) ? 0x10 : 0;
+		SonicCollisionHit hit;
+		double expected=0.0;
+		bool expected_hit=bruteRay(collision, rays[i], ignore_flags, expected);
+		bool result=collision.bvh.castRay(rays[i], hit, ignore_flags);
+
+		// Grazing rays can fall either way of a shared edge, only the distance has to agree
+		LIBGENS_TEST_CHECK(result == expected_hit);
+		if (result && expected_hit) {
+			LIBGENS_TEST_CHECK(fabs(hit.distance - expected) < 1e-3 * std::max(1.0, expected));
+			LIBGENS_TEST_CHECK(!(collision.face_pool[hit.face].collision_flag & ignore_flags));
+			hit_count++;
+		}
+	}
+	LIBGENS_TEST_CHECK(hit_count > rays.size() / 4);
+
+	vector<SonicCollisionHit> hits;
+	collision.bvh.castRays(rays, hits, 0, 4);
+	LIBGENS_TEST_CHECK(hits.size() == rays.size());
+	for (size_t i=0; (i<rays.size()) && (i<hits.size()); i++) {
+		SonicCollisionHit hit;
+		collision.bvh.castRay(rays[i], hit);
+		LIBGENS_TEST_CHECK((hits[i].hit == hit.hit) && (hits[i].distance == hit.distance));
+	}
+}
+
+static void testClosestPoints(SonicCollision &collision) {
+	vector<Vector3> points;
+	for (size_t i=0; i<500; i++) {
+		points.push_back(Vector3(randomTestFloat(-10.0f, 138.0f), randomTestFloat(-10.0f, 60.0f), randomTestFloat(-10.0f, 138.0f)));
+	}
+
+	vector<SonicCollisionHit> hits;
+	collision.bvh.closestPoints(points, -1.0f, hits, 0, 4);
+	LIBGENS_TEST_CHECK(hits.size() == points.size());
+	for (size_t i=0; (i<points.size()) && (i<hits.size()); i++) {
+		double expected=bruteDistance(collision, points[i]);
+		LIBGENS_TEST_CHECK(hits[i].hit);
+		LIBGENS_TEST_CHECK(fabs(hits[i].distance - expected) < 1e-3 * std::max(1.0, expected));
+
+		// Limited searches only find what's in range
+		SonicCollisionHit hit;
+		bool found=collision.bvh.closestPoint(points[i], (float) expected * 0.5f, hit);
+		LIBGENS_TEST_CHECK(!found || (expected < 1e-4));
+	}
+}
+
+// At the distance a swept sphere reports it has to touch the mesh, and slightly before it must not
+static void testSpheres(SonicCollision &collision) {
+	for (size_t i=0; i<300; i++) {
+		Vector3 origin(randomTestFloat(32.0f, 96.0f), randomTestFloat(45.0f, 60.0f), randomTestFloat(32.0f, 96.0f));
+		Vector3 direction(randomTestFloat(-0.5f, 0.5f), -1.0f, randomTestFloat(-0.5f, 0.5f));
+		float radius=randomTestFloat(0.1f, 2.0f);
+		SonicCollisionRay ray(origin, direction, -1.0f, radius);
+
+		SonicCollisionHit hit;
+		LIBGENS_TEST_CHECK(collision.bvh.castSphere(ray, hit));
+		if (!hit.hit) continue;
+
+		Vector3 unit=direction * (1.0f / direction.length());
+		double touching=bruteDistance(collision, origin + unit * hit.distance);
+		double before=bruteDistance(collision, origin + unit * std::max(hit.distance - 0.01f, 0.0f));
+		LIBGENS_TEST_CHECK(fabs(touching - radius) < 1e-3)
+		LIBGENS_TEST_CHECK((hit.distance == 0.0f) || (before > radius));
+	}
+}
+
+// A sphere dropped beside a triangle must miss it wherever the triangle sits
+static void testSphereBesideTriangle(const Vector3 &corner) {
+	SonicCollision collision;
+	addTestTriangle(collision, corner, corner + Vector3(10.0f, 0.0f, 0.0f), corner + Vector3(0.0f, 10.0f, 0.0f));
+	collision.buildBVH(1);
+
+	SonicCollisionHit hit;
+	SonicCollisionRay outside(corner + Vector3(-5.0f, 5.0f, 10.0f), Vector3(0.0f, 0.0f, -1.0f), 20.0f, 0.5f);
+	LIBGENS_TEST_CHECK(!collision.bvh.castSphere(outside, hit));
+
+	SonicCollisionRay beyond_edge(corner + Vector3(7.5f, 7.5f, 10.0f), Vector3(0.0f, 0.0f, -1.0f), 20.0f, 0.5f);
+	LIBGENS_TEST_CHECK(!collision.bvh.castSphere(beyond_edge, hit));
+
+	SonicCollisionRay inside(corner + Vector3(2.0f, 2.0f, 10.0f), Vector3(0.0f, 0.0f, -1.0f), 20.0f, 0.5f);
+	LIBGENS_TEST_CHECK(collision.bvh.castSphere(inside, hit));
+	LIBGENS_TEST_CHECK(fabs(hit.distance - 9.5f) < 1e-3f);
+}
+
+int main(int argc, char** argv) {
+	SonicCollision collision;
+	buildTestCollision(collision);
+	collision.buildBVH(4);
+	LIBGENS_TEST_CHECK(!collision.bvh.empty());
+
+	testRays(collision);
+	testClosestPoints(collision);
+	testSpheres(collision);
+
+	testSphereBesideTriangle(Vector3(0.0f, 0.0f, 0.0f));
+	testSphereBesideTriangle(Vector3(20000.0f, 20000.0f, 0.0f));
+
+	SonicCollision empty;
+	empty.buildBVH();
+	SonicCollisionHit hit;
+	LIBGENS_TEST_CHECK(empty.bvh.empty());
+	LIBGENS_TEST_CHECK(!empty.bvh.castRay(SonicCollisionRay(Vector3(0.0f, 0.0f, 0.0f), Vector3(0.0f, -1.0f, 0.0f)), hit));
+
+	return LIBGENS_TEST_RESULT;
+}
@@ -0,0 +1,416 @@
+//=========================================================================
+//	  Copyright (c) 2016 SonicGLvl
+//
+//    This file is part of SonicGLvl, a community-created free level editor 
+//    for the PC version of Sonic Generations.
+//
+//    SonicGLvl is free software: you can redistribute it and/or modify
+//    it under the terms of the GNU General Public License as published by
+//    the Free Software Foundation, either version 3 of the License, or
+//    (at your option) any later version.
+//
+//    SonicGLvl is distributed in the hope that it will be useful,
+//    but WITHOUT ANY WARRANTY; without even the implied warranty of
+//    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+//    
+//
+//    Read AUTHORS.txt, LICENSE.txt and COPYRIGHT.txt for more details.
+//=========================================================================
+
+
+#include "S06Test.h"
+#include "S06XnFile.h"
+
+using namespace LibGens;
+
+static unsigned int readTestInt32(const string &data, size_t address) {
+	const unsigned char *bytes=(const unsigned char *) data.c_str() + address;
+	return bytes[0] | (bytes[1] << 8) | (bytes[2] << 16) | ((unsigned int) bytes[3] << 24);
+}
+
+// Numbers following every occurrence of a JSON key, in order
+static vector<size_t> findTestNumbers(const string &json, const string &key) {
+	vector<size_t> numbers;
+	string pattern="\"" + key + "\":";
+
+	for (size_t position=json.find(pattern); position != string::npos; position=json.find(pattern, position+1)) {
+		numbers.push_back(strtoul(json.c_str() + position + pattern.size(), NULL, 10));
+	}
+	return numbers;
+}
+
+// Checks the chunk layout of a GLB file and returns its JSON, empty when the layout is broken
+static string checkGLBLayout(const string &data, bool expect_binary) {
+	LIBGENS_TEST_CHECK(data.size() >= 20);
+	if (data.size() < 20) return "";
+
+	LIBGENS_TEST_CHECK(data.compare(0, 4, "glTF") == 0);
+	LIBGENS_TEST_CHECK(readTestInt32(data, 4) == 2);
+	LIBGENS_TEST_CHECK(readTestInt32(data, 8) == data.size());
+
+	size_t json_size=readTestInt32(data, 12);
+	LIBGENS_TEST_CHECK(data.compare(16, 4, "JSON") == 0);
+	LIBGENS_TEST_CHECK((json_size % 4) == 0);
+	LIBGENS_TEST_CHECK(20 + json_size <= data.size());
+	if (20 + json_size > data.size()) return "";
+
+	string json=data.substr(20, json_size);
+	LIBGENS_TEST_CHECK(json[0] == '{');
+	LIBGENS_TEST_CHECK(json.find_last_not_of(' ') == json.find_last_of('}'));
+
+	size_t binary_address=20 + json_size;
+	if (!expect_binary) {
+		LIBGENS_TEST_CHECK(binary_address == data.size());
+		LIBGENS_TEST_CHECK(json.find("\"buffers\"") == string::npos);
+		return json;
+	}
+
+	LIBGENS_TEST_CHECK(binary_address + 8 <= data.size());
+	if (binary_address + 8 > data.size()) return "";
+
+	size_t binary_size=readTestInt32(data, binary_address);
+	LIBGENS_TEST_CHECK(data.compare(binary_address + 4, 4, string("BIN\0", 4)) == 0);
+	LIBGENS_TEST_CHECK((binary_size % 4) == 0);
+	LIBGENS_TEST_CHECK(binary_address + 8 + binary_size == data.size());
+
+	// The single buffer covers the whole chunk, and every view starts aligned inside of it
+	size_t buffers=json.find("\"buffers\"");
+	LIBGENS_TEST_CHECK(buffers != string::npos);
+	if (buffers == string::npos) return json;
+
+	vector<size_t> buffer_sizes=findTestNumbers(json.substr(buffers), "byteLength");
+	LIBGENS_TEST_CHECK(buffer_sizes.size() && (buffer_sizes[0] == binary_size));
+
+	vector<size_t> offsets=findTestNumbers(json, "byteOffset");
+	vector<size_t> lengths=findTestNumbers(json, "byteLength");
+	LIBGENS_TEST_CHECK(offsets.size() && (offsets.size() + 1 == lengths.size()));
+	for (size_t i=0; (i<offsets.size()) && (i<lengths.size()); i++) {
+		LIBGENS_TEST_CHECK((offsets[i] % 4) == 0);
+		LIBGENS_TEST_CHECK(offsets[i] + lengths[i] <= binary_size);
+	}
+
+	return json;
+}
+
+// The index-th object of a JSON array, found by matching brackets
+static string findTestElement(const string &json, const string &array, size_t index) {
+	size_t position=json.find("\"" + array + "\":[");
+	if (position == string::npos) return "";
+
+	size_t depth=0, start=0, count=0;
+	for (size_t i=json.find('[', position)+1; i<json.size(); i++) {
+		char c=json[i];
+		if ((c == '{') || (c == '[')) {
+			if (!depth) start = i;
+			depth++;
+		}
+		else if ((c == '}') || (c == ']')) {
+			if (!depth) break;
+
+			depth--;
+			if (!depth) {
+				if (count == index) return json.substr(start, i+1-start);
+				count++;
+			}
+		}
+	}
+	return "";
+}
+
+// Values of an accessor, copied out of the binary chunk through its buffer view
+template <class T> static vector<T> readTestAccessor(const string &json, const string &binary, size_t index, size_t components) {
+	vector<T> values;
+	string accessor=findTestElement(json, "accessors", index);
+	vector<size_t> views=findTestNumbers(accessor, "bufferView");
+	vector<size_t> counts=findTestNumbers(accessor, "count");
+	if (!views.size() || !counts.size()) return values;
+
+	vector<size_t> offsets=findTestNumbers(findTestElement(json, "bufferViews", views[0]), "byteOffset");
+	size_t size=counts[0] * components * sizeof(T);
+	if (!offsets.size() || (offsets[0] + size > binary.size())) return values;
+
+	values.resize(counts[0] * components);
+	memcpy(&values[0], binary.c_str() + offsets[0], size);
+	return values;
+}
+
+static bool nearTestMatrix(const Matrix4 &a, const Matrix4 &b, float epsilon) {
+	for (size_t r=0; r<4; r++) {
+		for (size_t c=0; c<4; c++) {
+			if (fabs(a[r][c] - b[r][c]) > epsilon) return false;
+		}
+	}
+	return true;
+}
+
+// A GNO strip of quads along x over a chain of three bones, with skinning matrix indices running backwards
+// so joints only come out right when influences are mapped through them. The first 6 columns blend
+// two bones through the vertex bone data, the rest follow the submesh's matrix, the last bone.
+static void buildTestSkinnedObject(SonicXNObject &object) {
+	object.setFileMode(MODE_GNO);
+
+	for (size_t b=0; b<3; b++) {
+		SonicBone *bone=new SonicBone();
+		bone->matrix_index = 2 - b;
+		bone->parent_index = b ? b-1 : 0xFFFF;
+		bone->setTransform(Vector3(b ? 3.0f : 0.0f, 0.0f, 0.0f), Quaternion(1.0f, 0.0f, 0.0f, 0.0f), Vector3(1.0f, 1.0f, 1.0f));
+		object.bones.push_back(bone);
+	}
+	object.calculateSkinningMatrices();
+
+	SonicVertexResourceTable *table=new SonicVertexResourceTable();
+	SonicPolygonTable *polygon_table=new SonicPolygonTable();
+	for (size_t x=0; x<=8; x++) {
+		for (size_t y=0; y<2; y++) {
+			table->positions.push_back(Vector3((float) x, (float) y, 0.0f));
+
+			if (x < 6) {
+				SonicVertexBoneData bone_data;
+				bone_data.bone_1 = object.bones[x/3]->matrix_index;
+				bone_data.bone_2 = object.bones[x/3 + 1]->matrix_index;
+				bone_data.weight = 12288;
+				table->bones.push_back(bone_data);
+			}
+		}
+
+		if (x == 8) continue;
+
+		SonicPolygonPoint points[4];
+		for (size_t p=0; p<4; p++) {
+			points[p].position_index = (x + p/2)*2 + p%2;
+		}
+		polygon_table->faces.push_back(new SonicPolygon(points[0], points[1], points[2]));
+		polygon_table->faces.push_back(new SonicPolygon(points[2], points[1], points[3]));
+	}
+	object.vertex_resource_tables.push_back(table);
+	object.polygon_tables.push_back(polygon_table);
+
+	SonicSubmesh *submesh=new SonicSubmesh();
+	submesh->vertex_index = 0;
+	submesh->indices_index = 0;
+	submesh->material_index = 0;
+	submesh->matrix_index = object.bones[2]->matrix_index;
+
+	SonicMesh *mesh=new SonicMesh();
+	mesh->submeshes.push_back(submesh);
+	object.meshes.push_back(mesh);
+}
+
+static void clearTestSkinnedObject(SonicXNObject &object) {
+	for (size_t i=0; i<object.bones.size(); i++) delete object.bones[i];
+	for (size_t i=0; i<object.polygon_tables[0]->faces.size(); i++) delete object.polygon_tables[0]->faces[i];
+	delete object.polygon_tables[0];
+	delete object.vertex_resource_tables[0];
+	delete object.meshes[0]->submeshes[0];
+	delete object.meshes[0];
+}
+
+// The root moves over 30 frames while the middle bone makes a full turn around y
+static void buildTestMotion(SonicXNMotion &motion) {
+	motion.setFPS(30.0f);
+	motion.setLength(30.0f);
+
+	SonicMotionControl *translation=new SonicMotionControl();
+	translation->bone_index = 0;
+	translation->type = LIBGENS_XNMOTION_TYPE_COORDINATES_LINEAR;
+	translation->element_size = 16;
+	translation->key_frames.push_back(0.0f);
+	translation->key_frames.push_back(30.0f);
+	translation->key_values_floats.push_back(Vector3(1.0f, 2.0f, 3.0f));
+	translation->key_values_floats.push_back(Vector3(4.0f, 5.0f, 6.0f));
+	motion.pushMotionControl(translation);
+
+	SonicMotionControl *rotation=new SonicMotionControl();
+	rotation->bone_index = 1;
+	rotation->type = LIBGENS_XNMOTION_TYPE_Y_ANGLE_LINEAR;
+	rotation->element_size = 4;
+	for (size_t i=0; i<4; i++) {
+		rotation->key_frames.push_back(i * 10.0f);
+		rotation->key_values_int.push_back(i * 21845);
+	}
+	motion.pushMotionControl(rotation);
+}
+
+static void testSkinnedAnimation() {
+	SonicXNObject object(NULL, NULL, NULL);
+	buildTestSkinnedObject(object);
+
+	SonicXNMotion motion;
+	buildTestMotion(motion);
+
+	const float unit_scale=2.0f;
+	SonicGLBWriter writer;
+	vector<string> texture_names;
+	size_t bone_node=object.writeGLB(writer, texture_names, unit_scale);
+	motion.writeGLB(writer, &object, bone_node, unit_scale);
+	LIBGENS_TEST_CHECK(writer.save("glb_skinned.glb"));
+
+	string data=readTestFile("glb_skinned.glb");
+	string json=checkGLBLayout(data, true);
+	if (json.empty()) return;
+	string binary=data.substr(28 + json.size());
+
+	// One joint per bone, and each inverse bind matrix undoes its joint's world matrix at the exported scale
+	string skin=findTestElement(json, "skins", 0);
+	size_t joints_start=skin.find("\"joints\":[");
+	size_t joint_count=(joints_start != string::npos) ? 1 : 0;
+	for (size_t i=joints_start; (joints_start != string::npos) && (skin[i] != ']'); i++) {
+		if (skin[i] == ',') joint_count++;
+	}
+	LIBGENS_TEST_CHECK(findTestNumbers(json, "skin").size() == 1);
+	LIBGENS_TEST_CHECK(joint_count == 3);
+
+	vector<size_t> inverse_bind_index=findTestNumbers(skin, "inverseBindMatrices");
+	LIBGENS_TEST_CHECK(inverse_bind_index.size() == 1);
+	if (inverse_bind_index.size() != 1) return;
+
+	vector<float> inverse_bind_matrices=readTestAccessor<float>(json, binary, inverse_bind_index[0], 16);
+	LIBGENS_TEST_CHECK(inverse_bind_matrices.size() == 3*16);
+
+	Matrix4 identity;
+	identity.makeTransform(Vector3(0.0f, 0.0f, 0.0f), Vector3(1.0f, 1.0f, 1.0f), Quaternion(1.0f, 0.0f, 0.0f, 0.0f));
+	Matrix4 world=identity;
+	for (size_t b=0; (b<3) && (inverse_bind_matrices.size() == 3*16); b++) {
+		SonicBone *bone=object.bones[b];
+		Matrix4 local;
+		local.makeTransform(bone->translation * unit_scale, bone->scale, bone->orientation);
+		world = world * local;
+
+		Matrix4 inverse_bind;
+		for (size_t r=0; r<4; r++) {
+			for (size_t c=0; c<4; c++) {
+				inverse_bind[r][c] = inverse_bind_matrices[b*16 + c*4 + r];
+			}
+		}
+		LIBGENS_TEST_CHECK(nearTestMatrix(inverse_bind * world, identity, 1e-4f));
+	}
+
+	// Influences go from skinning matrix indices to joints, with weights adding up to one
+	string primitive=findTestElement(json, "primitives", 0);
+	vector<size_t> position_index=findTestNumbers(primitive, "POSITION");
+	vector<size_t> joints_index=findTestNumbers(primitive, "JOINTS_0");
+	vector<size_t> weights_index=findTestNumbers(primitive, "WEIGHTS_0");
+	LIBGENS_TEST_CHECK(position_index.size() && joints_index.size() && weights_index.size());
+	if (!position_index.size() || !joints_index.size() || !weights_index.size()) return;
+
+	vector<float> positions=readTestAccessor<float>(json, binary, position_index[0], 3);
+	vector<unsigned short> vertex_joints=readTestAccessor<unsigned short>(json, binary, joints_index[0], 4);
+	vector<float> weights=readTestAccessor<float>(json, binary, weights_index[0], 4);
+	LIBGENS_TEST_CHECK(positions.size() == 18*3);
+	LIBGENS_TEST_CHECK((vertex_joints.size() == 18*4) && (weights.size() == 18*4));
+
+	for (size_t v=0; (v*3 < positions.size()) && (v*4 < vertex_joints.size()) && (v*4 < weights.size()); v++) {
+		size_t x=(size_t) (positions[v*3] / unit_scale + 0.5f);
+		float total=weights[v*4] + weights[v*4+1] + weights[v*4+2] + weights[v*4+3];
+		LIBGENS_TEST_CHECK(fabs(total - 1.0f) < 1e-5f);
+
+		if (x < 6) {
+			LIBGENS_TEST_CHECK((vertex_joints[v*4] == x/3) && (fabs(weights[v*4] - 0.75f) < 1e-5f));
+			LIBGENS_TEST_CHECK((vertex_joints[v*4+1] == x/3 + 1) && (fabs(weights[v*4+1] - 0.25f) < 1e-5f));
+		}
+		else LIBGENS_TEST_CHECK((vertex_joints[v*4] == 2) && (weights[v*4] == 1.0f));
+	}
+
+	// A translation, rotation and scale sampler per bone, each with a key per frame
+	string animation=findTestElement(json, "animations", 0);
+	LIBGENS_TEST_CHECK(findTestElement(animation, "samplers", 9).empty());
+	LIBGENS_TEST_CHECK(findTestElement(animation, "channels", 9).empty());
+
+	for (size_t i=0; i<9; i++) {
+		string sampler=findTestElement(animation, "samplers", i);
+		vector<size_t> input=findTestNumbers(sampler, "input");
+		vector<size_t> output=findTestNumbers(sampler, "output");
+		LIBGENS_TEST_CHECK(input.size() && output.size());
+		if (!input.size() || !output.size()) continue;
+
+		size_t components=((i % 3) == 1) ? 4 : 3;
+		vector<float> times=readTestAccessor<float>(json, binary, input[0], 1);
+		vector<float> values=readTestAccessor<float>(json, binary, output[0], components);
+		LIBGENS_TEST_CHECK((times.size() == 31) && (values.size() == 31*components));
+		if ((times.size() != 31) || (values.size() != 31*components)) continue;
+		LIBGENS_TEST_CHECK(fabs(times[30] - 1.0f) < 1e-5f);
+
+		// Root translations are in the exported scale
+		if (i == 0) {
+			LIBGENS_TEST_CHECK((fabs(values[0] - 2.0f) < 1e-4f) && (fabs(values[1] - 4.0f) < 1e-4f) && (fabs(values[2] - 6.0f) < 1e-4f));
+			LIBGENS_TEST_CHECK((fabs(values[90] - 8.0f) < 1e-4f) && (fabs(values[91] - 10.0f) < 1e-4f) && (fabs(values[92] - 12.0f) < 1e-4f));
+		}
+
+		// Rotations never jump to the other hemisphere, so the full turn ends on the negated start
+		if (components == 4) {
+			for (size_t f=1; f<31; f++) {
+				float dot=0.0f;
+				for (size_t k=0; k<4; k++) dot += values[(f-1)*4 + k] * values[f*4 + k];
+				LIBGENS_TEST_CHECK(dot >= 0.0f);
+			}
+
+			if (i == 4) {
+				float dot=0.0f;
+				for (size_t k=0; k<4; k++) dot += values[k] * values[30*4 + k];
+				LIBGENS_TEST_CHECK(dot < -0.999f);
+			}
+		}
+	}
+
+	motion.clearMotionControls();
+	clearTestSkinnedObject(object);
+}
+
+static void testWriter() {
+	// Without any data there's no buffer and no binary chunk
+	SonicGLBWriter empty;
+	LIBGENS_TEST_CHECK(empty.save("glb_empty.glb"));
+	checkGLBLayout(readTestFile("glb_empty.glb"), false);
+
+	// Views after odd sized data still start aligned, and the chunk gets padded with zeros
+	SonicGLBWriter writer;
+	unsigned char bytes[3]={ 1, 2, 3 };
+	float values[3]={ 1.0f, 2.0f, 3.0f };
+	LIBGENS_TEST_CHECK(writer.addAccessor(bytes, 3, LIBGENS_GLB_COMPONENT_UNSIGNED_BYTE, "SCALAR", LIBGENS_GLB_TARGET_NONE) == 0);
+	LIBGENS_TEST_CHECK(writer.addAccessor(values, 1, LIBGENS_GLB_COMPONENT_FLOAT, "VEC3", LIBGENS_GLB_TARGET_NONE) == 1);
+	LIBGENS_TEST_CHECK(writer.save("glb_accessors.glb"));
+
+	string data=readTestFile("glb_accessors.glb");
+	string json=checkGLBLayout(data, true);
+	vector<size_t> offsets=findTestNumbers(json, "byteOffset");
+	LIBGENS_TEST_CHECK((offsets.size() == 2) && (offsets[1] == 4));
+	if ((offsets.size() == 2) && (data.size() >= 44)) {
+		size_t binary=data.size() - 16;
+		LIBGENS_TEST_CHECK(data[binary + 3] == 0);
+		LIBGENS_TEST_CHECK(memcmp(data.c_str() + binary + 4, values, sizeof(values)) == 0);
+	}
+}
+
+static void testObjectRoundTrip() {
+	LIBGENS_TEST_CHECK(writeTestFile("glb_grid.gltf", buildTestGridGLTF(8)));
+	SonicXNFile file(MODE_XNO);
+	file.importGLTF("glb_grid.gltf");
+	LIBGENS_TEST_CHECK(file.getObject() != NULL);
+	if (!file.getObject()) return;
+
+	file.saveGLB("glb_grid.glb");
+	string json=checkGLBLayout(readTestFile("glb_grid.glb"), true);
+	LIBGENS_TEST_CHECK(json.find("\"meshes\"") != string::npos);
+	LIBGENS_TEST_CHECK(json.find("\"scene\":0") != string::npos);
+
+	// Importing the export gives back every face
+	SonicXNFile imported(MODE_XNO);
+	imported.importGLTF("glb_grid.glb");
+	SonicXNObject *object=imported.getObject();
+	LIBGENS_TEST_CHECK(object != NULL);
+	if (!object) return;
+
+	size_t count=0;
+	for (size_t i=0; i<object->index_tables.size(); i++) {
+		count += object->index_tables[i]->indices_vector.size();
+	}
+	LIBGENS_TEST_CHECK(count == 8*8*2);
+}
+
+int main(int argc, char** argv) {
+	testWriter();
+	testObjectRoundTrip();
+	testSkinnedAnimation();
+
+	return LIBGENS_TEST_RESULT;
+}
@@ -0,0 +1,341 @@
+//=========================================================================
+//	  Copyright (c) 2016 SonicGLvl
+//
+//    This file is part of SonicGLvl, a community-created free level editor 
+//    for the PC version of Sonic Generations.
+//
+//    SonicGLvl is free software: you can redistribute it and/or modify
+//    it under the terms of the GNU General Public License as published by
+//    the Free Software Foundation, either version 3 of the License, or
+//    (at your option) any later version.
+//
+//    SonicGLvl is distributed in the hope that it will be useful,
+//    but WITHOUT ANY WARRANTY; without even the implied warranty of
+//    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+//    
+//
+//    Read AUTHORS.txt, LICENSE.txt and COPYRIGHT.txt for more details.
+//=========================================================================
+
+
+#include "S06Test.h"
+#include "S06Set.h"
+#include <algorithm>
+#include <set>
+
+using namespace LibGens;
+
+static unsigned int test_seed=12345;
+
+static float randomTestFloat(float minimum, float maximum) {
+	test_seed = test_seed*1664525 + 1013904223;
+	return minimum + (maximum - minimum) * ((test_seed >> 8) / 16777216.0f);
+}
+
+static void putTestInt32BE(string &data, size_t address, unsigned int value) {
+	if (data.size() < address+4) data.resize(address+4, 0);
+	data[address]   = (char)(value >> 24);
+	data[address+1] = (char)(value >> 16);
+	data[address+2] = (char)(value >> 8);
+	data[address+3] = (char)value;
+}
+
+static void putTestFloat32BE(string &data, size_t address, float value) {
+	unsigned int bits=0;
+	memcpy(&bits, &value, 4);
+	putTestInt32BE(data, address, bits);
+}
+
+// Addresses inside set files are relative to the end of the 32 byte header
+static void putTestAddress(string &data, size_t address, size_t target) {
+	putTestInt32BE(data, address, target - 32);
+}
+
+// A set of objects named obj<i> on a line along X, alternating between two types. Each one has a string,
+// a float and a vector parameter derived from its number, so they can be checked after moving around.
+static string buildTestSet(size_t object_count) {
+	const size_t parameter_count=3;
+
+	string data(96, 0);
+	data.replace(44, 4, "test");
+	putTestInt32BE(data, 76, object_count);
+	putTestAddress(data, 80, 96);
+
+	size_t parameter_table=96 + object_count*64;
+	size_t string_table=parameter_table + object_count*parameter_count*20;
+
+	string strings="";
+	for (size_t i=0; i<object_count; i++) {
+		size_t object=96 + i*64;
+		size_t name=string_table + strings.size();
+		strings += "obj" + ToString(i) + string(1, '\0');
+		size_t type=string_table + strings.size();
+		strings += string((i%2) ? "spring" : "ring") + string(1, '\0');
+		size_t target=string_table + strings.size();
+		strings += "target" + ToString(i%5) + string(1, '\0');
+
+		putTestAddress(data, object, name);
+		putTestAddress(data, object+4, type);
+		putTestFloat32BE(data, object+24, i*10.0f);
+		putTestFloat32BE(data, object+48, 1.0f);
+		putTestInt32BE(data, object+56, parameter_count);
+		putTestAddress(data, object+60, parameter_table + i*parameter_count*20);
+
+		size_t parameter=parameter_table + i*parameter_count*20;
+		putTestInt32BE(data, parameter, LIBGENS_S06_SET_PARAMETER_STRING);
+		putTestAddress(data, parameter+4, target);
+		putTestInt32BE(data, parameter+20, LIBGENS_S06_SET_PARAMETER_FLOAT);
+		putTestFloat32BE(data, parameter+24, i*0.5f);
+		putTestInt32BE(data, parameter+40, LIBGENS_S06_SET_PARAMETER_VECTOR3);
+		putTestFloat32BE(data, parameter+44, (float)i);
+		putTestFloat32BE(data, parameter+48, i*2.0f);
+		putTestFloat32BE(data, parameter+52, i*3.0f);
+	}
+
+	data.resize(string_table);
+	data += strings;
+	data.resize((data.size() + 3) & ~(size_t)3, 0);
+	putTestAddress(data, 4, data.size());
+	putTestInt32BE(data, 0, data.size());
+	return data;
+}
+
+static bool checkParameters(SonicSetObject *object, size_t i) {
+	SonicSetParameterSpan parameters=object->getParameters();
+	if (parameters.size() != 3) return false;
+	if (parameters.getValueString(0) != ("target" + ToString(i%5))) return false;
+	if (parameters[1].getValueFloat() != i*0.5f) return false;
+
+	Vector3 v=parameters[2].getValueVector();
+	return (v.x == (float)i) && (v.y == i*2.0f) && (v.z == i*3.0f);
+}
+
+static size_t objectNumber(SonicSetObject *object) {
+	return atoi(object->getName().c_str() + 3);
+}
+
+static bool checkSet(SonicSet &set, size_t object_count) {
+	const vector<SonicSetObject *> &objects=set.getObjects();
+	if (objects.size() != object_count) return false;
+
+	for (size_t i=0; i<objects.size(); i++) {
+		if (!checkParameters(objects[i], objectNumber(objects[i]))) return false;
+	}
+	return true;
+}
+
+static void testParameterLifetime() {
+	LIBGENS_TEST_CHECK(writeTestFile("set_parameters.set", buildTestSet(64)));
+	SonicSet set("set_parameters.set");
+	LIBGENS_TEST_CHECK(checkSet(set, 64));
+	if (set.getObjects().size() != 64) return;
+
+	vector<SonicSetObject *> objects=set.getObjects();
+	SonicSetParameterPool *pool=objects[0]->getParameterPool();
+	size_t pool_size=pool->size();
+
+	// Clones start with their own parameters and don't grow the set's pool
+	SonicSetObject *clone=new SonicSetObject(objects[7]);
+	LIBGENS_TEST_CHECK(clone->getParameterPool() != pool);
+	LIBGENS_TEST_CHECK(pool->size() == pool_size);
+	LIBGENS_TEST_CHECK(checkParameters(clone, 7));
+
+	// Removed objects keep their parameters after the set deletes its own
+	SonicSetObject *removed=objects[3];
+	set.removeObject(removed);
+	vector<SonicSetObject *> removed_objects(objects.begin()+8, objects.begin()+48);
+	set.removeObjects(removed_objects);
+	LIBGENS_TEST_CHECK(removed->getParameterPool() != pool);
+	LIBGENS_TEST_CHECK(checkParameters(removed, 3));
+	LIBGENS_TEST_CHECK(checkSet(set, 23));
+
+	// Most of the pool was unused, so it got compacted
+	LIBGENS_TEST_CHECK(pool->size() == 23*3);
+
+	set.addObject(clone);
+	set.addObject(removed);
+	LIBGENS_TEST_CHECK(clone->getParameterPool() == pool);
+	LIBGENS_TEST_CHECK(checkSet(set, 25));
+
+	set.save("set_parameters_saved.set");
+	set.deleteObjects();
+
+	for (size_t i=0; i<removed_objects.size(); i++) {
+		LIBGENS_TEST_CHECK(checkParameters(removed_objects[i], i+8));
+		delete removed_objects[i];
+	}
+
+	SonicSet saved("set_parameters_saved.set");
+	LIBGENS_TEST_CHECK(checkSet(saved, 25));
+	saved.deleteObjects();
+}
+
+static void testRenaming() {
+	LIBGENS_TEST_CHECK(writeTestFile("set_names.set", buildTestSet(8)));
+	SonicSet set("set_names.set");
+	if (set.getObjects().size() != 8) return;
+
+	SonicSetObject *object=set.getObject("obj2");
+	LIBGENS_TEST_CHECK(object != NULL);
+	set.renameObject(object, "renamed");
+	LIBGENS_TEST_CHECK(set.getObject("obj2") == NULL);
+	LIBGENS_TEST_CHECK(set.getObject("renamed") == object);
+
+	// Objects outside of the set don't show up in its index
+	SonicSetObject *clone=new SonicSetObject(object);
+	set.renameObject(clone, "clone");
+	LIBGENS_TEST_CHECK(clone->getName() == "clone");
+	LIBGENS_TEST_CHECK(set.getObject("clone") == NULL);
+	LIBGENS_TEST_CHECK(set.getObjectsByName("renamed").size() == 1);
+
+	set.addObject(clone);
+	LIBGENS_TEST_CHECK(set.getObject("clone") == clone);
+
+	// Duplicates get the first free name of their type
+	set.renameObject(clone, "obj0");
+	set.fixDuplicateNames();
+	LIBGENS_TEST_CHECK(set.getObjectsByName("obj0").size() == 1);
+	LIBGENS_TEST_CHECK(set.getObject("ring0") == clone);
+	set.deleteObjects();
+}
+
+static bool sameObjects(vector<SonicSetObject *> results, vector<SonicSetObject *> expected) {
+	std::sort(results.begin(), results.end());
+	std::sort(expected.begin(), expected.end());
+	return results == expected;
+}
+
+static float sphereDistance(SonicSetIndex *index, SonicSetObject *object, const Vector3 &point) {
+	Vector3 p=object->getPosition();
+	float x=p.x-point.x, y=p.y-point.y, z=p.z-point.z;
+	return std::max((float)sqrt(x*x + y*y + z*z) - index->getRadius(object), 0.0f);
+}
+
+// Every query of the index against a brute force pass over the set's objects, while objects move,
+// leave and join the set between queries
+static void testIndexQueries() {
+	LIBGENS_TEST_CHECK(writeTestFile("set_index.set", buildTestSet(600)));
+	SonicSet set("set_index.set");
+	if (set.getObjects().size() != 600) return;
+
+	SonicSetIndex *index=set.getIndex();
+	index->setDefaultRadius(5.0f);
+	index->setTypeRadius("spring", 40.0f);
+	LIBGENS_TEST_CHECK(index->size() == 600);
+
+	vector<SonicSetObject *> all=set.getObjects();
+	for (size_t i=0; i<all.size(); i++) {
+		set.moveObject(all[i], Vector3(randomTestFloat(-1000.0f, 1000.0f), randomTestFloat(-200.0f, 200.0f), randomTestFloat(-1000.0f, 1000.0f)));
+	}
+
+	vector<SonicSetObject *> removed;
+	vector<SonicSetObject *> results;
+	vector<SonicSetObject *> expected;
+	for (size_t iteration=0; iteration<200; iteration++) {
+		for (size_t m=0; m<10; m++) {
+			SonicSetObject *object=all[(size_t)randomTestFloat(0.0f, (float)all.size()) % all.size()];
+			float step=(m%2) ? 2.0f : 300.0f;
+			set.moveObject(object, object->getPosition() + Vector3(randomTestFloat(-step, step), randomTestFloat(-step, step), randomTestFloat(-step, step)));
+		}
+
+		if ((iteration%3) == 0) {
+			SonicSetObject *object=set.getObjects()[(size_t)randomTestFloat(0.0f, (float)set.getObjects().size()) % set.getObjects().size()];
+			set.removeObject(object);
+			removed.push_back(object);
+		}
+		else if (((iteration%3) == 1) && !removed.empty()) {
+			set.addObject(removed.back());
+			removed.pop_back();
+		}
+
+		if (iteration == 100) index->setTypeRadius("ring", 8.0f);
+
+		const vector<SonicSetObject *> &objects=set.getObjects();
+		LIBGENS_TEST_CHECK(index->size() == objects.size());
+
+		Vector3 center(randomTestFloat(-1000.0f, 1000.0f), randomTestFloat(-200.0f, 200.0f), randomTestFloat(-1000.0f, 1000.0f));
+		float radius=randomTestFloat(0.0f, 250.0f);
+
+		results.clear();
+		expected.clear();
+		index->querySphere(center, radius, results);
+		for (size_t i=0; i<objects.size(); i++) {
+			Vector3 p=objects[i]->getPosition();
+			float x=p.x-center.x, y=p.y-center.y, z=p.z-center.z;
+			float reach=radius + index->getRadius(objects[i]);
+			if (x*x + y*y + z*z <= reach * reach) expected.push_back(objects[i]);
+		}
+		LIBGENS_TEST_CHECK(sameObjects(results, expected));
+
+		float box_min[3]={ center.x-radius, center.y-radius, center.z-radius };
+		float box_max[3]={ center.x+radius, center.y+radius*2.0f, center.z+radius };
+		results.clear();
+		expected.clear();
+		index->queryBox(Vector3(box_min[0], box_min[1], box_min[2]), Vector3(box_max[0], box_max[1], box_max[2]), results);
+		for (size_t i=0; i<objects.size(); i++) {
+			Vector3 p=objects[i]->getPosition();
+			float point[3]={ p.x, p.y, p.z };
+			float distance=0.0f;
+			for (size_t k=0; k<3; k++) {
+				float d=(point[k] < box_min[k]) ? box_min[k]-point[k] : ((point[k] > box_max[k]) ? point[k]-box_max[k] : 0.0f);
+				distance += d*d;
+			}
+
+			float object_radius=index->getRadius(objects[i]);
+			if (distance <= object_radius * object_radius) expected.push_back(objects[i]);
+		}
+		LIBGENS_TEST_CHECK(sameObjects(results, expected));
+
+		// The same box as planes facing inwards, which also keeps spheres poking out of its corners
+		float planes[6][4]={
+			{ 1.0f, 0.0f, 0.0f, -box_min[0] }, { -1.0f, 0.0f, 0.0f, box_max[0] },
+			{ 0.0f, 1.0f, 0.0f, -box_min[1] }, { 0.0f, -1.0f, 0.0f, box_max[1] },
+			{ 0.0f, 0.0f, 1.0f, -box_min[2] }, { 0.0f, 0.0f, -1.0f, box_max[2] }
+		};
+		results.clear();
+		expected.clear();
+		index->queryFrustum(planes, results);
+		for (size_t i=0; i<objects.size(); i++) {
+			Vector3 p=objects[i]->getPosition();
+			bool outside=false;
+			for (size_t k=0; k<6; k++) {
+				if (planes[k][0]*p.x + planes[k][1]*p.y + planes[k][2]*p.z + planes[k][3] < -index->getRadius(objects[i])) outside = true;
+			}
+			if (!outside) expected.push_back(objects[i]);
+		}
+		LIBGENS_TEST_CHECK(sameObjects(results, expected));
+
+		// Nearest objects come back in order, at the same distances as the closest ones found by brute force
+		vector<float> distances;
+		for (size_t i=0; i<objects.size(); i++) {
+			distances.push_back(sphereDistance(index, objects[i], center));
+		}
+		std::sort(distances.begin(), distances.end());
+
+		results.clear();
+		index->queryNearest(center, 10, results);
+		LIBGENS_TEST_CHECK(results.size() == 10);
+		for (size_t i=0; (i<results.size()) && (i<distances.size()); i++) {
+			float distance=sphereDistance(index, results[i], center);
+			LIBGENS_TEST_CHECK(fabs(distance - distances[i]) <= 0.01f);
+		}
+
+		size_t within=std::upper_bound(distances.begin(), distances.end(), 50.0f) - distances.begin();
+		results.clear();
+		index->queryNearest(center, objects.size(), results, 50.0f);
+		LIBGENS_TEST_CHECK(results.size() == within);
+	}
+
+	set.deleteObjects();
+	for (size_t i=0; i<removed.size(); i++) {
+		delete removed[i];
+	}
+}
+
+int main(int argc, char** argv) {
+	testParameterLifetime();
+	testRenaming();
+	testIndexQueries();
+
+	return LIBGENS_TEST_RESULT;
+}
@@ -0,0 +1,123 @@
+//=========================================================================
+//	  Copyright (c) 2016 SonicGLvl
+//
+//    This file is part of SonicGLvl, a community-created free level editor 
+//    for the PC version of Sonic Generations.
+//
+//    SonicGLvl is free software: you can redistribute it and/or modify
+//    it under the terms of the GNU General Public License as published by
+//    the Free Software Foundation, either version 3 of the License, or
+//    (at your option) any later version.
+//
+//    SonicGLvl is distributed in the hope that it will be useful,
+//    but WITHOUT ANY WARRANTY; without even the implied warranty of
+//    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+//    
+//
+//    Read AUTHORS.txt, LICENSE.txt and COPYRIGHT.txt for more details.
+//=========================================================================
+
+#pragma once
+
+#include "LibGens.h"
+
+// Shared checks and fixtures of the tests. Every test is its own executable, so the helpers are
+// static and the failure count is reported by returning LIBGENS_TEST_RESULT from main.
+static int test_failures=0;
+
+#define LIBGENS_TEST_CHECK(condition) \
+	if (!(condition)) { \
+		printf("%s:%d: check failed: %s\n", __FILE__, __LINE__, #condition); \
+		test_failures++; \
+	}
+
+#define LIBGENS_TEST_RESULT (test_failures ? 1 : 0)
+
+static string encodeTestBase64(const void *data, size_t size) {
+	const char *alphabet="ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz0123456789+/";
+	const unsigned char *bytes=(const unsigned char *) data;
+	string text="";
+
+	for (size_t i=0; i<size; i+=3) {
+		unsigned int bits=bytes[i] << 16;
+		if (i+1 < size) bits |= bytes[i+1] << 8;
+		if (i+2 < size) bits |= bytes[i+2];
+
+		text += alphabet[(bits >> 18) & 63];
+		text += alphabet[(bits >> 12) & 63];
+		text += (i+1 < size) ? alphabet[(bits >> 6) & 63] : '=';
+		text += (i+2 < size) ? alphabet[bits & 63] : '=';
+	}
+
+	return text;
+}
+
+static bool writeTestFile(const string &filename, const string &text) {
+	FILE *file=fopen(filename.c_str(), "wb");
+	if (!file) return false;
+
+	fwrite(text.c_str(), 1, text.size(), file);
+	fclose(file);
+	return true;
+}
+
+static string readTestFile(const string &filename) {
+	string text="";
+	FILE *file=fopen(filename.c_str(), "rb");
+	if (!file) return text;
+
+	char buffer[4096];
+	size_t read=0;
+	while ((read = fread(buffer, 1, sizeof(buffer), file)) > 0) text.append(buffer, read);
+	fclose(file);
+	return text;
+}
+
+// A size by size grid of quads on the XZ plane with a smooth bump in the middle, so simplification
+// has both flat and curved areas to work with. Positions are xyz floats, indices a triangle list.
+static void buildTestGrid(size_t size, vector<float> &positions, vector<unsigned short> &indices) {
+	for (size_t z=0; z<=size; z++) {
+		for (size_t x=0; x<=size; x++) {
+			float dx=(float) x - size*0.5f;
+			float dz=(float) z - size*0.5f;
+			positions.push_back((float) x);
+			positions.push_back(size*0.25f * exp(-(dx*dx + dz*dz) / (size*size*0.05f)));
+			positions.push_back((float) z);
+		}
+	}
+
+	for (size_t z=0; z<size; z++) {
+		for (size_t x=0; x<size; x++) {
+			unsigned short a=z*(size+1) + x;
+			unsigned short b=a + 1;
+			unsigned short c=a + size + 1;
+			unsigned short d=c + 1;
+			unsigned short quad[6]={ a, c, b, b, c, d };
+			indices.insert(indices.end(), quad, quad+6);
+		}
+	}
+}
+
+// glTF file with the grid as a single mesh, its buffer embedded as a data URI
+static string buildTestGridGLTF(size_t size) {
+	vector<float> positions;
+	vector<unsigned short> indices;
+	buildTestGrid(size, positions, indices);
+
+	size_t positions_size=positions.size() * sizeof(float);
+	size_t indices_size=indices.size() * sizeof(unsigned short);
+	vector<unsigned char> buffer(positions_size + indices_size);
+	memcpy(&buffer[0], &positions[0], positions_size);
+	memcpy(&buffer[positions_size], &indices[0], indices_size);
+
+	float maximum=(float) size;
+	string json="{\"asset\":{\"version\":\"2.0\"},\"scene\":0,\"scenes\":[{\"nodes\":[0]}],\"nodes\":[{\"mesh\":0,\"name\":\"Grid\"}],";
+	json += "\"meshes\":[{\"name\":\"Grid\",\"primitives\":[{\"attributes\":{\"POSITION\":0},\"indices\":1}]}],";
+	json += "\"accessors\":[{\"bufferView\":0,\"componentType\":5126,\"count\":" + ToString(positions.size()/3) + ",\"type\":\"VEC3\",";
+	json += "\"min\":[0,0,0],\"max\":[" + ToString(maximum) + "," + ToString(maximum) + "," + ToString(maximum) + "]},";
+	json += "{\"bufferView\":1,\"componentType\":5123,\"count\":" + ToString(indices.size()) + ",\"type\":\"SCALAR\"}],";
+	json += "\"bufferViews\":[{\"buffer\":0,\"byteOffset\":0,\"byteLength\":" + ToString(positions_size) + "},";
+	json += "{\"buffer\":0,\"byteOffset\":" + ToString(positions_size) + ",\"byteLength\":" + ToString(indices_size) + "}],";
+	json += "\"buffers\":[{\"byteLength\":" + ToString(buffer.size()) + ",\"uri\":\"data:application/octet-stream;base64," + encodeTestBase64(&buffer[0], buffer.size()) + "\"}]}";
+	return json;
+}
@@ -0,0 +1,114 @@
+//=========================================================================
+//	  Copyright (c) 2016 SonicGLvl
+//
+//    This file is part of SonicGLvl, a community-created free level editor 
+//    for the PC version of Sonic Generations.
+//
+//    SonicGLvl is free software: you can redistribute it and/or modify
+//    it under the terms of the GNU General Public License as published by
+//    the Free Software Foundation, either version 3 of the License, or
+//    (at your option) any later version.
+//
+//    SonicGLvl is distributed in the hope that it will be useful,
+//    but WITHOUT ANY WARRANTY; without even the implied warranty of
+//    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+//    
+//
+//    Read AUTHORS.txt, LICENSE.txt and COPYRIGHT.txt for more details.
+//=========================================================================
+
+
+#include "S06Test.h"
+#include "S06Common.h"
+#include "S06Text.h"
+
+using namespace LibGens;
+
+static vector<unsigned char> encodeTestText(const string &value) {
+	vector<unsigned char> units;
+	SonicUnicode::encodeUTF16BE(value, units);
+	return units;
+}
+
+static string decodeTestText(const vector<unsigned char> &units, size_t *read=NULL) {
+	string value="";
+	size_t count=SonicUnicode::decodeUTF16BE(units.size() ? &units[0] : NULL, units.size()/2, value);
+	if (read) *read = count;
+	return value;
+}
+
+static bool sameUnits(const vector<unsigned char> &units, const unsigned char *expected, size_t size) {
+	return (units.size() == size) && !memcmp(&units[0], expected, size);
+}
+
+static void testKnownUnits() {
+	const unsigned char ascii[]={ 0x00, 'A', 0x00, 'b' };
+	LIBGENS_TEST_CHECK(sameUnits(encodeTestText("Ab"), ascii, sizeof(ascii)));
+
+	const unsigned char latin[]={ 0x00, 0xE9 };
+	LIBGENS_TEST_CHECK(sameUnits(encodeTestText("\xC3\xA9"), latin, sizeof(latin)));
+
+	const unsigned char kana[]={ 0x30, 0xBD, 0x30, 0xCB, 0x30, 0xC3, 0x30, 0xAF };
+	LIBGENS_TEST_CHECK(sameUnits(encodeTestText("\xE3\x82\xBD\xE3\x83\x8B\xE3\x83\x83\xE3\x82\xAF"), kana, sizeof(kana)));
+
+	const unsigned char emoji[]={ 0xD8, 0x3D, 0xDE, 0x00 };
+	LIBGENS_TEST_CHECK(sameUnits(encodeTestText("\xF0\x9F\x98\x80"), emoji, sizeof(emoji)));
+
+	// Malformed UTF-8 becomes one replacement per bad byte
+	const unsigned char replaced[]={ 0xFF, 0xFD, 0x00, 'x', 0xFF, 0xFD };
+	LIBGENS_TEST_CHECK(sameUnits(encodeTestText("\xFFx\xC3"), replaced, sizeof(replaced)));
+
+	// Lone surrogates decode to U+FFFD
+	vector<unsigned char> lone={ 0xD8, 0x3D, 0x00, 'a', 0xDE, 0x00 };
+	LIBGENS_TEST_CHECK(decodeTestText(lone) == "\xEF\xBF\xBD" "a" "\xEF\xBF\xBD");
+}
+
+// Every block boundary and every position of a non-ASCII character or a null in a long run
+static void testBlocks() {
+	string run="Sonic the Hedgehog and Miles Tails Prower went to Kingdom Valley";
+	for (size_t position=0; position<run.size(); position++) {
+		string value=run.substr(0, position) + "\xC3\xA9" + run.substr(position);
+		vector<unsigned char> units=encodeTestText(value);
+		LIBGENS_TEST_CHECK(units.size() == (run.size() + 1) * 2);
+		LIBGENS_TEST_CHECK(units[position*2] == 0x00);
+		LIBGENS_TEST_CHECK(units[position*2+1] == 0xE9);
+		LIBGENS_TEST_CHECK(decodeTestText(units) == value);
+
+		vector<unsigned char> terminated=encodeTestText(run);
+		terminated[position*2] = terminated[position*2+1] = 0;
+		size_t read=0;
+		LIBGENS_TEST_CHECK(decodeTestText(terminated, &read) == run.substr(0, position));
+		LIBGENS_TEST_CHECK(read == position);
+	}
+
+	for (size_t length=0; length<=run.size(); length++) {
+		string value=run.substr(0, length);
+		LIBGENS_TEST_CHECK(decodeTestText(encodeTestText(value)) == value);
+	}
+}
+
+// Texts written by SonicText read back with the same entries and values
+static void testTextFile() {
+	SonicText text;
+	text.setName("test");
+	text.insertEntry("msg_hint_001", "Sonic the Hedgehog is running through Kingdom Valley");
+	text.insertEntry("msg_hint_002", "\xE3\x82\xBD\xE3\x83\x8B\xE3\x83\x83\xE3\x82\xAF \xF0\x9F\x98\x80 caf\xC3\xA9");
+	text.insertEntry("msg_hint_003", "");
+	text.save("S06TextTest.mst");
+
+	SonicText loaded("S06TextTest.mst");
+	LIBGENS_TEST_CHECK(loaded.getEntries().size() == 3);
+	for (size_t i=0; i<text.getEntries().size(); i++) {
+		SonicTextEntry *entry=text.getEntries()[i];
+		SonicTextEntry *loaded_entry=loaded.getEntry(entry->getID());
+		LIBGENS_TEST_CHECK(loaded_entry != NULL);
+		if (loaded_entry) LIBGENS_TEST_CHECK(loaded_entry->getValue() == entry->getValue());
+	}
+}
+
+int main(int argc, char** argv) {
+	testKnownUnits();
+	testBlocks();
+	testTextFile();
+	return LIBGENS_TEST_RESULT;
+}
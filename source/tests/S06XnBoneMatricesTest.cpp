@@ -0,0 +1,230 @@
+//=========================================================================
+//	  Copyright (c) 2016 SonicGLvl
+//
+//    This file is part of SonicGLvl, a community-created free level editor 
+//    for the PC version of Sonic Generations.
+//
+//    SonicGLvl is free software: you can redistribute it and/or modify
+//    it under the terms of the GNU General Public License as published by
+//    the Free Software Foundation, either version 3 of the License, or
+//    (at your option) any later version.
+//
+//    SonicGLvl is distributed in the hope that it will be useful,
+//    but WITHOUT ANY WARRANTY; without even the implied warranty of
+//    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+//    
+//
+//    Read AUTHORS.txt, LICENSE.txt and COPYRIGHT.txt for more details.
+//=========================================================================
+
+
+#include "S06Test.h"
+#include "S06XnFile.h"
+
+using namespace LibGens;
+
+static unsigned int test_seed=12345;
+
+static float randomTestFloat(float minimum, float maximum) {
+	test_seed = test_seed*1664525 + 1013904223;
+	return minimum + (maximum - minimum) * ((test_seed >> 8) / 16777216.0f);
+}
+
+static Quaternion randomTestOrientation() {
+	float x=randomTestFloat(-1.0f, 1.0f), y=randomTestFloat(-1.0f, 1.0f), z=randomTestFloat(-1.0f, 1.0f), w=randomTestFloat(-1.0f, 1.0f);
+	float length=sqrt(x*x + y*y + z*z + w*w);
+	return Quaternion(w/length, x/length, y/length, z/length);
+}
+
+static bool nearTestMatrix(const Matrix4 &a, const Matrix4 &b, float epsilon) {
+	for (size_t r=0; r<4; r++) {
+		for (size_t c=0; c<4; c++) {
+			if (fabs(a[r][c] - b[r][c]) > epsilon * std::max(1.0f, (float) fabs(b[r][c]))) return false;
+		}
+	}
+	return true;
+}
+
+// Bones in scrambled order, each parented to a random earlier one in the tree, with a few extra roots
+static void buildTestSkeleton(SonicXNObject &object, size_t count) {
+	vector<unsigned short> slots;
+	for (size_t i=0; i<count; i++) {
+		slots.push_back((i * 7) % count);
+		object.bones.push_back(new SonicBone());
+	}
+
+	for (size_t i=0; i<count; i++) {
+		SonicBone *bone=object.bones[slots[i]];
+		bone->matrix_index = slots[i];
+		if (i && (i % 11)) bone->parent_index = slots[(size_t) randomTestFloat(0.0f, (float) i)];
+
+		Vector3 translation(randomTestFloat(-5.0f, 5.0f), randomTestFloat(-5.0f, 5.0f), randomTestFloat(-5.0f, 5.0f));
+		Vector3 scale(randomTestFloat(0.5f, 2.0f), randomTestFloat(0.5f, 2.0f), randomTestFloat(0.5f, 2.0f));
+		bone->setTransform(translation, randomTestOrientation(), scale);
+	}
+}
+
+static void clearTestSkeleton(SonicXNObject &object) {
+	for (size_t i=0; i<object.bones.size(); i++) {
+		delete object.bones[i];
+	}
+	object.bones.clear();
+}
+
+static Matrix4 worldTestMatrix(SonicXNObject &object, size_t b) {
+	SonicBone *bone=object.bones[b];
+	if (bone->parent_index >= object.bones.size()) return bone->current_matrix;
+	return worldTestMatrix(object, bone->parent_index) * bone->current_matrix;
+}
+
+static void testSkinningMatrices() {
+	SonicXNObject object(NULL, NULL, NULL);
+	buildTestSkeleton(object, 37);
+	object.calculateSkinningMatrices();
+
+	Matrix4 identity;
+	identity.makeTransform(Vector3(0.0f, 0.0f, 0.0f), Vector3(1.0f, 1.0f, 1.0f), Quaternion(1.0f, 0.0f, 0.0f, 0.0f));
+
+	// Every bone's stored matrix undoes the world matrix of its bind pose
+	for (size_t b=0; b<object.bones.size(); b++) {
+		Matrix4 product=object.bones[b]->matrix.transpose() * worldTestMatrix(object, b);
+		LIBGENS_TEST_CHECK(nearTestMatrix(product, identity, 1e-3f));
+	}
+
+	clearTestSkeleton(object);
+}
+
+// Translation keys on every third bone, angle keys on every fourth and scale keys on every fifth
+static void buildTestMotion(SonicXNMotion &motion, size_t bone_count) {
+	for (size_t b=0; b<bone_count; b++) {
+		if ((b % 3) == 0) {
+			SonicMotionControl *control=new SonicMotionControl();
+			control->bone_index = b;
+			control->type = LIBGENS_XNMOTION_TYPE_COORDINATES_LINEAR;
+			control->element_size = 16;
+			control->key_frames.push_back(0.0f);
+			control->key_frames.push_back(10.0f);
+			control->key_values_floats.push_back(Vector3(randomTestFloat(-5.0f, 5.0f), randomTestFloat(-5.0f, 5.0f), 0.0f));
+			control->key_values_floats.push_back(Vector3(randomTestFloat(-5.0f, 5.0f), 0.0f, randomTestFloat(-5.0f, 5.0f)));
+			motion.pushMotionControl(control);
+		}
+
+		if ((b % 4) == 0) {
+			SonicMotionControl *control=new SonicMotionControl();
+			control->bone_index = b;
+			control->type = LIBGENS_XNMOTION_TYPE_Y_ANGLE_LINEAR;
+			control->element_size = 4;
+			control->key_frames.push_back(0.0f);
+			control->key_frames.push_back(10.0f);
+			control->key_values_int.push_back((unsigned short) randomTestFloat(0.0f, 65535.0f));
+			control->key_values_int.push_back((unsigned short) randomTestFloat(0.0f, 65535.0f));
+			motion.pushMotionControl(control);
+		}
+
+		if ((b % 5) == 0) {
+			SonicMotionControl *control=new SonicMotionControl();
+			control->bone_index = b;
+			control->type = LIBGENS_XNMOTION_TYPE_X_SCALE_LINEAR;
+			control->element_size = 8;
+			control->key_frames.push_back(0.0f);
+			control->key_frames.push_back(10.0f);
+			control->key_values.push_back(randomTestFloat(0.5f, 2.0f));
+			control->key_values.push_back(randomTestFloat(0.5f, 2.0f));
+			motion.pushMotionControl(control);
+		}
+	}
+}
+
+// Matrix4 math bone by bone, through the parent chain
+static void checkTestPose(SonicXNObject &object, SonicXNMotion &motion, float frame, float unit_scale) {
+	SonicXNPose pose(&motion, &object);
+	pose.evaluate(frame, unit_scale);
+
+	SonicXNPose reference(&motion, &object);
+	vector<Matrix4> locals(object.bones.size());
+	for (size_t b=0; b<object.bones.size(); b++) {
+		locals[b] = reference.evaluateBone(b, frame, unit_scale);
+	}
+
+	for (size_t b=0; b<object.bones.size(); b++) {
+		Matrix4 world=locals[b];
+		for (unsigned short p=object.bones[b]->parent_index; p<object.bones.size(); p=object.bones[p]->parent_index) {
+			world = locals[p] * world;
+		}
+
+		LIBGENS_TEST_CHECK(nearTestMatrix(pose.local_matrices.get(b), locals[b], 1e-5f));
+		LIBGENS_TEST_CHECK(nearTestMatrix(pose.world_matrices.get(b), world, 1e-3f));
+	}
+}
+
+static void testPose() {
+	SonicXNObject object(NULL, NULL, NULL);
+	buildTestSkeleton(object, 23);
+
+	SonicXNMotion motion;
+	buildTestMotion(motion, object.bones.size());
+
+	// Sorted by the pose itself, then through the object's hierarchy
+	checkTestPose(object, motion, 4.5f, 2.0f);
+	object.buildBoneHierarchy();
+	checkTestPose(object, motion, 7.25f, 1.0f);
+
+	motion.clearMotionControls();
+	clearTestSkeleton(object);
+}
+
+static void testMatrixKernels() {
+	// Counts around the vector width take both the SSE and the one by one paths
+	for (size_t count=1; count<=9; count++) {
+		SonicBoneMatrices locals, worlds, inverses;
+		locals.resize(count);
+		worlds.resize(count);
+
+		vector<Matrix4> expected(count);
+		vector<unsigned short> parents(count, 0xFFFF);
+		vector<unsigned short> level;
+		for (size_t i=0; i<count; i++) {
+			Matrix4 m;
+			m.makeTransform(Vector3(randomTestFloat(-5.0f, 5.0f), 1.0f, 2.0f), Vector3(1.0f, randomTestFloat(0.5f, 2.0f), 1.0f), randomTestOrientation());
+			locals.set(i, m);
+
+			// The first bone is the root of all the others, which form a single level
+			if (i) {
+				parents[i] = 0;
+				level.push_back(i);
+			}
+			expected[i] = i ? expected[0] * m : m;
+		}
+
+		unsigned short root=0;
+		worlds.concatenate(locals, parents, &root, 1);
+		if (level.size()) worlds.concatenate(locals, parents, level.data(), level.size());
+		worlds.invert(inverses);
+
+		for (size_t i=0; i<count; i++) {
+			LIBGENS_TEST_CHECK(nearTestMatrix(worlds.get(i), expected[i], 1e-4f));
+			LIBGENS_TEST_CHECK(nearTestMatrix(inverses.get(i), expected[i].inverseAffine(), 1e-3f));
+		}
+	}
+
+	// Singular matrices invert to zero instead of infinities
+	SonicBoneMatrices singular, inverses;
+	singular.resize(5);
+	for (size_t k=0; k<12; k++) {
+		singular.elements[k].assign(5, 0.0f);
+	}
+	singular.invert(inverses);
+	for (size_t k=0; k<12; k++) {
+		for (size_t i=0; i<5; i++) {
+			LIBGENS_TEST_CHECK(inverses.elements[k][i] == 0.0f);
+		}
+	}
+}
+
+int main(int argc, char** argv) {
+	testSkinningMatrices();
+	testMatrixKernels();
+	testPose();
+
+	return LIBGENS_TEST_RESULT;
+}
@@ -0,0 +1,76 @@
+//=========================================================================
+//	  Copyright (c) 2016 SonicGLvl
+//
+//    This file is part of SonicGLvl, a community-created free level editor 
+//    for the PC version of Sonic Generations.
+//
+//    SonicGLvl is free software: you can redistribute it and/or modify
+//    it under the terms of the GNU General Public License as published by
+//    the Free Software Foundation, either version 3 of the License, or
+//    (at your option) any later version.
+//
+//    SonicGLvl is distributed in the hope that it will be useful,
+//    but WITHOUT ANY WARRANTY; without even the implied warranty of
+//    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+//    
+//
+//    Read AUTHORS.txt, LICENSE.txt and COPYRIGHT.txt for more details.
+//=========================================================================
+
+
+#include "S06Test.h"
+#include "S06XnFile.h"
+
+using namespace LibGens;
+
+// A single triangle whose position accessor and buffer view fields are given as raw JSON
+static string buildTriangleGLTF(const string &accessor_fields, const string &view_fields) {
+	float positions[12]={ 0.0f, 0.0f, 0.0f, 1.0f, 0.0f, 0.0f, 0.0f, 0.0f, 1.0f, 0.0f, 0.0f, 0.0f };
+	string json="{\"asset\":{\"version\":\"2.0\"},\"nodes\":[{\"mesh\":0}],";
+	json += "\"meshes\":[{\"primitives\":[{\"attributes\":{\"POSITION\":0}}]}],";
+	json += "\"accessors\":[{\"bufferView\":0,\"componentType\":5126,\"type\":\"VEC3\"" + accessor_fields + "}],";
+	json += "\"bufferViews\":[{\"buffer\":0,\"byteLength\":" + ToString(sizeof(positions)) + view_fields + "}],";
+	json += "\"buffers\":[{\"byteLength\":" + ToString(sizeof(positions)) + ",\"uri\":\"data:application/octet-stream;base64," + encodeTestBase64(positions, sizeof(positions)) + "\"}]}";
+	return json;
+}
+
+static size_t importTriangles(const string &filename, const string &json) {
+	LIBGENS_TEST_CHECK(writeTestFile(filename, json));
+
+	SonicXNFile file(MODE_XNO);
+	file.importGLTF(filename);
+	SonicXNObject *object=file.getObject();
+	if (!object) return 0;
+
+	size_t count=0;
+	for (size_t i=0; i<object->index_tables.size(); i++) {
+		count += object->index_tables[i]->indices_vector.size();
+	}
+	return count;
+}
+
+int main() {
+	// Well formed files import every face
+	LIBGENS_TEST_CHECK(importTriangles("gltf_grid.gltf", buildTestGridGLTF(8)) == 8*8*2);
+	LIBGENS_TEST_CHECK(importTriangles("gltf_triangle.gltf", buildTriangleGLTF(",\"count\":3", "")) == 1);
+
+	// Missing and negative counts used to wrap around and pass the bounds check with an offset
+	// of two elements, then read far past the buffer
+	LIBGENS_TEST_CHECK(importTriangles("gltf_no_count.gltf", buildTriangleGLTF(",\"byteOffset\":24", ",\"byteStride\":12")) == 0);
+	LIBGENS_TEST_CHECK(importTriangles("gltf_negative_count.gltf", buildTriangleGLTF(",\"count\":-1,\"byteOffset\":24", ",\"byteStride\":12")) == 0);
+	LIBGENS_TEST_CHECK(importTriangles("gltf_zero_count.gltf", buildTriangleGLTF(",\"count\":0", "")) == 0);
+
+	// Counts, offsets and strides past the end of the view
+	LIBGENS_TEST_CHECK(importTriangles("gltf_large_count.gltf", buildTriangleGLTF(",\"count\":2147483647", "")) == 0);
+	LIBGENS_TEST_CHECK(importTriangles("gltf_one_over.gltf", buildTriangleGLTF(",\"count\":5", "")) == 0);
+	LIBGENS_TEST_CHECK(importTriangles("gltf_large_offset.gltf", buildTriangleGLTF(",\"count\":3,\"byteOffset\":4294967295", "")) == 0);
+	LIBGENS_TEST_CHECK(importTriangles("gltf_large_stride.gltf", buildTriangleGLTF(",\"count\":3", ",\"byteStride\":4294967295")) == 0);
+	LIBGENS_TEST_CHECK(importTriangles("gltf_negative_offset.gltf", buildTriangleGLTF(",\"count\":3,\"byteOffset\":-12", "")) == 0);
+	LIBGENS_TEST_CHECK(importTriangles("gltf_view_outside.gltf", buildTriangleGLTF(",\"count\":3", ",\"byteOffset\":24")) == 0);
+
+	// Truncated files are rejected without crashing
+	string json=buildTestGridGLTF(4);
+	LIBGENS_TEST_CHECK(importTriangles("gltf_truncated.gltf", json.substr(0, json.size()/2)) == 0);
+
+	return LIBGENS_TEST_RESULT;
+}
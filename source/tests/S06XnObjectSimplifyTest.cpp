@@ -0,0 +1,96 @@
+//=========================================================================
+//	  Copyright (c) 2016 SonicGLvl
+//
+//    This file is part of SonicGLvl, a community-created free level editor 
+//    for the PC version of Sonic Generations.
+//
+//    SonicGLvl is free software: you can redistribute it and/or modify
+//    it under the terms of the GNU General Public License as published by
+//    the Free Software Foundation, either version 3 of the License, or
+//    (at your option) any later version.
+//
+//    SonicGLvl is distributed in the hope that it will be useful,
+//    but WITHOUT ANY WARRANTY; without even the implied warranty of
+//    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+//    
+//
+//    Read AUTHORS.txt, LICENSE.txt and COPYRIGHT.txt for more details.
+//=========================================================================
+
+
+#include "S06Test.h"
+#include "S06XnFile.h"
+
+using namespace LibGens;
+
+static size_t countTriangles(SonicXNObject *object) {
+	size_t count=0;
+	for (size_t i=0; i<object->index_tables.size(); i++) {
+		vector<unsigned int> triangles;
+		object->index_tables[i]->getTriangles(triangles);
+
+		// The decoded triangles the exporters read have to match the strips
+		LIBGENS_TEST_CHECK(object->index_tables[i]->indices_vector.size() == triangles.size()/3);
+		count += triangles.size()/3;
+	}
+	return count;
+}
+
+static size_t countTrianglesDAE(const string &text) {
+	size_t count=0;
+	for (size_t position=text.find("<triangles"); position != string::npos; position=text.find("<triangles", position+1)) {
+		size_t attribute=text.find("count=\"", position);
+		if (attribute != string::npos) count += strtoul(text.c_str() + attribute + 7, NULL, 10);
+	}
+	return count;
+}
+
+int main() {
+	const size_t grid_size=32;
+	LIBGENS_TEST_CHECK(writeTestFile("simplify_grid.gltf", buildTestGridGLTF(grid_size)));
+
+	SonicXNFile file(MODE_XNO);
+	file.importGLTF("simplify_grid.gltf");
+	SonicXNObject *object=file.getObject();
+	LIBGENS_TEST_CHECK(object && object->index_tables.size());
+	if (!object) return LIBGENS_TEST_RESULT;
+
+	// Imported meshes go through setTriangles and must keep their faces
+	size_t source_triangles=countTriangles(object);
+	LIBGENS_TEST_CHECK(source_triangles == grid_size*grid_size*2);
+
+	vector<float> ratios;
+	ratios.push_back(0.25f);
+	ratios.push_back(0.5f);
+	vector<SonicLODLevel> levels;
+	object->generateLODs(ratios, levels, 2);
+
+	// Levels come back in the order of the ratios and leave the object alone
+	LIBGENS_TEST_CHECK(levels.size() == 2);
+	LIBGENS_TEST_CHECK(countTriangles(object) == source_triangles);
+	if (levels.size() != 2) return LIBGENS_TEST_RESULT;
+
+	size_t level_triangles[2]={ 0, 0 };
+	for (size_t l=0; l<levels.size(); l++) {
+		LIBGENS_TEST_CHECK(levels[l].ratio == ratios[l]);
+		LIBGENS_TEST_CHECK(levels[l].triangles.size() == object->index_tables.size());
+		for (size_t i=0; i<levels[l].triangles.size(); i++) level_triangles[l] += levels[l].triangles[i].size()/3;
+		LIBGENS_TEST_CHECK(level_triangles[l] <= (size_t) (source_triangles * ratios[l]));
+		LIBGENS_TEST_CHECK(level_triangles[l] > 0);
+	}
+	LIBGENS_TEST_CHECK(level_triangles[0] < level_triangles[1]);
+
+	// The simplified faces make it through both exporters
+	object->applyLOD(levels[0]);
+	LIBGENS_TEST_CHECK(countTriangles(object) == level_triangles[0]);
+
+	file.saveDAE("simplify_lod.dae");
+	LIBGENS_TEST_CHECK(countTrianglesDAE(readTestFile("simplify_lod.dae")) == level_triangles[0]);
+
+	file.saveGLB("simplify_lod.glb");
+	SonicXNFile reimported(MODE_XNO);
+	reimported.importGLTF("simplify_lod.glb");
+	LIBGENS_TEST_CHECK(reimported.getObject() && (countTriangles(reimported.getObject()) == level_triangles[0]));
+
+	return LIBGENS_TEST_RESULT;
+}